@@ -0,0 +1,261 @@
+#ifndef _FLEET_QUERY_H_
+#define _FLEET_QUERY_H_
+
+/*
+ * Fleet Query
+ *
+ * Range and aggregate queries over a Store. The work is split into one
+ * task per unit-month partition and run on a pool of threads; each task
+ * opens its own .dat file, so partitions are scanned in parallel.
+ *
+ * Blocks are skipped from the index alone when they are dead, outside the
+ * time range, or (range queries with a value bound) outside the value
+ * range. An aggregate bucket that wholly contains a block, and whose
+ * query range does too, takes the block's count / sum / min / max from
+ * the index without reading its data - with the hour-aligned blocks, an
+ * hourly or daily mean over a long period reads only the index files.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FleetStore.h"
+
+namespace fleet {
+
+struct Aggregate {
+    double sum = 0;
+    float min = NAN, max = NAN;
+    uint64_t count = 0;
+
+    void add(float v) {
+        if (std::isnan(v)) return;
+        if (count == 0 || v < min) min = v;
+        if (count == 0 || v > max) max = v;
+        sum += v;
+        count++;
+    }
+
+    void add(const ColumnStats &s) {
+        if (s.count == 0) return;
+        if (count == 0 || s.min < min) min = s.min;
+        if (count == 0 || s.max > max) max = s.max;
+        sum += s.sum;
+        count += s.count;
+    }
+
+    void add(const Aggregate &a) {
+        if (a.count == 0) return;
+        if (count == 0 || a.min < min) min = a.min;
+        if (count == 0 || a.max > max) max = a.max;
+        sum += a.sum;
+        count += a.count;
+    }
+
+    double mean() const { return count > 0 ? sum / count : NAN; }
+};
+
+struct QueryStats {
+    uint64_t partitions = 0;
+    uint64_t blocks = 0;            // Live blocks overlapping the range
+    uint64_t fromIndex = 0;         // Answered by the index alone
+    uint64_t scanned = 0;           // Decoded
+    uint64_t rows = 0;              // Rows decoded
+    uint64_t bytesRead = 0;
+
+    void add(const QueryStats &o) {
+        partitions += o.partitions;
+        blocks += o.blocks;
+        fromIndex += o.fromIndex;
+        scanned += o.scanned;
+        rows += o.rows;
+        bytesRead += o.bytesRead;
+    }
+};
+
+struct Sample {
+    int64_t epoch;
+    float value;
+};
+
+class Query {
+private:
+    const Store &_store;
+    unsigned _threads;
+
+    struct Task {
+        std::string unit;
+        int month;
+    };
+
+    std::vector<Task> tasks(const std::vector<std::string> &units, int64_t from, int64_t to) const {
+        std::vector<Task> out;
+        for (size_t u = 0; u < units.size(); u++) {
+            std::vector<int> months = _store.months(units[u]);
+            for (size_t m = 0; m < months.size(); m++) {
+                int64_t start = monthStartMs(months[m]);
+                int64_t end = monthStartMs(nextMonth(months[m]));
+                if (end <= from || start > to) continue;
+                Task task = {units[u], months[m]};
+                out.push_back(task);
+            }
+        }
+        return out;
+    }
+
+    // Run fn(taskIndex) for every task on the pool
+    template <typename Fn>
+    void run(size_t count, Fn fn) const {
+        std::atomic<size_t> next(0);
+        unsigned threads = (unsigned)std::min<size_t>(_threads, count);
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; t++) {
+            pool.push_back(std::thread([&]() {
+                for (size_t i = next++; i < count; i = next++) fn(i);
+            }));
+        }
+        for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+    }
+
+public:
+    Query(const Store &store, unsigned threads) : _store(store), _threads(threads > 0 ? threads : 1) {}
+
+    // Per unit, `bucketMs` buckets of `column` over [from, to]: count, mean, min, max
+    std::map<std::string, std::map<int64_t, Aggregate> > aggregate(const std::vector<std::string> &units,
+                                                                   const std::string &column, int64_t from,
+                                                                   int64_t to, int64_t bucketMs,
+                                                                   QueryStats &stats) const {
+        std::vector<Task> work = tasks(units, from, to);
+        std::vector<std::map<int64_t, Aggregate> > results(work.size());
+        std::vector<QueryStats> taskStats(work.size());
+
+        run(work.size(), [&](size_t i) {
+            Partition part(_store.partitionBase(work[i].unit, work[i].month));
+            QueryStats &qs = taskStats[i];
+            // Opened with the index: a compaction may replace the data file afterwards
+            FILE *data = part.open();
+            int c = part.column(column);
+            if (data == NULL || c < 0) {
+                if (data != NULL) fclose(data);
+                return;
+            }
+            qs.partitions++;
+            std::map<int64_t, Aggregate> &buckets = results[i];
+            std::vector<int64_t> epochs;
+            std::vector<float> values;
+            std::vector<uint8_t> scratch;
+
+            for (size_t b = 0; b < part.blocks.size(); b++) {
+                const BlockEntry &e = part.blocks[b];
+                if (e.dead || e.tMax < from || e.tMin > to) continue;
+                qs.blocks++;
+                if (c >= (int)e.columns.size() || e.columns[c].count == 0) continue;
+
+                int64_t bucket = e.tMin / bucketMs * bucketMs;
+                if (e.tMin >= from && e.tMax <= to && e.tMax < bucket + bucketMs) {
+                    buckets[bucket].add(e.columns[c]);
+                    qs.fromIndex++;
+                    continue;
+                }
+
+                if (!Partition::readEpochs(data, e, epochs, scratch)) continue;
+                qs.bytesRead += scratch.size();
+                if (!Partition::readColumn(data, e, c, values, scratch)) continue;
+                qs.bytesRead += scratch.size();
+                qs.scanned++;
+                qs.rows += e.rows;
+                for (size_t r = 0; r < e.rows; r++) {
+                    if (epochs[r] < from || epochs[r] > to) continue;
+                    buckets[epochs[r] / bucketMs * bucketMs].add(values[r]);
+                }
+            }
+            fclose(data);
+        });
+
+        std::map<std::string, std::map<int64_t, Aggregate> > out;
+        for (size_t i = 0; i < work.size(); i++) {
+            stats.add(taskStats[i]);
+            std::map<int64_t, Aggregate> &unit = out[work[i].unit];
+            for (std::map<int64_t, Aggregate>::iterator b = results[i].begin(); b != results[i].end(); ++b) {
+                unit[b->first].add(b->second);
+            }
+        }
+        return out;
+    }
+
+    // Samples of `column` over [from, to] with the value in [low, high]
+    std::map<std::string, std::vector<Sample> > range(const std::vector<std::string> &units,
+                                                      const std::string &column, int64_t from, int64_t to,
+                                                      float low, float high, QueryStats &stats) const {
+        std::vector<Task> work = tasks(units, from, to);
+        std::vector<std::vector<Sample> > results(work.size());
+        std::vector<QueryStats> taskStats(work.size());
+
+        run(work.size(), [&](size_t i) {
+            Partition part(_store.partitionBase(work[i].unit, work[i].month));
+            QueryStats &qs = taskStats[i];
+            // Opened with the index: a compaction may replace the data file afterwards
+            FILE *data = part.open();
+            int c = part.column(column);
+            if (data == NULL || c < 0) {
+                if (data != NULL) fclose(data);
+                return;
+            }
+            qs.partitions++;
+            std::vector<int64_t> epochs;
+            std::vector<float> values;
+            std::vector<uint8_t> scratch;
+
+            // Blocks are appended out of order when an hour is rewritten
+            std::vector<size_t> order;
+            for (size_t b = 0; b < part.blocks.size(); b++) {
+                const BlockEntry &e = part.blocks[b];
+                if (e.dead || e.tMax < from || e.tMin > to) continue;
+                qs.blocks++;
+                if (c >= (int)e.columns.size()) continue;
+                const ColumnStats &s = e.columns[c];
+                if (s.count == 0 || s.max < low || s.min > high) {
+                    qs.fromIndex++;
+                    continue;
+                }
+                order.push_back(b);
+            }
+            std::sort(order.begin(), order.end(),
+                      [&](size_t a, size_t b) { return part.blocks[a].tMin < part.blocks[b].tMin; });
+
+            for (size_t k = 0; k < order.size(); k++) {
+                const BlockEntry &e = part.blocks[order[k]];
+                if (!Partition::readEpochs(data, e, epochs, scratch)) continue;
+                qs.bytesRead += scratch.size();
+                if (!Partition::readColumn(data, e, c, values, scratch)) continue;
+                qs.bytesRead += scratch.size();
+                qs.scanned++;
+                qs.rows += e.rows;
+                for (size_t r = 0; r < e.rows; r++) {
+                    if (epochs[r] < from || epochs[r] > to) continue;
+                    if (std::isnan(values[r]) || values[r] < low || values[r] > high) continue;
+                    Sample sample = {epochs[r], values[r]};
+                    results[i].push_back(sample);
+                }
+            }
+            fclose(data);
+        });
+
+        std::map<std::string, std::vector<Sample> > out;
+        for (size_t i = 0; i < work.size(); i++) {
+            stats.add(taskStats[i]);
+            std::vector<Sample> &unit = out[work[i].unit];
+            unit.insert(unit.end(), results[i].begin(), results[i].end());
+        }
+        return out;
+    }
+};
+
+} // namespace fleet
+
+#endif // _FLEET_QUERY_H_
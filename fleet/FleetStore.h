@@ -0,0 +1,785 @@
+#ifndef _FLEET_STORE_H_
+#define _FLEET_STORE_H_
+
+/*
+ * Fleet Store
+ *
+ * Time-partitioned, per-unit columnar store for the logs of many units:
+ *
+ *   <root>/<unit>/<YYYY-MM>.dat    column chunks, append-only
+ *   <root>/<unit>/<YYYY-MM>.idx    schema + one entry per block
+ *   <root>/<unit>/.lock            held while the unit is written
+ *
+ * A partition is one unit and one UTC month. Rows are stored in blocks of
+ * at most one hour, so a block never spans an hour boundary; within a
+ * block each column is a separate chunk, read on its own:
+ *
+ *   epoch_ms   varint of the first value, then varint deltas
+ *   values     float32 XORed with the previous value, high zero bytes
+ *              dropped; a nibble per value holds the bytes kept (a held
+ *              or empty value costs half a byte)
+ *
+ * Each index entry has the block's time range and, per column, the chunk
+ * location and the min / max / sum / count of its values. Queries skip
+ * blocks by time and value range, and an aggregate over whole hours is
+ * answered from the index without reading the data.
+ *
+ * Ingest is idempotent: rows already stored (same epoch_ms) are dropped,
+ * so a data.txt collected again later, or an MQTT batch delivered twice,
+ * only adds what is new. An hour that gains rows is rewritten as a new
+ * block and its old block marked dead; the index is replaced atomically.
+ *
+ * Once dead blocks take more than COMPACT_DEAD_SHARE of a data file, the
+ * live blocks are copied to a new one (<YYYY-MM>.<generation>.dat), the
+ * index switches to it atomically and the old file is removed, so
+ * collecting a unit a few minutes at a time does not grow the store
+ * without bound. Readers open the data file through Partition::open(),
+ * which follows such a switch.
+ *
+ * Ingest holds an flock() on the unit's .lock file, so a second process
+ * writing the same unit fails instead of corrupting it; the lock goes
+ * with the process, also when it dies.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "LogParser.h"
+
+namespace fleet {
+
+const int64_t HOUR_MS = 3600000LL;
+const char INDEX_MAGIC[8] = {'A', 'Q', 'F', 'I', 'D', 'X', '0', '2'};
+const char INDEX_MAGIC_V1[8] = {'A', 'Q', 'F', 'I', 'D', 'X', '0', '1'};   // No generation, data in .dat
+const double COMPACT_DEAD_SHARE = 0.5;  // Dead share of a data file that triggers a compaction
+
+// Per-column statistics of one block
+struct ColumnStats {
+    uint64_t offset = 0;    // Chunk position in the .dat file
+    uint32_t bytes = 0;
+    float min = NAN, max = NAN;
+    double sum = 0;
+    uint32_t count = 0;     // Non-empty values
+
+    void add(float v) {
+        if (std::isnan(v)) return;
+        if (count == 0 || v < min) min = v;
+        if (count == 0 || v > max) max = v;
+        sum += v;
+        count++;
+    }
+};
+
+struct BlockEntry {
+    int64_t tMin = 0, tMax = 0;
+    uint32_t rows = 0;
+    bool dead = false;
+    uint64_t epochOffset = 0;
+    uint32_t epochBytes = 0;
+    std::vector<ColumnStats> columns;   // Prefix of the partition schema
+
+    // Chunks are written back to back from epochOffset
+    uint64_t bytes() const {
+        uint64_t total = epochBytes;
+        for (size_t c = 0; c < columns.size(); c++) total += columns[c].bytes;
+        return total;
+    }
+};
+
+// ---- Encoding -------------------------------------------------------------
+
+namespace codec {
+
+inline void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Sorted, unique epochs
+inline void encodeEpochs(const int64_t *epochs, size_t n, std::vector<uint8_t> &out) {
+    int64_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        putVarint(out, (uint64_t)(epochs[i] - prev));
+        prev = epochs[i];
+    }
+}
+
+inline bool decodeEpochs(const uint8_t *p, size_t bytes, size_t n, int64_t *out) {
+    const uint8_t *end = p + bytes;
+    int64_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t delta;
+        if (!getVarint(p, end, delta)) return false;
+        prev += (int64_t)delta;
+        out[i] = prev;
+    }
+    return true;
+}
+
+inline uint32_t floatBits(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    return bits;
+}
+
+// values[i * stride] for i < n
+inline void encodeFloats(const float *values, size_t n, size_t stride, std::vector<uint8_t> &out) {
+    size_t tags = out.size();
+    out.resize(tags + (n + 1) / 2, 0);
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t x = floatBits(values[i * stride]) ^ prev;
+        prev ^= x;
+        uint8_t len = x == 0 ? 0 : x < 0x100 ? 1 : x < 0x10000 ? 2 : x < 0x1000000 ? 3 : 4;
+        out[tags + i / 2] |= len << ((i & 1) * 4);
+        for (uint8_t b = 0; b < len; b++) out.push_back((uint8_t)(x >> (8 * b)));
+    }
+}
+
+inline bool decodeFloats(const uint8_t *p, size_t bytes, size_t n, float *out) {
+    const uint8_t *tags = p, *end = p + bytes;
+    p += (n + 1) / 2;
+    if (p > end) return false;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t len = (tags[i / 2] >> ((i & 1) * 4)) & 0x0F;
+        if (len > 4 || end - p < len) return false;
+        uint32_t x = 0;
+        for (uint8_t b = 0; b < len; b++) x |= (uint32_t)*p++ << (8 * b);
+        prev ^= x;
+        memcpy(&out[i], &prev, 4);
+    }
+    return true;
+}
+
+} // namespace codec
+
+// ---- Time -----------------------------------------------------------------
+
+// UTC month of an epoch, as YYYYMM
+inline int monthOf(int64_t epochMs) {
+    time_t seconds = (time_t)(epochMs / 1000);
+    struct tm t;
+    gmtime_r(&seconds, &t);
+    return (t.tm_year + 1900) * 100 + t.tm_mon + 1;
+}
+
+inline int64_t monthStartMs(int month) {
+    struct tm t = tm();
+    t.tm_year = month / 100 - 1900;
+    t.tm_mon = month % 100 - 1;
+    t.tm_mday = 1;
+    return (int64_t)timegm(&t) * 1000;
+}
+
+inline int nextMonth(int month) {
+    return month % 100 == 12 ? (month / 100 + 1) * 100 + 1 : month + 1;
+}
+
+inline std::string monthName(int month) {
+    char text[16];
+    snprintf(text, sizeof(text), "%04d-%02d", month / 100, month % 100);
+    return text;
+}
+
+// Month lookups for sorted-ish epochs without a gmtime per row
+class MonthCursor {
+private:
+    int64_t _start = 0, _end = 0;
+    int _month = 0;
+
+public:
+    int month(int64_t epochMs) {
+        if (epochMs < _start || epochMs >= _end) {
+            _month = monthOf(epochMs);
+            _start = monthStartMs(_month);
+            _end = monthStartMs(nextMonth(_month));
+        }
+        return _month;
+    }
+};
+
+// ---- Partition ------------------------------------------------------------
+
+class Partition {
+public:
+    std::string base;                   // Path without .dat / .idx
+    uint32_t generation = 0;            // Compactions so far; names the data file
+    std::vector<std::string> schema;
+    std::vector<BlockEntry> blocks;
+
+    explicit Partition(const std::string &base) : base(base) {}
+
+    std::string dataPath() const {
+        return generation == 0 ? base + ".dat" : base + "." + std::to_string(generation) + ".dat";
+    }
+    std::string indexPath() const { return base + ".idx"; }
+
+    int column(const std::string &name) const {
+        for (size_t i = 0; i < schema.size(); i++) {
+            if (schema[i] == name) return (int)i;
+        }
+        return -1;
+    }
+
+    int addColumn(const std::string &name) {
+        int c = column(name);
+        if (c >= 0) return c;
+        schema.push_back(name);
+        return (int)schema.size() - 1;
+    }
+
+    // False only for an index that exists but cannot be read
+    bool load() {
+        schema.clear();
+        blocks.clear();
+        generation = 0;
+        FILE *f = fopen(indexPath().c_str(), "rb");
+        if (f == NULL) return true;
+        bool ok = readIndex(f);
+        fclose(f);
+        return ok;
+    }
+
+    // Load the index and open its data file for reading; NULL when there
+    // is none. A compaction between the two is followed by loading again
+    FILE *open() {
+        for (int attempt = 0; attempt < 3; attempt++) {
+            if (!load()) return NULL;
+            FILE *f = fopen(dataPath().c_str(), "rb");
+            if (f != NULL || blocks.empty()) return f;
+        }
+        return NULL;
+    }
+
+    bool save() const {
+        std::string tmp = indexPath() + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "wb");
+        if (f == NULL) return false;
+        fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC), f);
+        put(f, generation);
+        put(f, (uint16_t)schema.size());
+        for (size_t i = 0; i < schema.size(); i++) {
+            put(f, (uint8_t)schema[i].size());
+            fwrite(schema[i].data(), 1, schema[i].size(), f);
+        }
+        put(f, (uint32_t)blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++) {
+            const BlockEntry &e = blocks[b];
+            put(f, e.tMin);
+            put(f, e.tMax);
+            put(f, e.rows);
+            put(f, (uint8_t)e.dead);
+            put(f, e.epochOffset);
+            put(f, e.epochBytes);
+            put(f, (uint16_t)e.columns.size());
+            for (size_t c = 0; c < e.columns.size(); c++) {
+                const ColumnStats &s = e.columns[c];
+                put(f, s.offset);
+                put(f, s.bytes);
+                put(f, s.min);
+                put(f, s.max);
+                put(f, s.sum);
+                put(f, s.count);
+            }
+        }
+        bool ok = fflush(f) == 0 && ferror(f) == 0;
+        ok = fclose(f) == 0 && ok;
+        return ok && rename(tmp.c_str(), indexPath().c_str()) == 0;
+    }
+
+    // Read a block's epochs; `file` is the open .dat
+    static bool readEpochs(FILE *file, const BlockEntry &e, std::vector<int64_t> &out,
+                           std::vector<uint8_t> &scratch) {
+        out.resize(e.rows);
+        return readChunk(file, e.epochOffset, e.epochBytes, scratch) &&
+               codec::decodeEpochs(scratch.data(), scratch.size(), e.rows, out.data());
+    }
+
+    // Read a column of a block; a column the block predates reads as empty
+    static bool readColumn(FILE *file, const BlockEntry &e, int column, std::vector<float> &out,
+                           std::vector<uint8_t> &scratch) {
+        out.resize(e.rows);
+        if (column < 0 || column >= (int)e.columns.size()) {
+            std::fill(out.begin(), out.end(), NAN);
+            return true;
+        }
+        const ColumnStats &s = e.columns[column];
+        return readChunk(file, s.offset, s.bytes, scratch) &&
+               codec::decodeFloats(scratch.data(), scratch.size(), e.rows, out.data());
+    }
+
+private:
+    template <typename T>
+    static void put(FILE *f, T value) {
+        fwrite(&value, sizeof(T), 1, f);
+    }
+
+    template <typename T>
+    static bool get(FILE *f, T &value) {
+        return fread(&value, sizeof(T), 1, f) == 1;
+    }
+
+    static bool readChunk(FILE *file, uint64_t offset, uint32_t bytes, std::vector<uint8_t> &out) {
+        out.resize(bytes);
+        if (bytes == 0) return true;
+        if (fseeko(file, (off_t)offset, SEEK_SET) != 0) return false;
+        return fread(out.data(), 1, bytes, file) == bytes;
+    }
+
+    bool readIndex(FILE *f) {
+        char magic[sizeof(INDEX_MAGIC)];
+        if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)) return false;
+        if (memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0) {
+            if (!get(f, generation)) return false;
+        } else if (memcmp(magic, INDEX_MAGIC_V1, sizeof(magic)) != 0) {
+            return false;
+        }
+        uint16_t columns;
+        if (!get(f, columns)) return false;
+        for (uint16_t i = 0; i < columns; i++) {
+            uint8_t len;
+            char name[256];
+            if (!get(f, len) || fread(name, 1, len, f) != len) return false;
+            schema.push_back(std::string(name, len));
+        }
+        uint32_t count;
+        if (!get(f, count)) return false;
+        blocks.resize(count);
+        for (uint32_t b = 0; b < count; b++) {
+            BlockEntry &e = blocks[b];
+            uint8_t dead;
+            uint16_t n;
+            if (!get(f, e.tMin) || !get(f, e.tMax) || !get(f, e.rows) || !get(f, dead) ||
+                !get(f, e.epochOffset) || !get(f, e.epochBytes) || !get(f, n)) {
+                return false;
+            }
+            e.dead = dead != 0;
+            e.columns.resize(n);
+            for (uint16_t c = 0; c < n; c++) {
+                ColumnStats &s = e.columns[c];
+                if (!get(f, s.offset) || !get(f, s.bytes) || !get(f, s.min) || !get(f, s.max) ||
+                    !get(f, s.sum) || !get(f, s.count)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// ---- Store ----------------------------------------------------------------
+
+struct IngestStats {
+    size_t rows = 0;            // Rows offered
+    size_t added = 0;           // New rows stored
+    size_t duplicates = 0;      // Already stored, or repeated in the input
+    size_t blocks = 0;          // Blocks written
+    size_t rewritten = 0;       // Existing blocks replaced
+    uint64_t bytes = 0;         // Data bytes written
+    uint64_t reclaimed = 0;     // Dead block bytes removed by compaction
+
+    void add(const IngestStats &o) {
+        rows += o.rows;
+        added += o.added;
+        duplicates += o.duplicates;
+        blocks += o.blocks;
+        rewritten += o.rewritten;
+        bytes += o.bytes;
+        reclaimed += o.reclaimed;
+    }
+};
+
+// Exclusive flock() on a unit's .lock file for one ingest
+class UnitLock {
+private:
+    int _fd = -1;
+
+public:
+    UnitLock() {}
+    UnitLock(const UnitLock &) = delete;
+    UnitLock &operator=(const UnitLock &) = delete;
+    ~UnitLock() {
+        if (_fd >= 0) close(_fd); // Releases the lock
+    }
+
+    // False when another process holds it
+    bool acquire(const std::string &path) {
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (_fd < 0) return false;
+        if (flock(_fd, LOCK_EX | LOCK_NB) == 0) return true;
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+};
+
+class Store {
+private:
+    std::string _root;
+
+    static bool makeDir(const std::string &path) {
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    // Rows of one partition, columns in partition schema order
+    struct Rows {
+        size_t width = 0;
+        std::vector<int64_t> epochs;
+        std::vector<float> values;      // Row-major, `width` per row
+    };
+
+    // Append one block (rows [first, last) of sorted `rows`) and index it
+    static bool writeBlock(FILE *data, Partition &part, const Rows &rows, const std::vector<size_t> &order,
+                           size_t first, size_t last, IngestStats &stats) {
+        size_t n = last - first;
+        std::vector<int64_t> epochs(n);
+        std::vector<float> column(n);
+        for (size_t i = 0; i < n; i++) epochs[i] = rows.epochs[order[first + i]];
+
+        BlockEntry e;
+        e.rows = (uint32_t)n;
+        e.tMin = epochs.front();
+        e.tMax = epochs.back();
+
+        if (fseeko(data, 0, SEEK_END) != 0) return false;
+        uint64_t offset = (uint64_t)ftello(data);
+        std::vector<uint8_t> chunk;
+        codec::encodeEpochs(epochs.data(), n, chunk);
+        e.epochOffset = offset;
+        e.epochBytes = (uint32_t)chunk.size();
+        if (fwrite(chunk.data(), 1, chunk.size(), data) != chunk.size()) return false;
+        offset += chunk.size();
+
+        e.columns.resize(part.schema.size());
+        for (size_t c = 0; c < part.schema.size(); c++) {
+            ColumnStats &s = e.columns[c];
+            for (size_t i = 0; i < n; i++) {
+                float v = c < rows.width ? rows.values[order[first + i] * rows.width + c] : NAN;
+                column[i] = v;
+                s.add(v);
+            }
+            chunk.clear();
+            codec::encodeFloats(column.data(), n, 1, chunk);
+            s.offset = offset;
+            s.bytes = (uint32_t)chunk.size();
+            if (fwrite(chunk.data(), 1, chunk.size(), data) != chunk.size()) return false;
+            offset += chunk.size();
+        }
+
+        stats.blocks++;
+        stats.bytes += offset - e.epochOffset;
+        part.blocks.push_back(e);
+        return true;
+    }
+
+    // Copy the live blocks to the next generation's data file once dead
+    // blocks take more than COMPACT_DEAD_SHARE of it. The new file is
+    // synced before the index switches to it; until then the old index
+    // and data stay in place
+    static bool compact(Partition &part, IngestStats &stats, std::string &error) {
+        uint64_t live = 0, dead = 0;
+        for (size_t b = 0; b < part.blocks.size(); b++) {
+            (part.blocks[b].dead ? dead : live) += part.blocks[b].bytes();
+        }
+        if (dead == 0 || dead <= (live + dead) * COMPACT_DEAD_SHARE) return true;
+
+        Partition next(part.base);
+        next.generation = part.generation + 1;
+        next.schema = part.schema;
+        FILE *from = fopen(part.dataPath().c_str(), "rb");
+        FILE *to = fopen(next.dataPath().c_str(), "wb");
+        bool ok = from != NULL && to != NULL;
+        std::vector<uint8_t> chunk;
+        uint64_t offset = 0;
+        for (size_t b = 0; b < part.blocks.size() && ok; b++) {
+            const BlockEntry &e = part.blocks[b];
+            if (e.dead) continue;
+            chunk.resize(e.bytes());
+            ok = fseeko(from, (off_t)e.epochOffset, SEEK_SET) == 0 &&
+                 fread(chunk.data(), 1, chunk.size(), from) == chunk.size() &&
+                 fwrite(chunk.data(), 1, chunk.size(), to) == chunk.size();
+            BlockEntry moved = e;
+            moved.epochOffset = offset;
+            for (size_t c = 0; c < moved.columns.size(); c++) moved.columns[c].offset += offset - e.epochOffset;
+            next.blocks.push_back(moved);
+            offset += chunk.size();
+        }
+        if (from != NULL) fclose(from);
+        if (to != NULL) {
+            ok = fflush(to) == 0 && fsync(fileno(to)) == 0 && ok;
+            ok = fclose(to) == 0 && ok;
+        }
+        if (!ok || !next.save()) {
+            remove(next.dataPath().c_str());
+            error = "cannot compact " + part.dataPath();
+            return false;
+        }
+        remove(part.dataPath().c_str());
+        part = next;
+        stats.reclaimed += dead;
+        return true;
+    }
+
+    // Live blocks of the hour starting at `hour`
+    static void blocksOfHour(const Partition &part, int64_t hour, std::vector<size_t> &out) {
+        out.clear();
+        for (size_t b = 0; b < part.blocks.size(); b++) {
+            const BlockEntry &e = part.blocks[b];
+            if (!e.dead && e.tMin < hour + HOUR_MS && e.tMax >= hour) out.push_back(b);
+        }
+    }
+
+    bool ingestPartition(const std::string &unit, int month, Rows &rows, Partition &part,
+                         IngestStats &stats, std::string &error) {
+        FILE *data = fopen(part.dataPath().c_str(), "r+b");
+        if (data == NULL) data = fopen(part.dataPath().c_str(), "w+b");
+        if (data == NULL) {
+            error = "cannot open " + part.dataPath();
+            return false;
+        }
+
+        // Sort by time; the first of equal epochs is kept
+        std::vector<size_t> order(rows.epochs.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return rows.epochs[a] < rows.epochs[b]; });
+
+        std::vector<size_t> unique;
+        unique.reserve(order.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            if (!unique.empty() && rows.epochs[unique.back()] == rows.epochs[order[i]]) {
+                stats.duplicates++;
+                continue;
+            }
+            unique.push_back(order[i]);
+        }
+
+        std::vector<size_t> existing;
+        std::vector<int64_t> storedEpochs;
+        std::vector<float> storedColumn;
+        std::vector<uint8_t> scratch;
+        bool ok = true;
+
+        for (size_t first = 0; first < unique.size() && ok;) {
+            int64_t hour = rows.epochs[unique[first]] / HOUR_MS * HOUR_MS;
+            size_t last = first;
+            while (last < unique.size() && rows.epochs[unique[last]] < hour + HOUR_MS) last++;
+
+            blocksOfHour(part, hour, existing);
+            if (existing.empty()) {
+                ok = writeBlock(data, part, rows, unique, first, last, stats);
+                stats.added += last - first;
+                first = last;
+                continue;
+            }
+
+            // Merge with the stored rows of this hour; skip if nothing is new
+            Rows merged;
+            merged.width = part.schema.size();
+            for (size_t k = 0; k < existing.size() && ok; k++) {
+                const BlockEntry &e = part.blocks[existing[k]];
+                ok = Partition::readEpochs(data, e, storedEpochs, scratch);
+                size_t base0 = merged.epochs.size();
+                merged.epochs.insert(merged.epochs.end(), storedEpochs.begin(), storedEpochs.end());
+                merged.values.resize(merged.epochs.size() * merged.width, NAN);
+                for (size_t c = 0; c < merged.width && ok; c++) {
+                    ok = Partition::readColumn(data, e, (int)c, storedColumn, scratch);
+                    for (size_t i = 0; i < e.rows; i++) {
+                        merged.values[(base0 + i) * merged.width + c] = storedColumn[i];
+                    }
+                }
+            }
+            if (!ok) break;
+
+            std::vector<int64_t> sortedStored(merged.epochs);
+            std::sort(sortedStored.begin(), sortedStored.end());
+            size_t fresh = 0;
+            for (size_t i = first; i < last; i++) {
+                size_t r = unique[i];
+                if (std::binary_search(sortedStored.begin(), sortedStored.end(), rows.epochs[r])) {
+                    stats.duplicates++;
+                    continue;
+                }
+                merged.epochs.push_back(rows.epochs[r]);
+                merged.values.insert(merged.values.end(), rows.values.begin() + r * rows.width,
+                                     rows.values.begin() + r * rows.width + merged.width);
+                fresh++;
+            }
+            if (fresh > 0) {
+                std::vector<size_t> mergedOrder(merged.epochs.size());
+                for (size_t i = 0; i < mergedOrder.size(); i++) mergedOrder[i] = i;
+                std::sort(mergedOrder.begin(), mergedOrder.end(),
+                          [&](size_t a, size_t b) { return merged.epochs[a] < merged.epochs[b]; });
+                ok = writeBlock(data, part, merged, mergedOrder, 0, mergedOrder.size(), stats);
+                for (size_t k = 0; k < existing.size(); k++) part.blocks[existing[k]].dead = true;
+                stats.rewritten += existing.size();
+                stats.added += fresh;
+            }
+            first = last;
+        }
+
+        ok = fflush(data) == 0 && ok;
+        fclose(data);
+        if (!ok) {
+            error = "write failed for " + part.dataPath();
+            return false;
+        }
+        if (!part.save()) {
+            error = "cannot write " + part.indexPath();
+            return false;
+        }
+        return compact(part, stats, error);
+    }
+
+public:
+    explicit Store(const std::string &root) : _root(root) {}
+
+    const std::string &root() const { return _root; }
+
+    bool create() { return makeDir(_root); }
+
+    // Unit names (directories under the root)
+    std::vector<std::string> units() const {
+        std::vector<std::string> out;
+        DIR *dir = opendir(_root.c_str());
+        if (dir == NULL) return out;
+        while (struct dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') continue;
+            struct stat st;
+            std::string path = _root + "/" + entry->d_name;
+            if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) out.push_back(entry->d_name);
+        }
+        closedir(dir);
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    // Months (YYYYMM) stored for a unit
+    std::vector<int> months(const std::string &unit) const {
+        std::vector<int> out;
+        DIR *dir = opendir((_root + "/" + unit).c_str());
+        if (dir == NULL) return out;
+        while (struct dirent *entry = readdir(dir)) {
+            int year, month;
+            char ext[8];
+            if (sscanf(entry->d_name, "%4d-%2d.%3s", &year, &month, ext) == 3 && strcmp(ext, "idx") == 0) {
+                out.push_back(year * 100 + month);
+            }
+        }
+        closedir(dir);
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    std::string partitionBase(const std::string &unit, int month) const {
+        return _root + "/" + unit + "/" + monthName(month);
+    }
+
+    // Add parsed batches of one unit
+    bool ingest(const std::string &unit, const std::vector<RowBatch> &batches, IngestStats &stats,
+                std::string &error) {
+        if (unit.empty() || unit.find('/') != std::string::npos || unit[0] == '.') {
+            error = "bad unit name '" + unit + "'";
+            return false;
+        }
+        if (!makeDir(_root) || !makeDir(_root + "/" + unit)) {
+            error = "cannot create " + _root + "/" + unit;
+            return false;
+        }
+        UnitLock lock;
+        if (!lock.acquire(_root + "/" + unit + "/.lock")) {
+            error = "another process is writing " + _root + "/" + unit;
+            return false;
+        }
+
+        // Split the rows by month, mapping columns onto each partition's
+        // schema; columns go in first so every month's width is final
+        MonthCursor cursor;
+        std::map<int, Partition> parts;
+        std::vector<std::vector<int> > batchMonths(batches.size());
+        for (size_t b = 0; b < batches.size(); b++) {
+            const RowBatch &batch = batches[b];
+            std::vector<int> &touched = batchMonths[b];
+            for (size_t r = 0; r < batch.rows(); r++) {
+                int month = cursor.month(batch.epochs[r]);
+                if (std::find(touched.begin(), touched.end(), month) == touched.end()) touched.push_back(month);
+            }
+            for (size_t m = 0; m < touched.size(); m++) {
+                std::map<int, Partition>::iterator p = parts.find(touched[m]);
+                if (p == parts.end()) {
+                    p = parts.insert(std::make_pair(touched[m], Partition(partitionBase(unit, touched[m])))).first;
+                    if (!p->second.load()) {
+                        error = "unreadable index " + p->second.indexPath();
+                        return false;
+                    }
+                }
+                for (size_t c = 0; c < batch.names.size(); c++) p->second.addColumn(batch.names[c]);
+            }
+        }
+
+        std::map<int, Rows> rowsByMonth;
+        for (std::map<int, Partition>::iterator p = parts.begin(); p != parts.end(); ++p) {
+            rowsByMonth[p->first].width = p->second.schema.size();
+        }
+        for (size_t b = 0; b < batches.size(); b++) {
+            const RowBatch &batch = batches[b];
+            size_t width = batch.names.size();
+            std::map<int, std::vector<int> > mapping;
+            for (size_t m = 0; m < batchMonths[b].size(); m++) {
+                const Partition &part = parts.find(batchMonths[b][m])->second;
+                std::vector<int> &map = mapping[batchMonths[b][m]];
+                for (size_t c = 0; c < width; c++) map.push_back(part.column(batch.names[c]));
+            }
+            for (size_t r = 0; r < batch.rows(); r++) {
+                int month = cursor.month(batch.epochs[r]);
+                const std::vector<int> &map = mapping[month];
+                Rows &rows = rowsByMonth[month];
+                rows.epochs.push_back(batch.epochs[r]);
+                size_t at = rows.values.size();
+                rows.values.resize(at + rows.width, NAN);
+                for (size_t c = 0; c < width; c++) rows.values[at + map[c]] = batch.values[r * width + c];
+                stats.rows++;
+            }
+        }
+
+        for (std::map<int, Rows>::iterator m = rowsByMonth.begin(); m != rowsByMonth.end(); ++m) {
+            if (!ingestPartition(unit, m->first, m->second, parts.find(m->first)->second, stats, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace fleet
+
+#endif // _FLEET_STORE_H_
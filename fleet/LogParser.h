@@ -0,0 +1,462 @@
+#ifndef _FLEET_LOG_PARSER_H_
+#define _FLEET_LOG_PARSER_H_
+
+/*
+ * Log Parser
+ *
+ * Turns the logs a unit produces into row batches for the store:
+ *
+ *   CSV   data.txt as written to the SD card: header lines
+ *         ("date , time , epoch_ms , lat , lng , co2 , ...") followed by
+ *         records. A header line mid-file starts a new batch.
+ *   CBOR  MQTT uplink payloads (MqttUplink.h): {"c": names, "r": records},
+ *         any number of them back to back in one file, as a broker bridge
+ *         saves them.
+ *
+ * Rows are keyed by epoch_ms. date and time are local renderings of it
+ * and are dropped; rows logged before the unit's first GPS time carry
+ * uptime instead of UTC and are rejected, as are rows of a log without an
+ * epoch_ms column (firmware older than the GPS clock).
+ *
+ * Schema 2 logs (a "schema" column, AcquisitionCore.h) carry a
+ * "<name>_status" column of STATUS_* bits next to each measured value.
+ * The status columns are kept like any other; applyStatus() blanks the
+ * values whose status has any of the given bits, a strided pass over
+ * each value / status column pair. Older logs have no status columns and
+ * pass unchanged.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fleet {
+
+const int64_t EPOCH_VALID_MS = 946684800000LL; // 2000-01-01 UTC, as TimeService.h
+
+// Status bits of a value, as SensorRegistry.h
+enum {
+    STATUS_WARMING      = 0x01,
+    STATUS_CALIBRATED   = 0x02,
+    STATUS_STALE        = 0x04,
+    STATUS_FAULT        = 0x08,
+    STATUS_INTERPOLATED = 0x10
+};
+
+const char *const STATUS_NAMES[] = {"warming", "calibrated", "stale", "fault", "interpolated"};
+const uint8_t STATUS_DROP_DEFAULT = STATUS_WARMING | STATUS_FAULT;
+
+struct RowBatch {
+    std::vector<std::string> names;     // Value columns, in log order
+    std::vector<int64_t> epochs;
+    std::vector<float> values;          // Row-major, names.size() per row; NaN = empty
+    size_t rejected = 0;                // Rows without a UTC time
+
+    size_t rows() const { return epochs.size(); }
+};
+
+struct ParseResult {
+    std::vector<RowBatch> batches;
+    size_t rows = 0, rejected = 0, malformed = 0;
+};
+
+namespace detail {
+
+inline bool isHeaderLine(const char *line, const char *end) {
+    while (line < end && *line == ' ') line++;
+    return line < end && ((*line >= 'a' && *line <= 'z') || (*line >= 'A' && *line <= 'Z'));
+}
+
+// Split [line, end) on commas with the fields trimmed
+inline void splitFields(const char *line, const char *end,
+                        std::vector<std::pair<const char *, const char *> > &fields) {
+    fields.clear();
+    const char *start = line;
+    for (const char *p = line;; p++) {
+        if (p == end || *p == ',') {
+            const char *a = start, *b = p;
+            while (a < b && (*a == ' ' || *a == '\t')) a++;
+            while (b > a && (b[-1] == ' ' || b[-1] == '\t' || b[-1] == '\r')) b--;
+            fields.push_back(std::make_pair(a, b));
+            if (p == end) break;
+            start = p + 1;
+        }
+    }
+}
+
+// Column layout of the current header
+struct CsvLayout {
+    int epoch = -1;
+    std::vector<int> value;             // Field index of each value column
+};
+
+inline bool skippedColumn(const std::string &name) {
+    return name == "date" || name == "time" || name == "epoch_ms" || name == "schema";
+}
+
+} // namespace detail
+
+inline ParseResult parseCsv(const char *data, size_t size) {
+    using namespace detail;
+    ParseResult result;
+    std::vector<std::pair<const char *, const char *> > fields;
+    CsvLayout layout;
+    RowBatch *batch = NULL;
+    char number[64];
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == NULL) break; // A record still being written
+        const char *line = p, *lineEnd = eol;
+        p = eol + 1;
+        if (lineEnd > line && lineEnd[-1] == '\r') lineEnd--;
+        if (lineEnd == line) continue;
+
+        splitFields(line, lineEnd, fields);
+        if (isHeaderLine(line, lineEnd)) {
+            result.batches.push_back(RowBatch());
+            batch = &result.batches.back();
+            layout = CsvLayout();
+            for (size_t i = 0; i < fields.size(); i++) {
+                std::string name(fields[i].first, fields[i].second);
+                if (name == "epoch_ms") layout.epoch = (int)i;
+                if (skippedColumn(name) || name.empty()) continue;
+                layout.value.push_back((int)i);
+                batch->names.push_back(name);
+            }
+            continue;
+        }
+        if (batch == NULL || layout.epoch < 0) {
+            result.rejected++;
+            continue;
+        }
+        if ((int)fields.size() <= layout.epoch) {
+            result.malformed++;
+            continue;
+        }
+
+        const std::pair<const char *, const char *> &epochField = fields[layout.epoch];
+        char *stop;
+        size_t len = epochField.second - epochField.first;
+        if (len == 0 || len >= sizeof(number)) {
+            result.malformed++;
+            continue;
+        }
+        memcpy(number, epochField.first, len);
+        number[len] = '\0';
+        int64_t epoch = strtoll(number, &stop, 10);
+        if (*stop != '\0') {
+            result.malformed++;
+            continue;
+        }
+        if (epoch < EPOCH_VALID_MS) {
+            batch->rejected++;
+            result.rejected++;
+            continue;
+        }
+
+        batch->epochs.push_back(epoch);
+        for (size_t c = 0; c < layout.value.size(); c++) {
+            float value = NAN;
+            int f = layout.value[c];
+            if (f < (int)fields.size()) {
+                len = fields[f].second - fields[f].first;
+                if (len > 0 && len < sizeof(number)) {
+                    memcpy(number, fields[f].first, len);
+                    number[len] = '\0';
+                    value = strtof(number, &stop);
+                    if (*stop != '\0') value = NAN;
+                }
+            }
+            batch->values.push_back(value);
+        }
+        result.rows++;
+    }
+    return result;
+}
+
+namespace detail {
+
+// Minimal CBOR reader for the uplink payloads
+class CborReader {
+private:
+    const uint8_t *_p, *_end;
+    bool _error = false;
+
+public:
+    static const uint64_t INDEFINITE = ~0ULL;
+
+    CborReader(const uint8_t *data, size_t size) : _p(data), _end(data + size) {}
+
+    bool error() const { return _error; }
+    bool atEnd() const { return _p >= _end; }
+    const uint8_t *position() const { return _p; }
+
+    bool fail() {
+        _error = true;
+        _p = _end;
+        return false;
+    }
+
+    // Major type and argument of the next item
+    bool head(uint8_t &major, uint8_t &info, uint64_t &value) {
+        if (_p >= _end) return fail();
+        uint8_t b = *_p++;
+        major = b >> 5;
+        info = b & 0x1F;
+        if (info < 24) {
+            value = info;
+            return true;
+        }
+        if (info == 31) {
+            value = INDEFINITE;
+            return true;
+        }
+        if (info > 27) return fail();
+        int bytes = 1 << (info - 24);
+        if (_end - _p < bytes) return fail();
+        value = 0;
+        for (int i = 0; i < bytes; i++) value = (value << 8) | *_p++;
+        return true;
+    }
+
+    bool isBreak() const { return _p < _end && *_p == 0xFF; }
+
+    void skipBreak() { _p++; }
+
+    bool text(std::string &out) {
+        uint8_t major, info;
+        uint64_t len;
+        if (!head(major, info, len) || major != 3 || len == INDEFINITE) return fail();
+        if ((uint64_t)(_end - _p) < len) return fail();
+        out.assign((const char *)_p, len);
+        _p += len;
+        return true;
+    }
+
+    // A number (or null) as float; other items are an error
+    bool number(float &out) {
+        uint8_t major, info;
+        uint64_t value;
+        if (!head(major, info, value)) return false;
+        switch (major) {
+            case 0:
+                out = (float)value;
+                return true;
+            case 1:
+                out = -1.0f - (float)value;
+                return true;
+            case 7:
+                if (info == 22 || info == 23) {
+                    out = NAN; // null, undefined
+                    return true;
+                }
+                if (info == 25) {
+                    out = halfToFloat((uint16_t)value);
+                    return true;
+                }
+                if (info == 26) {
+                    uint32_t bits = (uint32_t)value;
+                    memcpy(&out, &bits, 4);
+                    return true;
+                }
+                if (info == 27) {
+                    double d;
+                    memcpy(&d, &value, 8);
+                    out = (float)d;
+                    return true;
+                }
+                return fail();
+            default:
+                return fail();
+        }
+    }
+
+    // Integer as int64 (epoch_ms keeps full precision)
+    bool integer(int64_t &out, bool &isNull) {
+        uint8_t major, info;
+        uint64_t value;
+        isNull = false;
+        if (!head(major, info, value)) return false;
+        if (major == 0) out = (int64_t)value;
+        else if (major == 1) out = -1 - (int64_t)value;
+        else if (major == 7 && (info == 22 || info == 23)) isNull = true;
+        else if (major == 7 && info == 26) {
+            float f;
+            uint32_t bits = (uint32_t)value;
+            memcpy(&f, &bits, 4);
+            out = (int64_t)f;
+        } else if (major == 7 && info == 27) {
+            double d;
+            memcpy(&d, &value, 8);
+            out = (int64_t)d;
+        } else return fail();
+        return true;
+    }
+
+    static float halfToFloat(uint16_t h) {
+        int exponent = (h >> 10) & 0x1F;
+        int mantissa = h & 0x3FF;
+        float value;
+        if (exponent == 0) value = ldexpf((float)mantissa, -24);
+        else if (exponent == 31) value = mantissa ? NAN : INFINITY;
+        else value = ldexpf((float)(mantissa + 1024), exponent - 25);
+        return (h & 0x8000) ? -value : value;
+    }
+};
+
+} // namespace detail
+
+// One or more uplink payloads back to back
+inline ParseResult parseCbor(const uint8_t *data, size_t size) {
+    using detail::CborReader;
+    ParseResult result;
+    CborReader in(data, size);
+
+    while (!in.atEnd()) {
+        uint8_t major, info;
+        uint64_t pairs;
+        if (!in.head(major, info, pairs) || major != 5 || pairs == CborReader::INDEFINITE) {
+            result.malformed++;
+            break;
+        }
+        RowBatch batch;
+        int epochColumn = -1;
+        std::vector<int> valueColumn;   // Record field -> value column, -1 = dropped
+        for (uint64_t i = 0; i < pairs && !in.error(); i++) {
+            std::string key;
+            if (!in.text(key)) break;
+            uint64_t count;
+            if (!in.head(major, info, count) || major != 4) {
+                in.fail();
+                break;
+            }
+            if (key == "c") {
+                for (uint64_t n = 0; count == CborReader::INDEFINITE ? !in.isBreak() : n < count; n++) {
+                    std::string name;
+                    if (!in.text(name)) break;
+                    if (name == "epoch_ms") epochColumn = (int)valueColumn.size();
+                    if (detail::skippedColumn(name) || name.empty()) {
+                        valueColumn.push_back(-1);
+                    } else {
+                        valueColumn.push_back((int)batch.names.size());
+                        batch.names.push_back(name);
+                    }
+                }
+                if (count == CborReader::INDEFINITE && !in.error()) in.skipBreak();
+            } else if (key == "r") {
+                std::vector<float> row;
+                for (uint64_t n = 0; count == CborReader::INDEFINITE ? !in.isBreak() : n < count; n++) {
+                    uint64_t fields;
+                    if (!in.head(major, info, fields) || major != 4) {
+                        in.fail();
+                        break;
+                    }
+                    row.assign(batch.names.size(), NAN);
+                    int64_t epoch = -1;
+                    bool fine = epochColumn >= 0;
+                    uint64_t f = 0;
+                    for (; fields == CborReader::INDEFINITE ? !in.isBreak() : f < fields; f++) {
+                        if ((int)f == epochColumn) {
+                            bool isNull;
+                            if (!in.integer(epoch, isNull)) break;
+                            if (isNull) fine = false;
+                            continue;
+                        }
+                        float value;
+                        if (!in.number(value)) break;
+                        int column = f < valueColumn.size() ? valueColumn[f] : -1;
+                        if (column >= 0) row[column] = value;
+                    }
+                    if (in.error()) break;
+                    if (fields == CborReader::INDEFINITE) in.skipBreak();
+                    if (!fine) {
+                        result.malformed++;
+                    } else if (epoch < EPOCH_VALID_MS) {
+                        batch.rejected++;
+                        result.rejected++;
+                    } else {
+                        batch.epochs.push_back(epoch);
+                        batch.values.insert(batch.values.end(), row.begin(), row.end());
+                        result.rows++;
+                    }
+                }
+                if (count == CborReader::INDEFINITE && !in.error()) in.skipBreak();
+            } else {
+                in.fail(); // Not an uplink payload
+            }
+        }
+        if (in.error()) {
+            result.malformed++;
+            break;
+        }
+        result.batches.push_back(batch);
+    }
+    return result;
+}
+
+// Blank (NaN) every value whose "<name>_status" has any of the `drop` bits;
+// returns how many were blanked
+inline size_t applyStatus(RowBatch &batch, uint8_t drop) {
+    const size_t width = batch.names.size(), rows = batch.rows();
+    const std::string suffix = "_status";
+    size_t blanked = 0;
+    if (drop == 0) return 0;
+    for (size_t sc = 0; sc < width; sc++) {
+        const std::string &name = batch.names[sc];
+        if (name.size() <= suffix.size() ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string target = name.substr(0, name.size() - suffix.size());
+        size_t vc = std::find(batch.names.begin(), batch.names.end(), target) - batch.names.begin();
+        if (vc == width) continue;
+        float *value = batch.values.data() + vc;
+        const float *status = batch.values.data() + sc;
+        for (size_t r = 0; r < rows; r++, value += width, status += width) {
+            // A missing status (NaN) keeps the value
+            bool flagged = *status >= 0 && ((uint32_t)*status & drop) != 0;
+            blanked += flagged && !std::isnan(*value);
+            *value = flagged ? NAN : *value;
+        }
+    }
+    return blanked;
+}
+
+// "warming,fault" -> bits; "none" -> 0; false on an unknown name
+inline bool parseStatusBits(const char *text, uint8_t &out) {
+    out = 0;
+    if (strcmp(text, "none") == 0) return true;
+    std::string list(text);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string name = list.substr(start, comma - start);
+        size_t bit = 0;
+        while (bit < 5 && name != STATUS_NAMES[bit]) bit++;
+        if (bit == 5) return false;
+        out |= 1 << bit;
+        start = comma + 1;
+    }
+    return true;
+}
+
+// CBOR payloads start with a map head, CSV with text
+inline bool looksLikeCbor(const uint8_t *data, size_t size) {
+    return size > 0 && (data[0] >> 5) == 5;
+}
+
+inline ParseResult parseLog(const uint8_t *data, size_t size) {
+    if (looksLikeCbor(data, size)) return parseCbor(data, size);
+    return parseCsv((const char *)data, size);
+}
+
+} // namespace fleet
+
+#endif // _FLEET_LOG_PARSER_H_
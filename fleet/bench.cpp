@@ -0,0 +1,109 @@
+/*
+ * EnviroSense AQMS - fleet store benchmark
+ *
+ * Ingests synthetic one-second records of the ESP32 schema (16 columns,
+ * CO2 drifting, PM held between the 5 minute windows) for a number of
+ * units and days into a new store, then times the queries a dashboard
+ * asks for, with 1 and 4 threads:
+ *
+ *   fleet_bench <units> <days> <store>
+ *
+ * Prints the ingest rate, the bytes per row on disk, and per query the
+ * time and how many blocks came from the index or were scanned.
+ *
+ * Build: ./build.sh
+ */
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "FleetQuery.h"
+
+using namespace fleet;
+
+static const char *const benchColumns[] = {"lat", "lng",    "co2", "so2", "h2s", "ch4",  "no2",  "c2h5oh",
+                                           "h2",  "nh3",    "co",  "tvoc", "eco2", "pm25", "pm10", "ready"};
+static const size_t BENCH_COLUMNS = sizeof(benchColumns) / sizeof(benchColumns[0]);
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+static float hundredths(float v) { return roundf(v * 100) / 100; }
+
+// One unit-day of records
+static RowBatch day(std::mt19937 &rng, int64_t start) {
+    std::normal_distribution<float> noise(0, 1);
+    RowBatch batch;
+    for (size_t c = 0; c < BENCH_COLUMNS; c++) batch.names.push_back(benchColumns[c]);
+    float co2 = 420, pm = 12;
+    for (int s = 0; s < 86400; s++) {
+        batch.epochs.push_back(start + s * 1000LL);
+        co2 += 0.05f * noise(rng);
+        if (s % 300 == 0) pm = 10 + 5 * fabsf(noise(rng));
+        float values[BENCH_COLUMNS] = {6.901234f, 79.861234f, hundredths(co2), hundredths(fabsf(noise(rng)) * 0.1f),
+                                       0.01f, hundredths(1.8f + 0.01f * noise(rng)), 0.04f, NAN, 0.1f, 0.3f, 0.6f,
+                                       12, 400, pm, pm * 1.3f, 15};
+        batch.values.insert(batch.values.end(), values, values + BENCH_COLUMNS);
+    }
+    return batch;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: fleet_bench <units> <days> <store>\n");
+        return 2;
+    }
+    int units = atoi(argv[1]), days = atoi(argv[2]);
+    Store store(argv[3]);
+    if (units <= 0 || days <= 0 || !store.create()) {
+        fprintf(stderr, "cannot create %s\n", argv[3]);
+        return 1;
+    }
+
+    int64_t start = monthStartMs(202606), end = start + days * 86400000LL - 1;
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    IngestStats ingested;
+    for (int u = 0; u < units; u++) {
+        std::mt19937 rng(u);
+        for (int d = 0; d < days; d++) {
+            std::vector<RowBatch> batches(1, day(rng, start + d * 86400000LL));
+            std::string error;
+            if (!store.ingest("unit" + std::to_string(u), batches, ingested, error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        }
+    }
+    double took = seconds(began);
+    printf("ingest: %zu rows in %.1f s (%.2f M rows/s), %.1f MB = %.2f B/row (float32 columns: %zu B/row)\n",
+           ingested.rows, took, ingested.rows / took / 1e6, ingested.bytes / 1e6,
+           (double)ingested.bytes / ingested.rows, 8 + BENCH_COLUMNS * 4);
+
+    std::vector<std::string> all = store.units();
+    for (unsigned threads = 1; threads <= 4; threads *= 4) {
+        Query query(store, threads);
+        QueryStats hourly, quarter, range;
+        began = std::chrono::steady_clock::now();
+        query.aggregate(all, "co2", start, end, HOUR_MS, hourly);
+        double hourlyTook = seconds(began);
+        began = std::chrono::steady_clock::now();
+        query.aggregate(all, "pm25", start, end, 15 * 60000, quarter);
+        double quarterTook = seconds(began);
+        began = std::chrono::steady_clock::now();
+        std::map<std::string, std::vector<Sample> > hits = query.range(all, "co2", start, end, 430, INFINITY, range);
+        double rangeTook = seconds(began);
+        size_t samples = 0;
+        for (std::map<std::string, std::vector<Sample> >::iterator u = hits.begin(); u != hits.end(); ++u) {
+            samples += u->second.size();
+        }
+        printf("%u thread%s: hourly co2 %.3f s (%llu blocks from the index, %llu scanned); "
+               "15 min pm25 %.3f s (%llu rows scanned); co2 >= 430 %.3f s (%zu samples, %llu of %llu blocks "
+               "skipped)\n",
+               threads, threads == 1 ? "" : "s", hourlyTook, (unsigned long long)hourly.fromIndex,
+               (unsigned long long)hourly.scanned, quarterTook, (unsigned long long)quarter.rows, rangeTook, samples,
+               (unsigned long long)range.fromIndex, (unsigned long long)range.blocks);
+    }
+    return 0;
+}
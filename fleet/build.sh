@@ -0,0 +1,4 @@
+#!/bin/bash
+# Builds the fleet store tool and its benchmark (Linux / macOS, g++ or clang++)
+${CXX:-g++} -std=c++17 -O2 -pthread -Wall -o fleet fleet.cpp
+${CXX:-g++} -std=c++17 -O2 -pthread -Wall -o fleet_bench bench.cpp
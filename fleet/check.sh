@@ -0,0 +1,71 @@
+#!/bin/bash
+# Checks the fleet store against reference.py: builds, ingests two
+# synthetic unit logs, compares range and aggregate answers with the
+# reference, ingests one log a minute at a time (the store must stay about
+# the size of a single ingest), and checks that a second writer is refused
+set -e
+cd "$(dirname "$0")"
+./build.sh
+
+work=$(mktemp -d /tmp/aqms_fleet_XXXXXX)
+trap 'rm -rf "$work"' EXIT
+start=1782856800000   # 2026-07-01 00:00 UTC
+end=1783461599999     # a week later
+
+python3 reference.py log "$work/A.txt" 1 $start 20000
+python3 reference.py log "$work/B.txt" 2 $((start + 86400000)) 20000
+./fleet ingest "$work/store" A "$work/A.txt" 2> /dev/null
+./fleet ingest "$work/store" B "$work/B.txt" 2> /dev/null
+
+compare() {
+    if ! cmp -s "$work/expected" "$work/got"; then
+        echo "fleet check: FAILED: $1"
+        diff "$work/expected" "$work/got" | head -5
+        exit 1
+    fi
+}
+
+for bucket in 3600000 900000; do
+    python3 reference.py aggregate co2 $start $end $bucket A="$work/A.txt" B="$work/B.txt" > "$work/expected"
+    ./fleet aggregate "$work/store" all co2 $start $end $bucket > "$work/got" 2> /dev/null
+    compare "aggregate co2, bucket $bucket ms"
+done
+python3 reference.py aggregate pm25 $((start + 5000000)) $((start + 90000000)) 3600000 \
+    A="$work/A.txt" B="$work/B.txt" > "$work/expected"
+./fleet aggregate "$work/store" all pm25 $((start + 5000000)) $((start + 90000000)) 1h > "$work/got" 2> /dev/null
+compare "aggregate pm25 over a part of the hours"
+python3 reference.py range pm25 $start $end 10 12.5 A="$work/A.txt" B="$work/B.txt" > "$work/expected"
+./fleet range "$work/store" all pm25 $start $end 10 12.5 > "$work/got" 2> /dev/null
+compare "range pm25"
+
+# A unit sending its log a minute at a time: the last hour is rewritten
+# each time and its old block is dead
+python3 reference.py log "$work/C.txt" 3 $start 7200
+./fleet ingest "$work/once" C "$work/C.txt" 2> /dev/null
+once=$(cat "$work"/once/C/*.dat | wc -c)
+for minute in $(seq 1 60); do
+    head -n $((4 + minute * 120)) "$work/C.txt" > "$work/part.txt"
+    ./fleet ingest "$work/store" C "$work/part.txt" 2> /dev/null
+done
+./fleet ingest "$work/store" C "$work/C.txt" 2> /dev/null
+grown=$(cat "$work"/store/C/*.dat | wc -c)
+if [ "$grown" -gt $((once * 2)) ]; then
+    echo "fleet check: FAILED: 61 ingests take $grown bytes, one takes $once"
+    exit 1
+fi
+python3 reference.py range co2 $start $end 0 1000 C="$work/C.txt" > "$work/expected"
+./fleet range "$work/store" C co2 $start $end 0 1000 > "$work/got" 2> /dev/null
+compare "range co2 after the compactions"
+
+# A second writer of the same unit is refused while the first holds the lock
+if python3 -c 'import fcntl, subprocess, sys
+lock = open(sys.argv[1], "a")
+fcntl.flock(lock, fcntl.LOCK_EX)
+sys.exit(subprocess.call(sys.argv[2:], stderr=subprocess.DEVNULL))' \
+    "$work/store/A/.lock" ./fleet ingest "$work/store" A "$work/A.txt"; then
+    echo "fleet check: FAILED: a second writer of a unit was not refused"
+    exit 1
+fi
+
+./fleet_bench 4 3 "$work/bench"
+echo "fleet store $grown bytes after 61 ingests ($once for one); fleet checks passed"
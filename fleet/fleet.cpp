@@ -0,0 +1,298 @@
+/*
+ * EnviroSense AQMS - fleet store
+ *
+ * Collects the logs of many units into one columnar store and answers
+ * range and aggregate queries over it (see FleetStore.h, FleetQuery.h).
+ *
+ *   fleet ingest <store> <unit> <file>...
+ *   fleet ingest-tree <store> <dir>          <dir>/<unit>/<files>, units in parallel
+ *   fleet units <store>
+ *   fleet columns <store> <unit>
+ *   fleet range <store> <unit|all> <column> <from> <to> [min max]
+ *   fleet aggregate <store> <unit|all> <column> <from> <to> [bucket]
+ *
+ * Files are data.txt logs (CSV) or saved MQTT uplink payloads (CBOR); the
+ * format is detected per file. Times are epoch ms or UTC dates like
+ * 2026-06-15 or 2026-06-15T10:30; buckets are ms or 15m / 1h / 1d
+ * (default 1h). -j N sets the number of threads.
+ *
+ * On ingest, values whose status column (schema 2 logs) has a warming or
+ * fault bit are stored empty; --drop sets the bits instead, e.g.
+ * --drop warming,fault,stale, or --drop none to keep every value.
+ *
+ * Build: ./build.sh (g++ -std=c++17 -O2 -pthread)
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "FleetQuery.h"
+#include "FleetStore.h"
+#include "LogParser.h"
+
+using namespace fleet;
+
+static bool readWholeFile(const std::string &path, std::vector<uint8_t> &out) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL) return false;
+    fseeko(f, 0, SEEK_END);
+    off_t size = ftello(f);
+    fseeko(f, 0, SEEK_SET);
+    out.resize((size_t)size);
+    bool ok = fread(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+// Epoch ms, or YYYY-MM-DD[THH[:MM[:SS]]] in UTC
+static bool parseTime(const char *text, int64_t &out) {
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    int n = sscanf(text, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second);
+    if (n >= 3 && strchr(text, '-') != NULL) {
+        struct tm t = tm();
+        t.tm_year = year - 1900;
+        t.tm_mon = month - 1;
+        t.tm_mday = day;
+        t.tm_hour = hour;
+        t.tm_min = minute;
+        t.tm_sec = second;
+        out = (int64_t)timegm(&t) * 1000;
+        return true;
+    }
+    char *end;
+    out = strtoll(text, &end, 10);
+    return *end == '\0';
+}
+
+static bool parseBucket(const char *text, int64_t &out) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0) return false;
+    if (strcmp(end, "s") == 0) value *= 1000;
+    else if (strcmp(end, "m") == 0) value *= 60000;
+    else if (strcmp(end, "h") == 0) value *= HOUR_MS;
+    else if (strcmp(end, "d") == 0) value *= 24 * HOUR_MS;
+    else if (*end != '\0') return false;
+    out = (int64_t)value;
+    return out > 0;
+}
+
+static void printNumber(double value) {
+    if (std::isnan(value)) printf(",");
+    else printf(",%.4g", value);
+}
+
+static std::vector<std::string> unitList(const Store &store, const std::string &unit) {
+    if (unit == "all") return store.units();
+    return std::vector<std::string>(1, unit);
+}
+
+static std::vector<std::string> listFiles(const std::string &dir) {
+    std::vector<std::string> out;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) return out;
+    while (struct dirent *entry = readdir(d)) {
+        if (entry->d_name[0] == '.') continue;
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) out.push_back(path);
+    }
+    closedir(d);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Parse and store one unit's files; false on a store error
+static bool ingestFiles(Store &store, const std::string &unit, const std::vector<std::string> &files,
+                        uint8_t drop, IngestStats &stats, std::string &report) {
+    std::vector<RowBatch> batches;
+    size_t rejected = 0, malformed = 0, flagged = 0;
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!readWholeFile(files[i], data)) {
+            report += "  cannot read " + files[i] + "\n";
+            continue;
+        }
+        ParseResult parsed = parseLog(data.data(), data.size());
+        rejected += parsed.rejected;
+        malformed += parsed.malformed;
+        for (size_t b = 0; b < parsed.batches.size(); b++) {
+            if (parsed.batches[b].rows() == 0) continue;
+            flagged += applyStatus(parsed.batches[b], drop);
+            batches.push_back(std::move(parsed.batches[b]));
+        }
+    }
+    std::string error;
+    IngestStats unitStats;
+    if (!store.ingest(unit, batches, unitStats, error)) {
+        report += "  " + unit + ": " + error + "\n";
+        return false;
+    }
+    char line[256];
+    snprintf(line, sizeof(line),
+             "  %s: %zu rows, %zu new, %zu duplicate, %zu without GPS time, %zu malformed, %zu values flagged, "
+             "%zu blocks, %llu dead bytes reclaimed\n",
+             unit.c_str(), unitStats.rows, unitStats.added, unitStats.duplicates, rejected, malformed, flagged,
+             unitStats.blocks, (unsigned long long)unitStats.reclaimed);
+    report += line;
+    stats.add(unitStats);
+    return true;
+}
+
+static int usage() {
+    fprintf(stderr,
+            "usage: fleet [-j threads] [--drop flags] ingest <store> <unit> <file>...\n"
+            "       fleet [-j threads] [--drop flags] ingest-tree <store> <dir>\n"
+            "       fleet units <store>\n"
+            "       fleet columns <store> <unit>\n"
+            "       fleet [-j threads] range <store> <unit|all> <column> <from> <to> [min max]\n"
+            "       fleet [-j threads] aggregate <store> <unit|all> <column> <from> <to> [bucket]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    uint8_t drop = STATUS_DROP_DEFAULT;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--drop") == 0 && i + 1 < argc) {
+            if (!parseStatusBits(argv[++i], drop)) return usage();
+        } else args.push_back(argv[i]);
+    }
+    if (threads == 0) threads = 1;
+    if (args.size() < 2) return usage();
+
+    const std::string &command = args[0];
+    Store store(args[1]);
+
+    if (command == "ingest" && args.size() >= 4) {
+        std::vector<std::string> files(args.begin() + 3, args.end());
+        IngestStats stats;
+        std::string report;
+        bool ok = ingestFiles(store, args[2], files, drop, stats, report);
+        fputs(report.c_str(), stderr);
+        return ok ? 0 : 1;
+    }
+
+    if (command == "ingest-tree" && args.size() == 3) {
+        Store inbox(args[2]);
+        std::vector<std::string> units = inbox.units();
+        std::vector<IngestStats> stats(units.size());
+        std::vector<std::string> reports(units.size());
+        std::atomic<size_t> next(0);
+        std::atomic<bool> ok(true);
+        std::vector<std::thread> pool;
+        if (!store.create()) {
+            fprintf(stderr, "cannot create %s\n", args[1].c_str());
+            return 1;
+        }
+        for (unsigned t = 0; t < std::min<size_t>(threads, units.size()); t++) {
+            pool.push_back(std::thread([&]() {
+                for (size_t i = next++; i < units.size(); i = next++) {
+                    if (!ingestFiles(store, units[i], listFiles(args[2] + "/" + units[i]), drop, stats[i],
+                                     reports[i])) {
+                        ok = false;
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+        IngestStats total;
+        for (size_t i = 0; i < units.size(); i++) {
+            fputs(reports[i].c_str(), stderr);
+            total.add(stats[i]);
+        }
+        fprintf(stderr, "%zu units, %zu rows, %zu new, %llu bytes written\n", units.size(), total.rows,
+                total.added, (unsigned long long)total.bytes);
+        return ok ? 0 : 1;
+    }
+
+    if (command == "units") {
+        std::vector<std::string> units = store.units();
+        for (size_t i = 0; i < units.size(); i++) {
+            std::vector<int> months = store.months(units[i]);
+            printf("%s", units[i].c_str());
+            if (!months.empty()) {
+                printf(" %s..%s", monthName(months.front()).c_str(), monthName(months.back()).c_str());
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    if (command == "columns" && args.size() == 3) {
+        std::vector<std::string> columns;
+        std::vector<int> months = store.months(args[2]);
+        for (size_t m = 0; m < months.size(); m++) {
+            Partition part(store.partitionBase(args[2], months[m]));
+            if (!part.load()) continue;
+            for (size_t c = 0; c < part.schema.size(); c++) {
+                if (std::find(columns.begin(), columns.end(), part.schema[c]) == columns.end()) {
+                    columns.push_back(part.schema[c]);
+                }
+            }
+        }
+        for (size_t c = 0; c < columns.size(); c++) printf("%s\n", columns[c].c_str());
+        return 0;
+    }
+
+    if ((command == "range" || command == "aggregate") && args.size() >= 6) {
+        int64_t from, to;
+        if (!parseTime(args[4].c_str(), from) || !parseTime(args[5].c_str(), to)) return usage();
+        Query query(store, threads);
+        QueryStats stats;
+        std::vector<std::string> units = unitList(store, args[2]);
+
+        if (command == "range") {
+            float low = -INFINITY, high = INFINITY;
+            if (args.size() == 8) {
+                low = strtof(args[6].c_str(), NULL);
+                high = strtof(args[7].c_str(), NULL);
+            }
+            std::map<std::string, std::vector<Sample> > result =
+                query.range(units, args[3], from, to, low, high, stats);
+            printf("unit,epoch_ms,%s\n", args[3].c_str());
+            for (std::map<std::string, std::vector<Sample> >::iterator u = result.begin(); u != result.end(); ++u) {
+                for (size_t i = 0; i < u->second.size(); i++) {
+                    printf("%s,%lld,%.6g\n", u->first.c_str(), (long long)u->second[i].epoch, u->second[i].value);
+                }
+            }
+        } else {
+            int64_t bucket = HOUR_MS;
+            if (args.size() >= 7 && !parseBucket(args[6].c_str(), bucket)) return usage();
+            std::map<std::string, std::map<int64_t, Aggregate> > result =
+                query.aggregate(units, args[3], from, to, bucket, stats);
+            printf("unit,epoch_ms,count,mean,min,max\n");
+            for (std::map<std::string, std::map<int64_t, Aggregate> >::iterator u = result.begin();
+                 u != result.end(); ++u) {
+                for (std::map<int64_t, Aggregate>::iterator b = u->second.begin(); b != u->second.end(); ++b) {
+                    printf("%s,%lld,%llu", u->first.c_str(), (long long)b->first,
+                           (unsigned long long)b->second.count);
+                    printNumber(b->second.mean());
+                    printNumber(b->second.min);
+                    printNumber(b->second.max);
+                    printf("\n");
+                }
+            }
+        }
+        fprintf(stderr, "%llu partitions, %llu blocks: %llu from the index, %llu scanned (%llu rows, %llu bytes)\n",
+                (unsigned long long)stats.partitions, (unsigned long long)stats.blocks,
+                (unsigned long long)stats.fromIndex, (unsigned long long)stats.scanned,
+                (unsigned long long)stats.rows, (unsigned long long)stats.bytesRead);
+        return 0;
+    }
+
+    return usage();
+}
@@ -0,0 +1,115 @@
+"""Reference answers for the fleet store check (check.sh).
+
+Writes synthetic data.txt logs and answers range and aggregate queries
+straight from the logs, the slow and obvious way, in the format fleet
+prints them:
+
+    python3 reference.py log <file> <seed> <start_ms> <seconds>
+    python3 reference.py range <column> <from> <to> <min> <max> <unit>=<file>...
+    python3 reference.py aggregate <column> <from> <to> <bucket_ms> <unit>=<file>...
+
+A log has a header change half way (a column added), rows from before
+the first GPS time, gaps, empty values and a cut-off last line, as a
+unit's card can. Rows keep the first value logged for an epoch_ms, rows
+before 2000-01-01 (no GPS time yet) are skipped and values are rounded
+to float32, as the store does. Only the Python standard library is used.
+"""
+
+import random
+import struct
+import sys
+
+EPOCH_2000_MS = 946684800000
+
+
+def f32(text):
+    return struct.unpack("f", struct.pack("f", float(text)))[0]
+
+
+def write_log(path, seed, start, seconds):
+    rng = random.Random(seed)
+    first = "date , time , epoch_ms , lat , lng , co2 , pm25\r\n"
+    second = "date , time , epoch_ms , lat , lng , co2 , pm25 , ready\r\n"
+    lines = [first]
+    for boot in range(3):
+        lines.append("0,0,%d,0.000000,0.000000,410.00,5.00\r\n" % (1000 + boot * 1000))
+    epoch = start
+    for i in range(seconds):
+        epoch += 1000 if rng.random() > 0.01 else 60000
+        if i == seconds // 2:
+            lines.append(second)
+        pm25 = "" if rng.random() < 0.02 else "%.2f" % (rng.random() * 30)
+        row = "20260701,000000,%d,6.901234,79.861234,%.2f,%s" % (epoch, 400 + rng.random() * 50, pm25)
+        if i >= seconds // 2:
+            row += ",15"
+        lines.append(row + "\r\n")
+    with open(path, "w", newline="") as f:
+        f.write("".join(lines) + "20260701,0000")
+
+
+def rows(path):
+    columns = None
+    with open(path, newline="") as f:
+        for line in f:
+            if not line.endswith("\n"):
+                break
+            line = line.rstrip("\r\n")
+            if line[:1].isalpha():
+                columns = [c.strip() for c in line.split(",")]
+                continue
+            values = dict(zip(columns, [v.strip() for v in line.split(",")]))
+            epoch = int(values["epoch_ms"])
+            if epoch >= EPOCH_2000_MS:
+                yield epoch, values
+
+
+# (unit, epoch, value) of every stored value of `column` in [start, end]
+def samples(units, column, start, end):
+    for unit, path in sorted(units):
+        seen = set()
+        for epoch, values in rows(path):
+            if epoch in seen:
+                continue
+            seen.add(epoch)
+            if start <= epoch <= end and values.get(column, "") != "":
+                yield unit, epoch, f32(values[column])
+
+
+def query_range(units, column, start, end, low, high):
+    print("unit,epoch_ms,%s" % column)
+    for unit, epoch, value in samples(units, column, start, end):
+        if low <= value <= high:
+            print("%s,%d,%.6g" % (unit, epoch, value))
+
+
+def query_aggregate(units, column, start, end, bucket):
+    buckets = {}
+    for unit, epoch, value in samples(units, column, start, end):
+        b = buckets.setdefault((unit, epoch // bucket * bucket), [0, 0.0, value, value])
+        b[0] += 1
+        b[1] += value
+        b[2] = min(b[2], value)
+        b[3] = max(b[3], value)
+    print("unit,epoch_ms,count,mean,min,max")
+    for (unit, epoch), (count, total, low, high) in sorted(buckets.items()):
+        print("%s,%d,%d,%.4g,%.4g,%.4g" % (unit, epoch, count, total / count, low, high))
+
+
+def main(argv):
+    if len(argv) == 6 and argv[1] == "log":
+        write_log(argv[2], int(argv[3]), int(argv[4]), int(argv[5]))
+        return 0
+    if len(argv) > 7 and argv[1] == "range":
+        units = [u.split("=", 1) for u in argv[7:]]
+        query_range(units, argv[2], int(argv[3]), int(argv[4]), float(argv[5]), float(argv[6]))
+        return 0
+    if len(argv) > 6 and argv[1] == "aggregate":
+        units = [u.split("=", 1) for u in argv[6:]]
+        query_aggregate(units, argv[2], int(argv[3]), int(argv[4]), int(argv[5]))
+        return 0
+    print(__doc__.split("\n\n")[1], file=sys.stderr)
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,154 @@
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+/*
+ * Host Arduino shim
+ *
+ * Just enough of the Arduino core to build the AQMS_Core headers on a PC
+ * (g++ / clang++, C++17): Print, Stream, Serial on stdout, F() and the
+ * usual helpers. The program supplies the clock and the inputs, e.g. from
+ * a simulation or a TraceReplay:
+ *
+ *   unsigned long millis() { return replay.millis(); }
+ *   unsigned long micros() { return replay.millis() * 1000; }
+ *   int analogRead(uint8_t pin) { return replay.analogRead(pin); }
+ *   void delay(unsigned long ms) { ... }
+ *   void yield() { ... }      // Busy-wait loops call it; advance the clock
+ *
+ * The ESP32 firmware itself builds on top of this with Esp32Host.h.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+
+using std::isinf;
+using std::isnan;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define F(text) (text)
+#define PROGMEM
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+#define DEC    10
+#define HEX    16
+
+template <typename T, typename L, typename H>
+inline auto constrain(T x, L lo, H hi) -> decltype(x + lo + hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+#define PI         3.1415926535897932384626433832795
+#define TWO_PI     6.283185307179586476925286766559
+#define radians(deg) ((deg) * PI / 180.0)
+#define degrees(rad) ((rad) * 180.0 / PI)
+#define sq(x)        ((x) * (x))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+// Supplied by the host program
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+int analogRead(uint8_t pin);
+
+inline void delayMicroseconds(unsigned int) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+class Print {
+private:
+    size_t number(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        char text[48];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        return n > 0 ? write((const uint8_t *)text, strlen(text)) : 0;
+    }
+
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buf++);
+        return n;
+    }
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    virtual void flush() {}
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC) { return base == HEX ? number("%lX", v) : number("%ld", v); }
+    size_t print(unsigned long v, int base = DEC) { return base == HEX ? number("%lX", v) : number("%lu", v); }
+    size_t print(double v, int digits = 2) { return number("%.*f", digits, v); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+    template <typename T>
+    size_t println(T v, int format) { return print(v, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(uint8_t *buf, size_t size) {
+        size_t n = 0;
+        while (n < size && available() > 0) buf[n++] = (uint8_t)read();
+        return n;
+    }
+    void setTimeout(unsigned long) {}
+};
+
+// Serial: stdout unless sent elsewhere (NULL discards), nothing to read
+class HostSerial : public Stream {
+private:
+    FILE *_out = stdout;
+
+public:
+    void setOutput(FILE *out) { _out = out; }
+
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) { return _out == NULL || fputc(c, _out) != EOF ? 1 : 0; }
+    void flush() {
+        if (_out != NULL) fflush(_out);
+    }
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+};
+
+inline HostSerial Serial;
+
+#endif // _HOST_ARDUINO_H_
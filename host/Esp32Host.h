@@ -0,0 +1,62 @@
+#ifndef _HOST_ESP32_H_
+#define _HOST_ESP32_H_
+
+/*
+ * Host ESP32 core stand-in
+ *
+ * What src/esp_main.cpp takes from the ESP32 Arduino core beyond Arduino.h,
+ * so the firmware itself builds and runs on the PC:
+ *
+ *   #include "Esp32Host.h"
+ *   #include "../src/esp_main.cpp"
+ *
+ * The ADC settings, interrupts and FreeRTOS calls do nothing; a task is
+ * never started, so the spike capture stays idle. RTC memory is ordinary
+ * memory unless the program defines RTC_DATA_ATTR first (lp_check keeps
+ * it in a section of its own). The program supplies the clock and inputs as for Arduino.h, the
+ * sleeps of esp_sleep.h, and attaches devices to the UARTs (HardwareSerial.h)
+ * and to Wire.
+ */
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include <Wire.h>
+#include <SD.h>
+#include <WiFi.h>
+#include <esp_sleep.h>
+
+#ifndef RTC_DATA_ATTR
+#define RTC_DATA_ATTR
+#endif
+#define IRAM_ATTR
+
+#define ADC_11db 3
+inline void analogSetWidth(uint8_t) {}
+inline void analogSetAttenuation(uint8_t) {}
+
+#define RISING 1
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+
+// FreeRTOS
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+#define portMAX_DELAY      0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return NULL; }
+inline int xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return 1; }
+inline int xSemaphoreGive(SemaphoreHandle_t) { return 1; }
+inline TickType_t xTaskGetTickCount() { return millis(); }
+inline void vTaskDelayUntil(TickType_t *, TickType_t) {}
+inline int xTaskCreatePinnedToCore(void (*)(void *), const char *, uint32_t, void *, int, TaskHandle_t *, int) {
+    return 0;
+}
+
+struct EspClass {
+    uint32_t getFreeHeap() { return 0; }
+};
+inline EspClass ESP;
+
+#endif // _HOST_ESP32_H_
@@ -0,0 +1,39 @@
+#ifndef _HOST_HARDWARE_SERIAL_H_
+#define _HOST_HARDWARE_SERIAL_H_
+
+/*
+ * Host ESP32 UART stand-in
+ *
+ * A UART talks to whatever Stream is attached as the device on the other
+ * end: read() gives the device's output and write() feeds its input (a
+ * simulated sensor, or a ReplayStream, which drops what it is sent).
+ * Without a device nothing arrives.
+ */
+
+#include <Arduino.h>
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+private:
+    Stream *_device = NULL;
+
+public:
+    explicit HardwareSerial(int) {}
+
+    void attach(Stream *device) { _device = device; }
+
+    void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+    void end() {}
+
+    int available() { return _device != NULL ? _device->available() : 0; }
+    int read() { return _device != NULL ? _device->read() : -1; }
+    int peek() { return _device != NULL ? _device->peek() : -1; }
+    size_t write(uint8_t c) { return _device != NULL ? _device->write(c) : 1; }
+    size_t write(const uint8_t *buf, size_t size) { return _device != NULL ? _device->write(buf, size) : size; }
+};
+
+inline HardwareSerial Serial1(1);
+inline HardwareSerial Serial2(2);
+
+#endif // _HOST_HARDWARE_SERIAL_H_
@@ -0,0 +1,173 @@
+#ifndef _HOST_SD_H_
+#define _HOST_SD_H_
+
+/*
+ * Host SD library stand-in
+ *
+ * The card is a directory on the PC (SD.setRoot(), default "."), so the
+ * firmware's config.txt, data.txt and the rest are ordinary files. Open
+ * modes follow the AVR library: FILE_WRITE creates and appends. Handles
+ * come from a fixed pool and are closed with the last copy, as on the
+ * ESP32, and nothing here uses operator new.
+ */
+
+#include <Arduino.h>
+
+#define FILE_READ   0
+#define FILE_WRITE  1
+#define FILE_APPEND 1
+
+#define SD_HOST_FILES 16    // Files open at the same time
+#define SD_HOST_PATH  256
+
+class File : public Stream {
+private:
+    struct Slot {
+        FILE *file;
+        int refs;
+        long size;      // Kept up to date by write(), so available() needs no seek
+    };
+
+    static Slot *slots() {
+        static Slot pool[SD_HOST_FILES];
+        return pool;
+    }
+
+    int _slot = -1;
+
+    FILE *handle() const { return _slot >= 0 ? slots()[_slot].file : NULL; }
+
+    void release() {
+        if (_slot < 0) return;
+        Slot &slot = slots()[_slot];
+        if (--slot.refs == 0) {
+            fclose(slot.file);
+            slot.file = NULL;
+        }
+        _slot = -1;
+    }
+
+public:
+    File() {}
+
+    explicit File(FILE *file) {
+        if (file == NULL) return;
+        for (int i = 0; i < SD_HOST_FILES; i++) {
+            if (slots()[i].file != NULL) continue;
+            long here = ftell(file);
+            fseek(file, 0, SEEK_END);
+            slots()[i].size = ftell(file);
+            fseek(file, here, SEEK_SET);
+            slots()[i].file = file;
+            slots()[i].refs = 1;
+            _slot = i;
+            return;
+        }
+        fclose(file); // Pool exhausted: the open fails, as on the card
+    }
+
+    File(const File &other) : _slot(other._slot) {
+        if (_slot >= 0) slots()[_slot].refs++;
+    }
+
+    File &operator=(const File &other) {
+        if (this == &other) return *this;
+        release();
+        _slot = other._slot;
+        if (_slot >= 0) slots()[_slot].refs++;
+        return *this;
+    }
+
+    ~File() { release(); }
+
+    explicit operator bool() const { return handle() != NULL; }
+
+    void close() { release(); }
+
+    uint32_t size() const { return handle() != NULL ? (uint32_t)slots()[_slot].size : 0; }
+
+    uint32_t position() const {
+        FILE *f = handle();
+        return f != NULL ? (uint32_t)ftell(f) : 0;
+    }
+
+    bool seek(uint32_t pos) {
+        FILE *f = handle();
+        return f != NULL && fseek(f, pos, SEEK_SET) == 0;
+    }
+
+    int available() {
+        FILE *f = handle();
+        return f != NULL ? (int)(size() - position()) : 0;
+    }
+
+    int read() {
+        FILE *f = handle();
+        return f != NULL ? fgetc(f) : -1;
+    }
+
+    int peek() {
+        FILE *f = handle();
+        if (f == NULL) return -1;
+        int c = fgetc(f);
+        if (c != EOF) ungetc(c, f);
+        return c;
+    }
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+
+    size_t write(const uint8_t *buf, size_t size) {
+        FILE *f = handle();
+        if (f == NULL) return 0;
+        size_t written = fwrite(buf, 1, size, f);
+        long end = ftell(f);
+        if (end > slots()[_slot].size) slots()[_slot].size = end;
+        return written;
+    }
+
+    void flush() {
+        FILE *f = handle();
+        if (f != NULL) fflush(f);
+    }
+};
+
+class SDClass {
+private:
+    char _root[SD_HOST_PATH] = ".";
+
+    const char *path(const char *name, char *buf) const {
+        int n = snprintf(buf, SD_HOST_PATH, "%s/%s", _root, name[0] == '/' ? name + 1 : name);
+        return n < SD_HOST_PATH ? buf : ""; // Too long: opens nothing
+    }
+
+public:
+    void setRoot(const char *dir) { snprintf(_root, sizeof(_root), "%s", dir); }
+
+    bool begin(uint8_t = 0) { return true; }
+
+    File open(const char *name, uint8_t mode = FILE_READ) {
+        char buf[SD_HOST_PATH];
+        return File(fopen(path(name, buf), mode == FILE_READ ? "rb" : "ab+"));
+    }
+
+    bool exists(const char *name) {
+        char buf[SD_HOST_PATH];
+        FILE *f = fopen(path(name, buf), "rb");
+        if (f != NULL) fclose(f);
+        return f != NULL;
+    }
+
+    bool remove(const char *name) {
+        char buf[SD_HOST_PATH];
+        return ::remove(path(name, buf)) == 0;
+    }
+
+    bool rename(const char *from, const char *to) {
+        char a[SD_HOST_PATH], b[SD_HOST_PATH];
+        return ::rename(path(from, a), path(to, b)) == 0;
+    }
+};
+
+inline SDClass SD;
+
+#endif // _HOST_SD_H_
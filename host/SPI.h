@@ -0,0 +1,24 @@
+#ifndef _HOST_SPI_H_
+#define _HOST_SPI_H_
+
+// Host stand-in so SPI drivers build; nothing is attached
+#include <Arduino.h>
+
+#define MSBFIRST  1
+#define SPI_MODE0 0
+
+struct SPISettings {
+    SPISettings(uint32_t = 0, uint8_t = 0, uint8_t = 0) {}
+};
+
+class SPIClass {
+public:
+    void begin() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t) { return 0xFF; }
+};
+
+inline SPIClass SPI;
+
+#endif // _HOST_SPI_H_
@@ -0,0 +1,311 @@
+#ifndef _HOST_SIM_SENSORS_H_
+#define _HOST_SIM_SENSORS_H_
+
+/*
+ * Simulated sensors for the host builds of the firmware
+ *
+ * Each device talks the real wire protocol, so the firmware's own drivers
+ * run against it unchanged:
+ *
+ *   SimGPS     NMEA RMC + GGA once a second, with a fix from fixFrom on and
+ *              an optional fix-loss window (UART, attach to Serial2)
+ *   SimSDS011  0xB4 commands answered with 0xC5 replies, 0xC0 data frames in
+ *              active and query mode, sleep and wake (UART, attach to SerialPM)
+ *   SimENS160  PART_ID, OPMODE, DATA_STATUS, TVOC and ECO2 registers
+ *              (I2C, Wire.attach(0x53, ...))
+ *   SimGas     ADC codes of the MG-811, MQ and MICS inputs, optionally stuck
+ *
+ * Time is whatever the program passes to update(now); output produced up
+ * to `now` can be read. Noise comes from a fixed-seed generator, so a run
+ * gives the same input every time.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SIM_UART_BUFFER 1024   // Bytes a UART holds before the oldest is dropped
+
+// Fixed-seed noise shared by the devices
+inline uint32_t &simSeed() {
+    static uint32_t seed = 12345;
+    return seed;
+}
+
+inline int simNoise(int amplitude) {
+    uint32_t &seed = simSeed();
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// Bytes the device has sent and the firmware not read yet
+class SimUart : public Stream {
+private:
+    uint8_t _buf[SIM_UART_BUFFER];
+    uint16_t _head = 0, _count = 0;
+
+protected:
+    void send(const uint8_t *data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            if (_count == SIM_UART_BUFFER) {
+                _head = (_head + 1) % SIM_UART_BUFFER;
+                _count--;
+            }
+            _buf[(_head + _count++) % SIM_UART_BUFFER] = data[i];
+        }
+    }
+
+public:
+    int available() { return _count; }
+
+    int read() {
+        if (_count == 0) return -1;
+        uint8_t c = _buf[_head];
+        _head = (_head + 1) % SIM_UART_BUFFER;
+        _count--;
+        return c;
+    }
+
+    int peek() { return _count > 0 ? _buf[_head] : -1; }
+    size_t write(uint8_t) { return 1; }
+};
+
+// GPS receiver: a second's sentences arrive 100 ms after the second
+class SimGPS : public SimUart {
+private:
+    uint64_t _next = 1100;
+
+    void sentence(const char *body) {
+        uint8_t checksum = 0;
+        for (const char *c = body; *c; c++) checksum ^= (uint8_t)*c;
+        char line[128];
+        int n = snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+        if (n > 0 && n < (int)sizeof(line)) send((const uint8_t *)line, n);
+    }
+
+public:
+    uint32_t fixFrom = 20000;               // ms: no fix before this
+    uint32_t lossFrom = 0, lossUntil = 0;   // ms: fix lost in between
+
+    bool fix(uint64_t ms) const { return ms >= fixFrom && !(ms >= lossFrom && ms < lossUntil); }
+
+    void update(uint64_t now) {
+        while (_next <= now) {
+            unsigned s = (unsigned)(_next / 1000);
+            unsigned hh = (6 + s / 3600) % 24, mm = (s / 60) % 60, ss = s % 60;
+            bool valid = fix(_next);
+            char body[100];
+            snprintf(body, sizeof(body), "GPRMC,%02u%02u%02u.00,%c,0654.%04u,N,07951.%04u,E,0.1,0.0,150626,,,%c",
+                     hh, mm, ss, valid ? 'A' : 'V', 2000 + s % 7, 6000 + s % 5, valid ? 'A' : 'N');
+            sentence(body);
+            snprintf(body, sizeof(body), "GPGGA,%02u%02u%02u.00,0654.%04u,N,07951.%04u,E,%d,08,0.9,12.0,M,-95.0,M,,",
+                     hh, mm, ss, 2000 + s % 7, 6000 + s % 5, valid ? 1 : 0);
+            sentence(body);
+            _next += 1000;
+        }
+    }
+};
+
+// SDS011: replies SIM_SDS011_LATENCY ms after a command, a data frame each
+// second while awake in active mode
+#define SIM_SDS011_LATENCY 20
+#define SIM_SDS011_PENDING 4
+
+class SimSDS011 : public SimUart {
+private:
+    struct Frame {
+        uint64_t at;
+        uint8_t bytes[10];
+    };
+
+    uint8_t _cmd[19];
+    uint8_t _cmdLen = 0;
+    Frame _pending[SIM_SDS011_PENDING];
+    uint8_t _pendingCount = 0;
+    uint64_t _now = 0, _nextData = 1000;
+    uint32_t _commands = 0, _frames = 0;
+
+    void queue(uint64_t at, uint8_t type, const uint8_t *data) {
+        if (_pendingCount == SIM_SDS011_PENDING) return;
+        Frame &f = _pending[_pendingCount++];
+        f.at = at;
+        f.bytes[0] = 0xAA;
+        f.bytes[1] = type;
+        memcpy(f.bytes + 2, data, 6);
+        f.bytes[8] = 0;
+        for (uint8_t i = 2; i < 8; i++) f.bytes[8] += f.bytes[i];
+        f.bytes[9] = 0xAB;
+    }
+
+    void dataFrame(uint64_t at) {
+        uint16_t pm25 = pm25At(at), pm10 = pm25 + 60 + simNoise(8);
+        uint8_t data[6] = {(uint8_t)pm25, (uint8_t)(pm25 >> 8), (uint8_t)pm10, (uint8_t)(pm10 >> 8),
+                           (uint8_t)id, (uint8_t)(id >> 8)};
+        queue(at, 0xC0, data);
+        _frames++;
+    }
+
+    void reply(uint8_t cmd, uint8_t d3, uint8_t d4, uint8_t d5 = 0) {
+        uint8_t data[6] = {cmd, d3, d4, d5, (uint8_t)id, (uint8_t)(id >> 8)};
+        queue(_now + SIM_SDS011_LATENCY, 0xC5, data);
+    }
+
+    void command() {
+        uint8_t checksum = 0;
+        for (uint8_t i = 2; i < 17; i++) checksum += _cmd[i];
+        uint16_t target = _cmd[15] | (_cmd[16] << 8);
+        if (_cmd[17] != checksum || _cmd[18] != 0xAB || (target != 0xFFFF && target != id)) return;
+        _commands++;
+
+        uint8_t set = _cmd[3], value = _cmd[4];
+        switch (_cmd[2]) {
+            case 2: // Report mode
+                if (set) queryMode = value == 1;
+                reply(2, set, queryMode ? 1 : 0);
+                break;
+            case 4: // Query data
+                if (awake) dataFrame(_now + SIM_SDS011_LATENCY);
+                break;
+            case 5: // Set ID
+                id = _cmd[13] | (_cmd[14] << 8);
+                reply(5, 0, 0);
+                break;
+            case 6: // Sleep / work
+                if (set) awake = value == 1;
+                if (awake) _nextData = _now + 1000;
+                reply(6, set, awake ? 1 : 0);
+                break;
+            case 7: // Firmware version
+                reply(7, 18, 11, 16);
+                break;
+            case 8: // Working period
+                if (set) period = value;
+                reply(8, set, period);
+                break;
+        }
+    }
+
+public:
+    uint16_t id = 0xA1B2;
+    bool awake = true, queryMode = false;
+    uint8_t period = 0;
+
+    // PM2.5 in 0.1 ug/m3
+    uint16_t pm25At(uint64_t ms) const { return 120 + (ms / 1000) % 90 + simNoise(5); }
+
+    uint32_t commands() const { return _commands; }  // Valid commands received
+    uint32_t frames() const { return _frames; }      // Data frames sent
+
+    size_t write(uint8_t c) {
+        if (_cmdLen == 0 && c != 0xAA) return 1;
+        if (_cmdLen == 1 && c != 0xB4) {
+            _cmdLen = c == 0xAA ? 1 : 0;
+            return 1;
+        }
+        _cmd[_cmdLen++] = c;
+        if (_cmdLen == sizeof(_cmd)) {
+            _cmdLen = 0;
+            command();
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t *buf, size_t size) {
+        for (size_t i = 0; i < size; i++) write(buf[i]);
+        return size;
+    }
+
+    void update(uint64_t now) {
+        _now = now;
+        while (awake && !queryMode && _nextData <= now) {
+            dataFrame(_nextData);
+            _nextData += 1000;
+        }
+        // Frames leave in the order they are due
+        for (;;) {
+            int8_t first = -1;
+            for (uint8_t i = 0; i < _pendingCount; i++) {
+                if (_pending[i].at <= now && (first < 0 || _pending[i].at < _pending[first].at)) first = i;
+            }
+            if (first < 0) break;
+            send(_pending[first].bytes, 10);
+            _pending[first] = _pending[--_pendingCount];
+        }
+    }
+};
+
+// ENS160 on I2C: warm-up for the first 3 min in standard mode, then normal
+class SimENS160 : public HostI2CDevice {
+private:
+    uint8_t _mode = 0;
+    uint64_t _standardSince = 0, _now = 0;
+
+    size_t word(uint16_t v, uint8_t *data, size_t len) {
+        if (len > 0) data[0] = (uint8_t)v;
+        if (len > 1) data[1] = (uint8_t)(v >> 8);
+        return len < 2 ? len : 2;
+    }
+
+public:
+    bool present = true;
+
+    void update(uint64_t now) { _now = now; }
+
+    bool measuring() const { return _mode == 2; }
+    uint16_t eco2At(uint64_t ms) const { return 450 + (ms / 2000) % 150; }
+    uint16_t tvocAt(uint64_t ms) const { return 80 + (ms / 3000) % 40; }
+
+    void writeReg(uint8_t reg, const uint8_t *data, size_t len) {
+        if (reg == 0x10 && len > 0) {
+            if (data[0] == 2 && _mode != 2) _standardSince = _now;
+            _mode = data[0];
+        }
+    }
+
+    size_t readReg(uint8_t reg, uint8_t *data, size_t len) {
+        if (!present) return 0;
+        switch (reg) {
+            case 0x00: return word(0x0160, data, len);
+            case 0x10: data[0] = _mode; return 1;
+            case 0x20: {
+                uint8_t validity = _now - _standardSince < 180000 ? 1 : 0;
+                data[0] = (measuring() ? 0x80 | 0x02 : 0) | validity << 2;
+                return 1;
+            }
+            case 0x22: return word(measuring() ? tvocAt(_now) : 0, data, len);
+            case 0x24: return word(measuring() ? eco2At(_now) : 0, data, len);
+        }
+        memset(data, 0, len);
+        return len;
+    }
+};
+
+// Gas inputs: a level per pin with slow drift and reading noise
+class SimGas {
+private:
+    static const uint8_t PINS = 8;
+    uint8_t _pins[PINS];
+    uint16_t _base[PINS];
+    bool _stuck[PINS];
+    uint8_t _count = 0;
+
+public:
+    // stuck: the input returns `base` and nothing else, a dead ADC channel
+    void add(uint8_t pin, uint16_t base, bool stuck = false) {
+        if (_count == PINS) return;
+        _pins[_count] = pin;
+        _stuck[_count] = stuck;
+        _base[_count++] = base;
+    }
+
+    int read(uint8_t pin, uint64_t now) {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_pins[i] != pin) continue;
+            if (_stuck[i]) return _base[i];
+            int level = _base[i] + (int)(40 * sin(now / 120000.0 + i)) + simNoise(12);
+            return constrain(level, 0, 4095);
+        }
+        return 0;
+    }
+};
+
+#endif // _HOST_SIM_SENSORS_H_
@@ -0,0 +1,18 @@
+#ifndef _HOST_SOFTWARE_SERIAL_H_
+#define _HOST_SOFTWARE_SERIAL_H_
+
+// Host stand-in so AVR drivers build; nothing is sent or received
+#include <Arduino.h>
+
+class SoftwareSerial : public Stream {
+public:
+    SoftwareSerial(uint8_t, uint8_t) {}
+    void begin(long) {}
+    bool listen() { return true; }
+    size_t write(uint8_t) { return 1; }
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+};
+
+#endif // _HOST_SOFTWARE_SERIAL_H_
@@ -0,0 +1,48 @@
+#ifndef _HOST_WIFI_H_
+#define _HOST_WIFI_H_
+
+/*
+ * Host WiFi stand-in: the network never comes up, so the firmware's
+ * uplink and dashboard stay offline. Tests of MqttUplink and
+ * HttpDashboard plug in their own Client / Server classes instead.
+ */
+
+#include <Arduino.h>
+
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1 } wifi_mode_t;
+
+class WiFiClient : public Stream {
+public:
+    int connect(const char *, uint16_t) { return 0; }
+    uint8_t connected() { return 0; }
+    void stop() {}
+    void setNoDelay(bool) {}
+    explicit operator bool() { return false; }
+
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t) { return 0; }
+    size_t write(const uint8_t *, size_t) { return 0; }
+};
+
+class WiFiServer {
+public:
+    WiFiServer(uint16_t = 80) {}
+    void begin(uint16_t = 0) {}
+    WiFiClient available() { return WiFiClient(); }
+};
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t) { return true; }
+    wl_status_t begin(const char *, const char *) { return WL_DISCONNECTED; }
+    wl_status_t status() { return WL_DISCONNECTED; }
+    const char *localIP() { return "0.0.0.0"; }
+    int8_t RSSI() { return 0; }
+};
+
+inline WiFiClass WiFi;
+
+#endif // _HOST_WIFI_H_
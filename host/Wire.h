@@ -0,0 +1,87 @@
+#ifndef _HOST_WIRE_H_
+#define _HOST_WIRE_H_
+
+/*
+ * Host Wire stand-in
+ *
+ * Register transfers go to a HostI2CDevice attached at an address, e.g. a
+ * simulated sensor or a TraceReplay; other addresses do not answer.
+ */
+
+#include <Arduino.h>
+
+#define WIRE_HOST_DEVICES 4
+#define WIRE_HOST_BUFFER  32
+
+class HostI2CDevice {
+public:
+    virtual ~HostI2CDevice() {}
+    virtual void writeReg(uint8_t reg, const uint8_t *data, size_t len) = 0;
+    virtual size_t readReg(uint8_t reg, uint8_t *data, size_t len) = 0;
+};
+
+class TwoWire {
+private:
+    uint8_t _addrs[WIRE_HOST_DEVICES];
+    HostI2CDevice *_devices[WIRE_HOST_DEVICES] = {};
+    HostI2CDevice *_target = NULL;
+    uint8_t _tx[WIRE_HOST_BUFFER], _rx[WIRE_HOST_BUFFER];
+    uint8_t _txLen = 0, _rxLen = 0, _rxPos = 0;
+    uint8_t _reg = 0;
+
+    HostI2CDevice *device(uint8_t addr) {
+        for (uint8_t i = 0; i < WIRE_HOST_DEVICES; i++) {
+            if (_devices[i] != NULL && _addrs[i] == addr) return _devices[i];
+        }
+        return NULL;
+    }
+
+public:
+    void attach(uint8_t addr, HostI2CDevice *dev) {
+        for (uint8_t i = 0; i < WIRE_HOST_DEVICES; i++) {
+            if (_devices[i] != NULL && _addrs[i] != addr) continue;
+            _addrs[i] = addr;
+            _devices[i] = dev;
+            return;
+        }
+    }
+
+    void begin() {}
+    void setClock(uint32_t) {}
+
+    void beginTransmission(uint8_t addr) {
+        _target = device(addr);
+        _txLen = 0;
+    }
+
+    size_t write(uint8_t b) {
+        if (_txLen >= WIRE_HOST_BUFFER) return 0;
+        _tx[_txLen++] = b;
+        return 1;
+    }
+
+    // A register pointer alone selects the register for requestFrom(),
+    // anything longer is a register write
+    uint8_t endTransmission(bool = true) {
+        if (_target == NULL) return 2; // NACK on address
+        if (_txLen == 0) return 0;
+        _reg = _tx[0];
+        if (_txLen > 1) _target->writeReg(_reg, _tx + 1, _txLen - 1);
+        return 0;
+    }
+
+    uint8_t requestFrom(uint8_t addr, uint8_t len) {
+        HostI2CDevice *dev = device(addr);
+        if (len > WIRE_HOST_BUFFER) len = WIRE_HOST_BUFFER;
+        _rxLen = dev != NULL ? (uint8_t)dev->readReg(_reg, _rx, len) : 0;
+        _rxPos = 0;
+        return _rxLen;
+    }
+
+    int available() { return _rxLen - _rxPos; }
+    int read() { return _rxPos < _rxLen ? _rx[_rxPos++] : -1; }
+};
+
+inline TwoWire Wire;
+
+#endif // _HOST_WIRE_H_
@@ -0,0 +1,175 @@
+/*
+ * EnviroSense AQMS - AQI engine check
+ *
+ * Runs AQIEngine (libraries/AQMS_Core/src/AQIEngine.h) on synthetic
+ * samples. Checks that
+ *
+ *   - the breakpoint tables give the published sub-indices, including the
+ *     EPA truncation between rows
+ *   - the running 1 h / 8 h / 24 h sums of MinuteWindow match a brute-force
+ *     mean over the minute means, through gaps and random dropouts, and a
+ *     multi-minute advance matches as many single ones
+ *   - steady concentrations give the expected NAQI and EPA index, also
+ *     across the millis() wrap, and NAQI needs three pollutants
+ *   - a unit sampling one minute in five (LP_mode=1) gets an index once it
+ *     sets its sample interval, and none without it
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <vector>
+
+#include "AQIEngine.h"
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+void delay(unsigned long) {}
+void yield() {}
+
+#define CHECK_MINUTES 6000  // Brute-force run, longer than four 24 h windows
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "aqi_check: FAILED: %s\n", what);
+    failures++;
+}
+
+static void checkTables() {
+    struct Case {
+        const AQITable &table;
+        float c, index;
+    } cases[] = {
+        {aqiEPA.tables[AQI_PM25], 9.0f, 50},   {aqiEPA.tables[AQI_PM25], 9.05f, 50},
+        {aqiEPA.tables[AQI_PM25], 9.1f, 51},   {aqiEPA.tables[AQI_PM25], 35.4f, 100},
+        {aqiEPA.tables[AQI_PM25], 35.5f, 101}, {aqiEPA.tables[AQI_PM25], 12.0f, 56},
+        {aqiEPA.tables[AQI_PM25], 400, 500},   {aqiEPA.tables[AQI_PM10], 54.9f, 50},
+        {aqiEPA.tables[AQI_PM10], 100, 73},    {aqiEPA.tables[AQI_CO], 6.0f, 66},
+        {aqiEPA.tables[AQI_NO2], 100, 100},    {aqiEPA.tables[AQI_SO2], 75.5f, 100},
+        {aqiNAQI.tables[AQI_PM25], 45, 75},    {aqiNAQI.tables[AQI_PM25], 75, 150},
+        {aqiNAQI.tables[AQI_PM10], 300, 250},  {aqiNAQI.tables[AQI_CO], 1.5f, 75},
+        {aqiNAQI.tables[AQI_NO2], 130, 150},   {aqiNAQI.tables[AQI_PM25], 0, 0},
+    };
+    unsigned wrong = 0;
+    for (const Case &c : cases) {
+        if (aqiSubIndex(c.table, c.c) != c.index) wrong++;
+    }
+    check(wrong == 0, "sub-indices from the breakpoint tables");
+}
+
+// Mean of the last `length` minute means, NAN below the coverage rule
+static float bruteAverage(const std::vector<float> &minutes, size_t length, uint32_t interval) {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = minutes.size() > length ? minutes.size() - length : 0; i < minutes.size(); i++) {
+        if (isnan(minutes[i])) continue;
+        sum += minutes[i];
+        count++;
+    }
+    size_t expected = interval > AQI_MINUTE_MS ? length * AQI_MINUTE_MS / interval : length;
+    if (count == 0 || count * AQI_COVERAGE_DEN < expected * AQI_COVERAGE_NUM) return NAN;
+    return sum / count;
+}
+
+static bool same(float a, float b) {
+    return (isnan(a) && isnan(b)) || fabs(a - b) <= 1e-3 * (1 + fabs(b));
+}
+
+// Every closed minute, every window, against the brute-force mean
+static void checkWindows(uint32_t interval) {
+    srand(7);
+    MinuteWindow<1440> *window = new MinuteWindow<1440>();
+    std::vector<float> minutes;
+    unsigned wrong = 0, valid = 0;
+    uint32_t every = interval / AQI_MINUTE_MS;
+    for (int m = 0; m < CHECK_MINUTES; m++) {
+        bool gap = (m / 500) % 5 == 3 && (m % 500) < 200;
+        float mean = NAN;
+        if (!gap && m % every == 0 && rand() % 10 != 0) {
+            int samples = 1 + rand() % 5;
+            double sum = 0;
+            for (int s = 0; s < samples; s++) {
+                float value = rand() % 10000 / 10.0f;
+                window->add(value);
+                sum += value;
+            }
+            mean = (float)(sum / samples);
+        }
+        window->advance(1);
+        minutes.push_back(mean);
+        for (uint8_t w = 0; w < AQI_WINDOWS; w++) {
+            float got = window->average(w, interval);
+            if (!same(got, bruteAverage(minutes, aqiWindowMinutes[w], interval))) wrong++;
+            if (!isnan(got)) valid++;
+        }
+    }
+    delete window;
+    check(wrong == 0, "running window means match the brute-force ones");
+    check(valid > 0, "windows reach their coverage");
+    printf("windows, sampled every %lu min: %u averages checked, %u valid\n", (unsigned long)every,
+           CHECK_MINUTES * AQI_WINDOWS, valid);
+}
+
+static void checkAdvance() {
+    MinuteWindow<480> jumped, stepped;
+    unsigned wrong = 0;
+    for (int m = 0; m < 1000; m++) {
+        jumped.add(m);
+        stepped.add(m);
+        int minutes = 1 + m % 3;
+        jumped.advance(minutes);
+        for (int i = 0; i < minutes; i++) stepped.advance(1);
+        for (uint8_t w = AQI_1H; w <= AQI_8H; w++) {
+            if (!same(jumped.average(w), stepped.average(w))) wrong++;
+        }
+    }
+    check(wrong == 0, "a multi-minute advance matches single ones");
+}
+
+static void checkEngine() {
+    // PM2.5 75, PM10 300, CO 1.5 mg/m3 -> NAQI 250 (PM10), EPA 173 (PM10)
+    AQIEngine *engine = new AQIEngine();
+    uint32_t now = 4294000000UL; // Crosses the millis() wrap
+    for (int s = 0; s < 25 * 3600; s++, now += 1000) engine->sample(now, 75, 300, 1.5f * 24.45f / 28.01f, NAN, NAN, NAN);
+    check(engine->index() == 250 && engine->dominant() == AQI_PM10, "steady NAQI index");
+    engine->setStandard(aqiEPA);
+    check(engine->index() == 173 && engine->dominant() == AQI_PM10, "steady EPA index");
+    delete engine;
+
+    AQIEngine *two = new AQIEngine();
+    for (int s = 0; s < 25 * 3600; s++) two->sample(s * 1000UL, 75, NAN, NAN, 0.05f, NAN, NAN);
+    check(!two->valid(), "NAQI needs three pollutants");
+    delete two;
+}
+
+// LP_mode=1: awake for a minute of every LP_interval, one sample a second
+static float lightSleepIndex(bool setInterval) {
+    const uint32_t interval = 300000;
+    AQIEngine *engine = new AQIEngine();
+    if (setInterval) engine->setSampleInterval(interval);
+    for (uint32_t wake = 0; wake < 25 * 3600000UL; wake += interval) {
+        for (uint32_t s = 0; s < 60; s++) engine->sample(wake + 20000 + s * 1000, 75, 300, 1.3f, NAN, NAN, NAN);
+    }
+    float index = engine->index();
+    delete engine;
+    return index;
+}
+
+static void checkLightSleep() {
+    float index = lightSleepIndex(true);
+    check(index == 250, "index from one minute in five with the sample interval set");
+    check(isnan(lightSleepIndex(false)), "no index from one minute in five without it");
+    printf("light sleep, 1 min of 5: NAQI %.0f\n", index);
+}
+
+int main() {
+    checkTables();
+    checkWindows(AQI_MINUTE_MS);
+    checkWindows(5 * AQI_MINUTE_MS);
+    checkAdvance();
+    checkEngine();
+    checkLightSleep();
+    printf("sizeof(AQIEngine) %u B\n", (unsigned)sizeof(AQIEngine));
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Builds the host tools (Linux / macOS, g++ or clang++)
+set -e
+LIB=../libraries
+FLAGS="-std=c++17 -O2 -Wall -DARDUINO=100 -I. -I$LIB/AQMS_Core/src"
+# The firmware (src/esp_main.cpp) and the drivers it uses
+FIRMWARE="-I$LIB/TinyGPSPlus/src -I$LIB/SDS011-master -I$LIB/CO2Sensor-master/src -I$LIB/MQSensorsLib-master/src \
+    -I$LIB/MICS_4514_Arduino -I$LIB/DFRobot_ENS160"
+DRIVERS="$LIB/SDS011-master/SDS011.cpp $LIB/CO2Sensor-master/src/CO2Sensor.cpp $LIB/MQSensorsLib-master/src/MQUnifiedsensor.cpp \
+    $LIB/MICS_4514_Arduino/MICS_4514.cpp $LIB/DFRobot_ENS160/DFRobot_ENS160.cpp \
+    $LIB/TinyGPSPlus/src/TinyGPS++.cpp"
+${CXX:-g++} $FLAGS -o power_sim power_sim.cpp
+${CXX:-g++} $FLAGS $FIRMWARE -o trace_replay trace_replay.cpp $DRIVERS
+${CXX:-g++} $FLAGS $FIRMWARE -o heap_check heap_check.cpp $DRIVERS
+${CXX:-g++} $FLAGS $FIRMWARE -o lp_check lp_check.cpp $DRIVERS
+${CXX:-g++} $FLAGS -I$LIB/TinyGPSPlus/src -o core_check core_check.cpp "$LIB/TinyGPSPlus/src/TinyGPS++.cpp"
+${CXX:-g++} $FLAGS -I$LIB/TinyGPSPlus/src -o gps_bench gps_bench.cpp "$LIB/TinyGPSPlus/src/TinyGPS++.cpp"
+${CXX:-g++} $FLAGS -I$LIB/SDS011-master -o pm_check pm_check.cpp $LIB/SDS011-master/SDS011.cpp
+${CXX:-g++} $FLAGS -o mqtt_check mqtt_check.cpp
+${CXX:-g++} $FLAGS -o http_check http_check.cpp -pthread
+${CXX:-g++} $FLAGS -o aqi_check aqi_check.cpp
+${CXX:-g++} $FLAGS -o capture_check capture_check.cpp -pthread
+${CXX:-g++} $FLAGS -o filter_check filter_check.cpp
@@ -0,0 +1,217 @@
+/*
+ * EnviroSense AQMS - spike capture check
+ *
+ * Runs SpikeCapture (libraries/AQMS_Core/src/SpikeCapture.h) with the
+ * firmware's ring (1024 frames of the five gas inputs) at 100 Hz, 2 s
+ * before and 5 s after a trigger, writing to a capture file in memory.
+ * Checks that
+ *
+ *   - a 0.5 s step fires the level trigger (slope trigger off) once and gives exactly 701 rows,
+ *     t_ms -2000 to 5000, with the step where it was added
+ *   - a 4000 counts/s ramp fires the slope trigger (level trigger off)
+ *   - with the sampler a thread of its own adding frames faster than the
+ *     loop writes them, no row is torn (all inputs of a row from the same
+ *     frame) and every event's rows and lost frames add up to 701
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "SpikeCapture.h"
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+void delay(unsigned long) {}
+void yield() {}
+
+#define CHECK_RATE   100     // Frames per second, CAP_rate
+#define CHECK_LEVEL  200     // CAP_level, ADC counts
+#define CHECK_SLOPE  2000    // CAP_slope, counts per second
+#define CHECK_PRE    2000    // CAP_pre / CAP_post, ms
+#define CHECK_POST   5000
+#define CHECK_ROWS   ((CHECK_PRE + CHECK_POST) * CHECK_RATE / 1000 + 1)
+#define CHECK_FRAMES 1024    // CAPTURE_FRAMES of the firmware
+#define CHECK_BASE   1500    // Input level between spikes
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "capture_check: FAILED: %s\n", what);
+    failures++;
+}
+
+static const char *const checkNames[] = {"mg811", "mq136", "mq4", "mics_ox", "mics_red"};
+typedef SpikeCapture<5, CHECK_FRAMES> Capture;
+
+// The card stand-in: the capture file in memory
+class TextStorage {
+private:
+    struct Text : Print {
+        std::string text;
+        size_t write(uint8_t c) {
+            text += (char)c;
+            return 1;
+        }
+    };
+    Text _file;
+
+public:
+    template <class Fn>
+    bool appendFile(const char *, Fn fn) {
+        fn(_file);
+        return true;
+    }
+
+    const std::string &text() const { return _file.text; }
+};
+
+// Events of a capture file: rows, lost frames, first and last t_ms, torn rows
+struct EventSummary {
+    char trigger[8];
+    uint32_t rows, lost, torn;
+    long first, last, stepAt;   // stepAt: t_ms of the first row above the base
+};
+
+static std::vector<EventSummary> summarize(const std::string &text) {
+    std::vector<EventSummary> events;
+    for (size_t at = 0; at < text.size();) {
+        size_t eol = text.find('\n', at);
+        std::string line = text.substr(at, eol - at);
+        at = eol + 1;
+        if (line.compare(0, 8, "# event ") == 0) {
+            EventSummary e = {};
+            e.stepAt = -1000000;
+            const char *kind = strstr(line.c_str(), " slope,") != NULL ? "slope" : "level";
+            snprintf(e.trigger, sizeof(e.trigger), "%s", kind);
+            events.push_back(e);
+        } else if (line.compare(0, 2, "# ") == 0 && !events.empty()) {
+            events.back().lost += strtoul(line.c_str() + 2, NULL, 10);
+        } else if (!line.empty() && line[0] != 't' && !events.empty()) {
+            EventSummary &e = events.back();
+            long value[6];
+            const char *field = line.c_str();
+            for (int i = 0; i < 6; i++) {
+                value[i] = strtol(field, (char **)&field, 10);
+                if (*field == ',') field++;
+            }
+            if (e.rows == 0) e.first = value[0];
+            e.last = value[0];
+            e.rows++;
+            // The inputs of a frame differ by their channel number
+            for (int c = 1; c < 5; c++) {
+                if (value[c + 1] != value[1] + c) {
+                    e.torn++;
+                    break;
+                }
+            }
+            if (e.stepAt == -1000000 && value[1] > CHECK_BASE + CHECK_LEVEL) e.stepAt = value[0];
+        }
+    }
+    return events;
+}
+
+static void frame(uint16_t *values, uint16_t level) {
+    for (uint8_t c = 0; c < 5; c++) values[c] = level + c;
+}
+
+// Loop and sampler on one thread: the loop writes after every 10 frames
+static std::string runSequential(uint16_t (*signal)(uint32_t), uint32_t frames, float level, float slope) {
+    Capture *capture = new Capture(checkNames);
+    capture->configure(CHECK_RATE, level, slope, CHECK_PRE, CHECK_POST);
+    TextStorage storage;
+    uint16_t values[5];
+    for (uint32_t n = 0; n < frames; n++) {
+        uint32_t now = n * 1000 / CHECK_RATE;
+        frame(values, signal(n));
+        capture->addFrame(now, values);
+        if (n % 10 == 9 && capture->busy()) capture->write(storage, "/capture.txt", 1781518500000ULL + now, now);
+    }
+    while (capture->busy()) capture->write(storage, "/capture.txt", 0, 0);
+    delete capture;
+    return storage.text();
+}
+
+// +400 for 0.5 s at 20 s
+static uint16_t step(uint32_t n) { return n >= 2000 && n < 2050 ? CHECK_BASE + 2 * CHECK_LEVEL : CHECK_BASE; }
+
+// +40 per frame (4000 counts/s) for 0.5 s at 20 s, then held
+static uint16_t ramp(uint32_t n) {
+    if (n < 2000) return CHECK_BASE;
+    return CHECK_BASE + 40 * (n < 2050 ? n - 2000 : 50);
+}
+
+static void checkStep() {
+    std::vector<EventSummary> events = summarize(runSequential(step, 3000, CHECK_LEVEL, 0));
+    check(events.size() == 1, "one event for one step");
+    if (events.size() != 1) return;
+    const EventSummary &e = events[0];
+    check(strncmp(e.trigger, "level", 5) == 0, "the step fires the level trigger");
+    check(e.rows == CHECK_ROWS && e.lost == 0, "701 rows, none lost");
+    check(e.first == -CHECK_PRE && e.last == CHECK_POST, "rows from -2000 to 5000 ms");
+    // The 50 ms filter crosses the threshold a few frames into the step
+    check(e.stepAt <= 0 && e.stepAt >= -100, "the step at the trigger");
+    printf("step: %u rows, t_ms %ld..%ld, step at %ld ms\n", e.rows, e.first, e.last, e.stepAt);
+}
+
+static void checkRamp() {
+    std::vector<EventSummary> events = summarize(runSequential(ramp, 3000, 0, CHECK_SLOPE));
+    check(events.size() == 1 && strncmp(events[0].trigger, "slope", 5) == 0, "a ramp fires the slope trigger");
+}
+
+// The sampler as a thread of its own, a frame every 5 us; the loop writes a
+// chunk (128 frames) every ms and falls behind
+static void checkThreads() {
+    const uint32_t frames = 40000;
+    Capture *capture = new Capture(checkNames);
+    capture->configure(CHECK_RATE, CHECK_LEVEL, 0, CHECK_PRE, CHECK_POST);
+    TextStorage storage;
+    std::atomic<bool> done(false);
+    std::thread sampler([&]() {
+        uint16_t values[5];
+        for (uint32_t n = 0; n < frames; n++) {
+            // A 0.5 s pulse every 40 s; the frame number in the low bits shows a torn row
+            uint16_t pulse = n % 4000 >= 2000 && n % 4000 < 2050 ? 2 * CHECK_LEVEL : 0;
+            frame(values, CHECK_BASE + pulse + n % 64);
+            capture->addFrame(n * 1000 / CHECK_RATE, values);
+            std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + std::chrono::microseconds(5);
+            while (std::chrono::steady_clock::now() < next) {}
+        }
+        done = true;
+    });
+    while (!done || capture->busy()) {
+        if (capture->busy()) capture->write(storage, "/capture.txt", 0, 0);
+        usleep(1000);
+    }
+    sampler.join();
+
+    std::vector<EventSummary> events = summarize(storage.text());
+    uint32_t torn = 0, incomplete = 0, rows = 0, lost = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        torn += events[i].torn;
+        if (events[i].rows + events[i].lost != CHECK_ROWS) incomplete++;
+        rows += events[i].rows;
+        lost += events[i].lost;
+    }
+    check(!events.empty() && events.size() == capture->events(), "events written while the sampler runs");
+    check(rows > 0, "rows written while the sampler runs");
+    check(torn == 0, "no torn rows");
+    check(incomplete == 0, "rows and lost frames add up to 701 per event");
+    check(lost == capture->lost(), "lost frames counted");
+    printf("threads: %u events, %u rows, %u frames lost, %u torn rows\n", (unsigned)events.size(), rows, lost, torn);
+    delete capture;
+}
+
+int main() {
+    Serial.setOutput(NULL);
+    checkStep();
+    checkRamp();
+    checkThreads();
+    return failures == 0 ? 0 : 1;
+}
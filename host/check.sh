@@ -0,0 +1,30 @@
+#!/bin/bash
+# Host checks (Linux / macOS): builds the tools, records the sample trace
+# with the firmware against the simulated sensors and replays it (both
+# must give sample_trace.csv byte for byte), then runs the checks below
+set -e
+cd "$(dirname "$0")"
+./build.sh
+TRACE=$(mktemp /tmp/aqms_sample_XXXXXX)
+REPLAY=$(mktemp /tmp/aqms_replay_XXXXXX)
+trap 'rm -f "$TRACE" "$REPLAY"' EXIT
+./trace_replay --sample "$TRACE" | cmp - sample_trace.csv
+./trace_replay "$TRACE" > "$REPLAY"
+cmp "$REPLAY" sample_trace.csv
+# The replayed 40 s fix loss: lat and lng STALE, then the gps fault bit
+# (HEALTH_MISSING after GPS_FIX_TIMEOUT), both clear at the end
+awk -F, 'NR > 1 && $23 == 4 && $24 == 4 { stale++; if (int($22 / 128) % 2) missing++ }
+    END { if (stale < 35 || missing < 25 || $22 != 0 || $23 != 0) {
+        print "fix loss: FAILED: " stale + 0 " rows STALE, " missing + 0 " with gps missing" > "/dev/stderr"; exit 1 }
+        print "fix loss: " stale " rows STALE, " missing " with gps missing" }' "$REPLAY"
+./heap_check
+./lp_check
+./core_check
+./pm_check
+./gps_bench
+./mqtt_check
+./http_check
+./aqi_check
+./capture_check
+./filter_check
+echo "host checks passed"
@@ -0,0 +1,260 @@
+/*
+ * EnviroSense AQMS - shared acquisition core check
+ *
+ * Builds AcquisitionCore (libraries/AQMS_Core/src/AcquisitionCore.h) with
+ * each storage policy the boards use and runs the same simulated minute
+ * through all of them side by side: a GPS that gets its fix at 20 s and
+ * loses it for 10 s at 40 s (SimSensors.h), and two channels, one of them
+ * measured. Checks that
+ *
+ *   - SDStorage (the card, here a temp directory) and RamStorage<N> log
+ *     byte-identical data.txt records, so a board's choice of policy does
+ *     not change its output
+ *   - every record has the header's column count and the schema column
+ *   - the position is FAULT before the first fix and fresh after it, held
+ *     and STALE from AQMS_FIX_HOLD_MS into the fix loss, fresh once the
+ *     fix is back; the date and epoch come from the GPS time once it is
+ *     known
+ *   - config keys are found through SDStorage and never through NoStorage,
+ *     which logs nothing
+ *
+ * and prints what one logging cycle (GPS poll, channel poll, record to
+ * RamStorage) costs on this machine, the host benchmark the shared core
+ * was made for:
+ *
+ *   core_check [cycles]      benchmark cycles (default 200000)
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <SD.h>
+
+#include "AcquisitionCore.h"
+#include "SDStorage.h"
+#include "SimSensors.h"
+
+#define CHECK_SECONDS 60    // Simulated run, one record per second
+#define CHECK_LOSS 40000    // GPS loses its fix for 10 s from here
+#define CHECK_RAM     8192  // RamStorage bytes, enough for the whole run
+
+static uint64_t simNow = 0;
+
+unsigned long millis() { return (unsigned long)simNow; }
+unsigned long micros() { return millis() * 1000; }
+void delay(unsigned long ms) { simNow += ms; }
+void yield() {}
+int analogRead(uint8_t pin) { return 1000 + pin; }
+
+static float readLevel() { return 400.0f + (simNow / 1000) % 7; }
+static float readOther() { return 0.5f * (simNow / 1000 % 3); }
+
+static auto makeRegistry() {
+    return makeSensorRegistry(measuredChannel("co2", "ppm", 0, 2, []() { return readLevel(); }),
+                              sensorChannel("aux", "V", 2000, 3, []() { return readOther(); }));
+}
+
+typedef decltype(makeRegistry()) Registry;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "core_check: FAILED: %s\n", what);
+    failures++;
+}
+
+// Collects a Print's output, for comparing records
+class Capture : public Print {
+public:
+    char text[CHECK_RAM];
+    size_t length = 0;
+
+    size_t write(uint8_t c) {
+        if (length + 1 >= sizeof(text)) return 0;
+        text[length++] = (char)c;
+        text[length] = '\0';
+        return 1;
+    }
+};
+
+static char cardDir[] = "/tmp/aqms_card_XXXXXX";
+
+static void removeCard() {
+    DIR *dir = opendir(cardDir);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cardDir, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cardDir);
+}
+
+// 100 ms of one core's loop: GPS, channels, a record once a second. The
+// cores run side by side on the one clock (TimeService counts millis()
+// wraps, so the clock must not restart)
+template <class Core>
+static void step(Core &core, SimGPS &gps, Registry &sensors) {
+    gps.update(simNow);
+    core.gps.poll();
+    sensors.poll(millis());
+    if (core.cycleDue(millis(), 1000)) {
+        sensors.head().status = simNow < 30000 ? STATUS_WARMING : 0;
+        core.writeRecord(sensors);
+    }
+}
+
+static size_t countColumns(const char *line, size_t length) {
+    size_t columns = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (line[i] == ',') columns++;
+    }
+    return columns;
+}
+
+// Column `index` of a CSV line as a number
+static double column(const char *line, size_t index) {
+    for (size_t i = 0; i < index; i++) {
+        line = strchr(line, ',');
+        if (line == NULL) return -1;
+        line++;
+    }
+    return atof(line);
+}
+
+static void checkRecords(const char *log, size_t length) {
+    const char *end = log + length;
+    const char *line = log;
+    const char *eol = (const char *)memchr(line, '\n', end - line);
+    check(eol != NULL, "header line");
+    if (eol == NULL) return;
+    size_t columns = countColumns(line, eol - line);
+    check(columns == 5 + Registry::count + 2 + 1 + 1, "header columns");
+
+    unsigned records = 0, fixed = 0, stale = 0;
+    uint8_t position = 0;
+    double lastEpoch = 0;
+    for (line = eol + 1; line < end; line = eol + 1) {
+        eol = (const char *)memchr(line, '\n', end - line);
+        if (eol == NULL) break;
+        records++;
+        check(countColumns(line, eol - line) == columns, "record columns match the header");
+        check(column(line, columns - 1) == RECORD_SCHEMA, "schema column");
+        double date = column(line, 0), epoch = column(line, 2), lat = column(line, 3);
+        position = (uint8_t)column(line, 5 + Registry::count);
+        if (date != 0) {
+            check(date == 20260615, "date from the GPS");
+            check(epoch > 1.7e12, "epoch from the GPS time");
+            check(lastEpoch == 0 || epoch - lastEpoch == 1000, "one record per second of GPS time");
+            lastEpoch = epoch;
+        }
+        if (lat != 0) {
+            fixed++;
+            if (position == STATUS_STALE) stale++;
+            else check(position == 0, "position fresh while the fix holds");
+            check(lat > 6.9 && lat < 6.91, "position from the GPS");
+        } else {
+            check(position == STATUS_FAULT, "position FAULT before the first fix");
+        }
+    }
+    check(records == CHECK_SECONDS, "one record per second");
+    check(fixed >= CHECK_SECONDS - 22 && fixed <= CHECK_SECONDS - 19, "position from the 20 s fix on");
+    check(stale >= 7 && stale <= 9, "position STALE through the fix loss");
+    check(position == 0, "position fresh once the fix is back");
+}
+
+int main(int argc, char **argv) {
+    unsigned long cycles = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    Serial.setOutput(NULL);
+    if (mkdtemp(cardDir) == NULL) {
+        fprintf(stderr, "cannot set up the card directory\n");
+        return 1;
+    }
+    SD.setRoot(cardDir);
+    char path[SD_HOST_PATH];
+    snprintf(path, sizeof(path), "%s/config.txt", cardDir);
+    FILE *config = fopen(path, "wb");
+    if (config != NULL) {
+        fputs("# comment\ncycleInterval=1000\nPM_period=60000\n", config);
+        fclose(config);
+    }
+
+    // SD card
+    SDStorage card(4);
+    SimGPS cardGps;
+    Registry cardSensors = makeRegistry();
+    AcquisitionCore<SDStorage, RawADC, SimGPS> cardCore(card, cardGps);
+    card.begin();
+    int period = 0;
+    check(cardCore.readConfigInt("PM_period", period) && period == 60000, "config key through SDStorage");
+    check(!cardCore.readConfigInt("LP_mode", period), "missing config key");
+
+    static RamStorage<CHECK_RAM> ram;
+    SimGPS ramGps;
+    Registry ramSensors = makeRegistry();
+    AcquisitionCore<RamStorage<CHECK_RAM>, RawADC, SimGPS> ramCore(ram, ramGps);
+    ram.begin();
+
+    NoStorage none;
+    SimGPS noneGps;
+    Registry noneSensors = makeRegistry();
+    AcquisitionCore<NoStorage, RawADC, SimGPS> noneCore(none, noneGps);
+    check(!noneCore.readConfigInt("PM_period", period), "NoStorage finds no config");
+    check(none.record() == NULL, "NoStorage logs nothing");
+
+    // The same minute through all three
+    SimGPS *gps[] = {&cardGps, &ramGps, &noneGps};
+    for (SimGPS *g : gps) {
+        g->lossFrom = CHECK_LOSS;
+        g->lossUntil = CHECK_LOSS + 10000;
+    }
+    cardCore.writeHeader(cardSensors);
+    ramCore.writeHeader(ramSensors);
+    noneCore.writeHeader(noneSensors);
+    while (simNow < CHECK_SECONDS * 1000ULL) {
+        simNow += 100;
+        step(cardCore, cardGps, cardSensors);
+        step(ramCore, ramGps, ramSensors);
+        step(noneCore, noneGps, noneSensors);
+    }
+    card.record()->flush();
+
+    Capture cardLog;
+    snprintf(path, sizeof(path), "%s/data.txt", cardDir);
+    FILE *data = fopen(path, "rb");
+    int c;
+    while (data != NULL && (c = fgetc(data)) != EOF) cardLog.write((uint8_t)c);
+    if (data != NULL) fclose(data);
+
+    Capture ramLog;
+    for (uint16_t i = 0; i < ram.size(); i++) ramLog.write(ram.at(i));
+
+    check(cardLog.length > 0 && cardLog.length == ramLog.length &&
+          memcmp(cardLog.text, ramLog.text, cardLog.length) == 0,
+          "SDStorage and RamStorage log the same bytes");
+    checkRecords(ramLog.text, ramLog.length);
+    check(noneCore.gps.epochMs == ramCore.gps.epochMs, "NoStorage core keeps the same clock");
+    removeCard();
+
+    // Cost of a logging cycle: GPS poll, channel poll, record to RAM
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < cycles; i++) {
+        simNow += 1000;
+        ramGps.update(simNow);
+        ramCore.gps.poll();
+        ramSensors.poll(millis());
+        ramCore.writeRecord(ramSensors);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%u records, SD and RAM logs identical: %s\n", CHECK_SECONDS,
+           failures == 0 ? "yes" : "no");
+    printf("logging cycle (GPS second, 2 channels, RAM record): %.0f ns\n", cycles > 0 ? ns / cycles : 0.0);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+#ifndef _HOST_ESP_SLEEP_H_
+#define _HOST_ESP_SLEEP_H_
+
+// Host ESP-IDF sleep stand-in; the program supplies the sleeps, on its own clock
+#include <stdint.h>
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+    ESP_SLEEP_WAKEUP_TIMER = 4
+} esp_sleep_wakeup_cause_t;
+
+// Supplied by the host program
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+int esp_sleep_enable_timer_wakeup(uint64_t us);
+int esp_light_sleep_start();
+void esp_deep_sleep_start();
+
+#endif // _HOST_ESP_SLEEP_H_
@@ -0,0 +1,180 @@
+/*
+ * EnviroSense AQMS - filter check
+ *
+ * Simulates the CO2 inputs of the ESP32 build over 20 seeds and runs them
+ * through FusionKalman and the filter stages of SignalFilter.h
+ * (libraries/AQMS_Core/src), with the fixed IIR the firmware used before
+ * (CO2_inertia 0.99 per reading) for comparison: the MG-811 read every
+ * loop (50 ms) with 5 % noise, the ENS160 eCO2 once a second with 20 ppm
+ * noise and a drifting offset. Checks that
+ *
+ *   - the fused level is quieter than the IIR in steady air
+ *   - it follows a 50 ppm step to 90 % within 5 s and a 750 ppm step
+ *     within 0.5 s, where the IIR takes 8 s and more
+ *   - a Hampel stage replaces a lone spike, and passes every reading of a
+ *     window with no spread (MAD 0, a quantised or held input) through
+ *   - a Kalman stage smooths the noise of a steady input and follows a
+ *     step
+ *
+ * and prints the per-seed ranges:
+ *
+ *   filter_check [seeds]     simulated runs (default 20)
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <random>
+
+#include "SignalFilter.h"
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+void delay(unsigned long) {}
+void yield() {}
+
+#define CHECK_LOOP_MS   50      // MG-811 reading period
+#define CHECK_ECO2_MS   1000    // eCO2 reading period
+#define CHECK_STEADY_MS 120000  // Steady air before the step, noise measured over the second half
+#define CHECK_AFTER_MS  60000   // Run after the step
+#define CHECK_LEVEL     420     // ppm before the step
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "filter_check: FAILED: %s\n", what);
+    failures++;
+}
+
+struct StepResult {
+    float fusionNoise, iirNoise;    // Standard deviation in steady air, ppm
+    float fusionRise, iirRise;      // Time to 90 % of the step, s
+};
+
+// Time from the step to the output first reaching 90 % of it
+struct RiseTimer {
+    float target, rise = -1;
+    bool up;
+
+    RiseTimer(float from, float to) : target(from + 0.9f * (to - from)), up(to > from) {}
+
+    void sample(float value, uint32_t sinceStep) {
+        bool past = up ? value >= target : value <= target;
+        if (past && rise < 0) rise = sinceStep / 1000.0f;
+    }
+
+    float seconds() const { return rise < 0 ? 1e9f : rise; }
+};
+
+static StepResult runStep(uint32_t seed, float step) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 1);
+    FusionKalman fusion;
+    fusion.configure(0.2f, 0.05f, 20, 0.1f, 400); // CO2_rate, CO2_noise, ECO2_noise as in config.txt
+    float iir = NAN, offset = 40;
+    double fusionSum = 0, fusionSq = 0, iirSum = 0, iirSq = 0;
+    uint32_t steady = 0;
+    RiseTimer fusionRise(CHECK_LEVEL, CHECK_LEVEL + step), iirRise(CHECK_LEVEL, CHECK_LEVEL + step);
+
+    for (uint32_t now = 0; now < CHECK_STEADY_MS + CHECK_AFTER_MS; now += CHECK_LOOP_MS) {
+        float truth = now < CHECK_STEADY_MS ? CHECK_LEVEL : CHECK_LEVEL + step;
+        float mg811 = truth * (1 + 0.05f * noise(rng));
+        float level = fusion.updatePrimary(mg811, now);
+        iir = isnan(iir) ? mg811 : 0.99f * iir + 0.01f * mg811;
+        if (now % CHECK_ECO2_MS == 0) {
+            offset += 0.1f * noise(rng);
+            fusion.updateSecondary(truth + offset + 20 * noise(rng), now);
+        }
+        if (now >= CHECK_STEADY_MS / 2 && now < CHECK_STEADY_MS) {
+            fusionSum += level;
+            fusionSq += (double)level * level;
+            iirSum += iir;
+            iirSq += (double)iir * iir;
+            steady++;
+        } else if (now >= CHECK_STEADY_MS) {
+            fusionRise.sample(level, now - CHECK_STEADY_MS + CHECK_LOOP_MS);
+            iirRise.sample(iir, now - CHECK_STEADY_MS + CHECK_LOOP_MS);
+        }
+    }
+    StepResult r;
+    r.fusionNoise = sqrt(fusionSq / steady - (fusionSum / steady) * (fusionSum / steady));
+    r.iirNoise = sqrt(iirSq / steady - (iirSum / steady) * (iirSum / steady));
+    r.fusionRise = fusionRise.seconds();
+    r.iirRise = iirRise.seconds();
+    return r;
+}
+
+static void checkFusion(uint32_t seeds, float step, float riseLimit) {
+    float noiseLo = 1e9f, noiseHi = 0, iirNoiseLo = 1e9f, iirNoiseHi = 0;
+    float riseLo = 1e9f, riseHi = 0, iirRiseLo = 1e9f, iirRiseHi = 0;
+    unsigned noisier = 0, slow = 0;
+    for (uint32_t seed = 1; seed <= seeds; seed++) {
+        StepResult r = runStep(seed, step);
+        if (r.fusionNoise >= r.iirNoise) noisier++;
+        if (r.fusionRise > riseLimit) slow++;
+        noiseLo = min(noiseLo, r.fusionNoise);
+        noiseHi = max(noiseHi, r.fusionNoise);
+        iirNoiseLo = min(iirNoiseLo, r.iirNoise);
+        iirNoiseHi = max(iirNoiseHi, r.iirNoise);
+        riseLo = min(riseLo, r.fusionRise);
+        riseHi = max(riseHi, r.fusionRise);
+        iirRiseLo = min(iirRiseLo, r.iirRise);
+        iirRiseHi = max(iirRiseHi, r.iirRise);
+    }
+    check(noisier == 0, "the fused level is quieter than the IIR in steady air");
+    check(slow == 0, step < 100 ? "a 50 ppm step followed within 5 s" : "a 750 ppm step followed within 0.5 s");
+    printf("%.0f ppm step, %u seeds: noise %.2f-%.2f ppm (IIR %.2f-%.2f), 90 %% after %.2f-%.2f s (IIR %.1f-%.1f)\n",
+           step, (unsigned)seeds, noiseLo, noiseHi, iirNoiseLo, iirNoiseHi, riseLo, riseHi, iirRiseLo, iirRiseHi);
+}
+
+static void checkHampel() {
+    SignalFilter hampel;
+    hampel.configure("hampel:7:3");
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0, 1);
+    for (uint32_t i = 0; i < 20; i++) hampel.update(100 + noise(rng), i * 1000);
+    float out = hampel.update(500, 20000);
+    check(hampel.replaced() && fabs(out - 100) < 3, "a lone spike is replaced by the median");
+    check(fabs(hampel.update(100.5f, 21000) - 100.5f) < 1e-6f && !hampel.replaced(), "the next reading passes");
+
+    // A held input: mostly one value, a step of one count now and then
+    SignalFilter held;
+    held.configure("hampel:7:3");
+    unsigned replaced = 0;
+    for (uint32_t i = 0; i < 200; i++) {
+        float value = i % 9 == 4 ? 401 : 400;
+        if (held.update(value, i * 1000) != value || held.replaced()) replaced++;
+    }
+    check(replaced == 0, "no reading replaced while the MAD is 0");
+}
+
+static void checkKalmanStage() {
+    SignalFilter kalman;
+    kalman.configure("kalman:0.05:1");
+    std::mt19937 rng(2);
+    std::normal_distribution<float> noise(0, 1);
+    double sum = 0, sq = 0;
+    uint32_t n = 0, now = 0;
+    for (; now < 600000; now += 1000) {
+        float out = kalman.update(10 + noise(rng), now);
+        if (now < 300000) continue;
+        sum += out;
+        sq += (double)out * out;
+        n++;
+    }
+    float sigma = sqrt(sq / n - (sum / n) * (sum / n));
+    check(sigma < 0.3f, "a Kalman stage smooths a steady input");
+    float out = 0;
+    for (uint32_t end = now + 600000; now < end; now += 1000) out = kalman.update(15 + noise(rng), now);
+    check(fabs(out - 15) < 1, "a Kalman stage follows a step");
+    printf("kalman:0.05:1 on 1 unit of noise: %.2f\n", sigma);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seeds = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+    checkFusion(seeds, 50, 5);
+    checkFusion(seeds, 750, 0.5f);
+    checkHampel();
+    checkKalmanStage();
+    return failures == 0 ? 0 : 1;
+}
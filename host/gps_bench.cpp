@@ -0,0 +1,141 @@
+/*
+ * EnviroSense AQMS - TinyGPSLite check and benchmark
+ *
+ * Feeds the NMEA stream of libraries/TinyGPSPlus/examples/BasicExample
+ * (RMC + GGA) through TinyGPSPlus and TinyGPSLite (TinyGPSLite.h), and the
+ * same stream with the VTG / GSA / 3x GSV / GLL burst a typical receiver
+ * sends after every GGA. Checks that TinyGPSLite with every field selected
+ * decodes the same values as TinyGPSPlus at the end of every sentence, then
+ * prints the size of each parser and what it costs per byte on this
+ * machine:
+ *
+ *   gps_bench [passes]       benchmark passes over each stream (default 20000)
+ *
+ * Exits 1 if the parsers disagree. Build: ./build.sh
+ */
+
+#include <chrono>
+
+#include "TinyGPSLite.h"
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+void delay(unsigned long) {}
+void yield() {}
+int analogRead(uint8_t) { return 0; }
+
+// libraries/TinyGPSPlus/examples/BasicExample/BasicExample.ino
+static const char basicStream[] =
+    "$GPRMC,045103.000,A,3014.1984,N,09749.2872,W,0.67,161.46,030913,,,A*7C\r\n"
+    "$GPGGA,045104.000,3014.1985,N,09749.2873,W,1,09,1.2,211.6,M,-22.5,M,,0000*62\r\n"
+    "$GPRMC,045200.000,A,3014.3820,N,09748.9514,W,36.88,65.02,030913,,,A*77\r\n"
+    "$GPGGA,045201.000,3014.3864,N,09748.9411,W,1,10,1.2,200.8,M,-22.5,M,,0000*6C\r\n"
+    "$GPRMC,045251.000,A,3014.4275,N,09749.0626,W,0.51,217.94,030913,,,A*7D\r\n"
+    "$GPGGA,045252.000,3014.4273,N,09749.0628,W,1,09,1.3,206.9,M,-22.5,M,,0000*6F\r\n";
+
+// The rest of a receiver's second, checksums added by buildBurstStream()
+static const char *const burstBodies[] = {
+    "GPVTG,161.46,T,,M,0.67,N,1.24,K,A",
+    "GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.03,1.38",
+    "GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30",
+    "GPGSV,3,2,11,02,39,223,19,13,28,070,17,26,23,252,,04,14,186,14",
+    "GPGSV,3,3,11,29,09,301,24,16,09,020,,36,,,",
+    "GPGLL,3014.1984,N,09749.2872,W,045103.000,A,A"};
+
+typedef TinyGPSLite<GPS_LOCATION | GPS_DATE | GPS_TIME> LiteGPS; // What GPSInput uses
+typedef TinyGPSLite<GPS_LOCATION | GPS_DATE | GPS_TIME | GPS_SPEED | GPS_COURSE | GPS_ALTITUDE |
+                    GPS_SATELLITES | GPS_HDOP> AllFieldsGPS;
+
+static char burstStream[2048];
+
+// The basic stream with the burst after every GGA
+static size_t buildBurstStream() {
+    size_t length = 0;
+    for (const char *line = basicStream; *line;) {
+        const char *end = strchr(line, '\n') + 1;
+        memcpy(burstStream + length, line, end - line);
+        length += end - line;
+        if (strncmp(line, "$GPGGA", 6) == 0) {
+            for (const char *body : burstBodies) {
+                uint8_t checksum = 0;
+                for (const char *c = body; *c; c++) checksum ^= (uint8_t)*c;
+                length += snprintf(burstStream + length, sizeof(burstStream) - length, "$%s*%02X\r\n", body,
+                                   checksum);
+            }
+        }
+        line = end;
+    }
+    return length;
+}
+
+static int failures = 0;
+
+// The fields both parsers decode, as TinyGPSPlus reports them
+template <class A, class B>
+static bool sameFields(A &a, B &b) {
+    return a.location.isValid() == b.location.isValid() && a.location.lat() == b.location.lat() &&
+           a.location.lng() == b.location.lng() && a.date.isValid() == b.date.isValid() &&
+           a.date.value() == b.date.value() && a.time.isValid() == b.time.isValid() &&
+           a.time.value() == b.time.value() && a.speed.value() == b.speed.value() &&
+           a.course.value() == b.course.value() && a.altitude.value() == b.altitude.value() &&
+           a.satellites.value() == b.satellites.value() && a.hdop.value() == b.hdop.value();
+}
+
+static void compare(const char *name, const char *stream, size_t length) {
+    TinyGPSPlus full;
+    AllFieldsGPS lite;
+    unsigned sentences = 0;
+    for (size_t i = 0; i < length; i++) {
+        full.encode(stream[i]);
+        lite.encode(stream[i]);
+        if (stream[i] != '\n') continue;
+        sentences++;
+        if (!sameFields(full, lite)) {
+            fprintf(stderr, "gps_bench: FAILED: %s stream, sentence %u decoded differently\n", name, sentences);
+            failures++;
+            return;
+        }
+    }
+    if (!full.location.isValid() || full.satellites.value() == 0) {
+        fprintf(stderr, "gps_bench: FAILED: %s stream decoded nothing\n", name);
+        failures++;
+    }
+}
+
+static volatile double sink;
+
+template <class Parser>
+static double nsPerByte(const char *stream, size_t length, unsigned long passes) {
+    Parser gps;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long p = 0; p < passes; p++) {
+        for (size_t i = 0; i < length; i++) gps.encode(stream[i]);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    sink = gps.location.lat();
+    return passes > 0 ? ns / ((double)passes * length) : 0;
+}
+
+static void bench(const char *name, const char *stream, size_t length, unsigned long passes) {
+    double full = nsPerByte<TinyGPSPlus>(stream, length, passes);
+    double lite = nsPerByte<LiteGPS>(stream, length, passes);
+    double all = nsPerByte<AllFieldsGPS>(stream, length, passes);
+    printf("%-6s stream (%3u bytes): TinyGPSPlus %.1f ns/byte, lite %.1f, lite with all fields %.1f\n", name,
+           (unsigned)length, full, lite, all);
+}
+
+int main(int argc, char **argv) {
+    unsigned long passes = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    size_t basicLength = strlen(basicStream);
+    size_t burstLength = buildBurstStream();
+
+    compare("basic", basicStream, basicLength);
+    compare("burst", burstStream, burstLength);
+
+    printf("sizeof: TinyGPSPlus %u B, lite LOCATION|DATE|TIME %u B, lite all fields %u B\n",
+           (unsigned)sizeof(TinyGPSPlus), (unsigned)sizeof(LiteGPS), (unsigned)sizeof(AllFieldsGPS));
+    bench("basic", basicStream, basicLength, passes);
+    bench("burst", burstStream, burstLength, passes);
+    printf("lite decodes the same values as TinyGPSPlus: %s\n", failures == 0 ? "yes" : "no");
+    return failures == 0 ? 0 : 1;
+}
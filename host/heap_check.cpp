@@ -0,0 +1,168 @@
+/*
+ * EnviroSense AQMS - heap allocation check
+ *
+ * Runs the ESP32 firmware itself (src/esp_main.cpp, as trace_replay does)
+ * against the simulated sensors of SimSensors.h with a replacement global
+ * operator new that counts every call. setup() may allocate; after it the
+ * firmware must not, so months of uptime cannot fragment the heap:
+ *
+ *   heap_check [minutes]     simulated run after setup() (default 30)
+ *
+ * The config switches on what the host can run: the raw input trace, the
+ * cross-sensitivity model and its log, CO2 fusion, ABC, the AQI alert and
+ * the GPS clock. Arduino String does not exist in the host Arduino.h, so
+ * any use of it already fails to build. Exits 1 if loop() allocated.
+ *
+ * Build: ./build.sh
+ */
+
+#include <dirent.h>
+#include <new>
+#include <unistd.h>
+
+#include "Esp32Host.h"
+#include "SimSensors.h"
+
+#define CHECK_LOOP_MS 50    // Loop period of the simulated unit
+
+static const char checkConfig[] =
+    "TRACE_enable=1\n"
+    "warmupTime=60000\n"
+    "warmupMinTime=20000\n"
+    "PM_period=60000\n"
+    "PM_window=20000\n"
+    "PM_spinup=10000\n"
+    "XS_enable=1\n"
+    "XS_log=1\n"
+    "CO2_fusion=1\n"
+    "ABC_enable=1\n"
+    "AQI_alert=1\n";
+
+// A model on every output, so the whole matrix product runs
+static const char checkModel[] =
+    "version=1\n"
+    "so2=log,-2.3,-1.9,0.04,0.11,0.02,0.01,0.003,0.001\n"
+    "h2s=log,-4.1,-1.2,0.02,0.05,0.01,0.02,0.002,0.001\n"
+    "ch4=log,1.2,0.1,-2.1,0.2,0.01,0.01,0.004,0.002\n"
+    "no2=log,-3.0,0.01,0.02,0.1,1.1,0.01,0.003,0.001\n"
+    "c2h5oh=log,0.5,0.02,0.1,-1.4,0.02,0.3,0.002,0.001\n"
+    "h2=log,0.2,0.01,0.05,-1.1,0.01,0.1,0.001,0.001\n"
+    "nh3=log,-0.4,0.02,0.03,-0.9,0.04,0.05,0.002,0.002\n"
+    "co=linear,1.0,0.1,0.2,-0.8,0.05,0.02,0.01,0.005\n";
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static uint64_t simNow = 0;
+static SimGPS simGPS;
+static SimSDS011 simSDS011;
+static SimENS160 simENS160;
+static SimGas simGas;
+
+#include "../src/esp_main.cpp"
+
+static void simRun(uint64_t until) {
+    while (simNow < until) {
+        simNow++;
+        simGPS.update(simNow);
+        simSDS011.update(simNow);
+        simENS160.update(simNow);
+    }
+}
+
+unsigned long millis() { return (unsigned long)simNow; }
+unsigned long micros() { return millis() * 1000; }
+void delay(unsigned long ms) { simRun(simNow + ms); }
+void yield() { delay(1); }
+int analogRead(uint8_t pin) { return simGas.read(pin, simNow); }
+
+static uint64_t sleepUs = 0;
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return ESP_SLEEP_WAKEUP_UNDEFINED; }
+int esp_sleep_enable_timer_wakeup(uint64_t us) {
+    sleepUs = us;
+    return 0;
+}
+int esp_light_sleep_start() {
+    delay(sleepUs / 1000);
+    return 0;
+}
+void esp_deep_sleep_start() {
+    fprintf(stderr, "heap_check: deep sleep (LP_mode=2) is not simulated\n");
+    exit(1);
+}
+
+static char cardDir[] = "/tmp/aqms_card_XXXXXX";
+
+static bool writeCardFile(const char *name, const char *text) {
+    char path[SD_HOST_PATH];
+    snprintf(path, sizeof(path), "%s/%s", cardDir, name);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    bool ok = fputs(text, f) >= 0;
+    fclose(f);
+    return ok;
+}
+
+static void removeCard() {
+    DIR *dir = opendir(cardDir);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cardDir, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cardDir);
+}
+
+int main(int argc, char **argv) {
+    unsigned minutes = argc > 1 ? (unsigned)atoi(argv[1]) : 30;
+    if (mkdtemp(cardDir) == NULL || !writeCardFile("config.txt", checkConfig) ||
+        !writeCardFile("xsens.txt", checkModel)) {
+        fprintf(stderr, "cannot set up the card directory\n");
+        return 1;
+    }
+    SD.setRoot(cardDir);
+    Serial.setOutput(NULL);
+    simGas.add(MG811_PIN, 1100);
+    simGas.add(MQ136_PIN, 1200);
+    simGas.add(MQ4_PIN, 900);
+    simGas.add(MICS_NOX_PIN, 420);
+    simGas.add(MICS_RED_PIN, 610);
+    SerialPM.attach(&simSDS011);
+    Serial2.attach(&simGPS);
+    Wire.attach(ENS160_I2C_ADDRESS, &simENS160);
+
+    setup();
+    unsigned long setupAllocations = allocations;
+    uint64_t end = simNow + minutes * 60000ULL;
+    unsigned long passes = 0;
+    while (simNow < end) {
+        loop();
+        simRun(simNow + CHECK_LOOP_MS);
+        passes++;
+    }
+    unsigned long loopAllocations = allocations - setupAllocations;
+    bool modelLoaded = xsens.loaded();
+    removeCard();
+
+    printf("setup(): %lu allocations (allowed)\n", setupAllocations);
+    printf("loop(): %lu passes over %u min, %lu allocations\n", passes, minutes, loopAllocations);
+    if (!modelLoaded) {
+        fprintf(stderr, "heap_check: the cross-sensitivity model did not load\n");
+        return 1;
+    }
+    return loopAllocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * EnviroSense AQMS - HTTP dashboard check
+ *
+ * Serves HttpDashboard (libraries/AQMS_Core/src/HttpDashboard.h) from a
+ * data.txt on SDStorage (the card, here a temp directory) over a real
+ * loopback TCP socket, with non-blocking POSIX sockets standing in for
+ * WiFiServer / WiFiClient. A client thread sends the requests while the
+ * main thread runs the unit's loop: a record appended and a /latest
+ * snapshot taken every 10 ms, the dashboard polled in between. Checks that
+ *
+ *   - /history returns exactly the records in its range and every header
+ *     line, also for a range in the middle of a log with two headers
+ *   - a repeated /history reads a small part of the log, the index the
+ *     first one left behind jumping over the rest
+ *   - /latest, /stats and an unknown path answer as documented
+ *
+ * and prints what a poll() costs (thread CPU time) while the requests are
+ * served:
+ *
+ *   http_check [records]     log length before the run (default 40000)
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+#include <SD.h>
+
+#include "HttpDashboard.h"
+#include "SDStorage.h"
+
+#define CHECK_EPOCH      1781518500000ULL    // epoch_ms of the first record
+#define CHECK_CYCLE_US   10000               // Record / snapshot period of the simulated unit
+#define CHECK_RESPONSE   (4 * 1024 * 1024)   // Largest response the client keeps
+#define CHECK_POLL_US    1000                // Poll time histogram, 1 us buckets
+
+static uint64_t startUs = 0;
+
+static uint64_t monotonicUs() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+unsigned long millis() { return (monotonicUs() - startUs) / 1000; }
+unsigned long micros() { return monotonicUs() - startUs; }
+void delay(unsigned long) {}
+void yield() {}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "http_check: FAILED: %s\n", what);
+    failures++;
+}
+
+// WiFiClient stand-in: a non-blocking TCP socket
+class SocketClient {
+public:
+    int fd = -1;
+
+    explicit operator bool() const { return fd >= 0; }
+
+    int available() {
+        int n = 0;
+        if (fd < 0 || ioctl(fd, FIONREAD, &n) < 0) return 0;
+        return n;
+    }
+
+    int read() {
+        unsigned char c;
+        return fd >= 0 && recv(fd, &c, 1, MSG_DONTWAIT) == 1 ? c : -1;
+    }
+
+    uint8_t connected() {
+        if (fd < 0) return 0;
+        char c;
+        ssize_t r = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return r > 0 || (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    }
+
+    size_t write(const uint8_t *data, size_t len) {
+        if (fd < 0) return 0;
+        ssize_t sent = send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        return sent > 0 ? (size_t)sent : 0;
+    }
+
+    void stop() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+};
+
+// WiFiServer stand-in: a listening socket on the loopback interface
+class SocketServer {
+public:
+    int fd = -1;
+    uint16_t port = 0;
+
+    bool begin() {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0 ||
+            getsockname(fd, (sockaddr *)&addr, &len) < 0) {
+            return false;
+        }
+        port = ntohs(addr.sin_port);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    SocketClient available() {
+        SocketClient client;
+        client.fd = accept(fd, NULL, NULL);
+        if (client.fd >= 0) {
+            fcntl(client.fd, F_SETFL, O_NONBLOCK);
+            int size = 8192; // Small send buffer, as on the ESP32
+            setsockopt(client.fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        }
+        return client;
+    }
+};
+
+static char cardDir[] = "/tmp/aqms_card_XXXXXX";
+static SDStorage card(4);
+static SocketServer server;
+static HttpDashboard<SocketServer, SocketClient, SDStorage> dashboard(server, card, "/data.txt");
+static uint64_t nextEpoch = CHECK_EPOCH;
+
+static void removeCard() {
+    DIR *dir = opendir(cardDir);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cardDir, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cardDir);
+}
+
+static void header(Print &out) {
+    out.print("date,time,epoch_ms,lat,lng,co2,so2,h2s,ch4,no2,pm25,pm10,fault,schema\n");
+}
+
+static void record(Print &out) {
+    char line[160];
+    snprintf(line, sizeof(line), "20260615,101500,%llu,48.126633,11.516666,412.50,0.02,0.01,1.85,0.04,8.40,11.20,0,3\n",
+             (unsigned long long)nextEpoch);
+    out.print(line);
+    nextEpoch += 1000;
+}
+
+// The client side: one request, the whole response
+static char response[CHECK_RESPONSE];
+static size_t responseLen = 0;
+
+static bool get(uint16_t port, const char *target) {
+    responseLen = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) return false;
+    char request[256];
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: aqms\r\nUser-Agent: check\r\n\r\n", target);
+    bool ok = send(fd, request, n, 0) == n;
+    while (ok) {
+        ssize_t got = recv(fd, response + responseLen, sizeof(response) - 1 - responseLen, 0);
+        if (got <= 0) break;
+        responseLen += got;
+    }
+    close(fd);
+    response[responseLen] = '\0';
+    return ok && responseLen > 0;
+}
+
+// Records and header lines of a /history response; records out of range count as stray
+static void countLines(uint64_t from, uint64_t to, unsigned &records, unsigned &headers, unsigned &stray) {
+    records = headers = stray = 0;
+    const char *body = strstr(response, "\r\n\r\n");
+    for (const char *line = body ? body + 4 : response + responseLen; *line;) {
+        const char *eol = strchr(line, '\n');
+        if (eol == NULL) break;
+        if (strncmp(line, "date", 4) == 0) {
+            headers++;
+        } else {
+            const char *field = strchr(strchr(line, ',') + 1, ',') + 1;
+            uint64_t epoch = strtoull(field, NULL, 10);
+            if (epoch >= from && epoch <= to) records++;
+            else stray++;
+        }
+        line = eol + 1;
+    }
+}
+
+static std::atomic<bool> clientDone(false);
+
+static void client(uint16_t port, uint32_t logRecords) {
+    char target[96];
+    unsigned records, headers, stray;
+
+    // A range in the middle, after the second header
+    uint64_t from = CHECK_EPOCH + (uint64_t)(logRecords * 3 / 4) * 1000, to = from + 599 * 1000;
+    snprintf(target, sizeof(target), "/history?from=%llu&to=%llu", (unsigned long long)from,
+             (unsigned long long)to);
+    for (int pass = 0; pass < 2; pass++) {
+        check(get(port, target) && strncmp(response, "HTTP/1.1 200", 12) == 0, "/history answered");
+        countLines(from, to, records, headers, stray);
+        check(records == 600 && stray == 0, "/history returns exactly its range");
+        check(headers == 2, "/history passes every header line on");
+    }
+
+    check(get(port, "/latest") && strstr(response, "\"co2\":") != NULL, "/latest answered from the snapshot");
+    check(get(port, "/stats") && strstr(response, "\"uptime_ms\":") != NULL, "/stats answered");
+    check(get(port, "/nothing") && strncmp(response, "HTTP/1.1 404", 12) == 0, "unknown path is 404");
+    clientDone = true;
+}
+
+static void printStats(Print &out) {
+    out.print("{\"uptime_ms\":");
+    out.print((unsigned long)millis());
+    out.print(",\"http_requests\":");
+    out.print(dashboard.requests());
+    out.print('}');
+}
+
+static uint32_t pollHistogram[CHECK_POLL_US + 1];
+
+static uint64_t threadCpuNs() {
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static uint32_t percentile(uint64_t polls, double p) {
+    uint64_t wanted = (uint64_t)(p * polls), seen = 0;
+    for (uint32_t us = 0; us <= CHECK_POLL_US; us++) {
+        seen += pollHistogram[us];
+        if (seen > wanted) return us;
+    }
+    return CHECK_POLL_US;
+}
+
+int main(int argc, char **argv) {
+    uint32_t logRecords = argc > 1 ? strtoul(argv[1], NULL, 10) : 40000;
+    signal(SIGPIPE, SIG_IGN);
+    startUs = monotonicUs();
+    Serial.setOutput(NULL);
+    if (mkdtemp(cardDir) == NULL || !server.begin()) {
+        fprintf(stderr, "cannot set up the card directory or the socket\n");
+        return 1;
+    }
+    SD.setRoot(cardDir);
+    card.begin();
+
+    // A log with a reboot (second header) half way
+    Print *log = card.record();
+    header(*log);
+    for (uint32_t i = 0; i < logRecords; i++) {
+        if (i == logRecords / 2) header(*log);
+        record(*log);
+    }
+    card.commit();
+
+    dashboard.setStats(printStats);
+    std::thread requests(client, server.port, logRecords);
+    uint64_t nextCycle = micros(), polls = 0;
+    uint32_t worst = 0;
+    // Log bytes read up to the start of each request; the client sends one at a time
+    uint32_t scannedAt[8] = {};
+    while (!clientDone) {
+        if (micros() >= nextCycle) {
+            nextCycle += CHECK_CYCLE_US;
+            record(*card.record());
+            card.commit();
+            Print &snapshot = dashboard.beginSnapshot();
+            snapshot.print("{\"co2\":412.5}");
+            dashboard.endSnapshot();
+        }
+        uint64_t started = threadCpuNs();
+        uint32_t requestsBefore = dashboard.requests();
+        dashboard.poll(millis());
+        if (dashboard.requests() != requestsBefore && dashboard.requests() < 8) {
+            scannedAt[dashboard.requests()] = dashboard.scannedBytes();
+        }
+        uint32_t us = (uint32_t)((threadCpuNs() - started) / 1000);
+        pollHistogram[us < CHECK_POLL_US ? us : CHECK_POLL_US]++;
+        if (us > worst) worst = us;
+        polls++;
+    }
+    requests.join();
+    removeCard();
+
+    uint32_t scannedFirst = scannedAt[2] - scannedAt[1], scannedAgain = scannedAt[3] - scannedAt[2];
+    check(scannedFirst > 0 && scannedAgain < scannedFirst / 10, "a repeated /history reads a small part of the log");
+    printf("/history: the first request read %lu log bytes, the repeat %lu\n", (unsigned long)scannedFirst,
+           (unsigned long)scannedAgain);
+    printf("poll (thread CPU): %llu polls, p50 %u us, p99 %u us, p99.9 %u us, max %u us; %lu requests\n",
+           (unsigned long long)polls, percentile(polls, 0.5), percentile(polls, 0.99), percentile(polls, 0.999),
+           worst, (unsigned long)dashboard.requests());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+/*
+ * EnviroSense AQMS - deep-sleep logging check
+ *
+ * Runs the ESP32 firmware itself (src/esp_main.cpp, as trace_replay does)
+ * with LP_mode=2 against the simulated sensors of SimSensors.h. A deep
+ * sleep is what it is on the unit: esp_deep_sleep_start() writes the RTC
+ * memory (every RTC_DATA_ATTR variable, kept in a section of its own) to
+ * the card directory and runs this program again, so each wake starts
+ * from freshly constructed globals, millis() from 0 and setup(). The RTC
+ * clock (monotonicMillis) and the sensors keep running through the sleep.
+ *
+ *   lp_check [minutes]       simulated run (default 20)
+ *
+ * After the run it checks that
+ *
+ *   - the header is written once, at power-up, and every window queued
+ *     LP_burst records, all of them written out or still in the RTC queue
+ *   - epoch_ms stays UTC from the first GPS time on, including the first
+ *     record after every wake, and never steps back
+ *   - an ADC input stuck for longer than the flatline limit is flagged
+ *     although no single wake lasts that long, and a live one is not
+ *   - the clean-air baseline trackers keep their samples through the sleeps
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <dirent.h>
+#include <unistd.h>
+
+#define TIME_HOST_RTC                                   // monotonicMillis() below
+#define RTC_DATA_ATTR __attribute__((section("aqms_rtc")))
+
+#include "Esp32Host.h"
+#include "SimSensors.h"
+
+#define CHECK_LOOP_MS 50        // Loop period of the simulated unit
+#define CHECK_WAKE_FILE "lp_wake.bin"
+
+static const char checkConfig[] =
+    "LP_mode=2\n"
+    "LP_interval=60000\n"
+    "LP_lead=30000\n"
+    "LP_burst=5\n"
+    "LP_batch=3\n"
+    "warmupTime=25000\n"
+    "warmupMinTime=20000\n"
+    "PM_window=15000\n"
+    "PM_spinup=10000\n"
+    "ABC_enable=1\n";
+
+// What survives a deep sleep besides the RTC memory: the world outside the unit
+struct WakeState {
+    uint64_t now, end;              // World ms
+    uint32_t boots;
+    uint32_t seed;
+    bool pmAwake, pmQuery;
+    uint8_t pmPeriod;
+    uint16_t pmId;
+    char card[32];
+};
+
+static WakeState world;
+static uint64_t simNow = 0, bootAt = 0;
+static bool woke = false;
+static SimGPS simGPS;
+static SimSDS011 simSDS011;
+static SimENS160 simENS160;
+static SimGas simGas;
+
+#include "../src/esp_main.cpp"
+
+extern char __start_aqms_rtc[], __stop_aqms_rtc[];
+
+static void simRun(uint64_t until) {
+    while (simNow < until) {
+        simNow++;
+        simGPS.update(simNow);
+        simSDS011.update(simNow);
+        simENS160.update(simNow);
+    }
+}
+
+unsigned long millis() { return (unsigned long)(simNow - bootAt); }
+unsigned long micros() { return millis() * 1000; }
+void delay(unsigned long ms) { simRun(simNow + ms); }
+void yield() { delay(1); }
+int analogRead(uint8_t pin) { return simGas.read(pin, simNow); }
+uint64_t monotonicMillis() { return simNow; }
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "lp_check: FAILED: %s\n", what);
+    failures++;
+}
+
+static void cardPath(char *path, const char *name) {
+    snprintf(path, SD_HOST_PATH, "%s/%s", world.card, name);
+}
+
+static void removeCard() {
+    DIR *dir = opendir(world.card);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", world.card, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(world.card);
+}
+
+// Column `index` of a CSV line as a number
+static double column(const char *line, size_t index) {
+    for (size_t i = 0; i < index; i++) {
+        line = strchr(line, ',');
+        if (line == NULL) return -1;
+        line++;
+    }
+    return atof(line);
+}
+
+// Records of data.txt and the RTC queue, in order
+static void checkRecords(uint32_t windows) {
+    char path[SD_HOST_PATH];
+    cardPath(path, "data.txt");
+    FILE *data = fopen(path, "rb");
+    check(data != NULL, "data.txt written");
+    if (data == NULL) return;
+
+    char line[1024];
+    unsigned headers = 0, records = 0, utc = 0;
+    double lastEpoch = 0;
+    bool utcSeen = false;
+    auto record = [&](const char *text) {
+        if (strncmp(text, "date", 4) == 0) {
+            headers++;
+            return;
+        }
+        records++;
+        double epoch = column(text, 2);
+        check(epoch >= lastEpoch, "epoch_ms never steps back");
+        if (epoch > 1.7e12) {
+            utcSeen = true;
+            utc++;
+        } else {
+            check(!utcSeen, "epoch_ms UTC after every wake once the GPS time is known");
+        }
+        lastEpoch = epoch;
+    };
+    while (fgets(line, sizeof(line), data) != NULL) record(line);
+    fclose(data);
+
+    // Records still queued in RTC memory for the next batch
+    for (uint16_t start = 0, i = 0; i < lpQueue.used; i++) {
+        if (lpQueue.text[i] != '\n') continue;
+        snprintf(line, sizeof(line), "%.*s", i - start, lpQueue.text + start);
+        record(line);
+        start = i + 1;
+    }
+
+    check(headers == 1, "header written once, at power-up");
+    check(records == windows * (uint32_t)LP_burst, "LP_burst records per window");
+    check(utc > 0, "GPS time reached the records");
+    printf("%u windows, %u records (%u queued), %u UTC\n", (unsigned)windows, records,
+           (unsigned)lpQueue.records, utc);
+}
+
+static void finish() {
+    checkRecords(world.boots);
+    uint32_t stuck = health.count(HS_MQ4, 0), live = health.count(HS_MQ136, 0);
+    check(stuck > 0, "stuck MQ-4 input flagged as flatline across wakes");
+    check(live == 0, "live MQ-136 input not flagged");
+    uint16_t samples = baseline[CAL_MQ136_R0].samples();
+    check(samples > 1, "baseline samples kept through deep sleep");
+    printf("flatline: MQ-4 %u, MQ-136 %u; MQ-136 baseline samples %u\n", (unsigned)stuck, (unsigned)live,
+           (unsigned)samples);
+    removeCard();
+    exit(failures == 0 ? 0 : 1);
+}
+
+static char *selfPath = NULL;
+
+static uint64_t sleepUs = 0;
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return woke ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+int esp_sleep_enable_timer_wakeup(uint64_t us) {
+    sleepUs = us;
+    return 0;
+}
+int esp_light_sleep_start() {
+    delay(sleepUs / 1000);
+    return 0;
+}
+
+// RAM is lost: keep the RTC memory and the world, then boot again
+void esp_deep_sleep_start() {
+    simRun(simNow + sleepUs / 1000);
+    if (simNow >= world.end) finish();
+
+    world.now = simNow;
+    world.seed = simSeed();
+    world.pmAwake = simSDS011.awake;
+    world.pmQuery = simSDS011.queryMode;
+    world.pmPeriod = simSDS011.period;
+    world.pmId = simSDS011.id;
+    char path[SD_HOST_PATH];
+    cardPath(path, CHECK_WAKE_FILE);
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL && fwrite(&world, sizeof(world), 1, f) == 1 &&
+              fwrite(__start_aqms_rtc, 1, __stop_aqms_rtc - __start_aqms_rtc, f) ==
+                  (size_t)(__stop_aqms_rtc - __start_aqms_rtc);
+    if (f != NULL) fclose(f);
+    if (!ok) {
+        fprintf(stderr, "lp_check: cannot write %s\n", path);
+        exit(1);
+    }
+    fflush(stdout);
+    char *args[] = {selfPath, (char *)"--wake", path, NULL};
+    execv(selfPath, args);
+    fprintf(stderr, "lp_check: cannot run %s again\n", selfPath);
+    exit(1);
+}
+
+static bool wake(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    bool ok = fread(&world, sizeof(world), 1, f) == 1 &&
+              fread(__start_aqms_rtc, 1, __stop_aqms_rtc - __start_aqms_rtc, f) ==
+                  (size_t)(__stop_aqms_rtc - __start_aqms_rtc);
+    fclose(f);
+    remove(path);
+    if (!ok) return false;
+
+    woke = true;
+    world.boots++;
+    simNow = bootAt = world.now;
+    simSeed() = world.seed;
+    simSDS011.awake = world.pmAwake;
+    simSDS011.queryMode = world.pmQuery;
+    simSDS011.period = world.pmPeriod;
+    simSDS011.id = world.pmId;
+    simSDS011.update(simNow);
+    simGPS.update(simNow);
+    while (simGPS.available()) simGPS.read(); // Sent while asleep, not received
+    return true;
+}
+
+static bool powerUp(unsigned minutes) {
+    snprintf(world.card, sizeof(world.card), "/tmp/aqms_card_XXXXXX");
+    if (mkdtemp(world.card) == NULL) return false;
+    world.end = minutes * 60000ULL;
+    world.boots = 1;
+    char path[SD_HOST_PATH];
+    cardPath(path, "config.txt");
+    FILE *config = fopen(path, "wb");
+    if (config == NULL) return false;
+    bool ok = fputs(checkConfig, config) >= 0;
+    fclose(config);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    selfPath = argv[0];
+    Serial.setOutput(NULL);
+    if (argc > 2 && strcmp(argv[1], "--wake") == 0) {
+        if (!wake(argv[2])) {
+            fprintf(stderr, "lp_check: cannot read %s\n", argv[2]);
+            return 1;
+        }
+    } else if (!powerUp(argc > 1 ? (unsigned)atoi(argv[1]) : 20)) {
+        fprintf(stderr, "cannot set up the card directory\n");
+        return 1;
+    }
+    SD.setRoot(world.card);
+    simGas.add(MG811_PIN, 1100);
+    simGas.add(MQ136_PIN, 1200);
+    simGas.add(MQ4_PIN, 900, true);
+    simGas.add(MICS_NOX_PIN, 420);
+    simGas.add(MICS_RED_PIN, 610);
+    SerialPM.attach(&simSDS011);
+    Serial2.attach(&simGPS);
+    Wire.attach(ENS160_I2C_ADDRESS, &simENS160);
+
+    setup();
+    while (simNow < world.end) {
+        loop();
+        simRun(simNow + CHECK_LOOP_MS);
+    }
+    finish();
+}
@@ -0,0 +1,396 @@
+/*
+ * EnviroSense AQMS - MQTT uplink check
+ *
+ * Runs MqttUplink (libraries/AQMS_Core/src/MqttUplink.h) on SDStorage (the
+ * card, here a temp directory) against a broker stand-in that speaks the
+ * MQTT 3.1.1 the uplink uses (CONNECT / PUBLISH QoS 1 / PINGREQ) and
+ * decodes the CBOR batches. The socket takes at most CHECK_SOCKET_MAX
+ * bytes per write, as a full TCP send buffer would. Checks that
+ *
+ *   - every complete data.txt record reaches the broker, through lost
+ *     PUBACKs, a dropped link, a reboot, a torn offset file and a new
+ *     header with other columns, and a line still being written does not
+ *   - no poll writes more than MQTT_WRITE_MAX bytes, and a PUBLISH the
+ *     socket did not take at once is finished over the next polls
+ *   - the offset is saved once per catch-up minute, not for every batch,
+ *     and begin() resumes from the newer of the two offset files
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <SD.h>
+
+#include "MqttUplink.h"
+#include "SDStorage.h"
+
+#define CHECK_POLL_MS    10                  // Loop period of the simulated unit
+#define CHECK_SOCKET_MAX 1000                // Bytes the socket takes per write
+#define CHECK_EPOCH      1781518500000ULL    // epoch_ms of the first record
+#define CHECK_RECORDS    1024                // Most records a run writes
+
+static uint32_t simNow = 0;
+
+unsigned long millis() { return simNow; }
+unsigned long micros() { return simNow * 1000; }
+void delay(unsigned long ms) { simNow += ms; }
+void yield() {}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "mqtt_check: FAILED: %s\n", what);
+    failures++;
+}
+
+// Minimal CBOR reader for the uplink's batches
+class CborReader {
+private:
+    const uint8_t *_data;
+    uint32_t _len, _pos = 0;
+
+    uint64_t argument(uint8_t info) {
+        if (info < 24) return info;
+        uint8_t n = info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 8;
+        uint64_t value = 0;
+        for (uint8_t i = 0; i < n && _pos < _len; i++) value = value << 8 | _data[_pos++];
+        return value;
+    }
+
+public:
+    CborReader(const uint8_t *data, uint32_t len) : _data(data), _len(len) {}
+
+    bool atBreak() const { return _pos < _len && _data[_pos] == 0xFF; }
+    bool done() const { return _pos >= _len; }
+    void skipBreak() { _pos++; }
+
+    // Start of an indefinite array
+    bool beginArray() { return _pos < _len && _data[_pos++] == 0x9F; }
+
+    // One item as a number (0 for containers and text, which are skipped)
+    double item() {
+        if (_pos >= _len) return 0;
+        uint8_t initial = _data[_pos++];
+        uint8_t major = initial >> 5, info = initial & 31;
+        if (initial == 0xFA) {
+            uint32_t bits = (uint32_t)argument(26);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        if (initial == 0xF6) return NAN;
+        if (major == 0) return (double)argument(info);
+        if (major == 1) return -1.0 - (double)argument(info);
+        if (major == 3) {
+            _pos += (uint32_t)argument(info);
+            return 0;
+        }
+        if (major == 4 || major == 5) {
+            if (info == 31) {
+                while (!done() && !atBreak()) item();
+                skipBreak();
+            } else {
+                uint64_t n = argument(info) * (major == 5 ? 2 : 1);
+                for (uint64_t i = 0; i < n; i++) item();
+            }
+        }
+        return 0;
+    }
+};
+
+// Broker stand-in: answers CONNECT, PUBLISH (QoS 1) and PINGREQ
+class Broker {
+private:
+    uint8_t _in[MQTT_PAYLOAD_MAX + 256];
+    uint32_t _inLen = 0;
+
+    void answer(uint8_t type, uint8_t a, uint8_t b) {
+        uint8_t packet[4] = {type, 2, a, b};
+        memcpy(out + outLen, packet, sizeof(packet));
+        outLen += sizeof(packet);
+    }
+
+    // epoch_ms (third column) of every record of a batch
+    void batch(const uint8_t *payload, uint32_t len) {
+        CborReader body(payload + 1, len - 1); // After the map's initial byte
+        body.item();                    // "c"
+        body.item();                    // Column names
+        body.item();                    // "r"
+        if (!body.beginArray()) {
+            malformed++;
+            return;
+        }
+        while (!body.done() && !body.atBreak()) {
+            if (!body.beginArray()) {
+                malformed++;
+                return;
+            }
+            body.item();
+            body.item();
+            uint64_t epoch = (uint64_t)body.item();
+            while (!body.done() && !body.atBreak()) body.item();
+            body.skipBreak();
+            if (epoch >= CHECK_EPOCH && epoch < CHECK_EPOCH + CHECK_RECORDS) seen[epoch - CHECK_EPOCH]++;
+            else malformed++;
+        }
+    }
+
+    // Handle every complete packet in the input
+    void parse() {
+        while (_inLen >= 2) {
+            uint32_t i = 1, len = 0;
+            uint8_t shift = 0;
+            while (true) {
+                if (i >= _inLen) return;
+                uint8_t b = _in[i++];
+                len |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            if (_inLen < i + len) return;
+            uint8_t type = _in[0];
+            const uint8_t *body = _in + i;
+            switch (type >> 4) {
+                case 1: // CONNECT
+                    answer(0x20, 0, 0);
+                    break;
+                case 3: { // PUBLISH
+                    uint16_t topicLen = body[0] << 8 | body[1];
+                    uint8_t idHigh = body[2 + topicLen], idLow = body[3 + topicLen];
+                    if (type & 0x08) duplicates++;
+                    publishes++;
+                    batch(body + 4 + topicLen, len - 4 - topicLen);
+                    if (!dropAcks) answer(0x40, idHigh, idLow);
+                    break;
+                }
+                case 12: // PINGREQ
+                    out[outLen++] = 0xD0;
+                    out[outLen++] = 0;
+                    break;
+                default:
+                    malformed++;
+                    break;
+            }
+            memmove(_in, _in + i + len, _inLen - i - len);
+            _inLen -= i + len;
+        }
+    }
+
+public:
+    bool up = true, dropAcks = false;
+    uint8_t out[256];
+    uint32_t outLen = 0, outPos = 0;
+    uint16_t seen[CHECK_RECORDS] = {};
+    uint32_t publishes = 0, duplicates = 0, malformed = 0;
+
+    void reset() {
+        _inLen = outLen = outPos = 0;
+    }
+
+    size_t receive(const uint8_t *data, size_t len) {
+        if (len > sizeof(_in) - _inLen) len = sizeof(_in) - _inLen;
+        memcpy(_in + _inLen, data, len);
+        _inLen += len;
+        parse();
+        return len;
+    }
+};
+
+static Broker broker;
+
+// The unit's end of the TCP connection
+class BrokerClient {
+public:
+    bool open = false;
+    uint32_t pollBytes = 0;     // Written since the last poll
+
+    int connect(const char *, uint16_t) {
+        if (!broker.up) return 0;
+        broker.reset();
+        open = true;
+        return 1;
+    }
+    uint8_t connected() { return open && broker.up; }
+    void stop() { open = false; }
+
+    int available() { return connected() ? (int)(broker.outLen - broker.outPos) : 0; }
+    int read() {
+        if (available() <= 0) return -1;
+        int c = broker.out[broker.outPos++];
+        if (broker.outPos == broker.outLen) broker.outPos = broker.outLen = 0;
+        return c;
+    }
+
+    size_t write(const uint8_t *data, size_t len) {
+        if (!connected()) return 0;
+        if (len > CHECK_SOCKET_MAX) len = CHECK_SOCKET_MAX;
+        pollBytes += len;
+        return broker.receive(data, len);
+    }
+};
+
+// SDStorage that counts the files it rewrites
+class CountingStorage : public SDStorage {
+public:
+    uint32_t writes = 0;
+
+    CountingStorage() : SDStorage(4) {}
+
+    template <typename Fn>
+    bool writeFile(const char *path, Fn fn) {
+        writes++;
+        return SDStorage::writeFile(path, fn);
+    }
+};
+
+typedef MqttUplink<BrokerClient, CountingStorage> Uplink;
+
+static char cardDir[] = "/tmp/aqms_card_XXXXXX";
+static uint64_t nextEpoch = CHECK_EPOCH;
+static BrokerClient client;
+static uint32_t worstPollBytes = 0;
+
+static void cardPath(char *path, const char *name) {
+    snprintf(path, SD_HOST_PATH, "%s/%s", cardDir, name);
+}
+
+static void removeCard() {
+    DIR *dir = opendir(cardDir);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cardDir, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cardDir);
+}
+
+static void append(const char *text) {
+    char path[SD_HOST_PATH];
+    cardPath(path, "data.txt");
+    FILE *data = fopen(path, "ab");
+    if (data == NULL) return;
+    fputs(text, data);
+    fclose(data);
+}
+
+static void header() {
+    append("date,time,epoch_ms,lat,lng,co2,so2,h2s,ch4,no2,c2h5oh,h2,nh3,co,tvoc,eco2,pm25,pm10,fault,schema\n");
+}
+
+static void records(unsigned count) {
+    char line[256];
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(line, sizeof(line),
+                 "20260615,101500,%llu,48.126633,11.516666,412.50,0.02,0.01,1.85,0.04,,0.10,0.30,0.60,12,400,"
+                 "8.40,11.20,0,3\n", (unsigned long long)nextEpoch++);
+        append(line);
+    }
+}
+
+static void run(Uplink &uplink, uint32_t ms) {
+    for (uint32_t end = simNow + ms; simNow < end; simNow += CHECK_POLL_MS) {
+        client.pollBytes = 0;
+        uplink.poll(simNow, true);
+        if (client.pollBytes > worstPollBytes) worstPollBytes = client.pollBytes;
+    }
+}
+
+static void setUp(Uplink &uplink) {
+    uplink.configure("broker", 1883, "aqms/data", "unit1");
+    uplink.setBatch(60, 60000);
+    uplink.begin();
+}
+
+static uint32_t fileSize(const char *name) {
+    char path[SD_HOST_PATH];
+    cardPath(path, name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return 0;
+    fseek(f, 0, SEEK_END);
+    uint32_t size = (uint32_t)ftell(f);
+    fclose(f);
+    return size;
+}
+
+int main() {
+    Serial.setOutput(NULL);
+    if (mkdtemp(cardDir) == NULL) {
+        fprintf(stderr, "cannot set up the card directory\n");
+        return 1;
+    }
+    SD.setRoot(cardDir);
+    CountingStorage card;
+    card.begin();
+
+    // A backlog, and a record still being written
+    header();
+    records(500);
+    append("20260615,1015");
+    Uplink uplink(client, card, "/data.txt", "/mqtt_ack0.txt", "/mqtt_ack1.txt");
+    setUp(uplink);
+    run(uplink, 5000);
+    check(uplink.records() == 500, "backlog sent, the unfinished line left");
+    check(uplink.acked() == fileSize("data.txt") - 13, "acked up to the unfinished line");
+    check(card.writes == 1, "offset saved once, when the backlog is sent");
+
+    // Lost PUBACKs, then a dropped link with a batch in flight
+    append(",1781518500500,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,0,3\n");
+    nextEpoch++;
+    records(199);
+    broker.dropAcks = true;
+    run(uplink, 75000);
+    check(broker.duplicates > 0, "unconfirmed batch sent again with DUP");
+    broker.up = false;
+    broker.dropAcks = false;
+    run(uplink, 5000);
+    broker.up = true;
+    run(uplink, 40000);
+    check(uplink.acked() == fileSize("data.txt"), "caught up after the link is back");
+
+    // Reboot with the newer offset file torn: the older one is used
+    records(30);
+    uint32_t batches = uplink.batches(), saves = card.writes;
+    check(saves < batches, "offset not rewritten for every batch");
+    char path[SD_HOST_PATH];
+    cardPath(path, (saves & 1) ? "mqtt_ack1.txt" : "mqtt_ack0.txt");
+    FILE *torn = fopen(path, "wb");
+    if (torn != NULL) {
+        fputs("12,9", torn);
+        fclose(torn);
+    }
+    header();
+    append("date,time,epoch_ms,lat,lng,co2\n");
+    for (int i = 0; i < 5; i++) {
+        char line[80];
+        snprintf(line, sizeof(line), "20260616,000000,%llu,1.0,2.0,3.5\n", (unsigned long long)nextEpoch++);
+        append(line);
+    }
+    client.stop();
+    Uplink rebooted(client, card, "/data.txt", "/mqtt_ack0.txt", "/mqtt_ack1.txt");
+    setUp(rebooted);
+    check(rebooted.acked() > 0 && rebooted.acked() < fileSize("data.txt"), "resumed from the older offset file");
+    run(rebooted, 5000);
+    check(rebooted.acked() == fileSize("data.txt"), "everything sent after the reboot");
+
+    unsigned total = (unsigned)(nextEpoch - CHECK_EPOCH), arrived = 0, twice = 0;
+    for (unsigned i = 0; i < total; i++) {
+        if (broker.seen[i] > 0) arrived++;
+        if (broker.seen[i] > 1) twice++;
+    }
+    check(arrived == total, "every record reached the broker");
+    check(broker.malformed == 0, "every batch decodes");
+    check(worstPollBytes <= MQTT_WRITE_MAX, "at most MQTT_WRITE_MAX bytes per poll");
+    removeCard();
+
+    printf("%u/%u records at the broker in %lu publishes (%u sent twice, %lu with DUP), "
+           "%lu offset saves for %lu batches, largest poll write %lu B\n", arrived, total,
+           (unsigned long)broker.publishes, twice, (unsigned long)broker.duplicates, (unsigned long)card.writes,
+           (unsigned long)(batches + rebooted.batches()), (unsigned long)worstPollBytes);
+    return failures == 0 ? 0 : 1;
+}
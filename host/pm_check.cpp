@@ -0,0 +1,172 @@
+/*
+ * EnviroSense AQMS - SDS011 duty-cycle check
+ *
+ * Runs the SDS011 driver (libraries/SDS011-master) and PMScheduler
+ * (libraries/AQMS_Core/src/PMScheduler.h) against the SimSDS011 stand-in
+ * of SimSensors.h, which answers the real 0xB4 / 0xC5 / 0xC0 protocol
+ * SIM_SDS011_LATENCY ms after a command. Checks that
+ *
+ *   - the setup of the Mega and ESP32 firmware (continuous working period,
+ *     query mode, firmware version) is confirmed by the sensor, and a
+ *     command nobody answers times out after SDS011_REPLY_TIMEOUT
+ *   - a duty-cycled run keeps the fan on for spin-up + window of each
+ *     period, averages one queried frame per second of each window and
+ *     holds the average between windows
+ *   - the UNO's listen-only wiring (PM_LISTEN_ONLY) sends no byte at all,
+ *     not even the wakeup at boot, and still averages the sensor's stream
+ *
+ * Exits 1 if any check failed. Build: ./build.sh
+ */
+
+#include "SDS011.h"
+#include "PMScheduler.h"
+#include "SimSensors.h"
+
+#define CHECK_LOOP_MS 50        // Loop period of the simulated unit
+#define CHECK_PERIOD  60000     // Duty cycle: PM_period, PM_window, PM_spinup
+#define CHECK_WINDOW  20000
+#define CHECK_SPINUP  10000
+#define CHECK_PERIODS 10
+
+static uint64_t simNow = 0;
+
+// Counts every byte the firmware sends, valid command or not
+class CountingSDS011 : public SimSDS011 {
+public:
+    uint32_t bytes = 0;
+
+    size_t write(uint8_t c) {
+        bytes++;
+        return SimSDS011::write(c);
+    }
+
+    size_t write(const uint8_t *buf, size_t size) {
+        for (size_t i = 0; i < size; i++) write(buf[i]);
+        return size;
+    }
+};
+
+static CountingSDS011 *simSensor = NULL;
+static uint64_t awakeMs = 0;
+
+static void simRun(uint64_t until) {
+    while (simNow < until) {
+        simNow++;
+        if (simSensor == NULL) continue;
+        simSensor->update(simNow);
+        if (simSensor->awake) awakeMs++;
+    }
+}
+
+unsigned long millis() { return (unsigned long)simNow; }
+unsigned long micros() { return millis() * 1000; }
+void delay(unsigned long ms) { simRun(simNow + ms); }
+void yield() { delay(1); } // SDS011::waitReply lets a ms pass
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "pm_check: FAILED: %s\n", what);
+    failures++;
+}
+
+// Nothing answers: a sensor that is not connected
+static void checkTimeout() {
+    SimUart silent;
+    SDS011 sensor;
+    sensor.begin(&silent);
+    simSensor = NULL;
+    uint64_t start = simNow;
+    check(!sensor.setQueryMode(true), "no reply, no confirmation");
+    check(sensor.commandStatus() == SDS011_TIMEOUT, "no reply times out");
+    check(simNow - start > SDS011_REPLY_TIMEOUT && simNow - start <= SDS011_REPLY_TIMEOUT + 2,
+          "the timeout is SDS011_REPLY_TIMEOUT");
+}
+
+// Mega / ESP32: commands, query mode, one window per period
+static void checkDutyCycle() {
+    CountingSDS011 sim;
+    sim.awake = false; // Left asleep before the reset
+    sim.update(simNow);
+    simSensor = &sim;
+    SDS011 sensor;
+    sensor.begin(&sim);
+    PMScheduler<SDS011> scheduler(sensor);
+
+    // setupPMSensor()
+    sensor.wakeup();
+    uint64_t sent = simNow;
+    check(sensor.waitReply() && sim.awake, "wakeup confirmed");
+    // waitReply() polls, then lets a ms pass: done in the ms after the reply
+    check(simNow - sent == SIM_SDS011_LATENCY + 1, "reply after the sensor's latency");
+    check(sensor.setWorkingPeriod(0) && sim.period == 0, "continuous working period");
+    check(sensor.setQueryMode(true) && sim.queryMode, "query mode");
+    uint8_t year = 0, month = 0, day = 0;
+    check(sensor.getFirmwareVersion(&year, &month, &day) && year == 18 && month == 11 && day == 16,
+          "firmware version");
+    check(sensor.deviceId() == sim.id, "device ID from the replies");
+
+    scheduler.configure(CHECK_PERIOD, CHECK_WINDOW, CHECK_SPINUP);
+    scheduler.setQueryInterval(1000);
+    uint64_t start = simNow;
+    awakeMs = 0;
+    scheduler.begin(millis());
+    float lowest = 1e9f, highest = 0;
+    uint16_t fewest = 0xFFFF;
+    uint32_t windows = 0;
+    while (simNow - start < (uint64_t)CHECK_PERIODS * CHECK_PERIOD) {
+        scheduler.poll(millis());
+        if (scheduler.windows() != windows) {
+            windows = scheduler.windows();
+            lowest = min(lowest, scheduler.pm25());
+            highest = max(highest, scheduler.pm25());
+            if (scheduler.lastFrames() < fewest) fewest = scheduler.lastFrames();
+            check(!sim.awake || scheduler.state() != PM_SLEEPING, "asleep after the window");
+        }
+        simRun(simNow + CHECK_LOOP_MS);
+    }
+
+    float duty = (float)awakeMs / (simNow - start);
+    check(windows == CHECK_PERIODS, "one window per period");
+    check(fabs(duty - scheduler.dutyCycle()) < 0.01f, "fan on for spin-up + window of each period");
+    check(fewest >= CHECK_WINDOW / 1000 - 1 && fewest <= CHECK_WINDOW / 1000 + 1,
+          "one queried frame per second of the window");
+    // SimSDS011 sends 12.0 .. 21.0 ug/m3, +/- 0.5 of noise
+    check(lowest >= 11.5f && highest <= 21.5f, "window averages in the sensor's range");
+    check(scheduler.hasAverage(), "average held between windows");
+    printf("duty cycle: %u windows, fan on %.1f %% (expected %.1f %%), >= %u frames per window, "
+           "%lu commands\n", (unsigned)windows, duty * 100, scheduler.dutyCycle() * 100, (unsigned)fewest,
+           (unsigned long)sim.commands());
+}
+
+// UNO: the sensor only listened to, nothing sent
+static void checkListenOnly() {
+    CountingSDS011 sim;
+    sim.update(simNow);
+    simSensor = &sim;
+    SDS011 sensor;
+    sensor.begin(&sim);
+    PMScheduler<SDS011> scheduler(sensor);
+
+    uint64_t start = simNow;
+    scheduler.configure(0, 30000, 30000);
+    scheduler.begin(millis(), false);
+    while (simNow - start < 5 * 60000ULL) {
+        scheduler.poll(millis());
+        simRun(simNow + CHECK_LOOP_MS);
+    }
+    check(sim.bytes == 0, "listen-only sends no byte");
+    check(scheduler.windows() >= 8 && scheduler.lastFrames() >= 29, "listen-only averages the stream");
+    check(scheduler.pm25() >= 11.5f && scheduler.pm25() <= 21.5f, "listen-only average in range");
+    printf("listen-only: %lu windows, %lu bytes sent\n", (unsigned long)scheduler.windows(),
+           (unsigned long)sim.bytes);
+}
+
+int main() {
+    Serial.setOutput(NULL);
+    checkTimeout();
+    checkDutyCycle();
+    checkListenOnly();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/*
+ * EnviroSense AQMS - low-power mode simulation
+ *
+ * Drives PowerSchedule and PowerBudget (libraries/AQMS_Core/src/PowerManager.h)
+ * from a simulated clock the way src/esp_main.cpp does with LP_mode 1 or 2,
+ * and prints when each record is taken, the awake time and the battery
+ * projection per window, then the totals of the run.
+ *
+ *   power_sim [key=value]...
+ *
+ * Keys are the config.txt names LP_mode, LP_interval, LP_lead, LP_burst,
+ * LP_batch, LP_active_mA, LP_sleep_mA, LP_battery_mAh and cycleInterval
+ * (defaults as in the firmware, LP_mode=1), plus:
+ *
+ *   windows   windows to run (default 12)
+ *   loop_ms   time one loop() takes (default 20)
+ *   boot_ms   deep sleep only: wake to the end of setup() (default 1500),
+ *             awake but not counted by the firmware's projection
+ *
+ * Build: ./build.sh
+ */
+
+#include <Arduino.h>
+
+#include "PowerManager.h"
+
+static unsigned long simMillis = 0; // millis() of the simulated unit
+
+unsigned long millis() { return simMillis; }
+unsigned long micros() { return simMillis * 1000; }
+void delay(unsigned long ms) { simMillis += ms; }
+void yield() {}
+int analogRead(uint8_t) { return 0; }
+
+struct Config {
+    int LP_mode = LP_LIGHT;
+    unsigned long LP_interval = 300000;
+    unsigned long LP_lead = 60000;
+    int LP_burst = 5;
+    int LP_batch = 5;
+    float LP_active_mA = 250;
+    float LP_sleep_mA = 160;
+    float LP_battery_mAh = 10000;
+    unsigned long cycleInterval = 1000;
+    unsigned long windows = 12;
+    unsigned long loop_ms = 20;
+    unsigned long boot_ms = 1500;
+};
+
+static bool setKey(Config &config, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL) return false;
+    size_t len = eq - arg;
+    const char *value = eq + 1;
+#define KEY(name, parse) \
+    if (len == strlen(#name) && strncmp(arg, #name, len) == 0) { config.name = parse(value); return true; }
+    KEY(LP_mode, atoi)
+    KEY(LP_interval, atol)
+    KEY(LP_lead, atol)
+    KEY(LP_burst, atoi)
+    KEY(LP_batch, atoi)
+    KEY(LP_active_mA, atof)
+    KEY(LP_sleep_mA, atof)
+    KEY(LP_battery_mAh, atof)
+    KEY(cycleInterval, atol)
+    KEY(windows, atol)
+    KEY(loop_ms, atol)
+    KEY(boot_ms, atol)
+#undef KEY
+    return false;
+}
+
+int main(int argc, char **argv) {
+    Config config;
+    for (int i = 1; i < argc; i++) {
+        if (!setKey(config, argv[i])) {
+            fprintf(stderr, "usage: power_sim [key=value]... (unknown: %s)\n", argv[i]);
+            return 2;
+        }
+    }
+    if (config.LP_mode != LP_LIGHT && config.LP_mode != LP_DEEP) {
+        fprintf(stderr, "LP_mode must be 1 (light sleep) or 2 (deep sleep)\n");
+        return 2;
+    }
+    config.LP_burst = constrain(config.LP_burst, 1, 255);
+    if (config.LP_batch < 1) config.LP_batch = 1;
+    if (config.loop_ms == 0) config.loop_ms = 1;
+
+    PowerSchedule schedule;
+    PowerBudget budget;
+    budget.activeMa = config.LP_active_mA;
+    budget.sleepMa = config.LP_sleep_mA;
+
+    uint64_t wall = 0;             // Simulated real time
+    uint64_t awakeWall = 0;        // Real time awake, boot included
+    unsigned long lastCycle = 0;   // AcquisitionCore::cycleDue()
+    unsigned long records = 0, sdWrites = 0, queuedWindows = 0;
+    uint64_t lastRecordAt = 0, maxGap = 0;
+
+    // setup()
+    simMillis = config.LP_mode == LP_DEEP ? config.boot_ms : 0;
+    wall = simMillis;
+    awakeWall = simMillis;
+    schedule.configure(config.LP_interval, config.LP_lead, (uint8_t)config.LP_burst);
+    schedule.beginWindow(millis());
+
+    printf("window,start_s,records_at_s,awake_s,average_mA,battery_h\n");
+    for (unsigned long window = 0; window < config.windows;) {
+        char times[256] = "";
+        size_t used = 0;
+
+        // loop() until the burst is queued
+        while (!schedule.windowDone()) {
+            simMillis += config.loop_ms;
+            wall += config.loop_ms;
+            awakeWall += config.loop_ms;
+            if (millis() - lastCycle < config.cycleInterval) continue;
+            lastCycle = millis();
+            if (!schedule.measuring(millis())) continue;
+
+            schedule.recordTaken();
+            records++;
+            if (lastRecordAt != 0 && wall - lastRecordAt > maxGap) maxGap = wall - lastRecordAt;
+            lastRecordAt = wall;
+            if (used < sizeof(times) - 16) {
+                used += snprintf(times + used, sizeof(times) - used, "%s%.2f", used ? " " : "", wall / 1000.0);
+            }
+        }
+
+        // sleepUntilNextWindow()
+        if (++queuedWindows >= (unsigned long)config.LP_batch) {
+            queuedWindows = 0;
+            sdWrites++;
+        }
+        uint32_t sleepMs = schedule.sleepTime(millis());
+        printf("%lu,%.2f,%s,%.1f,%.1f,%.0f\n", window,
+               (wall - schedule.activeMs()) / 1000.0, times,
+               schedule.activeMs() / 1000.0,
+               budget.averageMa(schedule.activeMs(), config.LP_interval),
+               budget.batteryHours(config.LP_battery_mAh, schedule.activeMs(), config.LP_interval));
+        window++;
+
+        if (sleepMs == 0) {
+            schedule.nextWindow(millis());
+            continue;
+        }
+        wall += sleepMs;
+        if (config.LP_mode == LP_DEEP) {
+            // setup() runs again: millis(), the schedule and the cycle timer restart
+            simMillis = config.boot_ms;
+            wall += config.boot_ms;
+            awakeWall += config.boot_ms;
+            lastCycle = 0;
+            schedule.configure(config.LP_interval, config.LP_lead, (uint8_t)config.LP_burst);
+            schedule.beginWindow(millis());
+        } else {
+            simMillis += sleepMs;
+            schedule.nextWindow(millis());
+        }
+    }
+
+    double hours = wall / 3600000.0;
+    double averageMa = (config.LP_active_mA * awakeWall + config.LP_sleep_mA * (double)(wall - awakeWall)) / wall;
+    printf("\n");
+    printf("simulated      %.2f h, %lu records, longest gap %.1f s\n", hours, records, maxGap / 1000.0);
+    printf("SD writes      %lu (every %d windows)\n", sdWrites, config.LP_batch);
+    printf("awake          %.1f %% of the time\n", 100.0 * awakeWall / wall);
+    printf("average        %.1f mA, battery %.0f h (%.1f days)\n", averageMa,
+           config.LP_battery_mAh / averageMa, config.LP_battery_mAh / averageMa / 24);
+    return 0;
+}
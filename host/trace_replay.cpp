@@ -0,0 +1,274 @@
+/*
+ * EnviroSense AQMS - trace replay runner
+ *
+ * Runs the ESP32 firmware itself - src/esp_main.cpp on the stand-ins of
+ * Esp32Host.h - on a /trace.bin recorded with TRACE_enable=1
+ * (TraceRecorder.h). Every driver, filter and check sees the recorded
+ * input: readStableADC with the ADC correction table and AdaptiveSampler,
+ * the MQ / MICS / MG-811 drivers, SignalFilter, CrossSensitivity,
+ * HealthMonitor, AQIEngine, the GPS clock and the SDS011 scheduler. The
+ * replay clock jumps from event to event, so a week of input takes
+ * minutes and the output is always the same:
+ *
+ *   trace_replay [-v] <trace.bin> [config.txt]      data.txt records on stdout
+ *   trace_replay [-v] --sample <out.bin> [minutes]  record one (default 3 min)
+ *
+ * The replay runs with the unit's config.txt (the card's other files, e.g.
+ * /calib.txt or /adc_cal.txt, go next to it in the same directory);
+ * without one it uses the settings --sample records with. -v sends the
+ * firmware's Serial log to stderr.
+ *
+ * --sample runs the same firmware against the simulated sensors of
+ * SimSensors.h, with the GPS losing its fix for a while, and records the
+ * trace the way the unit does. Its data.txt must come out of the replay
+ * unchanged - the recorder and replay checked against each other.
+ * check.sh records the 3 min sample and replays it, and both outputs must
+ * match the committed sample_trace.csv. A change to a driver or filter
+ * that alters the output shows up as a diff; regenerate the file with
+ * --sample when the change is intended.
+ *
+ * Build: ./build.sh
+ */
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "Esp32Host.h"
+#include "TraceRecorder.h"
+#include "TraceReplay.h"
+#include "SimSensors.h"
+
+#define SAMPLE_LOOP_MS 50       // Loop period of the simulated unit
+#define SAMPLE_FIX_LOSS 90000   // GPS loses its fix for 40 s from here
+
+// The settings --sample records with, and the replay default
+static const char sampleConfig[] =
+    "TRACE_enable=1\n"
+    "warmupTime=60000\n"
+    "warmupMinTime=20000\n"
+    "PM_period=60000\n"
+    "PM_window=20000\n"
+    "PM_spinup=10000\n";
+
+static TraceReplay replay;
+static bool recording = false;      // --sample: simulated clock and sensors
+static bool traceEnded = false;     // The firmware asked for a burst the trace does not have
+static uint64_t simNow = 0;
+static SimGPS simGPS;
+static SimSDS011 simSDS011;
+static SimENS160 simENS160;
+static SimGas simGas;
+
+// The firmware's recorder, taking the bursts from the trace in replay.
+// Recording stays off in replay whatever config.txt says.
+class ReplayTracer : public TraceRecorder<4096> { // TRACE_BUFFER_BYTES
+private:
+    bool _replaying = false;
+
+public:
+    void begin(bool enabled) {
+        _replaying = !recording;
+        TraceRecorder<4096>::begin(enabled && recording);
+    }
+
+    void adcBegin(uint8_t pin) {
+        if (!_replaying) {
+            TraceRecorder<4096>::adcBegin(pin);
+        } else if (!replay.nextBurst(pin)) {
+            traceEnded = true;
+        }
+    }
+};
+
+#define AQMS_TRACER ReplayTracer
+#include "../src/esp_main.cpp"
+
+// ENS160 registers as recorded
+class ReplayENS160 : public HostI2CDevice {
+public:
+    void writeReg(uint8_t, const uint8_t *, size_t) {}
+    size_t readReg(uint8_t reg, uint8_t *data, size_t len) {
+        return replay.readReg(ENS160_I2C_ADDRESS, reg, data, len);
+    }
+};
+static ReplayENS160 replayENS160;
+
+static void simRun(uint64_t until) {
+    while (simNow < until) {
+        simNow++;
+        simGPS.update(simNow);
+        simSDS011.update(simNow);
+        simENS160.update(simNow);
+    }
+}
+
+unsigned long millis() { return recording ? (unsigned long)simNow : replay.millis(); }
+unsigned long micros() { return millis() * 1000; }
+
+void delay(unsigned long ms) {
+    if (recording) simRun(simNow + ms);
+    else replay.runUntil(replay.now() + ms);
+}
+
+void yield() { delay(1); } // Busy waits (SDS011::waitReply) let a ms pass
+
+int analogRead(uint8_t pin) { return recording ? simGas.read(pin, simNow) : replay.analogRead(pin); }
+
+static uint64_t sleepUs = 0;
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return ESP_SLEEP_WAKEUP_UNDEFINED; }
+int esp_sleep_enable_timer_wakeup(uint64_t us) {
+    sleepUs = us;
+    return 0;
+}
+int esp_light_sleep_start() {
+    delay(sleepUs / 1000);
+    return 0;
+}
+void esp_deep_sleep_start() {
+    fprintf(stderr, "trace_replay: deep sleep (LP_mode=2) is not simulated\n");
+    exit(1);
+}
+
+// The card: a fresh directory with config.txt
+static char cardDir[] = "/tmp/aqms_card_XXXXXX";
+
+static bool copyFile(const char *from, FILE *to) {
+    FILE *in = fopen(from, "rb");
+    if (in == NULL) return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) fwrite(buf, 1, n, to);
+    fclose(in);
+    return true;
+}
+
+static bool setupCard(const char *configPath) {
+    if (mkdtemp(cardDir) == NULL) return false;
+    SD.setRoot(cardDir);
+    char path[SD_HOST_PATH];
+    snprintf(path, sizeof(path), "%s/config.txt", cardDir);
+    FILE *config = fopen(path, "wb");
+    if (config == NULL) return false;
+    bool ok = configPath != NULL ? copyFile(configPath, config) : fputs(sampleConfig, config) >= 0;
+    fclose(config);
+    return ok;
+}
+
+static void removeCard() {
+    DIR *dir = opendir(cardDir);
+    if (dir == NULL) return;
+    char path[SD_HOST_PATH + 256];
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cardDir, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cardDir);
+}
+
+static bool printData() {
+    char path[SD_HOST_PATH];
+    snprintf(path, sizeof(path), "%s/data.txt", cardDir);
+    fflush(stdout);
+    return copyFile(path, stdout);
+}
+
+static bool readWholeFile(const char *path, uint8_t *&data, size_t &size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (uint8_t *)malloc(length > 0 ? length : 1);
+    size = data != NULL ? fread(data, 1, length, f) : 0;
+    fclose(f);
+    return data != NULL && size == (size_t)length;
+}
+
+static int runReplay(const char *tracePath, const char *configPath) {
+    uint8_t *data;
+    size_t size;
+    if (!readWholeFile(tracePath, data, size)) {
+        fprintf(stderr, "cannot read %s\n", tracePath);
+        return 1;
+    }
+    if (!setupCard(configPath)) {
+        fprintf(stderr, "cannot set up the card directory (config %s)\n", configPath ? configPath : "built in");
+        return 1;
+    }
+    replay.begin(data, size);
+    SerialPM.attach(&replay.uart(TRACE_PM));
+    Serial2.attach(&replay.uart(TRACE_GPS));
+    Wire.attach(ENS160_I2C_ADDRESS, &replayENS160);
+
+    setup();
+    while (!traceEnded && replay.runToNextPass()) loop();
+
+    bool printed = printData();
+    removeCard();
+    fprintf(stderr, "%s: %lu events, %lu lost while recording, %lu boots, %lu bursts not taken, %.1f h replayed\n",
+            tracePath, (unsigned long)replay.events(), (unsigned long)replay.lost(),
+            (unsigned long)replay.boots(), (unsigned long)replay.skipped(), replay.now() / 3600000.0);
+    free(data);
+    return printed ? 0 : 1;
+}
+
+static int writeSample(const char *tracePath, unsigned minutes) {
+    recording = true;
+    if (!setupCard(NULL)) {
+        fprintf(stderr, "cannot set up the card directory\n");
+        return 1;
+    }
+    simGPS.lossFrom = SAMPLE_FIX_LOSS;
+    simGPS.lossUntil = SAMPLE_FIX_LOSS + 40000;
+    simGas.add(MG811_PIN, 1100);
+    simGas.add(MQ136_PIN, 1200);
+    simGas.add(MQ4_PIN, 900);
+    simGas.add(MICS_NOX_PIN, 420); // The MICS driver scales to 10 bits
+    simGas.add(MICS_RED_PIN, 610);
+    SerialPM.attach(&simSDS011);
+    Serial2.attach(&simGPS);
+    Wire.attach(ENS160_I2C_ADDRESS, &simENS160);
+
+    setup();
+    while (simNow < minutes * 60000ULL) {
+        loop();
+        simRun(simNow + SAMPLE_LOOP_MS);
+    }
+    trace.flush(storage, TRACE_PATH);
+
+    char path[SD_HOST_PATH];
+    snprintf(path, sizeof(path), "%s%s", cardDir, TRACE_PATH);
+    FILE *out = fopen(tracePath, "wb");
+    bool written = out != NULL && copyFile(path, out);
+    if (out != NULL) fclose(out);
+    bool printed = printData();
+    removeCard();
+    if (!written) {
+        fprintf(stderr, "cannot write %s\n", tracePath);
+        return 1;
+    }
+    fprintf(stderr, "%s: %u min recorded, %lu events lost, %lu SDS011 commands, %lu frames\n",
+            tracePath, minutes, (unsigned long)trace.lost(), (unsigned long)simSDS011.commands(),
+            (unsigned long)simSDS011.frames());
+    return printed ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    int arg = 1;
+    Serial.setOutput(NULL);
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        Serial.setOutput(stderr);
+        arg++;
+    }
+    if (arg + 1 < argc && strcmp(argv[arg], "--sample") == 0) {
+        return writeSample(argv[arg + 1], arg + 2 < argc ? (unsigned)atoi(argv[arg + 2]) : 3);
+    }
+    if (arg >= argc || argv[arg][0] == '-') {
+        fprintf(stderr, "usage: trace_replay [-v] <trace.bin> [config.txt]\n"
+                        "       trace_replay [-v] --sample <out.bin> [minutes]\n");
+        return 2;
+    }
+    return runReplay(argv[arg], arg + 1 < argc ? argv[arg + 1] : NULL);
+}
@@ -0,0 +1,188 @@
+#ifndef _ADC_CALIBRATION_H_
+#define _ADC_CALIBRATION_H_
+
+/*
+ * ADC Calibration
+ *
+ * Per-unit correction of the ESP32 ADC transfer curve. A one-time capture
+ * procedure records a handful of (raw code, ideal code) points against known
+ * reference voltages; build() then expands them into a 4096-entry lookup
+ * table so every analogRead() can be corrected with a single array access.
+ *
+ * Benefits:
+ * - Removes the ADC non-linearity and Vref spread instead of averaging over it
+ * - O(1) correction per sample, so fewer samples are needed per reading
+ * - Points are stored as "raw=ideal" lines (same style as config.txt) on SD
+ *   and as a blob in NVS on ESP32
+ *
+ * The two ESP32 ADC units have their own transfer curves, so a board keeps
+ * one table per unit, each captured on a pin of that unit and stored under
+ * its own file and NVS namespace.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#ifdef ESP32
+#include <Preferences.h>
+#endif
+
+#define ADC_CAL_MAX_POINTS 16     // Maximum number of captured reference points
+#define ADC_CAL_LUT_SIZE   4096   // One entry per 12-bit ADC code
+#define ADC_CAL_NVS_NAMESPACE "adc_cal"
+
+class ADCCalibration {
+private:
+    uint16_t _raw[ADC_CAL_MAX_POINTS];   // Measured ADC code, sorted ascending
+    uint16_t _ideal[ADC_CAL_MAX_POINTS]; // Code the ADC should have returned
+    uint8_t _count = 0;
+    bool _valid = false;
+    uint16_t _lut[ADC_CAL_LUT_SIZE];
+
+    // Linear interpolation/extrapolation on the segment [i, i+1]
+    uint16_t interpolate(uint8_t i, int32_t raw) const {
+        int32_t dr = (int32_t)_raw[i + 1] - _raw[i];
+        int32_t di = (int32_t)_ideal[i + 1] - _ideal[i];
+        int32_t out = _ideal[i] + ((raw - _raw[i]) * di + dr / 2) / dr;
+        if (out < 0) out = 0;
+        if (out > ADC_CAL_LUT_SIZE - 1) out = ADC_CAL_LUT_SIZE - 1;
+        return (uint16_t)out;
+    }
+
+public:
+    ADCCalibration() {
+        reset();
+    }
+
+    // Drop all points and fall back to the identity mapping
+    void reset() {
+        _count = 0;
+        _valid = false;
+        for (uint16_t i = 0; i < ADC_CAL_LUT_SIZE; i++) {
+            _lut[i] = i;
+        }
+    }
+
+    // Add a reference point, keeping the table sorted by raw code
+    bool addPoint(uint16_t raw, uint16_t ideal) {
+        if (_count >= ADC_CAL_MAX_POINTS || raw >= ADC_CAL_LUT_SIZE || ideal >= ADC_CAL_LUT_SIZE) {
+            return false;
+        }
+        uint8_t i = _count;
+        while (i > 0 && _raw[i - 1] > raw) {
+            _raw[i] = _raw[i - 1];
+            _ideal[i] = _ideal[i - 1];
+            i--;
+        }
+        if (i > 0 && _raw[i - 1] == raw) {
+            // Same raw code captured twice - keep the newest ideal value
+            for (uint8_t j = i; j < _count; j++) {
+                _raw[j] = _raw[j + 1];
+                _ideal[j] = _ideal[j + 1];
+            }
+            _ideal[i - 1] = ideal;
+            return true;
+        }
+        _raw[i] = raw;
+        _ideal[i] = ideal;
+        _count++;
+        return true;
+    }
+
+    // Expand the captured points into the lookup table (piecewise-linear)
+    bool build() {
+        if (_count < 2) {
+            reset();
+            return false;
+        }
+        uint8_t seg = 0;
+        for (uint16_t code = 0; code < ADC_CAL_LUT_SIZE; code++) {
+            while (seg < _count - 2 && code > _raw[seg + 1]) {
+                seg++;
+            }
+            _lut[code] = interpolate(seg, code);
+        }
+        _valid = true;
+        return true;
+    }
+
+    // Corrected ADC code for a raw 12-bit reading
+    inline uint16_t apply(uint16_t raw) const {
+        return _lut[raw & (ADC_CAL_LUT_SIZE - 1)];
+    }
+
+    bool valid() const { return _valid; }
+    uint8_t pointCount() const { return _count; }
+
+    // Read "raw=ideal" lines (e.g. from an SD file) and build the table
+    bool load(Stream &in) {
+        reset();
+        char line[24];
+        uint8_t len = 0;
+        while (in.available()) {
+            char c = in.read();
+            if (c != '\n' && len < sizeof(line) - 1) {
+                if (c != '\r') line[len++] = c;
+                continue;
+            }
+            line[len] = '\0';
+            len = 0;
+            char *sep = strchr(line, '=');
+            if (sep != NULL) {
+                *sep = '\0';
+                addPoint((uint16_t)atoi(line), (uint16_t)atoi(sep + 1));
+            }
+        }
+        if (len > 0) {
+            line[len] = '\0';
+            char *sep = strchr(line, '=');
+            if (sep != NULL) {
+                *sep = '\0';
+                addPoint((uint16_t)atoi(line), (uint16_t)atoi(sep + 1));
+            }
+        }
+        return build();
+    }
+
+    // Write the captured points as "raw=ideal" lines
+    void save(Print &out) const {
+        for (uint8_t i = 0; i < _count; i++) {
+            out.print(_raw[i]);
+            out.print('=');
+            out.println(_ideal[i]);
+        }
+    }
+
+#ifdef ESP32
+    bool loadNVS(const char *space = ADC_CAL_NVS_NAMESPACE) {
+        Preferences prefs;
+        if (!prefs.begin(space, true)) return false;
+        uint8_t count = prefs.getUChar("count", 0);
+        bool ok = count >= 2 && count <= ADC_CAL_MAX_POINTS
+               && prefs.getBytes("raw", _raw, count * sizeof(uint16_t)) == count * sizeof(uint16_t)
+               && prefs.getBytes("ideal", _ideal, count * sizeof(uint16_t)) == count * sizeof(uint16_t);
+        prefs.end();
+        if (!ok) {
+            reset();
+            return false;
+        }
+        _count = count;
+        return build();
+    }
+
+    bool saveNVS(const char *space = ADC_CAL_NVS_NAMESPACE) const {
+        Preferences prefs;
+        if (!prefs.begin(space, false)) return false;
+        prefs.putUChar("count", _count);
+        prefs.putBytes("raw", _raw, _count * sizeof(uint16_t));
+        prefs.putBytes("ideal", _ideal, _count * sizeof(uint16_t));
+        prefs.end();
+        return true;
+    }
+#else
+    bool loadNVS(const char * = ADC_CAL_NVS_NAMESPACE) { return false; }
+    bool saveNVS(const char * = ADC_CAL_NVS_NAMESPACE) const { return false; }
+#endif
+};
+
+#endif // _ADC_CALIBRATION_H_
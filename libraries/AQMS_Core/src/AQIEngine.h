@@ -0,0 +1,339 @@
+#ifndef _AQI_ENGINE_H_
+#define _AQI_ENGINE_H_
+
+/*
+ * AQI Engine
+ *
+ * On-device Air Quality Index from the logged pollutant channels, against
+ * a selectable breakpoint table (India NAQI or US EPA).
+ *
+ * Samples are averaged per minute; each closed minute goes into a ring of
+ * minute means, and the 1 h / 8 h / 24 h window sums are kept running - the
+ * minute that enters is added and the one that leaves each window is
+ * subtracted, so an update is O(1) whatever the window length. A window
+ * counts once 75 % of its minutes have data, as the standards require of
+ * their averages. A unit that samples less often than once a minute (a
+ * measurement window every LP_interval in light-sleep mode) sets its
+ * sample interval, and 75 % of the minutes it samples in are enough.
+ *
+ * Each pollutant's sub-index interpolates its window average over the
+ * table's breakpoints; the AQI is the highest sub-index and that pollutant
+ * is the dominant one. NAQI needs at least three pollutants, one of them
+ * PM2.5 or PM10; EPA reports from any one.
+ *
+ * Concentrations come in the firmware's units (PM in ug/m3, gases in ppm)
+ * and each table converts them to its own (ppb, ug/m3 or mg/m3 at 25 C).
+ *
+ *   AQIEngine aqi;
+ *   aqi.setStandard(aqiNAQI);
+ *   aqi.setSampleInterval(300000);                          // if sampled every 5 min
+ *   aqi.sample(millis(), pm25, pm10, co, no2, so2, nh3);   // every cycle
+ *   if (aqi.valid()) Serial.println(aqi.index());
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define AQI_MINUTE_MS 60000UL
+#define AQI_COVERAGE_NUM 3      // A window needs 3/4 of its minutes
+#define AQI_COVERAGE_DEN 4
+#define AQI_MAX 500             // Concentrations above a table's top row cap here
+
+// Pollutant codes, also the logged "aqi_pollutant" value
+enum AQIPollutant { AQI_NONE, AQI_PM25, AQI_PM10, AQI_CO, AQI_NO2, AQI_SO2, AQI_NH3, AQI_POLLUTANTS };
+
+// Averaging windows
+enum AQIWindow { AQI_1H, AQI_8H, AQI_24H, AQI_WINDOWS };
+
+const uint16_t aqiWindowMinutes[AQI_WINDOWS] = {60, 480, 1440};
+
+inline const char *aqiPollutantName(uint8_t pollutant) {
+    static const char *const names[AQI_POLLUTANTS] = {"none", "PM2.5", "PM10", "CO", "NO2", "SO2", "NH3"};
+    return pollutant < AQI_POLLUTANTS ? names[pollutant] : names[AQI_NONE];
+}
+
+// One breakpoint row: concentrations cLo..cHi map linearly onto iLo..iHi
+struct AQISegment {
+    float cLo, cHi;
+    uint16_t iLo, iHi;
+};
+
+struct AQITable {
+    const AQISegment *segments;     // NULL = pollutant not in this standard
+    uint8_t count;
+    uint8_t window;                 // AQIWindow
+    float scale;                    // Firmware units -> table units
+    float step;                     // Truncate to this before the lookup (0 = none)
+};
+
+struct AQIStandard {
+    const char *name;
+    AQITable tables[AQI_POLLUTANTS]; // Indexed by AQIPollutant, [AQI_NONE] unused
+    uint8_t minPollutants;
+    bool needsPM;                   // One of them must be PM2.5 or PM10
+    uint16_t categoryTop[6];        // Highest index of each category
+    const char *categories[6];
+};
+
+// US EPA (2024 PM2.5 revision). CO in ppm, NO2 / SO2 in ppb.
+const AQISegment aqiEpaPM25[] = {{0, 9.0f, 0, 50}, {9.1f, 35.4f, 51, 100}, {35.5f, 55.4f, 101, 150},
+                                 {55.5f, 125.4f, 151, 200}, {125.5f, 225.4f, 201, 300}, {225.5f, 325.4f, 301, 500}};
+const AQISegment aqiEpaPM10[] = {{0, 54, 0, 50}, {55, 154, 51, 100}, {155, 254, 101, 150},
+                                 {255, 354, 151, 200}, {355, 424, 201, 300}, {425, 604, 301, 500}};
+const AQISegment aqiEpaCO[] = {{0, 4.4f, 0, 50}, {4.5f, 9.4f, 51, 100}, {9.5f, 12.4f, 101, 150},
+                               {12.5f, 15.4f, 151, 200}, {15.5f, 30.4f, 201, 300}, {30.5f, 50.4f, 301, 500}};
+const AQISegment aqiEpaNO2[] = {{0, 53, 0, 50}, {54, 100, 51, 100}, {101, 360, 101, 150},
+                                {361, 649, 151, 200}, {650, 1249, 201, 300}, {1250, 2049, 301, 500}};
+const AQISegment aqiEpaSO2[] = {{0, 35, 0, 50}, {36, 75, 51, 100}, {76, 185, 101, 150},
+                                {186, 304, 151, 200}, {305, 604, 201, 300}, {605, 1004, 301, 500}};
+
+const AQIStandard aqiEPA = {
+    "EPA",
+    {{NULL, 0, 0, 0, 0},
+     {aqiEpaPM25, 6, AQI_24H, 1, 0.1f},
+     {aqiEpaPM10, 6, AQI_24H, 1, 1},
+     {aqiEpaCO, 6, AQI_8H, 1, 0.1f},
+     {aqiEpaNO2, 6, AQI_1H, 1000, 1},
+     {aqiEpaSO2, 6, AQI_1H, 1000, 1},
+     {NULL, 0, 0, 0, 0}},
+    1, false,
+    {50, 100, 150, 200, 300, AQI_MAX},
+    {"Good", "Moderate", "Unhealthy for Sensitive Groups", "Unhealthy", "Very Unhealthy", "Hazardous"}};
+
+// India NAQI (CPCB). PM and gases in ug/m3, CO in mg/m3; ppm converts at 25 C (24.45 l/mol).
+const AQISegment aqiNaqiPM25[] = {{0, 30, 0, 50}, {30, 60, 50, 100}, {60, 90, 100, 200},
+                                  {90, 120, 200, 300}, {120, 250, 300, 400}, {250, 380, 400, 500}};
+const AQISegment aqiNaqiPM10[] = {{0, 50, 0, 50}, {50, 100, 50, 100}, {100, 250, 100, 200},
+                                  {250, 350, 200, 300}, {350, 430, 300, 400}, {430, 510, 400, 500}};
+const AQISegment aqiNaqiCO[] = {{0, 1, 0, 50}, {1, 2, 50, 100}, {2, 10, 100, 200},
+                                {10, 17, 200, 300}, {17, 34, 300, 400}, {34, 51, 400, 500}};
+const AQISegment aqiNaqiNO2[] = {{0, 40, 0, 50}, {40, 80, 50, 100}, {80, 180, 100, 200},
+                                 {180, 280, 200, 300}, {280, 400, 300, 400}, {400, 520, 400, 500}};
+const AQISegment aqiNaqiSO2[] = {{0, 40, 0, 50}, {40, 80, 50, 100}, {80, 380, 100, 200},
+                                 {380, 800, 200, 300}, {800, 1600, 300, 400}, {1600, 2400, 400, 500}};
+const AQISegment aqiNaqiNH3[] = {{0, 200, 0, 50}, {200, 400, 50, 100}, {400, 800, 100, 200},
+                                 {800, 1200, 200, 300}, {1200, 1800, 300, 400}, {1800, 2400, 400, 500}};
+
+const AQIStandard aqiNAQI = {
+    "NAQI",
+    {{NULL, 0, 0, 0, 0},
+     {aqiNaqiPM25, 6, AQI_24H, 1, 0},
+     {aqiNaqiPM10, 6, AQI_24H, 1, 0},
+     {aqiNaqiCO, 6, AQI_8H, 28.01f / 24.45f, 0},
+     {aqiNaqiNO2, 6, AQI_24H, 46.01f * 1000 / 24.45f, 0},
+     {aqiNaqiSO2, 6, AQI_24H, 64.07f * 1000 / 24.45f, 0},
+     {aqiNaqiNH3, 6, AQI_24H, 17.03f * 1000 / 24.45f, 0}},
+    3, true,
+    {50, 100, 200, 300, 400, AQI_MAX},
+    {"Good", "Satisfactory", "Moderate", "Poor", "Very Poor", "Severe"}};
+
+// Sub-index of one concentration (table units); NAN when there is no table
+inline float aqiSubIndex(const AQITable &table, float c) {
+    if (table.segments == NULL || isnan(c)) return NAN;
+    if (c < 0) c = 0;
+    if (table.step > 0) c = floor(c / table.step + 1e-4f) * table.step;
+    for (uint8_t i = 0; i < table.count; i++) {
+        const AQISegment &s = table.segments[i];
+        // c <= cHi of this row; truncation leaves nothing between rows
+        if (c <= s.cHi + table.step / 2) {
+            if (c < s.cLo) c = s.cLo;
+            return floor((s.iHi - s.iLo) * (c - s.cLo) / (s.cHi - s.cLo) + s.iLo + 0.5f);
+        }
+    }
+    return AQI_MAX;
+}
+
+// Ring of minute means with running sums over every window that fits in it
+template <uint16_t Minutes>
+class MinuteWindow {
+private:
+    float _mean[Minutes];           // NAN = no samples that minute
+    uint16_t _head = Minutes - 1;   // Newest closed minute
+    double _sum[AQI_WINDOWS];
+    uint16_t _count[AQI_WINDOWS];
+    float _minuteSum = 0;
+    uint32_t _minuteSamples = 0;
+
+    // Close the current minute into the ring, O(windows)
+    void push(float mean) {
+        _head = _head + 1 == Minutes ? 0 : _head + 1;
+        for (uint8_t w = 0; w < AQI_WINDOWS; w++) {
+            uint16_t length = aqiWindowMinutes[w];
+            if (length > Minutes) break;
+            // The minute leaving a full-ring window is the one being overwritten
+            uint16_t leaving = _head >= length ? _head - length : _head + Minutes - length;
+            if (!isnan(_mean[leaving])) {
+                _sum[w] -= _mean[leaving];
+                _count[w]--;
+            }
+            if (!isnan(mean)) {
+                _sum[w] += mean;
+                _count[w]++;
+            }
+        }
+        _mean[_head] = mean;
+    }
+
+public:
+    MinuteWindow() { clear(); }
+
+    void clear() {
+        for (uint16_t i = 0; i < Minutes; i++) _mean[i] = NAN;
+        for (uint8_t w = 0; w < AQI_WINDOWS; w++) {
+            _sum[w] = 0;
+            _count[w] = 0;
+        }
+        _minuteSum = 0;
+        _minuteSamples = 0;
+    }
+
+    // A sample for the current minute; NAN and negative values are dropped
+    void add(float value) {
+        if (!(value >= 0) || isinf(value)) return;
+        _minuteSum += value;
+        _minuteSamples++;
+    }
+
+    // Close the current minute and `minutes - 1` empty ones after it
+    void advance(uint32_t minutes) {
+        if (minutes == 0) return;
+        if (minutes > Minutes) {
+            clear();
+            return;
+        }
+        push(_minuteSamples > 0 ? _minuteSum / _minuteSamples : NAN);
+        _minuteSum = 0;
+        _minuteSamples = 0;
+        for (uint32_t i = 1; i < minutes; i++) push(NAN);
+    }
+
+    // Mean over the window, NAN until 75 % of the minutes that can have
+    // data do: all of them, or one per `interval` ms when sampled less often
+    float average(uint8_t window, uint32_t interval = AQI_MINUTE_MS) const {
+        uint16_t length = aqiWindowMinutes[window];
+        if (length > Minutes || _count[window] == 0) return NAN;
+        uint32_t expected = length;
+        if (interval > AQI_MINUTE_MS) expected = (uint32_t)((uint64_t)length * AQI_MINUTE_MS / interval);
+        if ((uint32_t)_count[window] * AQI_COVERAGE_DEN < expected * AQI_COVERAGE_NUM) return NAN;
+        return _sum[window] / _count[window];
+    }
+
+    // Minutes with data in the window
+    uint16_t coverage(uint8_t window) const { return aqiWindowMinutes[window] <= Minutes ? _count[window] : 0; }
+};
+
+class AQIEngine {
+private:
+    // CO is only ever averaged over 8 h, the rest over up to 24 h (~31 KB in all)
+    MinuteWindow<1440> _pm25, _pm10, _no2, _so2, _nh3;
+    MinuteWindow<480> _co;
+    const AQIStandard *_standard = &aqiNAQI;
+    uint32_t _minuteStart = 0;
+    uint32_t _interval = AQI_MINUTE_MS; // Time between samples, once a minute or less often
+    bool _started = false;
+    float _sub[AQI_POLLUTANTS];
+    float _index = NAN;
+    uint8_t _dominant = AQI_NONE;
+
+    float average(uint8_t pollutant, uint8_t window) const {
+        switch (pollutant) {
+            case AQI_PM25: return _pm25.average(window, _interval);
+            case AQI_PM10: return _pm10.average(window, _interval);
+            case AQI_CO:   return _co.average(window, _interval);
+            case AQI_NO2:  return _no2.average(window, _interval);
+            case AQI_SO2:  return _so2.average(window, _interval);
+            case AQI_NH3:  return _nh3.average(window, _interval);
+            default:       return NAN;
+        }
+    }
+
+    // Sub-indices and the overall index from the current window averages
+    void evaluate() {
+        uint8_t valid = 0;
+        bool hasPM = false;
+        _index = NAN;
+        _dominant = AQI_NONE;
+        _sub[AQI_NONE] = NAN;
+        for (uint8_t p = AQI_NONE + 1; p < AQI_POLLUTANTS; p++) {
+            const AQITable &table = _standard->tables[p];
+            _sub[p] = table.segments != NULL ? aqiSubIndex(table, average(p, table.window) * table.scale) : NAN;
+            if (isnan(_sub[p])) continue;
+            valid++;
+            if (p == AQI_PM25 || p == AQI_PM10) hasPM = true;
+            if (_dominant == AQI_NONE || _sub[p] > _index) {
+                _index = _sub[p];
+                _dominant = p;
+            }
+        }
+        if (valid < _standard->minPollutants || (_standard->needsPM && !hasPM)) {
+            _index = NAN;
+            _dominant = AQI_NONE;
+        }
+    }
+
+public:
+    AQIEngine() {
+        for (uint8_t p = 0; p < AQI_POLLUTANTS; p++) _sub[p] = NAN;
+    }
+
+    // Switch tables; the averages are kept
+    void setStandard(const AQIStandard &standard) {
+        _standard = &standard;
+        evaluate();
+    }
+
+    const AQIStandard &standard() const { return *_standard; }
+
+    // How often samples come (ms); up to a minute, every minute must have data
+    void setSampleInterval(uint32_t interval) {
+        _interval = interval > AQI_MINUTE_MS ? interval : AQI_MINUTE_MS;
+        evaluate();
+    }
+
+    // One reading of each pollutant (NAN = not available); O(1), the index
+    // is re-evaluated when a minute closes
+    void sample(uint32_t now, float pm25, float pm10, float co, float no2, float so2, float nh3) {
+        if (!_started) {
+            _minuteStart = now;
+            _started = true;
+        }
+        uint32_t minutes = (now - _minuteStart) / AQI_MINUTE_MS;
+        if (minutes > 0) {
+            _minuteStart += minutes * AQI_MINUTE_MS;
+            _pm25.advance(minutes);
+            _pm10.advance(minutes);
+            _co.advance(minutes);
+            _no2.advance(minutes);
+            _so2.advance(minutes);
+            _nh3.advance(minutes);
+            evaluate();
+        }
+        _pm25.add(pm25);
+        _pm10.add(pm10);
+        _co.add(co);
+        _no2.add(no2);
+        _so2.add(so2);
+        _nh3.add(nh3);
+    }
+
+    bool valid() const { return !isnan(_index); }
+    float index() const { return _index; }               // NAN until enough windows are covered
+    uint8_t dominant() const { return _dominant; }       // AQIPollutant
+    float subIndex(uint8_t pollutant) const { return pollutant < AQI_POLLUTANTS ? _sub[pollutant] : NAN; }
+
+    // Window average behind a sub-index, in the firmware's units
+    float concentration(uint8_t pollutant) const {
+        if (pollutant >= AQI_POLLUTANTS || _standard->tables[pollutant].segments == NULL) return NAN;
+        return average(pollutant, _standard->tables[pollutant].window);
+    }
+
+    const char *category() const {
+        if (!valid()) return "n/a";
+        for (uint8_t i = 0; i < 6; i++) {
+            if (_index <= _standard->categoryTop[i]) return _standard->categories[i];
+        }
+        return _standard->categories[5];
+    }
+};
+
+#endif // _AQI_ENGINE_H_
@@ -0,0 +1,282 @@
+#ifndef _ACQUISITION_CORE_H_
+#define _ACQUISITION_CORE_H_
+
+/*
+ * Acquisition Core
+ *
+ * The part of the firmware every board shares: config lookup, GPS
+ * position and the GPS-disciplined clock, the record layout, record
+ * output and the logging cadence. Boards differ only in the policies they plug in at
+ * compile time:
+ *
+ *   Storage - SDStorage, NoStorage, RamStorage<N>   (StoragePolicies.h / SDStorage.h)
+ *   ADC     - StableADC (ESP32, readStableADC) or RawADC (analogRead)
+ *   UART    - any serial class with available()/read(): HardwareSerial,
+ *             SoftwareSerial, or a host stand-in
+ *
+ * Policies are template parameters, so every call is resolved at compile
+ * time - the abstraction costs nothing per cycle. The core has no
+ * dependency on the sensor drivers, so it can be benchmarked on the host.
+ *
+ * Record layout, schema RECORD_SCHEMA:
+ *
+ *   date, time, epoch_ms, lat, lng, <channel values>,
+ *   lat_status, lng_status, <name>_status per measured channel, schema
+ *
+ * The status columns hold STATUS_* bits (SensorRegistry.h); the position
+ * is STALE while it is held without a fix and FAULT before the first one.
+ * Records without the schema column are schema 1: values only.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <TinyGPSLite.h>
+
+#include "ConfigReader.h"
+#include "SensorRegistry.h"
+#include "StoragePolicies.h"
+#include "TimeService.h"
+
+#define AQMS_CONFIG_PATH "/config.txt"
+#define AQMS_CONFIG_VALUE_MAX 16
+#define AQMS_FIX_HOLD_MS 2000   // The position is kept this long after the last valid fix
+
+#define RECORD_SCHEMA 2         // Version of the record layout, last column of each record
+
+// Forward declaration of the global stable ADC function (ESP32 builds)
+uint16_t readStableADC(uint8_t pin);
+
+// ADC backends
+struct StableADC {
+    static inline uint16_t read(uint8_t pin) { return readStableADC(pin); }
+};
+
+struct RawADC {
+    static inline uint16_t read(uint8_t pin) { return analogRead(pin); }
+};
+
+// Only what the records use is decoded: position, date and time, all from
+// RMC. Define AQMS_GPS_FIELDS (TinyGPSLite.h flags) before including to
+// decode more.
+#ifndef AQMS_GPS_FIELDS
+#define AQMS_GPS_FIELDS (GPS_LOCATION | GPS_DATE | GPS_TIME)
+#endif
+
+typedef TinyGPSLite<AQMS_GPS_FIELDS> GPSParser;
+
+// GPS position, plus a GPS-disciplined clock for the record timestamps
+template <class UART>
+class GPSInput {
+private:
+    UART &_uart;
+    uint32_t _lastValidFix = 0;
+    uint64_t _nextSecond = 0;
+
+public:
+    GPSParser gps;
+    TimeService clock;
+    float lat = 0.0, lng = 0.0;
+    uint32_t date = 0, time = 0;    // YYYYMMDD and HHMMSS (local), 0 until the first GPS time
+    uint64_t epochMs = 0;           // UTC ms, uptime ms until the first GPS time
+
+    GPSInput(UART &uart) : _uart(uart) {}
+
+    UART &uart() { return _uart; }
+
+    // ms since the last valid fix, UINT32_MAX before the first
+    uint32_t fixAge(uint32_t now) const { return _lastValidFix == 0 ? UINT32_MAX : now - _lastValidFix; }
+
+    // STATUS_* bits of lat and lng
+    uint8_t status(uint32_t now) const {
+        uint32_t age = fixAge(now);
+        if (age == UINT32_MAX) return STATUS_FAULT;
+        return age < AQMS_FIX_HOLD_MS ? 0 : STATUS_STALE;
+    }
+
+    void setTimezone(float hours) { clock.setTimezone(hours); }
+
+    // Drain the UART, discipline the clock on every GPS time, take the
+    // position from every fix and advance the timestamp
+    void poll() {
+        // Process incoming GPS data
+        while (_uart.available() > 0) {
+            if (gps.encode(_uart.read())) {
+                if (gps.time.isUpdated() && gps.time.isValid() && gps.date.isValid()) {
+                    syncClock();
+                }
+                // isValid() stays set once a fix was seen; only a sentence
+                // with a fix ('A' RMC, quality > 0 GGA) updates the location.
+                // Reading lat() clears the flag for the next one.
+                if (gps.location.isUpdated()) {
+                    _lastValidFix = millis();
+                    lat = gps.location.lat();
+                    lng = gps.location.lng();
+                }
+            }
+        }
+
+        // Timestamp keeps running between fixes; the local date and time
+        // are recomputed once per second, including the day rollover
+        epochMs = clock.nowMs(monotonicMillis());
+        if (clock.synced() && epochMs >= _nextSecond) {
+            clock.localDateTime(epochMs, date, time);
+            _nextSecond = (epochMs / 1000 + 1) * 1000;
+        }
+    }
+
+private:
+    void syncClock() {
+        uint16_t year = gps.date.year();
+        uint8_t month = gps.date.month();
+        uint8_t day = gps.date.day();
+        uint8_t hour = gps.time.hour();
+        uint8_t minute = gps.time.minute();
+        uint8_t second = gps.time.second();
+
+        // Receivers report 2000-00-00 or 1980 before they know the date
+        if (year < 2020 || year > 2100 || month < 1 || month > 12 || day < 1 || day > 31 ||
+            hour > 23 || minute > 59 || second > 59) {
+            return;
+        }
+
+        uint64_t utc = (uint64_t)daysFromCivil(year, month, day) * 86400000ULL +
+                       (hour * 3600UL + minute * 60UL + second) * 1000ULL +
+                       gps.time.centisecond() * 10UL;
+        clock.sync(utc, monotonicMillis());
+        _nextSecond = 0; // Refresh date/time now
+    }
+};
+
+template <class Storage, class ADC, class UART>
+class AcquisitionCore {
+private:
+    uint32_t _lastCycle = 0;
+
+public:
+    Storage &storage;
+    GPSInput<UART> gps;
+
+    AcquisitionCore(Storage &storage, UART &gpsUart) : storage(storage), gps(gpsUart) {}
+
+    // Config lookup through the storage policy (NoStorage never finds a key)
+    bool readConfig(const char *name, char *value, size_t len) {
+        value[0] = '\0';
+        bool found = false;
+        bool opened = storage.readFile(AQMS_CONFIG_PATH, [&](Stream &file) {
+            found = findConfigValue(file, name, value, len);
+        });
+        if (!opened && Storage::persistent) {
+            Serial.println(F("SD Card: error on opening file config.txt"));
+        }
+        return found && value[0] != '\0';
+    }
+
+    bool readConfigFloat(const char *name, float &out) {
+        char value[AQMS_CONFIG_VALUE_MAX];
+        if (!readConfig(name, value, sizeof(value))) return false;
+        Serial.println(value);
+        out = atof(value);
+        return true;
+    }
+
+    bool readConfigInt(const char *name, int &out) {
+        char value[AQMS_CONFIG_VALUE_MAX];
+        if (!readConfig(name, value, sizeof(value))) return false;
+        Serial.println(value);
+        out = atoi(value);
+        return true;
+    }
+
+    bool readConfigULong(const char *name, unsigned long &out) {
+        char value[AQMS_CONFIG_VALUE_MAX];
+        if (!readConfig(name, value, sizeof(value))) return false;
+        Serial.println(value);
+        out = strtoul(value, NULL, 10);
+        return true;
+    }
+
+    // Take readings on every pin to settle the ADC input stage
+    void sweepADC(const uint8_t *pins, uint8_t count) {
+        for (uint8_t i = 0; i < count; i++) {
+            ADC::read(pins[i]);
+        }
+    }
+
+    // True once per interval; call every loop
+    bool cycleDue(uint32_t now, uint32_t interval) {
+        if (now - _lastCycle < interval) return false;
+        _lastCycle = now;
+        return true;
+    }
+
+    // Column header for data.txt and the Serial monitor
+    template <class Registry>
+    void printHeader(Print &out, Registry &sensors, const char *separator) {
+        out.print("date"); out.print(separator);
+        out.print("time"); out.print(separator);
+        out.print("epoch_ms"); out.print(separator);
+        out.print("lat"); out.print(separator);
+        out.print("lng");
+        sensors.printHeader(out, separator);
+        out.print(separator); out.print("lat_status");
+        out.print(separator); out.print("lng_status");
+        sensors.printStatusHeader(out, separator);
+        out.print(separator); out.print("schema");
+        out.println();
+    }
+
+    template <class Registry>
+    void printRecord(Print &out, Registry &sensors, const char *separator, uint8_t latLngDecimals) {
+        out.print(gps.date); out.print(separator);
+        out.print(gps.time); out.print(separator);
+        printUint64(out, gps.epochMs); out.print(separator);
+        out.print(gps.lat, latLngDecimals); out.print(separator);
+        out.print(gps.lng, latLngDecimals);
+        sensors.printValues(out, separator);
+        uint8_t position = gps.status(millis());
+        out.print(separator); out.print(position);
+        out.print(separator); out.print(position);
+        sensors.printStatus(out, separator);
+        out.print(separator); out.print(RECORD_SCHEMA);
+        out.println();
+    }
+
+    // The same record as a JSON object (HTTP /latest)
+    template <class Registry>
+    void printJson(Print &out, Registry &sensors) {
+        out.print("{\"date\":"); out.print(gps.date);
+        out.print(",\"time\":"); out.print(gps.time);
+        out.print(",\"epoch_ms\":"); printUint64(out, gps.epochMs);
+        out.print(",\"lat\":"); printJsonNumber(out, gps.lat, 6);
+        out.print(",\"lng\":"); printJsonNumber(out, gps.lng, 6);
+        uint8_t position = gps.status(millis());
+        out.print(",\"lat_status\":"); out.print(position);
+        out.print(",\"lng_status\":"); out.print(position);
+        sensors.printJson(out);
+        out.print(",\"schema\":"); out.print(RECORD_SCHEMA);
+        out.print('}');
+    }
+
+    template <class Registry>
+    void writeHeader(Registry &sensors) {
+        Print *out = storage.record();
+        if (out == NULL) return;
+        printHeader(*out, sensors, " , ");
+        storage.commit();
+    }
+
+    template <class Registry>
+    void writeRecord(Registry &sensors) {
+        Print *out = storage.record();
+        if (out == NULL) return;
+        printRecord(*out, sensors, ",", 6);
+        storage.commit();
+    }
+
+    template <class Registry>
+    void logRecord(Registry &sensors) {
+        printRecord(Serial, sensors, " | ", 4);
+    }
+};
+
+#endif // _ACQUISITION_CORE_H_
@@ -0,0 +1,117 @@
+#ifndef _ADAPTIVE_SAMPLER_H_
+#define _ADAPTIVE_SAMPLER_H_
+
+/*
+ * Adaptive Sampler
+ *
+ * Picks the number of ADC samples to average for each channel from the
+ * noise actually measured on that channel. Every burst updates a running
+ * estimate of the per-sample variance; the next burst uses the smallest
+ * count n for which the averaged reading meets the noise target:
+ *
+ *   sigma / sqrt(n) <= target   =>   n = ceil(sigma^2 / target^2)
+ *
+ * A quiet channel settles at the minimum count, a noisy one gets more, and
+ * nothing is spent on channels that are already clean.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define ADAPTIVE_MAX_CHANNELS 8
+
+class AdaptiveSampler {
+private:
+    struct Channel {
+        uint8_t pin;
+        uint8_t samples;     // Count chosen for the next burst
+        bool seeded;         // Variance estimate available
+        float variance;      // Running per-sample variance (ADC codes^2)
+    };
+
+    Channel _channels[ADAPTIVE_MAX_CHANNELS];
+    uint8_t _count = 0;
+    uint8_t _minSamples = 2;
+    uint8_t _maxSamples = 16;
+    float _target = 2.0;     // Target std-dev of the averaged reading (ADC codes)
+    float _alpha = 0.1;      // Smoothing of the variance estimate
+
+    Channel *find(uint8_t pin) {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_channels[i].pin == pin) return &_channels[i];
+        }
+        if (_count >= ADAPTIVE_MAX_CHANNELS) return NULL;
+        Channel &ch = _channels[_count++];
+        ch.pin = pin;
+        ch.samples = _maxSamples;
+        ch.seeded = false;
+        ch.variance = 0;
+        return &ch;
+    }
+
+    uint8_t choose(float variance) const {
+        float n = variance / (_target * _target);
+        if (n <= _minSamples) return _minSamples;
+        if (n >= _maxSamples) return _maxSamples;
+        return (uint8_t)ceil(n);
+    }
+
+public:
+    void setNoiseTarget(float target) {
+        if (target > 0) _target = target;
+    }
+
+    void setSampleRange(uint8_t minSamples, uint8_t maxSamples) {
+        if (minSamples < 2) minSamples = 2;  // Need two samples to see any noise
+        if (maxSamples < minSamples) maxSamples = minSamples;
+        _minSamples = minSamples;
+        _maxSamples = maxSamples;
+        for (uint8_t i = 0; i < _count; i++) {
+            _channels[i].samples = _channels[i].seeded ? choose(_channels[i].variance) : _maxSamples;
+        }
+    }
+
+    // Number of samples to take on this pin for the next burst
+    uint8_t samplesFor(uint8_t pin) {
+        Channel *ch = find(pin);
+        return ch ? ch->samples : _maxSamples;
+    }
+
+    // Feed back the burst that was just taken (sum and sum of squares)
+    void update(uint8_t pin, uint8_t n, uint32_t sum, uint64_t sumSq) {
+        Channel *ch = find(pin);
+        if (ch == NULL || n < 2) return;
+        // Exact integer form of the sample variance, avoids float cancellation
+        int64_t spread = (int64_t)n * (int64_t)sumSq - (int64_t)sum * (int64_t)sum;
+        float var = spread > 0 ? (float)spread / ((float)n * (n - 1)) : 0;
+        if (ch->seeded) {
+            ch->variance += _alpha * (var - ch->variance);
+        } else {
+            ch->variance = var;
+            ch->seeded = true;
+        }
+        ch->samples = choose(ch->variance);
+    }
+
+    // Expected std-dev of the averaged reading with the current count
+    float achievedNoise(uint8_t pin) {
+        Channel *ch = find(pin);
+        if (ch == NULL || !ch->seeded) return 0;
+        return sqrt(ch->variance / ch->samples);
+    }
+
+    // "pin:samples/noise" for every tracked channel
+    void printDiagnostics(Print &out) {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (i > 0) out.print(" | ");
+            out.print(_channels[i].pin);
+            out.print(':');
+            out.print(_channels[i].samples);
+            out.print('/');
+            out.print(achievedNoise(_channels[i].pin), 2);
+        }
+        out.println();
+    }
+};
+
+#endif // _ADAPTIVE_SAMPLER_H_
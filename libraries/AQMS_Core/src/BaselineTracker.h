@@ -0,0 +1,193 @@
+#ifndef _BASELINE_TRACKER_H_
+#define _BASELINE_TRACKER_H_
+
+/*
+ * Baseline Tracker
+ *
+ * Automatic baseline correction (ABC) for drifting metal-oxide and MG-811
+ * sensors, in the spirit of the ABC used by NDIR CO2 modules: somewhere in
+ * every few days the unit sees clean air, so the cleanest reading over a
+ * rolling N-day window is the clean-air baseline.
+ *
+ * Each channel is fed the R0 (or curve offset) that the current reading
+ * would imply if the air were clean. Within a day the values go into a
+ * log-spaced histogram around the current calibration (+/- 2 octaves), so
+ * an update is one log2 and one increment. At the end of the day the
+ * clean-air percentile of that histogram, interpolated within its bin, is
+ * pushed into a ring of daily values, and baseline() is the cleanest of
+ * them. The bins are 2^(4 / Bins) wide (~19 % at 16 bins, ~4.4 % at 64), so
+ * callers should move a stored value less than binWidth() per adjustment.
+ *
+ * "Clean" is the high end for reducing-gas sensors (Rs drops in gas) and the
+ * MG-811 (EMF drops with CO2), the low end for oxidising-gas sensors.
+ *
+ * BaselineClock times the samples and the end of each day on the record
+ * clock (UTC once the GPS time is known), so a day is a calendar day and
+ * not a day of uptime. save() and restore() carry a tracker through a deep
+ * sleep in a BaselineState kept in RTC memory.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define BASELINE_OCTAVES    4       // Histogram span: reference / 4 .. reference * 4
+#define BASELINE_PERCENTILE 0.9f    // Daily clean-air percentile (0.1 for clean-low channels)
+#define BASELINE_MIN_SAMPLES 60     // Fewest samples for a day to count
+#define BASELINE_STATE_MAGIC 0x41514243UL // "AQBC"
+
+// Sample and day timing on the record clock: epoch ms, UTC once synced and
+// uptime before. Plain data, so it can be kept in RTC memory with the trackers.
+struct BaselineClock {
+    uint64_t lastSample;
+    uint32_t day;       // Day number of the samples being collected
+    bool synced;        // `day` counts UTC days
+
+    bool sampleDue(uint64_t epochMs, uint32_t interval) const { return epochMs - lastSample >= interval; }
+
+    // Call when a due sample was taken; until then it stays due
+    void sampled(uint64_t epochMs) { lastSample = epochMs; }
+
+    // True once as epochMs enters a new day. When the GPS time first
+    // arrives the day under way carries on as the UTC day, without closing.
+    bool dayEnded(uint64_t epochMs, uint32_t dayLength, bool gpsTime) {
+        uint32_t today = (uint32_t)(epochMs / dayLength);
+        if (gpsTime != synced) {
+            synced = gpsTime;
+            day = today;
+            return false;
+        }
+        if (today == day) return false;
+        day = today;
+        return true;
+    }
+};
+
+// Tracker contents kept across a deep sleep. No constructor: it can live in
+// RTC memory (RTC_DATA_ATTR); the caller keeps a magic value next to it.
+template <uint8_t Bins, uint8_t Days>
+struct BaselineState {
+    uint16_t hist[Bins];
+    uint16_t samples;
+    float reference;
+    float daily[Days];
+    uint8_t dayCount;
+    uint8_t dayHead;
+    bool cleanHigh;
+};
+
+template <uint8_t Bins, uint8_t Days>
+class BaselineTracker {
+private:
+    uint16_t _hist[Bins];
+    uint16_t _samples = 0;
+    float _reference = 0;
+    float _daily[Days];
+    uint8_t _dayCount = 0;
+    uint8_t _dayHead = 0;
+    bool _cleanHigh = true;
+
+    // Bin edge i as a value, i = 0..Bins
+    float edge(float bin) const {
+        return _reference * pow(2.0f, bin * BASELINE_OCTAVES / Bins - BASELINE_OCTAVES / 2.0f);
+    }
+
+public:
+    BaselineTracker() {
+        memset(_hist, 0, sizeof(_hist));
+    }
+
+    // cleanHigh: clean air gives the highest values on this channel
+    void begin(float reference, bool cleanHigh) {
+        _cleanHigh = cleanHigh;
+        _dayCount = 0;
+        _dayHead = 0;
+        setReference(reference);
+    }
+
+    // Re-centre the histogram, e.g. after an adjustment; clears today's samples
+    void setReference(float reference) {
+        _reference = reference;
+        _samples = 0;
+        memset(_hist, 0, sizeof(_hist));
+    }
+
+    // O(1): one log2 and one counter increment
+    void add(float value) {
+        if (!(value > 0) || !(_reference > 0)) return;
+        float position = (log(value / _reference) / log(2.0f) + BASELINE_OCTAVES / 2.0f) * Bins / BASELINE_OCTAVES;
+        int16_t bin = position < 0 ? 0 : (position >= Bins ? Bins - 1 : (int16_t)position);
+        if (_hist[bin] < 0xFFFF) _hist[bin]++;
+        if (_samples < 0xFFFF) _samples++;
+    }
+
+    // Push today's clean-air percentile into the ring; false if too few samples
+    bool closeDay() {
+        if (_samples < BASELINE_MIN_SAMPLES) {
+            setReference(_reference);
+            return false;
+        }
+
+        // Walk in from the clean end until (1 - percentile) of samples are covered
+        uint32_t target = (uint32_t)(_samples * (1.0f - BASELINE_PERCENTILE));
+        uint32_t seen = 0;
+        float value = _reference;
+        for (uint8_t i = 0; i < Bins; i++) {
+            uint8_t bin = _cleanHigh ? Bins - 1 - i : i;
+            if (_hist[bin] == 0) continue;
+            if (seen + _hist[bin] > target) {
+                // Samples assumed spread evenly over the bin, counted from its clean edge
+                float fraction = (target - seen + 0.5f) / _hist[bin];
+                value = edge(_cleanHigh ? bin + 1 - fraction : bin + fraction);
+                break;
+            }
+            seen += _hist[bin];
+        }
+
+        _daily[_dayHead] = value;
+        _dayHead = (_dayHead + 1) % Days;
+        if (_dayCount < Days) _dayCount++;
+        setReference(_reference);
+        return true;
+    }
+
+    void save(BaselineState<Bins, Days> &state) const {
+        memcpy(state.hist, _hist, sizeof(_hist));
+        state.samples = _samples;
+        state.reference = _reference;
+        memcpy(state.daily, _daily, sizeof(_daily));
+        state.dayCount = _dayCount;
+        state.dayHead = _dayHead;
+        state.cleanHigh = _cleanHigh;
+    }
+
+    void restore(const BaselineState<Bins, Days> &state) {
+        memcpy(_hist, state.hist, sizeof(_hist));
+        _samples = state.samples;
+        _reference = state.reference;
+        memcpy(_daily, state.daily, sizeof(_daily));
+        _dayCount = state.dayCount < Days ? state.dayCount : Days;
+        _dayHead = state.dayHead % Days;
+        _cleanHigh = state.cleanHigh;
+    }
+
+    uint8_t days() const { return _dayCount; }
+    uint16_t samples() const { return _samples; }
+    float reference() const { return _reference; }
+
+    // Relative width of one bin
+    float binWidth() const { return pow(2.0f, (float)BASELINE_OCTAVES / Bins) - 1; }
+
+    // Cleanest daily value over the last `window` days (<= Days)
+    float baseline(uint8_t window = Days) const {
+        if (_dayCount == 0) return _reference;
+        if (window > _dayCount) window = _dayCount;
+        float best = _daily[(_dayHead + Days - 1) % Days];
+        for (uint8_t i = 1; i < window; i++) {
+            float v = _daily[(_dayHead + Days - 1 - i) % Days];
+            if (_cleanHigh ? v > best : v < best) best = v;
+        }
+        return best;
+    }
+};
+
+#endif // _BASELINE_TRACKER_H_
@@ -0,0 +1,283 @@
+#ifndef _CALIBRATION_STORE_H_
+#define _CALIBRATION_STORE_H_
+
+/*
+ * Calibration Store
+ *
+ * Persists per-sensor R0 / baseline values across reboots, so a restart
+ * (including a watchdog reset) loads the last good calibration in
+ * milliseconds instead of recalibrating in whatever air is present.
+ *
+ * Each slot holds a value, the GPS date of the calibration it came from
+ * and the date of the last recalibration attempt. The firmware names the
+ * slots; the store only knows their order. Two copies are kept: a text
+ * file on SD (same "key=value" style as config.txt)
+ *
+ *   version=2
+ *   MQ136_R0=12.3456,20261018,20261120
+ *
+ * and a checksummed blob in NVS (ESP32) or EEPROM (AVR), used when the SD
+ * copy is missing or from another version.
+ *
+ * Validity policy:
+ * - Wrong version, bad checksum, or a value that is not finite and > 0:
+ *   the slot is treated as empty and recalibrated once the sensor is warm
+ * - Older than maxAgeDays (once the GPS date is known): recalibrate, at
+ *   most once a day - a rejected attempt keeps the old date and is retried
+ *   the next day, not every check
+ * - A new value more than maxChange (relative) away from a valid stored one
+ *   is rejected, so booting in polluted air cannot overwrite a good baseline
+ * - Baseline correction moves the value with adjust(), which keeps the
+ *   calibration date, so the value still expires
+ *
+ * Version 1 files (no attempt date) still load; the NVS / EEPROM copy of
+ * an older version is ignored and rewritten from the SD copy.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ConfigReader.h"
+#include "TimeService.h"
+
+#ifdef ESP32
+#include <Preferences.h>
+#elif defined(__AVR__)
+#include <EEPROM.h>
+#endif
+
+#define CAL_STORE_VERSION 2
+#define CAL_STORE_SLOTS   8
+#define CAL_STORE_PATH    "/calib.txt"
+#define CAL_NVS_NAMESPACE "calib"
+#define CAL_EEPROM_ADDR   0
+
+struct CalibrationEntry {
+    float value;
+    uint32_t date;     // YYYYMMDD when captured, 0 if no GPS date yet
+    uint32_t tried;    // YYYYMMDD of the last recalibration attempt, 0 if none
+    uint8_t valid;
+};
+
+// Days since 1970-01-01 for a YYYYMMDD date (civil calendar)
+inline int32_t calDayNumber(uint32_t yyyymmdd) {
+    return daysFromCivil(yyyymmdd / 10000, (yyyymmdd / 100) % 100, yyyymmdd % 100);
+}
+
+class CalibrationStore {
+private:
+    const char *const *_names;
+    uint8_t _count;
+    CalibrationEntry _entries[CAL_STORE_SLOTS];
+    uint16_t _maxAgeDays = 30;
+    float _maxChange = 0.5;
+
+    // Packed image for NVS / EEPROM
+    struct Blob {
+        uint8_t version;
+        uint8_t count;
+        CalibrationEntry entries[CAL_STORE_SLOTS];
+        uint16_t checksum;
+    };
+
+    static uint16_t checksum(const uint8_t *data, size_t len) {
+        uint16_t a = 0, b = 0; // Fletcher-16
+        for (size_t i = 0; i < len; i++) {
+            a = (a + data[i]) % 255;
+            b = (b + a) % 255;
+        }
+        return (b << 8) | a;
+    }
+
+    static bool plausibleValue(float value) {
+        return !isnan(value) && !isinf(value) && value > 0;
+    }
+
+    int8_t slotOf(const char *name) const {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (strcmp(_names[i], name) == 0) return i;
+        }
+        return -1;
+    }
+
+    void toBlob(Blob &blob) const {
+        memset(&blob, 0, sizeof(blob));
+        blob.version = CAL_STORE_VERSION;
+        blob.count = _count;
+        memcpy(blob.entries, _entries, sizeof(_entries));
+        blob.checksum = checksum((const uint8_t *)&blob, offsetof(Blob, checksum));
+    }
+
+    bool fromBlob(const Blob &blob) {
+        if (blob.version != CAL_STORE_VERSION || blob.count != _count) return false;
+        if (blob.checksum != checksum((const uint8_t *)&blob, offsetof(Blob, checksum))) return false;
+        for (uint8_t i = 0; i < _count; i++) {
+            _entries[i] = blob.entries[i];
+            if (!plausibleValue(_entries[i].value)) _entries[i].valid = 0;
+        }
+        return true;
+    }
+
+public:
+    CalibrationStore(const char *const *names, uint8_t count)
+        : _names(names), _count(count < CAL_STORE_SLOTS ? count : CAL_STORE_SLOTS) {
+        clear();
+    }
+
+    void clear() {
+        memset(_entries, 0, sizeof(_entries));
+    }
+
+    void setMaxAgeDays(uint16_t days) { _maxAgeDays = days; }
+    void setMaxChange(float fraction) { _maxChange = fraction; }
+
+    bool has(uint8_t slot) const { return slot < _count && _entries[slot].valid; }
+    float value(uint8_t slot) const { return _entries[slot].value; }
+    uint32_t date(uint8_t slot) const { return _entries[slot].date; }
+    const char *name(uint8_t slot) const { return _names[slot]; }
+    uint8_t count() const { return _count; }
+
+    // Record a new calibration; false if it is not a usable value
+    bool set(uint8_t slot, float value, uint32_t date) {
+        if (slot >= _count || !plausibleValue(value)) return false;
+        _entries[slot].value = value;
+        _entries[slot].date = date;
+        _entries[slot].tried = date;
+        _entries[slot].valid = 1;
+        return true;
+    }
+
+    // Move a stored value (baseline correction); its date, and so its
+    // expiry, stay those of the calibration
+    bool adjust(uint8_t slot, float value) {
+        if (!has(slot) || !plausibleValue(value)) return false;
+        _entries[slot].value = value;
+        return true;
+    }
+
+    // Note a recalibration attempt, accepted or rejected
+    void attempted(uint8_t slot, uint32_t today) {
+        if (slot < _count) _entries[slot].tried = today;
+    }
+
+    // Stamp entries captured before the first GPS fix; true if any changed
+    bool stampDate(uint32_t today) {
+        bool changed = false;
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_entries[i].valid && _entries[i].date == 0 && today != 0) {
+                _entries[i].date = today;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // True when a new value is close enough to the stored one to replace it
+    bool acceptable(uint8_t slot, float value) const {
+        if (!plausibleValue(value)) return false;
+        if (!has(slot)) return true;
+        float stored = _entries[slot].value;
+        return fabs(value - stored) <= _maxChange * stored;
+    }
+
+    // True when the slot is stored but older than maxAgeDays and was not
+    // already tried today (needs a GPS date)
+    bool expired(uint8_t slot, uint32_t today) const {
+        if (!has(slot) || today == 0 || _entries[slot].date == 0) return false;
+        if (_entries[slot].tried == today) return false;
+        return calDayNumber(today) - calDayNumber(_entries[slot].date) > (int32_t)_maxAgeDays;
+    }
+
+    // Parse the SD text format; false unless the version is known
+    bool load(Stream &in) {
+        char line[CONFIG_LINE_MAX];
+        size_t pos = 0;
+        bool versionOk = false;
+
+        while (true) {
+            int c = in.available() ? in.read() : -1;
+            if (c != '\n' && c >= 0) {
+                if (pos < sizeof(line) - 1) line[pos++] = (char)c;
+                continue;
+            }
+            line[pos] = '\0';
+            pos = 0;
+
+            char *sep = strchr(line, '=');
+            if (sep != NULL) {
+                *sep = '\0';
+                char *key = configTrim(line);
+                char *value = configTrim(sep + 1);
+                if (strcmp(key, "version") == 0) {
+                    int version = atoi(value);
+                    versionOk = version >= 1 && version <= CAL_STORE_VERSION;
+                    if (!versionOk) return false;
+                } else if (versionOk) {
+                    int8_t slot = slotOf(key);
+                    char *comma = strchr(value, ',');
+                    char *tried = comma != NULL ? strchr(comma + 1, ',') : NULL;
+                    if (slot >= 0 && set(slot, atof(value), comma != NULL ? strtoul(comma + 1, NULL, 10) : 0)) {
+                        attempted(slot, tried != NULL ? strtoul(tried + 1, NULL, 10) : _entries[slot].date);
+                    }
+                }
+            }
+            if (c < 0) break;
+        }
+        return versionOk;
+    }
+
+    void save(Print &out) const {
+        out.print("version=");
+        out.println(CAL_STORE_VERSION);
+        for (uint8_t i = 0; i < _count; i++) {
+            if (!_entries[i].valid) continue;
+            out.print(_names[i]);
+            out.print('=');
+            out.print(_entries[i].value, 4);
+            out.print(',');
+            out.print(_entries[i].date);
+            out.print(',');
+            out.println(_entries[i].tried);
+        }
+    }
+
+#ifdef ESP32
+    bool loadNVS() {
+        Preferences prefs;
+        if (!prefs.begin(CAL_NVS_NAMESPACE, true)) return false;
+        Blob blob;
+        bool ok = prefs.getBytes("blob", &blob, sizeof(blob)) == sizeof(blob) && fromBlob(blob);
+        prefs.end();
+        return ok;
+    }
+
+    bool saveNVS() const {
+        Preferences prefs;
+        if (!prefs.begin(CAL_NVS_NAMESPACE, false)) return false;
+        Blob blob;
+        toBlob(blob);
+        bool ok = prefs.putBytes("blob", &blob, sizeof(blob)) == sizeof(blob);
+        prefs.end();
+        return ok;
+    }
+#elif defined(__AVR__)
+    bool loadNVS() {
+        Blob blob;
+        EEPROM.get(CAL_EEPROM_ADDR, blob);
+        return fromBlob(blob);
+    }
+
+    bool saveNVS() const {
+        Blob blob;
+        toBlob(blob);
+        EEPROM.put(CAL_EEPROM_ADDR, blob); // put() only rewrites changed bytes
+        return true;
+    }
+#else
+    bool loadNVS() { return false; }
+    bool saveNVS() const { return false; }
+#endif
+};
+
+#endif // _CALIBRATION_STORE_H_
@@ -0,0 +1,70 @@
+#ifndef _CONFIG_READER_H_
+#define _CONFIG_READER_H_
+
+/*
+ * Config Reader
+ *
+ * Looks up a "key = value" entry in config.txt without touching the heap.
+ * The file is scanned one line at a time through a fixed buffer, so setup()
+ * leaves no String fragments behind on a long-running board.
+ *
+ * - Leading/trailing whitespace around keys and values is ignored
+ * - A line longer than CONFIG_LINE_MAX - 1 characters is rejected, never
+ *   cut short: its key is reported as not found, with a Serial error
+ * - The caller owns the output buffer
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define CONFIG_LINE_MAX 128     // A 63 character WPA2 passphrase fits with its key
+
+// Strip leading and trailing whitespace in place, returns the new start
+inline char *configTrim(char *text) {
+    while (*text == ' ' || *text == '\t') text++;
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return text;
+}
+
+// Scan the stream for `name` and copy its value into `value` (len bytes).
+// Returns false and leaves `value` empty when the key is not present.
+inline bool findConfigValue(Stream &in, const char *name, char *value, size_t len) {
+    char line[CONFIG_LINE_MAX];
+    size_t pos = 0;
+    bool tooLong = false;
+    if (len == 0) return false;
+    value[0] = '\0';
+
+    while (true) {
+        int c = in.available() ? in.read() : -1;
+        if (c != '\n' && c >= 0) {
+            if (pos < sizeof(line) - 1) line[pos++] = (char)c;
+            else tooLong = true;
+            continue;
+        }
+        line[pos] = '\0';
+        pos = 0;
+
+        char *sep = strchr(line, '=');
+        if (sep != NULL && sep != line) {
+            *sep = '\0';
+            if (strcmp(configTrim(line), name) == 0) {
+                if (tooLong) {
+                    Serial.print(F("config.txt: "));
+                    Serial.print(name);
+                    Serial.println(F(" line too long - ignored"));
+                    return false;
+                }
+                strncpy(value, configTrim(sep + 1), len - 1);
+                value[len - 1] = '\0';
+                return true;
+            }
+        }
+        tooLong = false;
+        if (c < 0) return false;
+    }
+}
+
+#endif // _CONFIG_READER_H_
@@ -0,0 +1,169 @@
+#ifndef _CROSS_SENSITIVITY_H_
+#define _CROSS_SENSITIVITY_H_
+
+/*
+ * Cross Sensitivity
+ *
+ * The MQ-136 responds to SO2 and H2S, the MICS RED element to CO, H2,
+ * NH3, ethanol and methane, and every metal-oxide element to temperature
+ * and humidity; the per-gas curves each read one ratio and ignore the
+ * rest. This stage maps the whole input vector onto every gas at once:
+ *
+ *   x = [1, ln Rs/R0 MQ-136, ln Rs/R0 MQ-4, ln Rs/R0 MICS RED,
+ *        ln Rs/R0 MICS OX, ln(TVOC + 1), temperature, humidity]
+ *   y = W x                      one row per gas
+ *   ppm = exp(y)   (log rows)    or   ppm = y   (linear rows)
+ *
+ * W is fitted offline against co-located reference instruments
+ * (readData/fit_xsens.py) and loaded from /xsens.txt, one row per gas in
+ * the config.txt key=value style:
+ *
+ *   version=1
+ *   so2=log,-2.31,-1.92,0.04,0.11,0.02,0.01,0.003,0.001
+ *
+ * Gases without a row keep their own curve. The product is a fixed
+ * Outputs x 8 loop over contiguous floats, which the compiler unrolls
+ * (and vectorises where the target has SIMD); on the ESP32 it is 64
+ * multiply-adds per update.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define XSENS_VERSION 1
+#define XSENS_PATH    "/xsens.txt"
+
+// Model inputs, in the order of the coefficients on a row
+enum { XS_BIAS, XS_MQ136, XS_MQ4, XS_MICS_RED, XS_MICS_OX, XS_TVOC, XS_TEMPERATURE, XS_HUMIDITY, XS_INPUTS };
+
+// Column names of the input log (/xsens_log.txt) and the fitting tool
+const char *const xsensInputNames[XS_INPUTS] = {"bias", "ln_mq136", "ln_mq4", "ln_mics_red", "ln_mics_ox",
+                                                "ln_tvoc", "temperature", "humidity"};
+
+// Row modes
+enum { XSENS_OFF, XSENS_LINEAR, XSENS_LOG };
+
+// Feature vector from the raw inputs; false if a ratio is unusable (sensor
+// not calibrated, open circuit)
+inline bool xsensFeatures(float *x, float mq136, float mq4, float micsRed, float micsOx, float tvoc,
+                          float temperature, float humidity) {
+    const float ratios[4] = {mq136, mq4, micsRed, micsOx};
+    x[XS_BIAS] = 1;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (!(ratios[i] > 0) || isinf(ratios[i])) return false;
+        x[XS_MQ136 + i] = log(ratios[i]);
+    }
+    x[XS_TVOC] = log((tvoc > 0 ? tvoc : 0) + 1);
+    x[XS_TEMPERATURE] = temperature;
+    x[XS_HUMIDITY] = humidity;
+    return true;
+}
+
+template <uint8_t Outputs>
+class CrossSensitivity {
+private:
+    const char *const *_names;
+    float _w[Outputs][XS_INPUTS];
+    float _y[Outputs];
+    uint8_t _mode[Outputs];
+    uint8_t _rows = 0;
+    bool _valid = false;
+
+    // "mode,c0,...,c7" into row o
+    bool parseRow(uint8_t o, char *text) {
+        char *field = strtok(text, ",");
+        if (field == NULL) return false;
+        uint8_t mode = strcmp(field, "log") == 0 ? XSENS_LOG : (strcmp(field, "linear") == 0 ? XSENS_LINEAR : XSENS_OFF);
+        if (mode == XSENS_OFF) return false;
+        float w[XS_INPUTS];
+        for (uint8_t i = 0; i < XS_INPUTS; i++) {
+            field = strtok(NULL, ",");
+            if (field == NULL) return false;
+            char *end;
+            w[i] = strtod(field, &end);
+            if (end == field || isnan(w[i]) || isinf(w[i])) return false;
+        }
+        memcpy(_w[o], w, sizeof(w));
+        _mode[o] = mode;
+        return true;
+    }
+
+    void parseLine(char *line, bool &versionOk) {
+        char *sep = strchr(line, '=');
+        if (sep == NULL) return;
+        *sep = '\0';
+        char *key = line, *value = sep + 1;
+        while (*key == ' ') key++;
+        for (char *end = sep - 1; end >= key && *end == ' '; end--) *end = '\0';
+        while (*value == ' ') value++;
+        if (strcmp(key, "version") == 0) {
+            versionOk = atoi(value) == XSENS_VERSION;
+            return;
+        }
+        for (uint8_t o = 0; o < Outputs; o++) {
+            if (strcmp(key, _names[o]) == 0 && parseRow(o, value)) _rows++;
+        }
+    }
+
+public:
+    // names: one per output, as the rows in the file are keyed
+    explicit CrossSensitivity(const char *const *names) : _names(names) { clear(); }
+
+    void clear() {
+        memset(_w, 0, sizeof(_w));
+        memset(_mode, XSENS_OFF, sizeof(_mode));
+        _rows = 0;
+        _valid = false;
+    }
+
+    // Rows from /xsens.txt; false (and no rows) on a version mismatch
+    bool load(Stream &in) {
+        clear();
+        bool versionOk = false;
+        char line[160];
+        uint8_t len = 0;
+        while (in.available()) {
+            char c = in.read();
+            if (c != '\n' && len < sizeof(line) - 1) {
+                if (c != '\r') line[len++] = c;
+                continue;
+            }
+            line[len] = '\0';
+            len = 0;
+            parseLine(line, versionOk);
+        }
+        if (len > 0) {
+            line[len] = '\0';
+            parseLine(line, versionOk);
+        }
+        if (!versionOk) clear();
+        return _rows > 0;
+    }
+
+    uint8_t rows() const { return _rows; }
+    bool loaded() const { return _rows > 0; }
+
+    // y = W x for every row; x from xsensFeatures(), NULL when it failed
+    void update(const float *x) {
+        _valid = x != NULL;
+        if (!_valid) return;
+        for (uint8_t o = 0; o < Outputs; o++) {
+            const float *w = _w[o];
+            float y = 0;
+            for (uint8_t i = 0; i < XS_INPUTS; i++) y += w[i] * x[i];
+            _y[o] = y;
+        }
+        for (uint8_t o = 0; o < Outputs; o++) {
+            if (_mode[o] == XSENS_LOG) _y[o] = exp(_y[o]);
+            else if (_y[o] < 0) _y[o] = 0;
+        }
+    }
+
+    // True when output o has a row and the last update had valid inputs
+    bool active(uint8_t o) const { return _valid && _mode[o] != XSENS_OFF; }
+
+    float value(uint8_t o) const { return _y[o]; }
+};
+
+#endif // _CROSS_SENSITIVITY_H_
@@ -0,0 +1,115 @@
+#ifndef _FIXED_POINT_H_
+#define _FIXED_POINT_H_
+
+/*
+ * Fixed Point
+ *
+ * Q16.16 conversion kernels for boards without an FPU (ATmega). The gas
+ * curves are all power laws (ppm = a * ratio^b, co2 = 400^x), so the only
+ * transcendental functions needed are log2 and exp2. Both use 65-entry
+ * PROGMEM tables with linear interpolation (relative error below 0.01%),
+ * so a power law costs a few shifts and integer multiplies instead of a
+ * soft-float pow().
+ *
+ * Values outside the Q16.16 range (-32768 .. 32767.99998) saturate.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+typedef int32_t q16_t;
+
+#define Q16_ONE   65536L
+#define Q16_MAX   INT32_MAX
+#define Q16_MIN   INT32_MIN
+
+// log2(1 + i/64) in Q16.16, i = 0..64
+static const uint32_t Q16_LOG2_TABLE[65] PROGMEM = {
+    0UL, 1466UL, 2909UL, 4331UL, 5732UL, 7112UL, 8473UL, 9814UL,
+    11136UL, 12440UL, 13727UL, 14996UL, 16248UL, 17484UL, 18704UL, 19909UL,
+    21098UL, 22272UL, 23433UL, 24579UL, 25711UL, 26830UL, 27936UL, 29029UL,
+    30109UL, 31178UL, 32234UL, 33279UL, 34312UL, 35334UL, 36346UL, 37346UL,
+    38336UL, 39316UL, 40286UL, 41246UL, 42196UL, 43137UL, 44068UL, 44990UL,
+    45904UL, 46809UL, 47705UL, 48593UL, 49472UL, 50344UL, 51207UL, 52063UL,
+    52911UL, 53751UL, 54584UL, 55410UL, 56229UL, 57040UL, 57845UL, 58643UL,
+    59434UL, 60219UL, 60997UL, 61769UL, 62534UL, 63294UL, 64047UL, 64794UL,
+    65536UL
+};
+
+// 2^(i/64) in Q16.16, i = 0..64
+static const uint32_t Q16_EXP2_TABLE[65] PROGMEM = {
+    65536UL, 66250UL, 66971UL, 67700UL, 68438UL, 69183UL, 69936UL, 70698UL,
+    71468UL, 72246UL, 73032UL, 73828UL, 74632UL, 75444UL, 76266UL, 77096UL,
+    77936UL, 78785UL, 79642UL, 80510UL, 81386UL, 82273UL, 83169UL, 84074UL,
+    84990UL, 85915UL, 86851UL, 87796UL, 88752UL, 89719UL, 90696UL, 91684UL,
+    92682UL, 93691UL, 94711UL, 95743UL, 96785UL, 97839UL, 98905UL, 99982UL,
+    101070UL, 102171UL, 103283UL, 104408UL, 105545UL, 106694UL, 107856UL, 109031UL,
+    110218UL, 111418UL, 112631UL, 113858UL, 115098UL, 116351UL, 117618UL, 118899UL,
+    120194UL, 121502UL, 122825UL, 124163UL, 125515UL, 126882UL, 128263UL, 129660UL,
+    131072UL
+};
+
+// Conversions - use at setup or print time, not in the sample path
+inline q16_t q16FromFloat(float value) {
+    if (value >= 32767.0f) return Q16_MAX;
+    if (value <= -32768.0f) return Q16_MIN;
+    return (q16_t)(value * 65536.0f + (value >= 0 ? 0.5f : -0.5f));
+}
+
+inline float q16ToFloat(q16_t value) {
+    return (float)value / 65536.0f;
+}
+
+inline q16_t q16Saturate(int64_t value) {
+    if (value > Q16_MAX) return Q16_MAX;
+    if (value < Q16_MIN) return Q16_MIN;
+    return (q16_t)value;
+}
+
+inline q16_t q16Mul(q16_t a, q16_t b) {
+    return q16Saturate(((int64_t)a * b) >> 16);
+}
+
+// Interpolate a 65-entry table at a 16-bit fraction
+inline uint32_t q16Lookup(const uint32_t *table, uint16_t fraction) {
+    uint8_t i = fraction >> 10;               // 64 segments
+    uint32_t t = fraction & 0x3FF;            // Position inside the segment
+    uint32_t y0 = pgm_read_dword(&table[i]);
+    uint32_t y1 = pgm_read_dword(&table[i + 1]);
+    return y0 + (((y1 - y0) * t) >> 10);
+}
+
+// log2(x) for x > 0; returns Q16_MIN for x <= 0
+inline q16_t q16Log2(q16_t x) {
+    if (x <= 0) return Q16_MIN;
+    int8_t exponent = 0;
+    uint32_t m = (uint32_t)x;
+    while (m >= 2UL * Q16_ONE) { m >>= 1; exponent++; }
+    while (m < (uint32_t)Q16_ONE) { m <<= 1; exponent--; }
+    return (q16_t)exponent * Q16_ONE + (q16_t)q16Lookup(Q16_LOG2_TABLE, (uint16_t)(m - Q16_ONE));
+}
+
+// 2^y, saturating at Q16_MAX
+inline q16_t q16Exp2(q16_t y) {
+    int16_t whole = (int16_t)(y >> 16);       // floor(y)
+    uint32_t value = q16Lookup(Q16_EXP2_TABLE, (uint16_t)(y & 0xFFFF));
+    if (whole >= 15) return Q16_MAX;
+    if (whole <= -17) return 0;
+    if (whole >= 0) return q16Saturate((int64_t)value << whole);
+    return (q16_t)(value >> -whole);
+}
+
+// x^b for x > 0, via 2^(b * log2(x))
+inline q16_t q16Pow(q16_t x, q16_t b) {
+    if (x <= 0) return 0;
+    return q16Exp2(q16Mul(b, q16Log2(x)));
+}
+
+// a * x^b with log2(a) precomputed, via a single 2^(log2(a) + b * log2(x)).
+// Keeps full Q16.16 resolution on small results, unlike q16Mul(a, q16Pow(x, b)).
+inline q16_t q16PowerLaw(q16_t log2a, q16_t x, q16_t b) {
+    if (x <= 0) return 0;
+    return q16Exp2(q16Saturate((int64_t)log2a + q16Mul(b, q16Log2(x))));
+}
+
+#endif // _FIXED_POINT_H_
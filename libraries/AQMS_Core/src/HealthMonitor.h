@@ -0,0 +1,196 @@
+#ifndef _HEALTH_MONITOR_H_
+#define _HEALTH_MONITOR_H_
+
+/*
+ * Health Monitor
+ *
+ * Streaming fault checks on the acquisition inputs. A dead sensor rarely
+ * announces itself: a stuck ADC keeps returning the same code, a railed
+ * input makes a driver return its 1e12 sentinel, the SDS011 simply stops
+ * sending and the last average is held, and every one of those still
+ * turns into a plausible-looking number in data.txt. Each input (an ADC
+ * pin, the ENS160, the SDS011, the GPS) is a source, and every sample of
+ * a source is checked against its limits:
+ *
+ *   flatline   no change at all for flatMs
+ *   rail       at or past railLow / railHigh (ADC 0 or full scale, a
+ *              driver sentinel), or infinite
+ *   range      outside the plausible min..max
+ *   step       more than `step` away from the previous sample
+ *   missing    no sample (NAN), e.g. a window without SDS011 frames
+ *
+ * A check is a few compares on the sample and the source's last value and
+ * last-change time - no history, fixed memory per source. Conditions the
+ * samples cannot show (no GPS fix, an invalid R0) are set from outside
+ * with set().
+ *
+ * Each source keeps the conditions of its latest sample, the conditions
+ * seen since the last record (endRecord()) and a count per condition of
+ * how often it began. mask() has bit s set when source s had any
+ * condition during the record - the "fault" column.
+ *
+ * save() and restore() carry the checks through a deep sleep in a
+ * HealthState kept in RTC memory. Flatline time is awake time: a sensor
+ * is not sampled while the unit sleeps.
+ *
+ *   HealthMonitor<HS_COUNT> health(healthLimits);
+ *   health.sample(HS_MQ136, code, millis());
+ *   health.set(HS_GPS, fix ? 0 : HEALTH_MISSING);
+ *   record.fault = health.mask(); health.endRecord();
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define HEALTH_CONDITIONS 5
+#define HEALTH_STATE_MAGIC 0x41514853UL // "AQHS"
+
+// Condition bits, per source
+enum {
+    HEALTH_FLATLINE = 0x01,
+    HEALTH_RAIL     = 0x02,
+    HEALTH_RANGE    = 0x04,
+    HEALTH_STEP     = 0x08,
+    HEALTH_MISSING  = 0x10
+};
+
+const char *const healthConditionNames[HEALTH_CONDITIONS] = {"flatline", "rail", "range", "step", "missing"};
+
+struct HealthLimits {
+    float railLow, railHigh;    // At or past these the input is pinned
+    float min, max;             // Plausible values
+    float step;                 // Largest change between samples (0 = off)
+    uint32_t flatMs;            // Longest time without any change (0 = off)
+};
+
+// Check state kept across a deep sleep. No constructor: it can live in RTC
+// memory (RTC_DATA_ATTR); the caller keeps a magic value next to it.
+template <uint8_t Sources>
+struct HealthState {
+    float last[Sources];
+    uint32_t unchanged[Sources];        // ms without a change at save()
+    uint8_t sampled[Sources];
+    uint8_t external[Sources];
+    uint32_t count[Sources][HEALTH_CONDITIONS];
+    uint32_t seen;
+};
+
+template <uint8_t Sources>
+class HealthMonitor {
+private:
+    const HealthLimits *_limits;
+    float _last[Sources];
+    uint32_t _changed[Sources];         // millis() of the last change
+    uint8_t _sampled[Sources];          // Conditions of the latest sample
+    uint8_t _external[Sources];         // Conditions from set()
+    uint8_t _record[Sources];           // Conditions since endRecord()
+    uint32_t _count[Sources][HEALTH_CONDITIONS];
+    uint32_t _seen = 0;                 // Bit s: source s has a last value
+
+    // Count the conditions that were not active before
+    void account(uint8_t s, uint8_t before, uint8_t after) {
+        uint8_t began = after & ~before;
+        for (uint8_t c = 0; began != 0; c++, began >>= 1) {
+            if (began & 1) _count[s][c]++;
+        }
+        _record[s] |= after;
+    }
+
+public:
+    // limits: one entry per source
+    explicit HealthMonitor(const HealthLimits *limits) : _limits(limits) { reset(); }
+
+    void reset() {
+        memset(_sampled, 0, sizeof(_sampled));
+        memset(_external, 0, sizeof(_external));
+        memset(_record, 0, sizeof(_record));
+        memset(_count, 0, sizeof(_count));
+        _seen = 0;
+    }
+
+    // One sample of source s; now is millis()
+    void sample(uint8_t s, float value, uint32_t now) {
+        const HealthLimits &l = _limits[s];
+        uint32_t bit = 1UL << s;
+        uint8_t bits = 0;
+        if (isnan(value)) {
+            bits = HEALTH_MISSING;
+        } else if (isinf(value) || value <= l.railLow || value >= l.railHigh) {
+            bits = HEALTH_RAIL;
+        } else {
+            if (value < l.min || value > l.max) bits |= HEALTH_RANGE;
+            if (!(_seen & bit)) {
+                _changed[s] = now;
+                _seen |= bit;
+            } else if (value != _last[s]) {
+                if (l.step > 0 && fabs(value - _last[s]) > l.step) bits |= HEALTH_STEP;
+                _changed[s] = now;
+            } else if (l.flatMs > 0 && now - _changed[s] >= l.flatMs) {
+                bits |= HEALTH_FLATLINE;
+            }
+            _last[s] = value;
+        }
+        account(s, _sampled[s] | _external[s], bits | _external[s]);
+        _sampled[s] = bits;
+    }
+
+    // Conditions of source s known from outside the samples; replaces the last set()
+    void set(uint8_t s, uint8_t bits) {
+        account(s, _sampled[s] | _external[s], _sampled[s] | bits);
+        _external[s] = bits;
+    }
+
+    // Conditions of source s now / since the last endRecord()
+    uint8_t active(uint8_t s) const { return _sampled[s] | _external[s]; }
+    uint8_t flags(uint8_t s) const { return _record[s]; }
+
+    // Bit s set when source s had any condition since the last endRecord()
+    uint32_t mask() const {
+        uint32_t m = 0;
+        for (uint8_t s = 0; s < Sources; s++) {
+            if (_record[s] != 0) m |= 1UL << s;
+        }
+        return m;
+    }
+
+    // A record was written: start the next one with the conditions still active
+    void endRecord() {
+        for (uint8_t s = 0; s < Sources; s++) _record[s] = _sampled[s] | _external[s];
+    }
+
+    // now is millis() before the sleep / after the wake
+    void save(HealthState<Sources> &state, uint32_t now) const {
+        for (uint8_t s = 0; s < Sources; s++) {
+            state.last[s] = _last[s];
+            state.unchanged[s] = now - _changed[s];
+        }
+        memcpy(state.sampled, _sampled, sizeof(_sampled));
+        memcpy(state.external, _external, sizeof(_external));
+        memcpy(state.count, _count, sizeof(_count));
+        state.seen = _seen;
+    }
+
+    // Conditions active before the sleep stay active, so they are not counted again
+    void restore(const HealthState<Sources> &state, uint32_t now) {
+        for (uint8_t s = 0; s < Sources; s++) {
+            _last[s] = state.last[s];
+            _changed[s] = now - state.unchanged[s];
+        }
+        memcpy(_sampled, state.sampled, sizeof(_sampled));
+        memcpy(_external, state.external, sizeof(_external));
+        memcpy(_count, state.count, sizeof(_count));
+        _seen = state.seen;
+        endRecord();
+    }
+
+    // How often condition c (0 = flatline ... 4 = missing) began on source s
+    uint32_t count(uint8_t s, uint8_t c) const { return _count[s][c]; }
+
+    uint32_t total(uint8_t s) const {
+        uint32_t n = 0;
+        for (uint8_t c = 0; c < HEALTH_CONDITIONS; c++) n += _count[s][c];
+        return n;
+    }
+};
+
+#endif // _HEALTH_MONITOR_H_
@@ -0,0 +1,554 @@
+#ifndef _HTTP_DASHBOARD_H_
+#define _HTTP_DASHBOARD_H_
+
+/*
+ * HTTP Dashboard
+ *
+ * A small HTTP server for checking a unit in the field over WiFi:
+ *
+ *   GET /                      status page, refreshed from /latest and /stats
+ *   GET /latest                last logged record, JSON
+ *   GET /stats                 firmware counters, JSON
+ *   GET /history?from=&to=     data.txt lines with epoch_ms in [from, to], CSV
+ *
+ * No response is built in the connection buffer. /latest is written
+ * straight from a snapshot the firmware renders once per logging cycle, so
+ * requests never touch the sensors; /stats is rendered into its own buffer
+ * when asked for (a body that does not fit is answered with 500, never
+ * cut short); the page is written from flash; /history is streamed
+ * from the SD card one line at a time through the connection's buffer
+ * (header lines are always passed on, so the CSV stays self-describing).
+ *
+ * /history keeps a sparse index of the log: the lowest and highest
+ * epoch_ms of each HTTP_INDEX_SPAN-byte segment and whether it holds a
+ * header line. A scan that reaches the end of the indexed part extends it,
+ * and later requests jump over the segments with no header and no record
+ * in their range, so only the first request reads the whole log. When the
+ * table is full, neighbouring segments are merged and the span doubles.
+ *
+ * poll() accepts at most one connection and takes one bounded step per
+ * open connection: read request bytes, or write up to HTTP_WRITE_MAX bytes
+ * after scanning at most HTTP_SCAN_MAX bytes of the log. A slow client
+ * costs the loop a bounded slice, never a wait, and is dropped after
+ * HTTP_IDLE_TIMEOUT. The worst poll() time is kept for /stats.
+ *
+ * Server and Client are the Arduino WiFiServer / WiFiClient, or a host
+ * stand-in; Storage is a storage policy with readFileFrom().
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define HTTP_CONNECTIONS   2       // Requests served at the same time
+#define HTTP_BUFFER        384     // Request line, response header, one log line
+#define HTTP_SNAPSHOT_MAX  768     // /latest body
+#define HTTP_STATS_MAX     1024    // /stats body
+#define HTTP_WRITE_MAX     1460    // Bytes written per connection per poll (one TCP segment)
+#define HTTP_SCAN_MAX      2048    // Log bytes scanned per connection per poll
+#define HTTP_IDLE_TIMEOUT  5000    // ms without progress before a connection is dropped
+#define HTTP_INDEX_SIZE    64      // /history index segments
+#define HTTP_INDEX_SPAN    8192    // Log bytes per index segment, doubled when the index is full
+
+// Print into a fixed buffer; output past the end is dropped and flagged
+class HttpBufferPrint : public Print {
+private:
+    char *_buf;
+    uint16_t _cap;
+    uint16_t _len = 0;
+    bool _overflow = false;
+
+public:
+    HttpBufferPrint(char *buf, uint16_t cap) : _buf(buf), _cap(cap) {}
+
+    size_t write(uint8_t c) {
+        if (_len >= _cap) {
+            _overflow = true;
+            return 0;
+        }
+        _buf[_len++] = (char)c;
+        return 1;
+    }
+
+    uint16_t length() const { return _len; }
+    bool overflow() const { return _overflow; }
+    void clear() {
+        _len = 0;
+        _overflow = false;
+    }
+};
+
+// Status page; a string literal lives in flash on the ESP32
+static const char HTTP_PAGE[] =
+    "<!DOCTYPE html><html><head><meta name=viewport content=\"width=device-width\">"
+    "<title>AQMS</title><style>body{font-family:sans-serif}td{padding:2px 12px}</style>"
+    "</head><body><h3>AQMS</h3><table id=l></table><h4>Status</h4><table id=s></table>"
+    "<script>"
+    "function show(e,o){var h='';for(var k in o)h+='<tr><td>'+k+'<td>'+o[k];e.innerHTML=h}"
+    "function load(){"
+    "fetch('/latest').then(function(r){return r.json()}).then(function(o){show(l,o)}).catch(function(){});"
+    "fetch('/stats').then(function(r){return r.json()}).then(function(o){show(s,o)}).catch(function(){})}"
+    "load();setInterval(load,5000)"
+    "</script></body></html>";
+
+enum HttpBody : uint8_t {
+    HTTP_BODY_NONE,     // Everything is in the connection buffer
+    HTTP_BODY_TEXT,     // Page from flash
+    HTTP_BODY_SNAPSHOT, // /latest
+    HTTP_BODY_STATS,    // /stats
+    HTTP_BODY_LOG       // /history
+};
+
+template <class Server, class Client, class Storage>
+class HttpDashboard {
+private:
+    struct Connection {
+        Client client;
+        bool open = false;
+        bool requestDone = false;
+        bool requestLine = false;   // Request line complete
+        uint16_t lineLength = 0;    // Bytes of the header line being read
+        uint8_t body = HTTP_BODY_NONE;
+        uint8_t snapshot = 0;       // Snapshot buffer the body comes from
+        char buf[HTTP_BUFFER];
+        uint16_t len = 0, sent = 0; // Bytes in buf, bytes of them written
+        const char *text = NULL;
+        uint16_t textLen = 0, textSent = 0;
+        uint32_t offset = 0;        // Next log byte
+        uint64_t from = 0, to = 0;
+        uint32_t lastActivity = 0;
+    };
+
+    // A stretch of the log: where it starts, its epoch_ms range
+    struct Segment {
+        uint32_t offset;
+        uint64_t lowest, highest;
+        bool header;
+    };
+
+    Server &_server;
+    Storage &_storage;
+    const char *_dataPath;
+    void (*_stats)(Print &) = NULL;
+
+    Connection _connections[HTTP_CONNECTIONS];
+
+    char _snapshots[2][HTTP_SNAPSHOT_MAX];
+    uint16_t _snapshotLen[2] = {0, 0};
+    uint8_t _active = 0;
+    HttpBufferPrint _snapshotWriter;
+
+    char _statsText[HTTP_STATS_MAX];
+    uint16_t _statsLen = 0;
+
+    Segment _index[HTTP_INDEX_SIZE];
+    uint8_t _indexCount = 0;
+    uint32_t _indexSpan = HTTP_INDEX_SPAN;
+    uint32_t _indexEnd = 0;         // Log bytes the index covers
+
+    uint32_t _requests = 0, _bytes = 0, _dropped = 0, _scanned = 0;
+    uint32_t _worstPollUs = 0;
+
+    static bool isHeader(const char *line) {
+        while (*line == ' ') line++;
+        return (*line >= 'a' && *line <= 'z') || (*line >= 'A' && *line <= 'Z');
+    }
+
+    static uint64_t parseUint64(const char *text) {
+        uint64_t value = 0;
+        while (*text >= '0' && *text <= '9') value = value * 10 + (*text++ - '0');
+        return value;
+    }
+
+    // Value of `name` in a query string ("from=1&to=2"), or NULL
+    static const char *queryValue(const char *query, const char *name) {
+        size_t len = strlen(name);
+        while (query != NULL && *query != '\0') {
+            if (strncmp(query, name, len) == 0 && query[len] == '=') return query + len + 1;
+            query = strchr(query, '&');
+            if (query != NULL) query++;
+        }
+        return NULL;
+    }
+
+    // epoch_ms is the third field of a record
+    static bool epochOf(const char *line, uint64_t &epoch) {
+        const char *field = strchr(line, ',');
+        if (field == NULL) return false;
+        field = strchr(field + 1, ',');
+        if (field == NULL) return false;
+        field++;
+        while (*field == ' ') field++;
+        if (*field < '0' || *field > '9') return false;
+        epoch = parseUint64(field);
+        return true;
+    }
+
+    uint16_t send(Connection &c, const void *data, uint16_t len, uint32_t now) {
+        if (len == 0) return 0;
+        int written = c.client.write((const uint8_t *)data, len);
+        if (written <= 0) return 0;
+        _bytes += written;
+        c.lastActivity = now;
+        return (uint16_t)written;
+    }
+
+    void close(Connection &c) {
+        c.client.stop();
+        c.open = false;
+    }
+
+    // Render /stats, unless another response is still sending the last
+    // rendering (then that one, a moment old, is served again); false if
+    // the body did not fit
+    bool renderStats() {
+        for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+            Connection &c = _connections[i];
+            if (c.open && c.body == HTTP_BODY_STATS) return true;
+        }
+        HttpBufferPrint out(_statsText, HTTP_STATS_MAX);
+        if (_stats != NULL) _stats(out);
+        else out.print("{}");
+        _statsLen = out.overflow() ? 0 : out.length();
+        return !out.overflow();
+    }
+
+    static void respond(const char *status, const char *type, HttpBufferPrint &out) {
+        out.print("HTTP/1.1 ");
+        out.print(status);
+        out.print("\r\nContent-Type: ");
+        out.print(type);
+        out.print("\r\nCache-Control: no-store\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n");
+    }
+
+    void route(Connection &c) {
+        _requests++;
+        // buf holds "GET /path?query HTTP/1.1"
+        bool get = c.len > 4 && strncmp(c.buf, "GET ", 4) == 0;
+        char path[16] = "";
+        uint64_t from = 0, to = ~(uint64_t)0;
+        if (get) {
+            char *target = c.buf + 4;
+            char *end = strchr(target, ' ');
+            if (end != NULL) *end = '\0';
+            char *query = strchr(target, '?');
+            if (query != NULL) {
+                *query++ = '\0';
+                const char *value = queryValue(query, "from");
+                if (value != NULL) from = parseUint64(value);
+                value = queryValue(query, "to");
+                if (value != NULL) to = parseUint64(value);
+            }
+            strncpy(path, target, sizeof(path) - 1);
+        }
+
+        HttpBufferPrint out(c.buf, sizeof(c.buf));
+        c.body = HTTP_BODY_NONE;
+        if (!get) {
+            respond("405 Method Not Allowed", "text/plain", out);
+        } else if (strcmp(path, "/") == 0) {
+            respond("200 OK", "text/html", out);
+            c.body = HTTP_BODY_TEXT;
+            c.text = HTTP_PAGE;
+            c.textLen = sizeof(HTTP_PAGE) - 1;
+            c.textSent = 0;
+        } else if (strcmp(path, "/latest") == 0) {
+            respond("200 OK", "application/json", out);
+            c.body = HTTP_BODY_SNAPSHOT;
+            c.snapshot = _active;
+            c.textSent = 0;
+        } else if (strcmp(path, "/stats") == 0) {
+            if (renderStats()) {
+                respond("200 OK", "application/json", out);
+                c.body = HTTP_BODY_STATS;
+                c.textSent = 0;
+            } else {
+                respond("500 Internal Server Error", "text/plain", out);
+                out.print("/stats is larger than HTTP_STATS_MAX\n");
+            }
+        } else if (strcmp(path, "/history") == 0) {
+            if (Storage::persistent) {
+                respond("200 OK", "text/csv", out);
+                c.body = HTTP_BODY_LOG;
+                c.offset = 0;
+                c.from = from;
+                c.to = to;
+            } else {
+                respond("503 Service Unavailable", "text/plain", out);
+                out.print("No log on this unit\n");
+            }
+        } else {
+            respond("404 Not Found", "text/plain", out);
+        }
+        c.len = out.length();
+        c.sent = 0;
+    }
+
+    // Collect the request line, skip the headers
+    void readRequest(Connection &c, uint32_t now) {
+        uint16_t budget = HTTP_BUFFER;
+        while (budget-- > 0 && c.client.available() > 0) {
+            int ch = c.client.read();
+            if (ch < 0) break;
+            c.lastActivity = now;
+            if (ch == '\n') {
+                if (!c.requestLine) {
+                    c.requestLine = true;
+                    c.buf[c.len] = '\0';
+                } else if (c.lineLength == 0) {
+                    c.requestDone = true;
+                    route(c);
+                    return;
+                }
+                c.lineLength = 0;
+            } else if (ch != '\r') {
+                c.lineLength++;
+                if (!c.requestLine && c.len < sizeof(c.buf) - 1) c.buf[c.len++] = (char)ch;
+            }
+        }
+    }
+
+    // Add a log line to the index; only a scan at its end extends it.
+    // line is NULL for a line longer than any record
+    void indexLine(uint32_t offset, uint32_t length, const char *line) {
+        if (offset != _indexEnd) return;
+        if (_indexCount == 0 || offset - _index[_indexCount - 1].offset >= _indexSpan) {
+            if (_indexCount == HTTP_INDEX_SIZE) {
+                // Merge neighbours: half the segments, twice the span
+                for (uint8_t i = 0; i < HTTP_INDEX_SIZE / 2; i++) {
+                    Segment &a = _index[2 * i], &b = _index[2 * i + 1];
+                    a.lowest = b.lowest < a.lowest ? b.lowest : a.lowest;
+                    a.highest = b.highest > a.highest ? b.highest : a.highest;
+                    a.header = a.header || b.header;
+                    _index[i] = a;
+                }
+                _indexCount = HTTP_INDEX_SIZE / 2;
+                _indexSpan *= 2;
+            }
+            Segment &added = _index[_indexCount++];
+            added.offset = offset;
+            added.lowest = ~(uint64_t)0;
+            added.highest = 0;
+            added.header = false;
+        }
+        Segment &last = _index[_indexCount - 1];
+        uint64_t epoch;
+        if (line != NULL && isHeader(line)) {
+            last.header = true;
+        } else if (line != NULL && epochOf(line, epoch)) {
+            if (epoch < last.lowest) last.lowest = epoch;
+            if (epoch > last.highest) last.highest = epoch;
+        }
+        _indexEnd = offset + length;
+    }
+
+    // Where c's scan goes on: past the indexed segments from c.offset on
+    // that hold no header line and no record in [c.from, c.to]
+    uint32_t skipSegments(const Connection &c) const {
+        uint8_t lo = 0, hi = _indexCount;
+        while (lo < hi) {
+            uint8_t mid = (lo + hi) / 2;
+            if (_index[mid].offset < c.offset) lo = mid + 1;
+            else hi = mid;
+        }
+        uint32_t offset = c.offset;
+        for (uint8_t i = lo; i < _indexCount && _index[i].offset == offset; i++) {
+            const Segment &s = _index[i];
+            if (s.header || (s.highest >= c.from && s.lowest <= c.to)) break;
+            offset = i + 1 < _indexCount ? _index[i + 1].offset : _indexEnd;
+        }
+        return offset;
+    }
+
+    // Scan the log from c.offset and write the wanted lines
+    void streamLog(Connection &c, uint16_t &budget, uint32_t now) {
+        bool finished = false;
+        c.offset = skipSegments(c);
+        bool opened = _storage.readFileFrom(_dataPath, c.offset, [&](Stream &file) {
+            uint16_t scanned = 0;
+            while (budget > 0 && scanned < HTTP_SCAN_MAX) {
+                if (skipSegments(c) != c.offset) return; // Jumped over next poll
+                uint16_t consumed = 0, pos = 0;
+                bool complete = false;
+                while (file.available() > 0) {
+                    int ch = file.read();
+                    if (ch < 0) break;
+                    consumed++;
+                    if (ch == '\n') {
+                        complete = true;
+                        break;
+                    }
+                    if (pos < sizeof(c.buf) - 1) c.buf[pos++] = (char)ch;
+                }
+                if (!complete) {
+                    // End of the log, or a record still being written
+                    finished = true;
+                    return;
+                }
+                uint32_t start = c.offset;
+                c.offset += consumed;
+                scanned += consumed;
+                _scanned += consumed;
+                c.lastActivity = now;
+                if (consumed > sizeof(c.buf) - 1) { // Longer than any record
+                    indexLine(start, consumed, NULL);
+                    continue;
+                }
+                c.buf[pos] = '\0';
+                indexLine(start, consumed, c.buf);
+
+                uint64_t epoch;
+                if (!isHeader(c.buf)) {
+                    if (!epochOf(c.buf, epoch) || epoch < c.from || epoch > c.to) continue;
+                }
+                c.buf[pos++] = '\n';
+                c.len = pos;
+                c.sent = send(c, c.buf, pos < budget ? pos : budget, now);
+                budget -= c.sent;
+                if (c.sent < c.len) return; // The rest goes out next poll
+                c.len = c.sent = 0;
+            }
+        });
+        if (!opened) {
+            // No log, or one shorter than the offset: it was replaced
+            _indexCount = 0;
+            _indexEnd = 0;
+            _indexSpan = HTTP_INDEX_SPAN;
+        }
+        if (!opened || finished) c.body = HTTP_BODY_NONE;
+    }
+
+    void step(Connection &c, uint32_t now) {
+        if (!c.requestDone) {
+            if (!c.client.connected() && c.client.available() <= 0) {
+                close(c);
+                return;
+            }
+            readRequest(c, now);
+            return;
+        }
+        if (!c.client.connected()) {
+            close(c);
+            return;
+        }
+
+        uint16_t budget = HTTP_WRITE_MAX;
+
+        // Header, or the part of a log line the socket did not take
+        if (c.sent < c.len) {
+            uint16_t n = c.len - c.sent;
+            c.sent += send(c, c.buf + c.sent, n < budget ? n : budget, now);
+            budget -= n < budget ? n : budget;
+            if (c.sent < c.len) return;
+            c.len = c.sent = 0;
+        }
+
+        switch (c.body) {
+            case HTTP_BODY_TEXT:
+            case HTTP_BODY_SNAPSHOT:
+            case HTTP_BODY_STATS: {
+                const char *text = c.text;
+                uint16_t length = c.textLen;
+                if (c.body == HTTP_BODY_SNAPSHOT) {
+                    text = _snapshots[c.snapshot];
+                    length = _snapshotLen[c.snapshot];
+                } else if (c.body == HTTP_BODY_STATS) {
+                    text = _statsText;
+                    length = _statsLen;
+                }
+                uint16_t n = length - c.textSent;
+                if (n > budget) n = budget;
+                c.textSent += send(c, text + c.textSent, n, now);
+                if (c.textSent >= length) c.body = HTTP_BODY_NONE;
+                break;
+            }
+            case HTTP_BODY_LOG:
+                if (budget > 0) streamLog(c, budget, now);
+                break;
+            default:
+                break;
+        }
+
+        if (c.body == HTTP_BODY_NONE && c.sent >= c.len) close(c);
+    }
+
+public:
+    HttpDashboard(Server &server, Storage &storage, const char *dataPath)
+        : _server(server), _storage(storage), _dataPath(dataPath),
+          _snapshotWriter(_snapshots[1], HTTP_SNAPSHOT_MAX) {
+        strcpy(_snapshots[0], "{}");
+        _snapshotLen[0] = 2;
+    }
+
+    // fn prints the /stats JSON object; it must not read the sensors
+    void setStats(void (*fn)(Print &)) { _stats = fn; }
+
+    // Print the next /latest body into this, then call endSnapshot()
+    Print &beginSnapshot() {
+        uint8_t next = _active ^ 1;
+        // A response still coming from that buffer would be overwritten
+        for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+            Connection &c = _connections[i];
+            if (c.open && c.body == HTTP_BODY_SNAPSHOT && c.snapshot == next) {
+                close(c);
+                _dropped++;
+            }
+        }
+        _snapshotWriter = HttpBufferPrint(_snapshots[next], HTTP_SNAPSHOT_MAX);
+        return _snapshotWriter;
+    }
+
+    // Serve the new snapshot; one that did not fit keeps the previous one
+    void endSnapshot() {
+        if (_snapshotWriter.overflow()) return;
+        _active ^= 1;
+        _snapshotLen[_active] = _snapshotWriter.length();
+    }
+
+    // Call every loop
+    void poll(uint32_t now) {
+        uint32_t started = micros();
+
+        for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+            Connection &c = _connections[i];
+            if (c.open) continue;
+            Client incoming = _server.available();
+            if (incoming) {
+                c.client = incoming;
+                c.open = true;
+                c.requestDone = c.requestLine = false;
+                c.lineLength = 0;
+                c.len = c.sent = 0;
+                c.body = HTTP_BODY_NONE;
+                c.lastActivity = now;
+            }
+            break; // At most one new connection per poll
+        }
+
+        for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) {
+            Connection &c = _connections[i];
+            if (!c.open) continue;
+            step(c, now);
+            if (c.open && now - c.lastActivity >= HTTP_IDLE_TIMEOUT) {
+                close(c);
+                _dropped++;
+            }
+        }
+
+        uint32_t took = micros() - started;
+        if (took > _worstPollUs) _worstPollUs = took;
+    }
+
+    uint8_t active() const {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < HTTP_CONNECTIONS; i++) n += _connections[i].open;
+        return n;
+    }
+
+    uint32_t requests() const { return _requests; }
+    uint32_t bytesSent() const { return _bytes; }
+    uint32_t dropped() const { return _dropped; }   // Timed out, or overtaken by a snapshot
+    uint32_t worstPollUs() const { return _worstPollUs; }
+    uint32_t scannedBytes() const { return _scanned; }  // Log bytes read for /history
+};
+
+#endif // _HTTP_DASHBOARD_H_
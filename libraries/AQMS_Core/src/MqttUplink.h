@@ -0,0 +1,663 @@
+#ifndef _MQTT_UPLINK_H_
+#define _MQTT_UPLINK_H_
+
+/*
+ * MQTT Uplink
+ *
+ * Publishes the records of data.txt to an MQTT broker, using the file
+ * itself as a store-and-forward queue. The broker's PUBACK for a batch
+ * moves the acknowledged byte offset forward, and the offset is kept in a
+ * small file next to the log, so after a dropped link or a reboot the
+ * uplink resumes at the first unacknowledged record instead of resending
+ * everything (a batch in flight when the link dropped is sent again).
+ *
+ * The offset goes to two files in turn, each line carrying a sequence
+ * number and a check value, and begin() takes the newest valid one, so a
+ * power loss while one file is rewritten leaves the other. It is saved
+ * when the backlog is sent and at most every MQTT_ACK_SAVE_INTERVAL while
+ * catching up, not for every batch; after a reboot the batches since the
+ * last save are sent again, which QoS 1 allows anyway.
+ *
+ * Records are batched: one QoS 1 PUBLISH carries up to `batch` records as
+ * CBOR, so the SD read, TCP write and round trip are paid once per batch.
+ *
+ *   { "c": ["date", "time", "epoch_ms", "lat", ...],     column names
+ *     "r": [[20260615, 101500, 1781518500000, 48.1, ...], ...] }
+ *
+ * Integer columns are CBOR integers, the rest float32, empty fields null.
+ * A batch ends early at a header line of data.txt, so the names always
+ * match the records.
+ *
+ * poll() does at most one bounded step per call (connect, scan up to
+ * MQTT_SCAN_MAX bytes of the log into the batch, write up to
+ * MQTT_WRITE_MAX bytes of the PUBLISH, or handle received bytes) and never
+ * waits for the broker, so acquisition is not held up by a slow or missing
+ * uplink. A batch is published every `interval` ms, or back to back while
+ * there is a backlog.
+ *
+ * Client is anything with the Arduino Client calls (WiFiClient, or a host
+ * stand-in talking to a test broker). Storage is a storage policy with
+ * readFileFrom().
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define MQTT_PAYLOAD_MAX    8192    // Bytes of CBOR per PUBLISH
+#define MQTT_LINE_MAX       512     // Longest data.txt line (the header); longer lines are skipped
+#define MQTT_NAMES_MAX      384     // CBOR of the column names
+#define MQTT_ACK_TIMEOUT    10000   // ms to wait for CONNACK / PUBACK
+#define MQTT_RETRY_INTERVAL 30000   // ms between connection attempts
+#define MQTT_KEEPALIVE      60      // s
+#define MQTT_WRITE_MAX      1460    // Bytes written per poll (one TCP segment)
+#define MQTT_SCAN_MAX       2048    // Log bytes scanned per poll
+#define MQTT_ACK_SAVE_INTERVAL 60000 // ms between offset saves while catching up
+
+// Minimal CBOR encoder (RFC 8949) into a caller-owned buffer
+class CborWriter {
+private:
+    uint8_t *_buf;
+    uint16_t _cap;
+    uint16_t _len = 0;
+    bool _overflow = false;
+
+public:
+    // len: bytes already in the buffer, to carry on an encoding
+    CborWriter(uint8_t *buf, uint16_t cap, uint16_t len = 0) : _buf(buf), _cap(cap), _len(len) {}
+
+    void byte(uint8_t b) {
+        if (_len < _cap) _buf[_len++] = b;
+        else _overflow = true;
+    }
+
+    void head(uint8_t major, uint64_t value) {
+        major <<= 5;
+        if (value < 24) {
+            byte(major | value);
+        } else if (value <= 0xFF) {
+            byte(major | 24);
+            byte(value);
+        } else if (value <= 0xFFFF) {
+            byte(major | 25);
+            byte(value >> 8); byte(value);
+        } else if (value <= 0xFFFFFFFFULL) {
+            byte(major | 26);
+            for (int8_t shift = 24; shift >= 0; shift -= 8) byte(value >> shift);
+        } else {
+            byte(major | 27);
+            for (int8_t shift = 56; shift >= 0; shift -= 8) byte(value >> shift);
+        }
+    }
+
+    void integer(int64_t value) {
+        if (value >= 0) head(0, (uint64_t)value);
+        else head(1, (uint64_t)(-1 - value));
+    }
+
+    void float32(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        byte(0xFA);
+        for (int8_t shift = 24; shift >= 0; shift -= 8) byte(bits >> shift);
+    }
+
+    void text(const char *s, uint16_t n) {
+        head(3, n);
+        for (uint16_t i = 0; i < n; i++) byte(s[i]);
+    }
+
+    void raw(const uint8_t *data, uint16_t n) {
+        for (uint16_t i = 0; i < n; i++) byte(data[i]);
+    }
+
+    void array(uint16_t n) { head(4, n); }
+    void map(uint16_t n) { head(5, n); }
+    void beginArray() { byte(0x9F); }   // Indefinite length, closed by end()
+    void end() { byte(0xFF); }
+    void null() { byte(0xF6); }
+
+    uint16_t length() const { return _len; }
+    bool overflow() const { return _overflow; }
+
+    // Drop everything after `length` (an encoding that did not fit)
+    void truncate(uint16_t length) {
+        _len = length;
+        _overflow = false;
+    }
+};
+
+enum MqttState : uint8_t {
+    MQTT_OFFLINE,       // No TCP connection
+    MQTT_CONNECTING,    // CONNECT sent, waiting for CONNACK
+    MQTT_READY,         // Connected, nothing in flight
+    MQTT_WAIT_ACK       // Batch published, waiting for PUBACK
+};
+
+template <class Client, class Storage>
+class MqttUplink {
+private:
+    Client &_client;
+    Storage &_storage;
+    const char *_dataPath;
+    const char *_ackPaths[2];
+    const char *_host = "";
+    uint16_t _port = 1883;
+    const char *_topic = "aqms/data";
+    const char *_clientId = "aqms";
+    uint8_t _batch = 60;
+    uint32_t _interval = 60000;
+
+    MqttState _state = MQTT_OFFLINE;
+    uint32_t _acked = 0;            // data.txt bytes the broker has confirmed
+    uint32_t _headerAt = 0;         // Header line the acked position belongs to
+    uint32_t _pendingEnd = 0, _pendingHeader = 0;
+    uint8_t _pendingRecords = 0;
+    uint16_t _packetId = 0;
+    bool _backlog = true;           // More complete lines may be waiting
+    bool _attempted = false;
+    uint32_t _sentAt = 0, _lastPublish = 0, _lastAttempt = 0, _lastTx = 0;
+
+    // Batch being read from the log, MQTT_SCAN_MAX bytes per poll
+    bool _building = false;
+    uint32_t _scanPos = 0;
+
+    // Offset saves: sequence of the last one (its slot is seq & 1)
+    uint32_t _ackSeq = 0;
+    uint32_t _lastSave = 0;
+    bool _saveDue = false;
+
+    // PUBLISH in flight: fixed header, topic, packet ID, payload
+    uint8_t _head[8];
+    uint8_t _headLen = 0;
+    uint32_t _txLen = 0, _txSent = 0;
+
+    uint8_t _payload[MQTT_PAYLOAD_MAX];
+    uint16_t _payloadLen = 0;
+    uint8_t _names[MQTT_NAMES_MAX];
+    uint16_t _namesLen = 0;
+
+    // Incoming packet: fixed header, remaining length, first body bytes
+    uint8_t _rxStage = 0;
+    uint8_t _rxType = 0;
+    uint32_t _rxLen = 0, _rxGot = 0;
+    uint8_t _rxShift = 0;
+    uint8_t _rxBody[4];
+
+    uint32_t _records = 0, _batches = 0, _bytes = 0, _connects = 0, _resends = 0;
+
+    static bool isHeader(const char *line) {
+        while (*line == ' ') line++;
+        return (*line >= 'a' && *line <= 'z') || (*line >= 'A' && *line <= 'Z');
+    }
+
+    // Next field of a comma-separated line, trimmed; NULL after the last
+    static const char *nextField(const char *&cursor, uint8_t &len) {
+        if (cursor == NULL) return NULL;
+        while (*cursor == ' ') cursor++;
+        const char *start = cursor;
+        const char *comma = strchr(cursor, ',');
+        const char *stop = comma ? comma : cursor + strlen(cursor);
+        cursor = comma ? comma + 1 : NULL;
+        while (stop > start && (stop[-1] == ' ' || stop[-1] == '\r')) stop--;
+        len = stop - start;
+        return start;
+    }
+
+    void setNames(const char *line) {
+        CborWriter out(_names, sizeof(_names));
+        out.beginArray();
+        const char *cursor = line;
+        uint8_t len;
+        const char *field;
+        while ((field = nextField(cursor, len)) != NULL) out.text(field, len);
+        out.end();
+        _namesLen = out.overflow() ? 0 : out.length();
+    }
+
+    static void encodeField(CborWriter &out, const char *field, uint8_t len) {
+        if (len == 0) {
+            out.null();
+            return;
+        }
+        bool integer = true;
+        for (uint8_t i = 0; i < len; i++) {
+            char c = field[i];
+            if (!((c >= '0' && c <= '9') || (c == '-' && i == 0))) integer = false;
+        }
+        if (integer && len < 20) {
+            out.integer(strtoll(field, NULL, 10));
+        } else {
+            out.float32(strtod(field, NULL));
+        }
+    }
+
+    // Reads one line; returns bytes consumed, 0 at the end of the file or
+    // at a line still being written (no newline yet)
+    static uint16_t readLine(Stream &file, char *line, uint16_t size, bool &tooLong) {
+        uint16_t consumed = 0, pos = 0;
+        tooLong = false;
+        while (file.available() > 0) {
+            int c = file.read();
+            if (c < 0) break;
+            consumed++;
+            if (c == '\n') {
+                line[pos] = '\0';
+                return consumed;
+            }
+            if (pos < size - 1) line[pos++] = (char)c;
+            else tooLong = true;
+        }
+        return 0;
+    }
+
+    void send(const uint8_t *data, uint16_t len) {
+        _client.write(data, len);
+        _bytes += len;
+    }
+
+    uint8_t putLength(uint8_t *out, uint32_t len) {
+        uint8_t n = 0;
+        do {
+            uint8_t digit = len & 0x7F;
+            len >>= 7;
+            out[n++] = digit | (len > 0 ? 0x80 : 0);
+        } while (len > 0);
+        return n;
+    }
+
+    void connect(uint32_t now) {
+        _lastAttempt = now;
+        _attempted = true;
+        if (!_client.connect(_host, _port)) return;
+
+        uint16_t idLen = strlen(_clientId);
+        uint8_t packet[16 + 64];
+        if (idLen > 64) idLen = 64;
+        uint8_t n = 0;
+        packet[n++] = 0x10;
+        n += putLength(packet + n, 10 + 2 + idLen);
+        const uint8_t variable[] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, MQTT_KEEPALIVE};
+        memcpy(packet + n, variable, sizeof(variable));
+        n += sizeof(variable);
+        packet[n++] = idLen >> 8;
+        packet[n++] = idLen;
+        memcpy(packet + n, _clientId, idLen);
+        n += idLen;
+        send(packet, n);
+
+        _rxStage = 0;
+        _state = MQTT_CONNECTING;
+        _sentAt = _lastTx = now;
+        _connects++;
+    }
+
+    void disconnect() {
+        _client.stop();
+        _state = MQTT_OFFLINE;
+        _building = false;
+    }
+
+    // Read up to MQTT_SCAN_MAX bytes of the log into the batch; true once
+    // a batch is ready, false while there is more to read or nothing to send
+    bool buildBatch() {
+        if (!_building) {
+            // After a reboot the column names come from the header the
+            // acked position belongs to
+            if (_namesLen == 0 && _headerAt < _acked) {
+                _storage.readFileFrom(_dataPath, _headerAt, [&](Stream &file) {
+                    char line[MQTT_LINE_MAX];
+                    bool tooLong;
+                    if (readLine(file, line, sizeof(line), tooLong) > 0 && !tooLong && isHeader(line)) {
+                        setNames(line);
+                    }
+                });
+            }
+            _building = true;
+            _scanPos = _pendingEnd = _acked;
+            _pendingHeader = _headerAt;
+            _pendingRecords = 0;
+            _payloadLen = 0;
+        }
+
+        CborWriter out(_payload, sizeof(_payload), _payloadLen);
+        bool full = false, done = false;
+
+        bool opened = _storage.readFileFrom(_dataPath, _scanPos, [&](Stream &file) {
+            char line[MQTT_LINE_MAX];
+            uint16_t scanned = 0;
+            while (_pendingRecords < _batch) {
+                if (scanned >= MQTT_SCAN_MAX) return; // The rest next poll
+                bool tooLong;
+                uint16_t consumed = readLine(file, line, sizeof(line), tooLong);
+                if (consumed == 0) {
+                    done = true; // End of the log, or a record still being written
+                    return;
+                }
+                scanned += consumed;
+                if (tooLong || line[0] == '\0' || line[0] == '\r') {
+                    _scanPos += consumed;
+                    _pendingEnd = _scanPos;
+                    continue;
+                }
+                if (isHeader(line)) {
+                    if (_pendingRecords > 0) {
+                        full = true; // New names start the next batch
+                        return;
+                    }
+                    setNames(line);
+                    _pendingHeader = _scanPos;
+                    _scanPos += consumed;
+                    _pendingEnd = _scanPos;
+                    continue;
+                }
+                if (_pendingRecords == 0) {
+                    out.map(2);
+                    out.text("c", 1);
+                    if (_namesLen > 0) out.raw(_names, _namesLen);
+                    else out.array(0);
+                    out.text("r", 1);
+                    out.beginArray();
+                }
+                uint16_t mark = out.length();
+                out.beginArray();
+                const char *cursor = line;
+                uint8_t len;
+                const char *field;
+                while ((field = nextField(cursor, len)) != NULL) encodeField(out, field, len);
+                out.end();
+                if (out.overflow() || out.length() >= sizeof(_payload) - 1) { // Room for the final end()
+                    out.truncate(mark);
+                    full = true;
+                    return;
+                }
+                _pendingRecords++;
+                _scanPos += consumed;
+                _pendingEnd = _scanPos;
+            }
+            full = true;
+        });
+        _payloadLen = out.length();
+
+        if (!opened) {
+            // A data.txt shorter than the acked offset was replaced; start over
+            if (_acked > 0 && _storage.readFile(_dataPath, [](Stream &) {})) {
+                _acked = _headerAt = 0;
+                _namesLen = 0;
+                _saveDue = true;
+            }
+            _building = false;
+            _backlog = false;
+            return false;
+        }
+        if (!full && !done) return false;
+
+        _building = false;
+        _backlog = full;
+        if (_pendingRecords == 0) {
+            // Only headers or skipped lines: nothing for the broker to confirm
+            _acked = _pendingEnd;
+            _headerAt = _pendingHeader;
+            return false;
+        }
+
+        out.end();
+        _payloadLen = out.length();
+        return true;
+    }
+
+    // Write the next part of the PUBLISH, at most MQTT_WRITE_MAX bytes;
+    // what the socket does not take goes out next poll
+    void transmit(uint32_t now) {
+        uint16_t topicLen = strlen(_topic);
+        uint8_t id[2] = {(uint8_t)(_packetId >> 8), (uint8_t)_packetId};
+        const uint8_t *parts[4] = {_head, (const uint8_t *)_topic, id, _payload};
+        const uint16_t lengths[4] = {_headLen, topicLen, 2, _payloadLen};
+        uint16_t budget = MQTT_WRITE_MAX;
+        uint32_t start = 0;
+        for (uint8_t i = 0; i < 4 && budget > 0; i++) {
+            if (_txSent < start + lengths[i]) {
+                uint16_t from = _txSent - start;
+                uint16_t n = lengths[i] - from;
+                if (n > budget) n = budget;
+                size_t written = _client.write(parts[i] + from, n);
+                _bytes += written;
+                _txSent += written;
+                budget -= written;
+                if (written > 0) _sentAt = _lastTx = now; // The PUBACK wait starts at the last byte
+                if (written < n) break;
+            }
+            start += lengths[i];
+        }
+    }
+
+    void publish(uint32_t now, bool duplicate) {
+        uint16_t topicLen = strlen(_topic);
+        uint32_t remaining = 2 + topicLen + 2 + _payloadLen;
+        _headLen = 0;
+        _head[_headLen++] = 0x32 | (duplicate ? 0x08 : 0); // PUBLISH, QoS 1
+        _headLen += putLength(_head + _headLen, remaining);
+        _head[_headLen++] = topicLen >> 8;
+        _head[_headLen++] = topicLen;
+        _txLen = _headLen + topicLen + 2 + _payloadLen;
+        _txSent = 0;
+        _state = MQTT_WAIT_ACK;
+        _sentAt = now;
+        transmit(now);
+    }
+
+    // Check value of a saved offset, so a torn or stale line is not taken
+    static uint32_t ackCheck(uint32_t seq, uint32_t acked, uint32_t headerAt) {
+        return (seq * 2654435761UL) ^ (acked * 40503UL) ^ headerAt ^ 0x41514D51UL;
+    }
+
+    // Write the offset to the slot the last save did not use
+    void saveAck(uint32_t now) {
+        uint32_t seq = _ackSeq + 1;
+        bool saved = _storage.writeFile(_ackPaths[seq & 1], [&](Print &file) {
+            file.print((unsigned long)seq);
+            file.print(',');
+            file.print((unsigned long)_acked);
+            file.print(',');
+            file.print((unsigned long)_headerAt);
+            file.print(',');
+            file.println((unsigned long)ackCheck(seq, _acked, _headerAt));
+        });
+        if (saved) _ackSeq = seq;
+        _saveDue = !saved;
+        _lastSave = now;
+    }
+
+    // "seq,acked,header,check" of one slot; false when missing or torn
+    bool loadAck(const char *path, uint32_t &seq, uint32_t &acked, uint32_t &headerAt) {
+        bool valid = false;
+        _storage.readFile(path, [&](Stream &file) {
+            char text[48];
+            uint8_t n = 0;
+            bool line = false;
+            while (file.available() > 0 && n < sizeof(text) - 1) {
+                int c = file.read();
+                if (c < 0) break;
+                if (c == '\n') {
+                    line = true;
+                    break;
+                }
+                text[n++] = (char)c;
+            }
+            text[n] = '\0';
+            uint32_t value[4];
+            char *cursor = text;
+            for (uint8_t i = 0; i < 4; i++) {
+                char *end;
+                value[i] = strtoul(cursor, &end, 10);
+                if (end == cursor || (i < 3 && *end != ',')) return;
+                cursor = end + 1;
+            }
+            seq = value[0];
+            acked = value[1];
+            headerAt = value[2];
+            valid = line && value[3] == ackCheck(seq, acked, headerAt) && headerAt <= acked;
+        });
+        return valid;
+    }
+
+    void packetDone(uint32_t now) {
+        _rxStage = 0;
+        switch (_rxType >> 4) {
+            case 2: // CONNACK
+                if (_state != MQTT_CONNECTING) break;
+                if (_rxLen >= 2 && _rxBody[1] == 0) {
+                    _state = MQTT_READY;
+                    _backlog = true;
+                } else {
+                    disconnect(); // Refused; retry later
+                }
+                break;
+            case 4: { // PUBACK
+                uint16_t id = (_rxBody[0] << 8) | _rxBody[1];
+                if (_state != MQTT_WAIT_ACK || _rxLen < 2 || id != _packetId) break;
+                _acked = _pendingEnd;
+                _headerAt = _pendingHeader;
+                _records += _pendingRecords;
+                _batches++;
+                _saveDue = true;
+                _state = MQTT_READY;
+                _lastPublish = now;
+                break;
+            }
+            default: // PINGRESP, or nothing we asked for
+                break;
+        }
+    }
+
+    void receive(uint32_t now) {
+        while (_state != MQTT_OFFLINE && _client.available() > 0) {
+            int c = _client.read();
+            if (c < 0) break;
+            uint8_t b = (uint8_t)c;
+            switch (_rxStage) {
+                case 0:
+                    _rxType = b;
+                    _rxLen = 0;
+                    _rxShift = 0;
+                    _rxStage = 1;
+                    break;
+                case 1:
+                    _rxLen |= (uint32_t)(b & 0x7F) << _rxShift;
+                    _rxShift += 7;
+                    if (b & 0x80) {
+                        if (_rxShift > 21) disconnect(); // Malformed length
+                    } else {
+                        _rxGot = 0;
+                        if (_rxLen == 0) packetDone(now);
+                        else _rxStage = 2;
+                    }
+                    break;
+                default:
+                    if (_rxGot < sizeof(_rxBody)) _rxBody[_rxGot] = b;
+                    if (++_rxGot >= _rxLen) packetDone(now);
+                    break;
+            }
+        }
+    }
+
+public:
+    // The acked offset is kept in ackPath0 and ackPath1 in turn
+    MqttUplink(Client &client, Storage &storage, const char *dataPath, const char *ackPath0,
+               const char *ackPath1)
+        : _client(client), _storage(storage), _dataPath(dataPath), _ackPaths{ackPath0, ackPath1} {}
+
+    // Strings stay owned by the caller
+    void configure(const char *host, uint16_t port, const char *topic, const char *clientId) {
+        _host = host;
+        _port = port;
+        _topic = topic;
+        _clientId = clientId;
+    }
+
+    // Records per PUBLISH, and ms between publishes once caught up
+    void setBatch(uint8_t records, uint32_t interval) {
+        _batch = records > 0 ? records : 1;
+        _interval = interval;
+    }
+
+    // Resume from the newest valid saved offset
+    void begin() {
+        for (uint8_t i = 0; i < 2; i++) {
+            uint32_t seq, acked, headerAt;
+            if (!loadAck(_ackPaths[i], seq, acked, headerAt)) continue;
+            if (_ackSeq != 0 && seq <= _ackSeq) continue;
+            _ackSeq = seq;
+            _acked = acked;
+            _headerAt = headerAt;
+        }
+    }
+
+    // Call every loop; linkUp = the network (e.g. WiFi) is connected
+    void poll(uint32_t now, bool linkUp) {
+        // Keep the offset once caught up or offline, now and then while catching up
+        bool caughtUp = _state == MQTT_READY && !_building && !_backlog;
+        if (_saveDue && (caughtUp || !linkUp || _state == MQTT_OFFLINE ||
+                         now - _lastSave >= MQTT_ACK_SAVE_INTERVAL)) {
+            saveAck(now);
+        }
+
+        if (!linkUp) {
+            if (_state != MQTT_OFFLINE) disconnect();
+            return;
+        }
+        if (_state != MQTT_OFFLINE && !_client.connected()) {
+            _state = MQTT_OFFLINE;
+        }
+
+        if (_state == MQTT_OFFLINE) {
+            if (!_attempted || now - _lastAttempt >= MQTT_RETRY_INTERVAL) connect(now);
+            return;
+        }
+
+        receive(now);
+
+        switch (_state) {
+            case MQTT_CONNECTING:
+                if (now - _sentAt >= MQTT_ACK_TIMEOUT) disconnect();
+                break;
+            case MQTT_READY:
+                if (_building || _backlog || now - _lastPublish >= _interval) {
+                    if (buildBatch()) {
+                        _packetId = _packetId == 0xFFFF ? 1 : _packetId + 1;
+                        publish(now, false);
+                    } else if (!_building && !_backlog) {
+                        _lastPublish = now; // Nothing new; look again next interval
+                    }
+                }
+                break;
+            case MQTT_WAIT_ACK:
+                if (_txSent < _txLen) {
+                    transmit(now);
+                    if (now - _sentAt >= MQTT_ACK_TIMEOUT) disconnect(); // The socket takes nothing
+                } else if (now - _sentAt >= MQTT_ACK_TIMEOUT) {
+                    _resends++;
+                    publish(now, true);
+                }
+                break;
+            default:
+                break;
+        }
+
+        // Keep the session alive while idle
+        if (_state == MQTT_READY && now - _lastTx >= MQTT_KEEPALIVE * 500UL) {
+            const uint8_t ping[2] = {0xC0, 0};
+            send(ping, 2);
+            _lastTx = now;
+        }
+    }
+
+    MqttState state() const { return _state; }
+    uint32_t acked() const { return _acked; }       // data.txt offset confirmed by the broker
+    uint32_t records() const { return _records; }   // Records confirmed since boot
+    uint32_t batches() const { return _batches; }
+    uint32_t bytesSent() const { return _bytes; }
+    uint32_t connects() const { return _connects; }
+    uint32_t resends() const { return _resends; }
+};
+
+#endif // _MQTT_UPLINK_H_
@@ -0,0 +1,156 @@
+#ifndef _PM_SCHEDULER_H_
+#define _PM_SCHEDULER_H_
+
+/*
+ * PM Scheduler
+ *
+ * Duty-cycles a particulate sensor (SDS011) instead of running its fan and
+ * laser continuously. Each period the sensor is woken, given a spin-up time
+ * for the fan to flush the chamber, then every frame received during the
+ * sampling window is averaged; the sensor then sleeps until the next period.
+ *
+ *   |<------------------------- period -------------------------->|
+ *   | spin-up (frames dropped) | window (frames averaged) | sleep  |
+ *
+ * The last window average is held between windows, so the logging cadence
+ * is unchanged. A period of 0 keeps the sensor running and averages
+ * back-to-back windows.
+ *
+ * With a query interval set, the sensor is expected to be in query mode:
+ * during the window one frame is requested per interval (e.g. per logging
+ * cycle) instead of parsing the sensor's own 1 Hz stream.
+ *
+ * Sensor needs read(float *pm25, float *pm10) returning 0 when a frame was
+ * decoded, sleep(), wakeup() and queryData() - the SDS011 driver's interface.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define PM_SPINUP_DEFAULT 30000   // Datasheet: at least 30 s after wakeup before reading
+
+enum PMState : uint8_t {
+    PM_SLEEPING,
+    PM_SPINUP,
+    PM_SAMPLING
+};
+
+template <typename Sensor>
+class PMScheduler {
+private:
+    Sensor &_sensor;
+    uint32_t _period = 0;                 // 0 = continuous
+    uint32_t _window = 30000;
+    uint32_t _spinup = PM_SPINUP_DEFAULT;
+    uint32_t _queryInterval = 0;          // 0 = sensor reports on its own
+    uint32_t _lastQuery = 0;
+    uint32_t _cycleStart = 0;
+    uint32_t _phaseStart = 0;
+    PMState _state = PM_SLEEPING;
+
+    float _sum25 = 0, _sum10 = 0;
+    uint16_t _frames = 0;
+    float _pm25 = 0, _pm10 = 0;
+    uint16_t _lastFrames = 0;
+    uint32_t _windows = 0;
+    uint32_t _averageAt = 0;
+    bool _hasAverage = false;
+
+    void startWindow(uint32_t now) {
+        _state = PM_SAMPLING;
+        _phaseStart = now;
+        _sum25 = _sum10 = 0;
+        _frames = 0;
+        _lastQuery = now - _queryInterval; // First query right away
+    }
+
+    void wake(uint32_t now, bool command = true) {
+        if (command) _sensor.wakeup();
+        _state = PM_SPINUP;
+        _phaseStart = now;
+    }
+
+public:
+    explicit PMScheduler(Sensor &sensor) : _sensor(sensor) {}
+
+    // All in ms; a non-zero period shorter than spin-up + window is stretched to fit
+    void configure(uint32_t period, uint32_t window, uint32_t spinup) {
+        _window = window > 0 ? window : 1000;
+        _spinup = spinup;
+        _period = period;
+        if (_period != 0 && _period < _spinup + _window) _period = _spinup + _window;
+    }
+
+    // Request one frame per interval during the window (sensor in query mode)
+    void setQueryInterval(uint32_t interval) { _queryInterval = interval; }
+
+    // Wake the sensor and start the first period. wakeSensor = false sends
+    // nothing, for a sensor that is only listened to (it runs continuously,
+    // so use a period of 0)
+    void begin(uint32_t now, bool wakeSensor = true) {
+        _cycleStart = now;
+        wake(now, wakeSensor);
+    }
+
+    // Call every loop: moves through the phases and collects frames
+    void poll(uint32_t now) {
+        float pm25, pm10;
+        switch (_state) {
+            case PM_SLEEPING:
+                if (now - _cycleStart >= _period) {
+                    // Keep the cadence unless we fell more than a period behind
+                    _cycleStart = now - _cycleStart < 2 * _period ? _cycleStart + _period : now;
+                    wake(now);
+                }
+                break;
+
+            case PM_SPINUP:
+                _sensor.read(&pm25, &pm10); // Drop frames while the fan settles
+                if (now - _phaseStart >= _spinup) startWindow(now);
+                break;
+
+            case PM_SAMPLING:
+                if (_queryInterval != 0 && now - _lastQuery >= _queryInterval) {
+                    _lastQuery = now;
+                    _sensor.queryData();
+                }
+                if (_sensor.read(&pm25, &pm10) == 0) {
+                    _sum25 += pm25;
+                    _sum10 += pm10;
+                    if (_frames < 0xFFFF) _frames++;
+                }
+                if (now - _phaseStart >= _window) {
+                    if (_frames > 0) {
+                        _pm25 = _sum25 / _frames;
+                        _pm10 = _sum10 / _frames;
+                        _averageAt = now;
+                        _hasAverage = true;
+                    }
+                    _lastFrames = _frames;
+                    _windows++;
+                    if (_period == 0) {
+                        startWindow(now);
+                    } else {
+                        _sensor.sleep();
+                        _state = PM_SLEEPING;
+                    }
+                }
+                break;
+        }
+    }
+
+    float pm25() const { return _pm25; }
+    float pm10() const { return _pm10; }
+    bool hasAverage() const { return _hasAverage; }
+    uint32_t averageAge(uint32_t now) const { return now - _averageAt; }  // ms since the held average was taken
+    uint16_t lastFrames() const { return _lastFrames; }   // Frames in the last window
+    uint32_t windows() const { return _windows; }         // Windows completed
+    PMState state() const { return _state; }
+
+    // Fraction of time the fan and laser are on
+    float dutyCycle() const {
+        return _period == 0 ? 1.0f : (float)(_spinup + _window) / _period;
+    }
+};
+
+#endif // _PM_SCHEDULER_H_
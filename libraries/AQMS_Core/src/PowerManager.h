@@ -0,0 +1,147 @@
+#ifndef _POWER_MANAGER_H_
+#define _POWER_MANAGER_H_
+
+/*
+ * Power Manager
+ *
+ * Low-power logging for battery / solar units. Instead of spinning loop()
+ * for every 1 s record, the unit works in windows:
+ *
+ *   |<------------------------ interval ------------------------->|
+ *   | lead (sensors wake, no records) | burst (N records) | sleep   |
+ *
+ * Records of a burst are queued as text in a RecordQueue, which is plain
+ * data so it can live in RTC memory (RTC_DATA_ATTR) and survive deep
+ * sleep. The queue is written to storage every `batch` windows, or sooner
+ * when it runs out of room, so the SD card is powered up a fraction as often.
+ *
+ * PowerSchedule and PowerBudget use only the millis() values passed in, so
+ * the timing and the battery projection can be run on the host with a
+ * simulated clock.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define LP_OFF   0   // Log every cycle, never sleep
+#define LP_LIGHT 1   // Light sleep between windows; RAM and warmup state kept
+#define LP_DEEP  2   // Deep sleep between windows; setup() runs on every wake
+
+#define LP_QUEUE_MAGIC 0x41514C50UL // "AQLP"
+#define LP_RECORD_MAX  256          // Room kept free for one more record
+
+// Record text queued between storage writes. No constructor or virtuals:
+// zero-initialised on power-up and left untouched by a deep-sleep wake.
+template <uint16_t Bytes>
+struct RecordQueue {
+    uint32_t magic;
+    uint16_t used;
+    uint16_t records;
+    uint16_t windows;          // Windows queued since the last flush
+    char text[Bytes];
+
+    // Keep a queue carried over from deep sleep, start empty otherwise
+    void begin() {
+        if (magic != LP_QUEUE_MAGIC || used > Bytes) clear();
+    }
+
+    void clear() {
+        magic = LP_QUEUE_MAGIC;
+        used = 0;
+        records = 0;
+        windows = 0;
+    }
+
+    bool put(uint8_t c) {
+        if (used >= Bytes) return false;
+        text[used++] = c;
+        return true;
+    }
+
+    uint16_t space() const { return Bytes - used; }
+
+    // Write everything queued and empty the queue
+    void flush(Print &out) {
+        out.write((const uint8_t *)text, used);
+        clear();
+    }
+};
+
+// Print adapter so records can be formatted straight into a RecordQueue
+template <class Queue>
+class RecordQueueWriter : public Print {
+private:
+    Queue &_queue;
+
+public:
+    explicit RecordQueueWriter(Queue &queue) : _queue(queue) {}
+    size_t write(uint8_t c) { return _queue.put(c) ? 1 : 0; }
+};
+
+class PowerSchedule {
+private:
+    uint32_t _interval = 300000;
+    uint32_t _lead = 60000;
+    uint8_t _burst = 5;
+    uint32_t _windowStart = 0;
+    uint32_t _activeMs = 0;
+    uint8_t _taken = 0;
+
+public:
+    // All in ms; lead is the time sensors run before the first record
+    void configure(uint32_t interval, uint32_t lead, uint8_t burst) {
+        _interval = interval;
+        _lead = lead;
+        _burst = burst > 0 ? burst : 1;
+    }
+
+    void beginWindow(uint32_t now) {
+        _windowStart = now;
+        _taken = 0;
+    }
+
+    // Start the next window on the fixed cadence (light sleep, where millis()
+    // keeps counting); restart it if we fell more than an interval behind
+    void nextWindow(uint32_t now) {
+        uint32_t next = _windowStart + _interval;
+        beginWindow(now - next < _interval ? next : now);
+    }
+
+    // True while records of this window should be queued
+    bool measuring(uint32_t now) const {
+        return now - _windowStart >= _lead && _taken < _burst;
+    }
+
+    void recordTaken() {
+        if (_taken < 255) _taken++;
+    }
+
+    bool windowDone() const { return _taken >= _burst; }
+
+    // ms left until the next window starts, 0 when the window overran it
+    uint32_t sleepTime(uint32_t now) {
+        _activeMs = now - _windowStart;
+        return _activeMs < _interval ? _interval - _activeMs : 0;
+    }
+
+    uint32_t activeMs() const { return _activeMs; }
+    uint32_t interval() const { return _interval; }
+};
+
+// Average current and battery life from the awake time per window
+struct PowerBudget {
+    float activeMa = 250;   // Whole unit awake: MCU, heaters, SDS011 fan
+    float sleepMa = 160;    // Asleep: mostly the MQ heaters, which are not switched
+
+    float averageMa(uint32_t activeMs, uint32_t intervalMs) const {
+        if (intervalMs == 0 || activeMs >= intervalMs) return activeMa;
+        return (activeMa * activeMs + sleepMa * (intervalMs - activeMs)) / intervalMs;
+    }
+
+    float batteryHours(float capacityMah, uint32_t activeMs, uint32_t intervalMs) const {
+        float average = averageMa(activeMs, intervalMs);
+        return average > 0 ? capacityMah / average : 0;
+    }
+};
+
+#endif // _POWER_MANAGER_H_
@@ -0,0 +1,104 @@
+#ifndef _SD_STORAGE_H_
+#define _SD_STORAGE_H_
+
+/*
+ * SD Storage
+ *
+ * SD card policy for AcquisitionCore (see StoragePolicies.h for the shape).
+ * data.txt is opened once and flushed after every record, so the logging
+ * loop never reopens the file or allocates a new handle.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+
+#ifdef ESP32
+#define AQMS_FILE_APPEND FILE_APPEND
+#else
+#define AQMS_FILE_APPEND FILE_WRITE   // AVR SD appends on FILE_WRITE
+#endif
+
+class SDStorage {
+private:
+    uint8_t _csPin;
+    const char *_dataPath;
+    File _data;
+
+public:
+    static const bool persistent = true;
+
+    SDStorage(uint8_t csPin, const char *dataPath = "/data.txt")
+        : _csPin(csPin), _dataPath(dataPath) {
+    }
+
+    // Retries until the card answers, as the firmware always has
+    bool begin() {
+        pinMode(_csPin, OUTPUT);
+        while (!SD.begin(_csPin)) {
+            Serial.println(F("SD Card: initialization failed!"));
+            delay(1000);
+        }
+        Serial.println(F("SD Card: initialization successful!"));
+        return true;
+    }
+
+    Print *record() {
+        if (!_data) {
+            _data = SD.open(_dataPath, AQMS_FILE_APPEND);
+        }
+        if (!_data) {
+            Serial.println(F("SD Card: error on opening file data.txt"));
+            return NULL;
+        }
+        return &_data;
+    }
+
+    // Commit the record without closing the file
+    void commit() {
+        if (_data) _data.flush();
+    }
+
+    template <typename Fn>
+    bool readFile(const char *path, Fn fn) {
+        File file = SD.open(path, FILE_READ);
+        if (!file) return false;
+        fn(file);
+        file.close();
+        return true;
+    }
+
+    // fn(Stream&) from byte `offset`; false when the file is shorter
+    template <typename Fn>
+    bool readFileFrom(const char *path, uint32_t offset, Fn fn) {
+        File file = SD.open(path, FILE_READ);
+        if (!file) return false;
+        if (offset > file.size() || !file.seek(offset)) {
+            file.close();
+            return false;
+        }
+        fn(file);
+        file.close();
+        return true;
+    }
+
+    template <typename Fn>
+    bool writeFile(const char *path, Fn fn) {
+        SD.remove(path);
+        File file = SD.open(path, FILE_WRITE);
+        if (!file) return false;
+        fn(file);
+        file.close();
+        return true;
+    }
+
+    template <typename Fn>
+    bool appendFile(const char *path, Fn fn) {
+        File file = SD.open(path, AQMS_FILE_APPEND);
+        if (!file) return false;
+        fn(file);
+        file.close();
+        return true;
+    }
+};
+
+#endif // _SD_STORAGE_H_
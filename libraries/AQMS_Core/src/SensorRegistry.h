@@ -0,0 +1,231 @@
+#ifndef _SENSOR_REGISTRY_H_
+#define _SENSOR_REGISTRY_H_
+
+/*
+ * Sensor Registry
+ *
+ * Compile-time list of sensor channels. Each channel is described once
+ * (name, unit, read period, print precision, read function) and the
+ * scheduler, CSV header, CSV/binary record writers and Serial printer are
+ * all generated from that list by template recursion - no virtual calls,
+ * no per-cycle lookups, and the read functions are inlined.
+ *
+ * Adding a channel is one line in the registry definition:
+ *
+ *   auto sensors = makeSensorRegistry(
+ *       sensorChannel("co2", "ppm", 0, 2, []() { return readCO2(); }),
+ *       sensorChannel("pm25", "ug/m3", 1000, 2, []() { return readPM25(); }));
+ *
+ *   sensors.poll(millis());
+ *   sensors.printValues(dataFile, ",");
+ *   sensors.printJson(client);              // ,"co2":412.50,"pm25":8.10
+ *   float co2 = sensors.value<0>();
+ *
+ * Channels made with measuredChannel() also carry a status byte, set by
+ * the board before each record and written after the values as a
+ * "<name>_status" column (STATUS_* bits below). A reader can then tell a
+ * reading from a warming sensor's placeholder or a held value without
+ * guessing from the number itself.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// JSON has no NaN or infinity; failed reads become null
+inline size_t printJsonNumber(Print &out, float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) return out.print("null");
+    return out.print(value, decimals);
+}
+
+// Status bits of a measured channel's value
+enum {
+    STATUS_WARMING      = 0x01,     // Sensor still warming up; the value is a placeholder
+    STATUS_CALIBRATED   = 0x02,     // Stored, fitted or factory calibration in use
+    STATUS_STALE        = 0x04,     // Held from an earlier reading, not measured for this record
+    STATUS_FAULT        = 0x08,     // The input failed a health check during the record
+    STATUS_INTERPOLATED = 0x10      // Estimated: the reading was rejected and replaced
+};
+
+template <typename ReadFn>
+struct SensorChannel {
+    const char *name;
+    const char *unit;
+    uint32_t period;       // Minimum time between reads in ms (0 = every poll)
+    uint8_t decimals;      // Digits printed after the decimal point
+    ReadFn read;
+    float value;
+    uint32_t lastRead;
+    bool hasRead;
+    bool hasStatus;        // Has a "<name>_status" column
+    uint8_t status;        // STATUS_* bits, set before each record
+
+    // Read the sensor if its period has elapsed
+    inline void poll(uint32_t now) {
+        if (!hasRead || now - lastRead >= period) {
+            value = read();
+            lastRead = now;
+            hasRead = true;
+        }
+    }
+};
+
+template <typename ReadFn>
+SensorChannel<ReadFn> sensorChannel(const char *name, const char *unit, uint32_t period,
+                                    uint8_t decimals, ReadFn read) {
+    SensorChannel<ReadFn> ch = {name, unit, period, decimals, read, 0.0f, 0, false, false, 0};
+    return ch;
+}
+
+// A channel read from a sensor, with a status column
+template <typename ReadFn>
+SensorChannel<ReadFn> measuredChannel(const char *name, const char *unit, uint32_t period,
+                                      uint8_t decimals, ReadFn read) {
+    SensorChannel<ReadFn> ch = {name, unit, period, decimals, read, 0.0f, 0, false, true, 0};
+    return ch;
+}
+
+template <typename... Channels>
+class SensorRegistry;
+
+// End of the channel list
+template <>
+class SensorRegistry<> {
+public:
+    static const uint8_t count = 0;
+
+    inline void poll(uint32_t) {}
+    inline void printHeader(Print &, const char *) const {}
+    inline void printValues(Print &, const char *) const {}
+    inline void printStatusHeader(Print &, const char *) const {}
+    inline void printStatus(Print &, const char *) const {}
+    inline void writeBinary(Print &) const {}
+    inline void printJson(Print &) const {}
+    inline void copyValues(float *) const {}
+    template <typename Fn> inline void forEach(Fn &) {}
+};
+
+template <typename Head, typename... Tail>
+class SensorRegistry<Head, Tail...> {
+public:
+    typedef SensorRegistry<Tail...> TailRegistry;
+    static const uint8_t count = 1 + TailRegistry::count;
+
+    SensorRegistry(const Head &head, const Tail &...tail) : _head(head), _tail(tail...) {}
+
+    Head &head() { return _head; }
+    const Head &head() const { return _head; }
+    TailRegistry &tail() { return _tail; }
+    const TailRegistry &tail() const { return _tail; }
+
+    // Read every channel whose period has elapsed, in declaration order
+    inline void poll(uint32_t now) {
+        _head.poll(now);
+        _tail.poll(now);
+    }
+
+    // Channel names, each preceded by the separator ("date , time" come first)
+    inline void printHeader(Print &out, const char *separator) const {
+        out.print(separator);
+        out.print(_head.name);
+        _tail.printHeader(out, separator);
+    }
+
+    // Latest values, each preceded by the separator
+    inline void printValues(Print &out, const char *separator) const {
+        out.print(separator);
+        out.print(_head.value, _head.decimals);
+        _tail.printValues(out, separator);
+    }
+
+    // "<name>_status" of the measured channels, each preceded by the separator
+    inline void printStatusHeader(Print &out, const char *separator) const {
+        if (_head.hasStatus) {
+            out.print(separator);
+            out.print(_head.name);
+            out.print("_status");
+        }
+        _tail.printStatusHeader(out, separator);
+    }
+
+    // Status of the measured channels, each preceded by the separator
+    inline void printStatus(Print &out, const char *separator) const {
+        if (_head.hasStatus) {
+            out.print(separator);
+            out.print(_head.status);
+        }
+        _tail.printStatus(out, separator);
+    }
+
+    // Latest values as JSON members, each preceded by a comma, then
+    // "<name>_status" after each measured one
+    inline void printJson(Print &out) const {
+        out.print(",\"");
+        out.print(_head.name);
+        out.print("\":");
+        printJsonNumber(out, _head.value, _head.decimals);
+        if (_head.hasStatus) {
+            out.print(",\"");
+            out.print(_head.name);
+            out.print("_status\":");
+            out.print(_head.status);
+        }
+        _tail.printJson(out);
+    }
+
+    // Latest values as little-endian IEEE floats, in declaration order,
+    // each measured one followed by its status byte
+    inline void writeBinary(Print &out) const {
+        out.write((const uint8_t *)&_head.value, sizeof(float));
+        if (_head.hasStatus) out.write(_head.status);
+        _tail.writeBinary(out);
+    }
+
+    // Snapshot the latest values into a float[count] record
+    inline void copyValues(float *record) const {
+        record[0] = _head.value;
+        _tail.copyValues(record + 1);
+    }
+
+    // Call fn(channel) for every channel; fn needs a templated operator()
+    template <typename Fn>
+    inline void forEach(Fn &fn) {
+        fn(_head);
+        _tail.forEach(fn);
+    }
+
+    template <uint8_t I>
+    inline float &value();
+
+private:
+    Head _head;
+    TailRegistry _tail;
+};
+
+// Compile-time indexed access to a channel value
+template <uint8_t I, typename Registry>
+struct SensorRegistryAt {
+    static inline float &get(Registry &r) {
+        return SensorRegistryAt<I - 1, typename Registry::TailRegistry>::get(r.tail());
+    }
+};
+
+template <typename Registry>
+struct SensorRegistryAt<0, Registry> {
+    static inline float &get(Registry &r) {
+        return r.head().value;
+    }
+};
+
+template <typename Head, typename... Tail>
+template <uint8_t I>
+inline float &SensorRegistry<Head, Tail...>::value() {
+    static_assert(I < count, "sensor index out of range");
+    return SensorRegistryAt<I, SensorRegistry<Head, Tail...> >::get(*this);
+}
+
+template <typename... Channels>
+SensorRegistry<Channels...> makeSensorRegistry(const Channels &...channels) {
+    return SensorRegistry<Channels...>(channels...);
+}
+
+#endif // _SENSOR_REGISTRY_H_
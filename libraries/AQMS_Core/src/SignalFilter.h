@@ -0,0 +1,318 @@
+#ifndef _SIGNAL_FILTER_H_
+#define _SIGNAL_FILTER_H_
+
+/*
+ * Signal Filter
+ *
+ * Per-channel filter chains, configured from config.txt, and a two-sensor
+ * Kalman fusion filter.
+ *
+ * A chain is up to FILTER_STAGES stages, applied in order, written as
+ *
+ *   hampel:7:3          drop outliers: a reading more than 3 scaled MADs
+ *                       from the median of the last 7 is replaced by it
+ *                       (never while the MAD is 0)
+ *   median:5            median of the last 5 readings
+ *   kalman:2:100        local-level Kalman filter: the value wanders about
+ *                       2 units per sqrt(s), readings have variance 100
+ *
+ * e.g. "so2_filter = hampel:7:3,kalman:0.05:0.01". Each stage has a fixed
+ * window (at most FILTER_WINDOW readings), so memory and work per reading
+ * are fixed: a median or Hampel stage sorts at most 9 values, a Kalman
+ * stage is a handful of multiply-adds. Failed reads (NAN) pass through
+ * without touching the state. replaced() tells whether a Hampel stage
+ * swapped the latest reading for its median.
+ *
+ * FusionKalman estimates one quantity from a primary sensor that holds
+ * the absolute level and a secondary one that is faster and quieter but
+ * offset - the MG-811 and ENS160 eCO2 for CO2. Its state is the level and
+ * the secondary's offset; each sensor updates it when a reading arrives,
+ * at its own rate. Readings more than FUSION_GATE standard deviations off
+ * are skipped, unless FUSION_GATE_MISSES arrive in a row, which is taken
+ * as a real step. Smaller changes are caught by a decaying sum of the
+ * normalised primary innovations: when it passes FUSION_DRIFT_LIMIT the
+ * readings have stayed on one side of the estimate for too long and the
+ * level variance is opened up. Both let the process noise stay low, so
+ * the level is smoothed hard while the air is steady and still follows a
+ * change within a second or two.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define FILTER_STAGES 3
+#define FILTER_WINDOW 9
+#define FILTER_MAD_SCALE 1.4826f    // MAD -> standard deviation for normal noise
+
+#define FUSION_GATE 4.0f
+#define FUSION_GATE_MISSES 3
+#define FUSION_DRIFT_DECAY 0.97f    // Per primary reading
+#define FUSION_DRIFT_LIMIT 16.0f
+
+enum { FILTER_NONE, FILTER_MEDIAN, FILTER_HAMPEL, FILTER_KALMAN };
+
+// Median of n values (n <= FILTER_WINDOW); insertion sort, the inputs are kept
+inline float filterMedian(const float *values, uint8_t n) {
+    float sorted[FILTER_WINDOW];
+    for (uint8_t i = 0; i < n; i++) {
+        float v = values[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+struct FilterStage {
+    uint8_t type;
+    uint8_t window;
+    uint8_t head;
+    uint8_t filled;
+    float a, b;                     // hampel: threshold; kalman: rate, variance
+    float history[FILTER_WINDOW];
+    float x, p;                     // Kalman estimate and variance
+    uint32_t last;
+    bool replaced;                  // hampel: the last reading was an outlier
+
+    void reset() {
+        head = filled = 0;
+        p = -1;                     // Not seeded
+        replaced = false;
+    }
+
+    float push(float v) {
+        history[head] = v;
+        head = head + 1 == window ? 0 : head + 1;
+        if (filled < window) filled++;
+        return filterMedian(history, filled);
+    }
+
+    float apply(float v, uint32_t now) {
+        switch (type) {
+            case FILTER_MEDIAN:
+                return push(v);
+            case FILTER_HAMPEL: {
+                float median = push(v);
+                if (filled < 3) return v;
+                float deviation[FILTER_WINDOW];
+                for (uint8_t i = 0; i < filled; i++) deviation[i] = fabs(history[i] - median);
+                float mad = filterMedian(deviation, filled) * FILTER_MAD_SCALE;
+                // A window mostly of one value (a quantised or held input)
+                // has no spread to judge by; pass readings through
+                replaced = mad > 0 && fabs(v - median) > a * mad;
+                return replaced ? median : v;
+            }
+            case FILTER_KALMAN: {
+                if (p < 0) {
+                    x = v;
+                    p = b;
+                } else {
+                    p += a * a * (now - last) / 1000.0f;
+                    float k = p / (p + b);
+                    x += k * (v - x);
+                    p *= 1 - k;
+                }
+                last = now;
+                return x;
+            }
+            default:
+                return v;
+        }
+    }
+};
+
+class SignalFilter {
+private:
+    FilterStage _stages[FILTER_STAGES];
+    uint8_t _count = 0;
+    bool _replaced = false;
+
+    // One "type:arg:arg" stage
+    bool parseStage(char *text) {
+        if (_count >= FILTER_STAGES) return false;
+        char *args[3] = {text, NULL, NULL};
+        uint8_t n = 1;
+        for (char *p = text; *p != '\0' && n < 3; p++) {
+            if (*p == ':') {
+                *p = '\0';
+                args[n++] = p + 1;
+            }
+        }
+        FilterStage &s = _stages[_count];
+        s.a = n > 2 ? atof(args[2]) : 0;
+        s.b = 0;
+        if (strcmp(args[0], "median") == 0 || strcmp(args[0], "hampel") == 0) {
+            int window = n > 1 ? atoi(args[1]) : 5;
+            if (window < 1 || window > FILTER_WINDOW) return false;
+            s.type = args[0][0] == 'm' ? FILTER_MEDIAN : FILTER_HAMPEL;
+            s.window = window;
+            if (s.type == FILTER_HAMPEL && !(s.a > 0)) s.a = 3;
+        } else if (strcmp(args[0], "kalman") == 0 && n == 3) {
+            s.type = FILTER_KALMAN;
+            s.a = atof(args[1]);
+            s.b = atof(args[2]);
+            if (!(s.a > 0) || !(s.b > 0)) return false;
+        } else {
+            return false;
+        }
+        s.reset();
+        _count++;
+        return true;
+    }
+
+public:
+    // "stage,stage,..." or "" / "none" for no filtering; false (and no
+    // filtering) on a malformed spec
+    bool configure(const char *spec) {
+        char text[64];
+        strncpy(text, spec, sizeof(text) - 1);
+        text[sizeof(text) - 1] = '\0';
+        _count = 0;
+        if (text[0] == '\0' || strcmp(text, "none") == 0) return true;
+        char *start = text;
+        for (char *p = text;; p++) {
+            if (*p == ',' || *p == '\0') {
+                bool last = *p == '\0';
+                *p = '\0';
+                while (*start == ' ') start++;
+                if (!parseStage(start)) {
+                    _count = 0;
+                    return false;
+                }
+                if (last) break;
+                start = p + 1;
+            }
+        }
+        return true;
+    }
+
+    uint8_t stages() const { return _count; }
+
+    // The latest reading was an outlier and the output is its replacement
+    bool replaced() const { return _replaced; }
+
+    void reset() {
+        for (uint8_t i = 0; i < _count; i++) _stages[i].reset();
+    }
+
+    // One reading through the chain; now is millis()
+    float update(float value, uint32_t now) {
+        _replaced = false;
+        if (isnan(value) || isinf(value)) return value;
+        for (uint8_t i = 0; i < _count; i++) {
+            value = _stages[i].apply(value, now);
+            _replaced |= _stages[i].replaced;
+        }
+        return value;
+    }
+};
+
+// Level from a primary sensor fused with an offset secondary one
+class FusionKalman {
+private:
+    float _rate = 5;                // Level change, units per sqrt(s)
+    float _biasRate = 0.1f;         // Secondary offset change, units per sqrt(s)
+    float _primaryNoise = 0.05f;    // Relative, of the reading
+    float _secondaryNoise = 20;     // Absolute
+    float _primaryFloor = 400;      // Primary noise is relative to at least this
+    float _level = 0, _bias = 0;
+    float _p00 = 0, _p01 = 0, _p11 = 0;
+    uint32_t _last = 0;
+    bool _seeded = false;
+    uint8_t _primaryMisses = 0, _secondaryMisses = 0;
+    float _drift = 0;               // Decaying sum of normalised primary innovations
+    uint32_t _secondaryCount = 0, _rejected = 0;
+    bool _gated = false;            // The last primary reading was skipped
+
+    void predict(uint32_t now) {
+        float dt = (now - _last) / 1000.0f;
+        _last = now;
+        _p00 += _rate * _rate * dt;
+        _p11 += _biasRate * _biasRate * dt;
+    }
+
+    // Measurement z = level + h1 * bias with variance r; false if gated out
+    bool correct(float z, float h1, float r, uint8_t &misses) {
+        float h0p = _p00 + h1 * _p01;       // (P H')[0]
+        float h1p = _p01 + h1 * _p11;       // (P H')[1]
+        float s = h0p + h1 * h1p + r;
+        float y = z - (_level + h1 * _bias);
+        if (y * y > FUSION_GATE * FUSION_GATE * s) {
+            if (++misses < FUSION_GATE_MISSES) {
+                _rejected++;
+                return false;
+            }
+            _p00 += y * y;                  // A real step: let the level jump
+            h0p = _p00 + h1 * _p01;
+            s = h0p + h1 * h1p + r;
+        }
+        misses = 0;
+        float k0 = h0p / s, k1 = h1p / s;
+        _level += k0 * y;
+        _bias += k1 * y;
+        _p00 -= k0 * h0p;
+        _p01 -= k0 * h1p;
+        _p11 -= k1 * h1p;
+        return true;
+    }
+
+public:
+    // rate: how fast the true value moves (units/sqrt(s)); primaryNoise relative;
+    // secondaryNoise absolute; biasRate: drift of the secondary's offset
+    void configure(float rate, float primaryNoise, float secondaryNoise, float biasRate, float primaryFloor) {
+        _rate = rate;
+        _primaryNoise = primaryNoise;
+        _secondaryNoise = secondaryNoise;
+        _biasRate = biasRate;
+        _primaryFloor = primaryFloor;
+    }
+
+    void reset() { _seeded = false; }
+
+    // A primary reading; returns the fused level
+    float updatePrimary(float z, uint32_t now) {
+        if (isnan(z) || isinf(z)) return _seeded ? _level : z;
+        float sigma = _primaryNoise * (z > _primaryFloor ? z : _primaryFloor);
+        if (!_seeded) {
+            _level = z;
+            _bias = 0;
+            _p00 = sigma * sigma;
+            _p01 = 0;
+            _p11 = 4 * _primaryFloor * _primaryFloor;   // Offset unknown
+            _last = now;
+            _seeded = true;
+            return _level;
+        }
+        predict(now);
+        float s = _p00 + sigma * sigma;
+        float y = z - _level;
+        _drift = _drift * FUSION_DRIFT_DECAY + y / sqrt(s);
+        if (fabs(_drift) > FUSION_DRIFT_LIMIT) {
+            _p00 += y * y;                  // Readings stay on one side: the level has moved
+            _drift = 0;
+        }
+        _gated = !correct(z, 0, sigma * sigma, _primaryMisses);
+        return _level;
+    }
+
+    // A secondary reading; ignored until the primary has seeded the level
+    void updateSecondary(float z, uint32_t now) {
+        if (!_seeded || isnan(z) || isinf(z)) return;
+        predict(now);
+        correct(z, 1, _secondaryNoise * _secondaryNoise, _secondaryMisses);
+        _secondaryCount++;
+    }
+
+    float level() const { return _level; }
+    float bias() const { return _bias; }                // Secondary minus level
+    float sigma() const { return sqrt(_p00); }          // Standard deviation of the level
+    uint32_t rejected() const { return _rejected; }
+    bool gated() const { return _gated; }               // The level ignores the last primary reading
+    uint32_t secondaryCount() const { return _secondaryCount; }
+};
+
+#endif // _SIGNAL_FILTER_H_
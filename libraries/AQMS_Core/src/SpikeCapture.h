@@ -0,0 +1,229 @@
+#ifndef _SPIKE_CAPTURE_H_
+#define _SPIKE_CAPTURE_H_
+
+/*
+ * Spike Capture
+ *
+ * Event-triggered high-rate capture of the raw analog inputs. The logged
+ * records are 1 s apart and each reading is a 16-sample average, so a
+ * passing truck or a short gas release is smeared into one or two values;
+ * this keeps the last few seconds of single readings at a much higher
+ * rate, and when a channel jumps writes them and the seconds after to a
+ * separate file.
+ *
+ * A sampler (on the ESP32 a FreeRTOS task on the other core) calls
+ * addFrame() at a fixed rate with one reading per channel. Frames go into
+ * a ring that always holds the pre-trigger window. Per channel, three
+ * exponential filters watch the signal:
+ *
+ *   fast      ~50 ms, the de-noised signal
+ *   lagging   ~250 ms; fast - lagging is the rate of change
+ *   baseline  ~30 s, frozen during an event
+ *
+ * An event starts when |fast - baseline| exceeds the level threshold or
+ * the rate of change exceeds the slope threshold on any channel. It spans
+ * `pre` frames before the trigger to `post` frames after it, and the loop
+ * appends it to the SD card with write(), a chunk per call. A new event
+ * can start once that is done and every channel is back below half of
+ * both thresholds.
+ *
+ * The sampler only touches the ring and its own filter state, the loop
+ * only reads; frame and event hand-over go through `volatile` counters
+ * with a memory barrier, single producer / single consumer. Frames the
+ * sampler overwrites before the loop has written them are counted as
+ * lost.
+ *
+ * File format, per event:
+ *
+ *   # event 3, epoch_ms 1718000000123, mq136 slope, 100 Hz
+ *   t_ms,mg811,mq136,mq4,mics_ox,mics_red
+ *   -2000,1834,1210,...                      t_ms relative to the trigger
+ *   # 12 frames lost                         only if the loop fell behind
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "TimeService.h"
+
+#define CAPTURE_FAST_MS     50      // Detection filter time constants
+#define CAPTURE_LAG_MS      250
+#define CAPTURE_BASELINE_MS 30000
+#define CAPTURE_SETTLE_MS   10000   // No trigger before the baseline has settled
+#define CAPTURE_WRITE_MAX   128     // Frames appended per write() call
+
+// What started an event
+enum { CAPTURE_LEVEL = 1, CAPTURE_SLOPE = 2 };
+
+template <uint8_t Channels, uint16_t Frames>
+class SpikeCapture {
+private:
+    const char *const *_names;
+    uint16_t _ring[Frames][Channels];
+    volatile uint32_t _written = 0;     // Frames added, producer-owned
+
+    // Detection state, producer-owned
+    float _fast[Channels], _lag[Channels], _baseline[Channels];
+    float _aFast = 1, _aLag = 1, _aBaseline = 1;
+    float _level = 0, _slope = 0;       // 0 = trigger off
+    float _slopeScale = 0;              // (fast - lagging) -> units per second
+    uint16_t _rate = 100;
+    uint32_t _pre = 0, _post = 0;
+    uint32_t _settleFrames = 0;
+    bool _armed = true;
+
+    // Event hand-over: set by the producer, cleared by the consumer
+    volatile bool _pending = false;
+    uint32_t _eventStart = 0, _eventTrigger = 0, _eventEnd = 0;
+    uint32_t _eventMs = 0;
+    uint8_t _eventChannel = 0, _eventKind = 0;
+
+    // Consumer state
+    bool _writing = false;
+    uint32_t _tail = 0;
+    uint32_t _eventLost = 0;
+    uint32_t _events = 0;
+    uint32_t _lostTotal = 0;
+
+    static float alpha(uint32_t tauMs, uint16_t rate) {
+        float dt = 1000.0f / rate;
+        return dt / (tauMs + dt);
+    }
+
+    void printHeader(Print &file, uint64_t epochMs) const {
+        file.print("# event ");
+        file.print(_events + 1);
+        file.print(", epoch_ms ");
+        printUint64(file, epochMs);
+        file.print(", ");
+        file.print(_names[_eventChannel]);
+        file.print(_eventKind == CAPTURE_SLOPE ? " slope, " : " level, ");
+        file.print(_rate);
+        file.print(" Hz\n");
+        file.print("t_ms");
+        for (uint8_t c = 0; c < Channels; c++) {
+            file.print(',');
+            file.print(_names[c]);
+        }
+        file.print('\n');
+    }
+
+public:
+    explicit SpikeCapture(const char *const *names) : _names(names) {}
+
+    // rate in frames per second; level in input units; slope in input units
+    // per second; pre and post in ms
+    void configure(uint16_t rate, float level, float slope, uint32_t preMs, uint32_t postMs) {
+        _rate = rate > 0 ? rate : 1;
+        _level = level;
+        _slope = slope;
+        _aFast = alpha(CAPTURE_FAST_MS, _rate);
+        _aLag = alpha(CAPTURE_LAG_MS, _rate);
+        _aBaseline = alpha(CAPTURE_BASELINE_MS, _rate);
+        _slopeScale = 1000.0f / (CAPTURE_LAG_MS - CAPTURE_FAST_MS);
+        _pre = (uint32_t)preMs * _rate / 1000;
+        if (_pre > Frames / 2) _pre = Frames / 2;   // Leave room for the loop to fall behind
+        _post = (uint32_t)postMs * _rate / 1000;
+        _settleFrames = (uint32_t)CAPTURE_SETTLE_MS * _rate / 1000;
+    }
+
+    // Producer: one reading per channel; now is millis()
+    void addFrame(uint32_t now, const uint16_t *values) {
+        uint32_t n = _written;
+        memcpy(_ring[n % Frames], values, sizeof(_ring[0]));
+
+        uint8_t fired = 0, channel = 0;
+        bool quiet = true;
+        for (uint8_t c = 0; c < Channels; c++) {
+            float x = values[c];
+            if (n == 0) _fast[c] = _lag[c] = _baseline[c] = x;
+            _fast[c] += _aFast * (x - _fast[c]);
+            _lag[c] += _aLag * (x - _lag[c]);
+            float level = fabs(_fast[c] - _baseline[c]);
+            float slope = fabs(_fast[c] - _lag[c]) * _slopeScale;
+            if (!fired) {
+                if (_level > 0 && level > _level) fired = CAPTURE_LEVEL;
+                else if (_slope > 0 && slope > _slope) fired = CAPTURE_SLOPE;
+                if (fired) channel = c;
+            }
+            if ((_level > 0 && level > _level / 2) || (_slope > 0 && slope > _slope / 2)) quiet = false;
+            if (!_pending) _baseline[c] += _aBaseline * (_fast[c] - _baseline[c]);
+        }
+
+        if (!_armed && !_pending && quiet) _armed = true;
+        if (fired && _armed && !_pending && n >= _settleFrames) {
+            _armed = false;
+            _eventTrigger = n;
+            _eventStart = n > _pre ? n - _pre : 0;
+            _eventEnd = n + _post + 1;
+            _eventMs = now;
+            _eventChannel = channel;
+            _eventKind = fired;
+            __sync_synchronize();
+            _pending = true;
+        }
+        __sync_synchronize();
+        _written = n + 1;
+    }
+
+    // Consumer: an event is waiting or being written
+    bool busy() const { return _pending; }
+
+    // Consumer: append up to CAPTURE_WRITE_MAX frames of the current event to
+    // `path`; epochMs / now are the clock and millis() at the call
+    template <class Storage>
+    bool write(Storage &storage, const char *path, uint64_t epochMs, uint32_t now) {
+        if (!_pending) return true;
+        __sync_synchronize();
+        bool header = !_writing;
+        if (header) {
+            _writing = true;
+            _tail = _eventStart;
+            _eventLost = 0;
+        }
+        uint32_t written = _written;
+        uint32_t end = (int32_t)(written - _eventEnd) < 0 ? written : _eventEnd;
+        uint64_t triggerEpoch = epochMs - (now - _eventMs);
+
+        bool ok = storage.appendFile(path, [&](Print &file) {
+            if (header) printHeader(file, triggerEpoch);
+            uint16_t frame[Channels];
+            for (uint16_t n = 0; (int32_t)(end - _tail) > 0 && n < CAPTURE_WRITE_MAX; n++, _tail++) {
+                memcpy(frame, _ring[_tail % Frames], sizeof(frame));
+                __sync_synchronize();
+                if (_written - _tail >= Frames) {
+                    _eventLost++;   // Overwritten before it was written out
+                    continue;
+                }
+                file.print((long)((int32_t)(_tail - _eventTrigger) * 1000L / _rate));
+                for (uint8_t c = 0; c < Channels; c++) {
+                    file.print(',');
+                    file.print(frame[c]);
+                }
+                file.print('\n');
+            }
+        });
+
+        if ((int32_t)(_tail - _eventEnd) >= 0 || !ok) {
+            if (_eventLost > 0) {
+                storage.appendFile(path, [&](Print &file) {
+                    file.print("# ");
+                    file.print(_eventLost);
+                    file.print(" frames lost\n");
+                });
+            }
+            _lostTotal += _eventLost;
+            _events++;
+            _writing = false;
+            __sync_synchronize();
+            _pending = false;
+        }
+        return ok;
+    }
+
+    uint32_t events() const { return _events; }
+    uint32_t lost() const { return _lostTotal; }
+    uint32_t frames() const { return _written; }
+    uint16_t rate() const { return _rate; }
+};
+
+#endif // _SPIKE_CAPTURE_H_
@@ -0,0 +1,81 @@
+#ifndef _STORAGE_POLICIES_H_
+#define _STORAGE_POLICIES_H_
+
+/*
+ * Storage Policies
+ *
+ * Compile-time storage backends for AcquisitionCore. Every policy has the
+ * same shape, so the firmware is written once and the board picks one:
+ *
+ *   begin()                     - bring the medium up
+ *   record()                    - Print to write the current record to (NULL if none)
+ *   commit()                    - finish the current record
+ *   readFile(path, fn)          - fn(Stream&) on an existing file
+ *   readFileFrom(path, off, fn) - fn(Stream&) from byte `off` of an existing file
+ *   writeFile(path, fn)         - fn(Print&) on a truncated file
+ *   appendFile(path, fn)        - fn(Print&) at the end of a file
+ *
+ * NoStorage and RamStorage live here; SDStorage (which pulls in SD.h) is in
+ * SDStorage.h so boards without a card never link the SD library.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Discards everything; config and calibration files are never found
+class NoStorage {
+public:
+    static const bool persistent = false;
+
+    bool begin() { return true; }
+    Print *record() { return NULL; }
+    void commit() {}
+
+    template <typename Fn> bool readFile(const char *, Fn) { return false; }
+    template <typename Fn> bool readFileFrom(const char *, uint32_t, Fn) { return false; }
+    template <typename Fn> bool writeFile(const char *, Fn) { return false; }
+    template <typename Fn> bool appendFile(const char *, Fn) { return false; }
+};
+
+// Keeps the most recent records in a RAM ring buffer (oldest bytes are
+// overwritten). Useful on boards without a card and for host benchmarks.
+template <uint16_t Bytes>
+class RamStorage : public Print {
+private:
+    uint8_t _buffer[Bytes];
+    uint16_t _head = 0;
+    uint16_t _size = 0;
+
+public:
+    static const bool persistent = false;
+
+    bool begin() {
+        _head = 0;
+        _size = 0;
+        return true;
+    }
+
+    Print *record() { return this; }
+    void commit() {}
+
+    size_t write(uint8_t c) {
+        _buffer[_head] = c;
+        _head = (_head + 1) % Bytes;
+        if (_size < Bytes) _size++;
+        return 1;
+    }
+
+    uint16_t size() const { return _size; }
+
+    // Byte i of the buffered log, oldest first
+    uint8_t at(uint16_t i) const {
+        return _buffer[(_head + Bytes - _size + i) % Bytes];
+    }
+
+    template <typename Fn> bool readFile(const char *, Fn) { return false; }
+    template <typename Fn> bool readFileFrom(const char *, uint32_t, Fn) { return false; }
+    template <typename Fn> bool writeFile(const char *, Fn) { return false; }
+    template <typename Fn> bool appendFile(const char *, Fn) { return false; }
+};
+
+#endif // _STORAGE_POLICIES_H_
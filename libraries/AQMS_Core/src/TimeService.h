@@ -0,0 +1,221 @@
+#ifndef _TIME_SERVICE_H_
+#define _TIME_SERVICE_H_
+
+/*
+ * Time Service
+ *
+ * A monotonic millisecond clock (the system time on ESP32, millis()
+ * extended to 64 bits elsewhere) disciplined against GPS time, so every
+ * sample gets a UTC epoch-ms timestamp - also between fixes and after the
+ * fix is lost.
+ *
+ * Each GPS time (NMEA date + time incl. centiseconds) is a sync point. With
+ * a PPS input the sync uses the monotonic time of the pulse that started
+ * that second instead of the sentence arrival, removing the serial latency.
+ * The clock rate error is estimated from sync points at least
+ * TIME_RATE_SPAN apart and applied between syncs.
+ *
+ * Timestamps never go backwards: a sync that would step the clock back
+ * holds it until real time catches up. Before the first sync the clock
+ * counts from 0 at boot, so values below TIME_EPOCH_VALID are not UTC.
+ *
+ * On the ESP32 the monotonic clock is the system time, which the RTC timer
+ * keeps counting through deep sleep (nothing sets it), so the sync state
+ * saved with save() before a deep sleep is still valid after restore() on
+ * the wake and records are UTC from the first one.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#ifdef ESP32
+#include <sys/time.h>
+#endif
+
+#define TIME_RATE_SPAN    600000ULL      // ms between sync points used for the rate estimate
+#define TIME_RATE_ALPHA   0.2f           // EWMA weight of a new rate estimate
+#define TIME_RATE_MAX_PPM 500.0f         // Crystal error bound; larger estimates are ignored
+#define TIME_PPS_WINDOW   1000           // A PPS edge older than this is not used
+#define TIME_NMEA_LATENCY_MS 0           // Sentence arrival after the second it reports (no PPS)
+#define TIME_EPOCH_VALID  946684800000ULL // 2000-01-01 UTC in ms
+#define TIME_STATE_MAGIC  0x41515453UL   // "AQTS"
+
+// Monotonic ms, 64 bits so it never wraps; on ESP32 since power-up,
+// deep sleep included
+#ifdef ESP32
+inline uint64_t monotonicMillis() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+#elif defined(TIME_HOST_RTC)
+// Supplied by a host program that simulates deep sleep, as ESP32's RTC
+uint64_t monotonicMillis();
+#else
+// Extends millis() by counting wraps; call at least every 49 days (every loop)
+inline uint64_t monotonicMillis() {
+    static uint32_t last = 0, wraps = 0;
+    uint32_t now = millis();
+    if (now < last) wraps++;
+    last = now;
+    return ((uint64_t)wraps << 32) | now;
+}
+#endif
+
+// Days since 1970-01-01 for a civil date
+inline int32_t daysFromCivil(int32_t y, int32_t m, int32_t d) {
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Civil date for a day count since 1970-01-01, as YYYYMMDD
+inline uint32_t civilFromDays(int32_t z) {
+    z += 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    uint32_t doe = (uint32_t)(z - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t y = (int32_t)yoe + era * 400;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t d = doy - (153 * mp + 2) / 5 + 1;
+    uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+    return (uint32_t)(y + (m <= 2)) * 10000UL + m * 100UL + d;
+}
+
+// Print has no 64-bit overload on AVR
+inline size_t printUint64(Print &out, uint64_t value) {
+    if (value < 1000000000ULL) return out.print((unsigned long)value);
+    size_t n = printUint64(out, value / 1000000000ULL);
+    uint32_t low = (uint32_t)(value % 1000000000ULL);
+    for (uint32_t digit = 100000000UL; digit > 1 && low < digit; digit /= 10) {
+        n += out.print('0');
+    }
+    return n + out.print((unsigned long)low);
+}
+
+// Sync state kept across a deep sleep. No constructor: it can live in RTC
+// memory (RTC_DATA_ATTR) and is ignored unless save() wrote it.
+struct TimeServiceState {
+    uint32_t magic;
+    uint64_t syncUtc, syncMono;
+    uint64_t rateUtc, rateMono;
+    uint64_t last;
+    float ppm;
+    bool rateKnown;
+};
+
+class TimeService {
+private:
+    uint64_t _syncUtc = 0;      // UTC ms at the last sync
+    uint64_t _syncMono = 0;     // Monotonic ms at the last sync
+    uint64_t _rateUtc = 0, _rateMono = 0;
+    uint64_t _last = 0;         // Last timestamp handed out
+    float _ppm = 0;             // Clock rate error, + = local clock slow
+    bool _rateKnown = false;
+    int16_t _offsetMin = 330;   // Local time offset (IST)
+    bool _synced = false;
+    volatile uint32_t _ppsMillis = 0;
+    volatile bool _ppsSeen = false;
+
+public:
+    // Timezone in hours, e.g. 5.5 for IST or -3.5 for NST
+    void setTimezone(float hours) {
+        _offsetMin = (int16_t)(hours * 60 + (hours < 0 ? -0.5f : 0.5f));
+    }
+
+    int16_t timezoneMinutes() const { return _offsetMin; }
+
+    // Call from the PPS interrupt
+    void ppsEdge(uint32_t ms) {
+        _ppsMillis = ms;
+        _ppsSeen = true;
+    }
+
+    // A GPS time (UTC, whole second plus centiseconds) was just decoded
+    void sync(uint64_t utcMs, uint64_t mono) {
+        uint32_t nowMillis = millis();
+        if (_ppsSeen && nowMillis - _ppsMillis < TIME_PPS_WINDOW) {
+            // The reported second began at the last pulse
+            mono -= nowMillis - _ppsMillis;
+            utcMs -= utcMs % 1000;
+        } else {
+            mono -= mono > TIME_NMEA_LATENCY_MS ? TIME_NMEA_LATENCY_MS : mono;
+        }
+
+        if (!_synced) {
+            _rateUtc = utcMs;
+            _rateMono = mono;
+        } else if (mono - _rateMono >= TIME_RATE_SPAN) {
+            int64_t error = (int64_t)(utcMs - _rateUtc) - (int64_t)(mono - _rateMono);
+            float ppm = (float)error * 1e6f / (float)(mono - _rateMono);
+            if (fabs(ppm) < TIME_RATE_MAX_PPM) {
+                _ppm = _rateKnown ? _ppm + TIME_RATE_ALPHA * (ppm - _ppm) : ppm;
+                _rateKnown = true;
+            }
+            _rateUtc = utcMs;
+            _rateMono = mono;
+        }
+
+        _syncUtc = utcMs;
+        _syncMono = mono;
+        _synced = true;
+    }
+
+    // Epoch ms (UTC) for a monotonic time; never less than the previous result
+    uint64_t nowMs(uint64_t mono) {
+        uint64_t t;
+        if (!_synced) {
+            t = mono;
+        } else {
+            int64_t elapsed = (int64_t)(mono - _syncMono);
+            t = _syncUtc + elapsed + (int64_t)(elapsed * _ppm / 1e6f);
+        }
+        if (t < _last) t = _last;
+        _last = t;
+        return t;
+    }
+
+    bool synced() const { return _synced; }
+    float ratePpm() const { return _ppm; }
+
+    // Keep the sync state before a deep sleep; nothing to keep before the first sync
+    void save(TimeServiceState &state) const {
+        state.magic = _synced ? TIME_STATE_MAGIC : 0;
+        state.syncUtc = _syncUtc;
+        state.syncMono = _syncMono;
+        state.rateUtc = _rateUtc;
+        state.rateMono = _rateMono;
+        state.last = _last;
+        state.ppm = _ppm;
+        state.rateKnown = _rateKnown;
+    }
+
+    // Continue from a state saved before the deep sleep just woken from
+    bool restore(const TimeServiceState &state) {
+        if (state.magic != TIME_STATE_MAGIC) return false;
+        _syncUtc = state.syncUtc;
+        _syncMono = state.syncMono;
+        _rateUtc = state.rateUtc;
+        _rateMono = state.rateMono;
+        _last = state.last;
+        _ppm = state.ppm;
+        _rateKnown = state.rateKnown;
+        _synced = true;
+        return true;
+    }
+
+    // Local YYYYMMDD and HHMMSS for an epoch-ms timestamp
+    void localDateTime(uint64_t epochMs, uint32_t &date, uint32_t &time) const {
+        int64_t seconds = (int64_t)(epochMs / 1000) + (int32_t)_offsetMin * 60;
+        int32_t days = (int32_t)(seconds / 86400);
+        uint32_t secondOfDay = (uint32_t)(seconds - (int64_t)days * 86400);
+        date = civilFromDays(days);
+        time = (secondOfDay / 3600) * 10000UL + ((secondOfDay / 60) % 60) * 100UL + secondOfDay % 60;
+    }
+};
+
+#endif // _TIME_SERVICE_H_
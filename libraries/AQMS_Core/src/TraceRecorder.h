@@ -0,0 +1,278 @@
+#ifndef _TRACE_RECORDER_H_
+#define _TRACE_RECORDER_H_
+
+/*
+ * Trace Recorder
+ *
+ * Raw sensor input captured in the field: every ADC burst, every byte
+ * read from a UART (GPS, SDS011) and every I2C register transfer, each
+ * with its millis() time. TraceReplay.h feeds a trace back through the
+ * real driver code on the host, faster than real time.
+ *
+ * Events are binary and small, so a day of full-rate input is tens of MB:
+ *
+ *   BOOT      type version                      once per setup()
+ *   SYNC      type ms(u32 LE)                   first event of every block
+ *   ADC       type dt pin n sample...           samples zigzag-delta varints
+ *   UART      type dt channel n byte...         bytes read in the same ms
+ *   I2C_READ  type dt addr reg n byte...
+ *   I2C_WRITE type dt addr reg n byte...
+ *   LOST      type count                        events dropped, buffer full
+ *   LOOP      type dt                           start of a loop() pass
+ *
+ * dt is a varint of ms since the previous event. A LOOP is written with
+ * the first event of a pass only, so passes that read nothing cost
+ * nothing; the replay starts its passes at the same times. Events go into a RAM
+ * buffer that the loop appends to the SD card once it is half full;
+ * each flushed block starts with a SYNC, so a block lost on power-down
+ * does not shift the timing of the next one.
+ *
+ * Recording hooks: TraceStream wraps a UART, TraceI2C wraps a driver with
+ * readReg/writeReg (DFRobot_ENS160), and readStableADC reports its
+ * bursts through adcBegin/adcSample/adcEnd.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define TRACE_VERSION 2
+
+// Event types
+#define TRACE_BOOT      1
+#define TRACE_SYNC      2
+#define TRACE_ADC       3
+#define TRACE_UART      4
+#define TRACE_I2C_READ  5
+#define TRACE_I2C_WRITE 6
+#define TRACE_LOST      7
+#define TRACE_LOOP      8
+
+// UART channels
+#define TRACE_GPS 0
+#define TRACE_PM  1
+
+#define TRACE_EVENT_MAX 255   // Bytes / samples in one event
+
+template <uint16_t Bytes>
+class TraceRecorder {
+private:
+    uint8_t _buf[Bytes];
+    uint16_t _used = 0;
+    uint16_t _eventStart = 0;
+    int16_t _open = -1;         // Count byte of the event still being extended
+    uint8_t _openType = 0;
+    uint8_t _openChannel = 0;
+    uint16_t _prevSample = 0;
+    uint32_t _last = 0;         // Time of the previous event
+    uint32_t _passStart = 0;    // Time of the loop pass being recorded
+    bool _passPending = false;  // Its LOOP is not written yet
+    uint32_t _lost = 0;         // Events dropped since the last LOST event
+    uint32_t _lostTotal = 0;
+    bool _enabled = false;
+    bool _synced = false;       // Block has its SYNC
+
+    void put(uint8_t b) { _buf[_used++] = b; }
+
+    void putVarint(uint32_t v) {
+        while (v >= 0x80) {
+            put((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        put((uint8_t)v);
+    }
+
+    uint16_t space() const { return Bytes - _used; }
+
+    void drop() {
+        _lost++;
+        _lostTotal++;
+    }
+
+    // Header of a timed event; false (and the event counted lost) when
+    // there is no room for the header plus `payload` bytes
+    bool startEvent(uint8_t type, uint32_t now, uint16_t payload) {
+        _open = -1;
+        if (space() < 5 + 6 + 6 + 6 + payload) { // SYNC + LOST + LOOP + type/dt
+            drop();
+            return false;
+        }
+        if (!_synced) {
+            uint32_t start = _passPending ? _passStart : now;
+            put(TRACE_SYNC);
+            put(start); put(start >> 8); put(start >> 16); put(start >> 24);
+            _last = start;
+            _synced = true;
+        }
+        if (_lost > 0) {
+            put(TRACE_LOST);
+            putVarint(_lost);
+            _lost = 0;
+        }
+        if (_passPending) {
+            put(TRACE_LOOP);
+            putVarint(_passStart - _last);
+            _last = _passStart;
+            _passPending = false;
+        }
+        _eventStart = _used;
+        put(type);
+        putVarint(now - _last);
+        _last = now;
+        return true;
+    }
+
+public:
+    // Recording stays off (every hook returns at once) unless enabled
+    void begin(bool enabled) {
+        _enabled = enabled;
+        _used = 0;
+        _synced = false;
+        _open = -1;
+        _passPending = false;
+        if (!_enabled) return;
+        put(TRACE_BOOT);
+        put(TRACE_VERSION);
+    }
+
+    bool enabled() const { return _enabled; }
+
+    // Top of loop(): the pass's LOOP goes in with its first event
+    void loopStart() {
+        if (!_enabled) return;
+        _passStart = millis();
+        _passPending = true;
+    }
+
+    // One byte read from UART `channel`; bytes of the same ms share an event
+    void uartByte(uint8_t channel, uint8_t c) {
+        if (!_enabled) return;
+        uint32_t now = millis();
+        if (_open >= 0 && _openType == TRACE_UART && _openChannel == channel &&
+            now == _last && _buf[_open] < TRACE_EVENT_MAX && space() > 0) {
+            put(c);
+            _buf[_open]++;
+            return;
+        }
+        if (!startEvent(TRACE_UART, now, 3)) return;
+        put(channel);
+        _open = _used;
+        put(1);
+        put(c);
+        _openType = TRACE_UART;
+        _openChannel = channel;
+    }
+
+    // An ADC burst: adcBegin, one adcSample per analogRead, adcEnd
+    void adcBegin(uint8_t pin) {
+        if (!_enabled) return;
+        if (!startEvent(TRACE_ADC, millis(), 2 + 3)) return;
+        put(pin);
+        _open = _used;
+        put(0);
+        _openType = TRACE_ADC;
+        _prevSample = 0;
+    }
+
+    void adcSample(uint16_t value) {
+        if (_open < 0 || _openType != TRACE_ADC || _buf[_open] >= TRACE_EVENT_MAX) return;
+        if (space() < 3) {
+            // Drop the whole burst rather than replay a short one
+            _used = _eventStart;
+            _open = -1;
+            drop();
+            return;
+        }
+        int32_t delta = (int32_t)value - (int32_t)_prevSample;
+        putVarint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        _prevSample = value;
+        _buf[_open]++;
+    }
+
+    void adcEnd() {
+        if (_openType == TRACE_ADC) _open = -1;
+    }
+
+    // A register transfer, type TRACE_I2C_READ or TRACE_I2C_WRITE
+    void i2c(uint8_t type, uint8_t addr, uint8_t reg, const void *data, size_t len) {
+        if (!_enabled) return;
+        if (len > TRACE_EVENT_MAX) len = TRACE_EVENT_MAX;
+        if (!startEvent(type, millis(), 3 + len)) return;
+        put(addr);
+        put(reg);
+        put((uint8_t)len);
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < len; i++) put(bytes[i]);
+    }
+
+    bool needsFlush() const { return _used >= Bytes / 2; }
+
+    // Append the buffered events to `path` and start a new block
+    template <class Storage>
+    bool flush(Storage &storage, const char *path) {
+        _open = -1;
+        if (_used == 0) return true;
+        bool written = storage.appendFile(path, [&](Print &file) {
+            file.write(_buf, _used);
+        });
+        _used = 0;
+        _synced = false;
+        return written;
+    }
+
+    uint16_t used() const { return _used; }
+    uint32_t lost() const { return _lostTotal; }
+};
+
+// UART wrapper that traces every byte read; writes pass straight through
+template <class Recorder>
+class TraceStream : public Stream {
+private:
+    Stream &_uart;
+    Recorder &_trace;
+    uint8_t _channel;
+
+public:
+    TraceStream(Stream &uart, Recorder &trace, uint8_t channel)
+        : _uart(uart), _trace(trace), _channel(channel) {}
+
+    int available() { return _uart.available(); }
+    int peek() { return _uart.peek(); }
+    void flush() { _uart.flush(); }
+
+    int read() {
+        int c = _uart.read();
+        if (c >= 0) _trace.uartByte(_channel, (uint8_t)c);
+        return c;
+    }
+
+    size_t write(uint8_t c) { return _uart.write(c); }
+    size_t write(const uint8_t *buffer, size_t size) { return _uart.write(buffer, size); }
+};
+
+// Register-level I2C tracing for drivers with virtual readReg/writeReg
+template <class Device, class Recorder>
+class TraceI2C : public Device {
+private:
+    Recorder &_trace;
+    uint8_t _addr;
+
+public:
+    // Remaining arguments go to the driver's constructor
+    template <typename... Args>
+    TraceI2C(Recorder &trace, uint8_t addr, Args... args)
+        : Device(args...), _trace(trace), _addr(addr) {}
+
+protected:
+    void writeReg(uint8_t reg, const void *buf, size_t size) {
+        Device::writeReg(reg, buf, size);
+        _trace.i2c(TRACE_I2C_WRITE, _addr, reg, buf, size);
+    }
+
+    size_t readReg(uint8_t reg, void *buf, size_t size) {
+        size_t count = Device::readReg(reg, buf, size);
+        _trace.i2c(TRACE_I2C_READ, _addr, reg, buf, count);
+        return count;
+    }
+};
+
+#endif // _TRACE_RECORDER_H_
@@ -0,0 +1,445 @@
+#ifndef _TRACE_REPLAY_H_
+#define _TRACE_REPLAY_H_
+
+/*
+ * Trace Replay
+ *
+ * Plays a TraceRecorder file back into the real firmware, on the host,
+ * as fast as it can consume it (host/trace_replay.cpp runs src/esp_main.cpp
+ * this way). The host build supplies millis() and analogRead() from the
+ * replay and hands the drivers replay endpoints in place of the hardware:
+ *
+ *   unsigned long millis() { return replay.millis(); }
+ *   void delay(unsigned long ms) { replay.runUntil(replay.now() + ms); }
+ *   int analogRead(uint8_t pin) { return replay.analogRead(pin); }
+ *   // readStableADC() starts each burst with replay.nextBurst(pin)
+ *
+ *   SerialPM.attach(&replay.uart(TRACE_PM));
+ *   ReplayI2C<DFRobot_ENS160_I2C> ens160(replay, ENS160_I2C_ADDRESS);
+ *
+ *   setup();
+ *   while (replay.runToNextPass()) loop();
+ *
+ * The trace sets the pace. Each loop() pass starts at the time of the
+ * recorded one, and events are applied as the clock passes them:
+ * UART bytes are queued on their channel, an I2C read becomes the value
+ * later readReg() calls of that register return, and ADC bursts queue up
+ * per pin. Each burst the firmware starts takes the pin's next recorded
+ * burst, waiting (jumping the clock) for it if need be, and analogRead()
+ * hands out its samples in recorded order, then the last one again. So
+ * every burst is replayed once and in order, however many the firmware
+ * takes per ms. No waiting, so a week of input replays in about a minute
+ * and always gives the same result.
+ *
+ * Recorded times restart at every boot; replay keeps its clock running,
+ * so time spent powered off or in deep sleep is not reproduced.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "TraceRecorder.h"
+
+#define TRACE_REPLAY_UARTS    2     // UART channels
+#define TRACE_REPLAY_RX       1024  // Bytes queued per UART
+#define TRACE_REPLAY_PINS     8     // ADC pins
+#define TRACE_REPLAY_QUEUE    64    // Bursts queued per pin
+#define TRACE_REPLAY_REGS     16    // I2C registers
+#define TRACE_REPLAY_REG_MAX  16    // Bytes kept per register
+
+// UART endpoint: recorded bytes in, driver writes discarded
+class ReplayStream : public Stream {
+private:
+    uint8_t _rx[TRACE_REPLAY_RX];
+    uint16_t _head = 0, _count = 0;
+    uint32_t _overflow = 0;
+
+public:
+    void push(uint8_t c) {
+        if (_count >= TRACE_REPLAY_RX) {
+            _overflow++;
+            return;
+        }
+        _rx[(_head + _count) % TRACE_REPLAY_RX] = c;
+        _count++;
+    }
+
+    int available() { return _count; }
+
+    int peek() { return _count > 0 ? _rx[_head] : -1; }
+
+    int read() {
+        if (_count == 0) return -1;
+        uint8_t c = _rx[_head];
+        _head = (_head + 1) % TRACE_REPLAY_RX;
+        _count--;
+        return c;
+    }
+
+    size_t write(uint8_t) { return 1; }
+
+    // Bytes lost because the driver did not read them in time
+    uint32_t overflow() const { return _overflow; }
+};
+
+class TraceReplay {
+private:
+    struct Burst {
+        uint8_t count, index;
+        uint16_t samples[TRACE_EVENT_MAX];
+    };
+
+    // Where a burst is in the trace, and its replay time
+    struct Queued {
+        uint64_t time;
+        uint32_t pos;
+    };
+
+    // Bursts of one pin not taken yet, and the one analogRead() reads
+    struct Pin {
+        uint8_t pin;
+        uint8_t head, queued;
+        Queued queue[TRACE_REPLAY_QUEUE];
+        Burst current;
+    };
+
+    struct Register {
+        uint8_t addr, reg, len;
+        uint8_t data[TRACE_REPLAY_REG_MAX];
+    };
+
+    const uint8_t *_data = NULL;
+    size_t _size = 0, _pos = 0;
+    uint64_t _now = 0;          // Replay clock
+    uint64_t _offset = 0;       // Replay clock minus recorded time
+    uint32_t _recorded = 0;     // Recorded time of the last event
+    bool _boot = true;          // Next SYNC starts a new boot
+    bool _marked = true;        // Loop passes are marked (version 2 on)
+    bool _hasNext = false;
+    uint64_t _nextTime = 0;
+    uint8_t _nextType = 0;
+
+    ReplayStream _uarts[TRACE_REPLAY_UARTS];
+    Pin _pins[TRACE_REPLAY_PINS];
+    uint8_t _pinCount = 0;
+    Register _regs[TRACE_REPLAY_REGS];
+    uint8_t _regCount = 0;
+
+    uint32_t _events = 0, _lost = 0, _boots = 0, _skipped = 0;
+    uint32_t _taken = 0, _takenAtLoop = 0;
+
+    bool byte(uint8_t &b) {
+        if (_pos >= _size) return false;
+        b = _data[_pos++];
+        return true;
+    }
+
+    bool varint(uint32_t &v) {
+        v = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) return false;
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // Reads up to the next timed event's payload; false at the end of the
+    // trace or at a truncated event
+    bool peekNext() {
+        _hasNext = false;
+        uint8_t type;
+        while (byte(type)) {
+            uint32_t value;
+            switch (type) {
+                case TRACE_BOOT: {
+                    uint8_t version;
+                    if (!byte(version) || version < 1 || version > TRACE_VERSION) return false;
+                    _marked = version >= 2;
+                    _boot = true;
+                    _boots++;
+                    break;
+                }
+                case TRACE_SYNC: {
+                    uint8_t b[4];
+                    for (uint8_t i = 0; i < 4; i++) {
+                        if (!byte(b[i])) return false;
+                    }
+                    uint32_t ms = b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+                    if (_boot) {
+                        // Continue the replay clock from where the last boot ended
+                        _offset = _now > ms ? _now - ms : 0;
+                        _boot = false;
+                    }
+                    _recorded = ms;
+                    break;
+                }
+                case TRACE_LOST:
+                    if (!varint(value)) return false;
+                    _lost += value;
+                    break;
+                case TRACE_ADC:
+                case TRACE_UART:
+                case TRACE_I2C_READ:
+                case TRACE_I2C_WRITE:
+                case TRACE_LOOP:
+                    if (!varint(value)) return false;
+                    _recorded += value;
+                    _nextTime = _offset + _recorded;
+                    _nextType = type;
+                    _hasNext = true;
+                    return true;
+                default:
+                    return false; // Not a trace, or corrupt
+            }
+        }
+        return false;
+    }
+
+    bool apply(uint8_t type) {
+        uint8_t channel, count;
+        if (type == TRACE_LOOP) return true;
+        if (!byte(channel)) return false;
+        switch (type) {
+            case TRACE_UART: {
+                if (!byte(count)) return false;
+                for (uint8_t i = 0; i < count; i++) {
+                    uint8_t c;
+                    if (!byte(c)) return false;
+                    if (channel < TRACE_REPLAY_UARTS) _uarts[channel].push(c);
+                }
+                return true;
+            }
+            case TRACE_ADC: {
+                // Queued by position, decoded when the firmware takes it
+                uint32_t start = _pos;
+                if (!byte(count)) return false;
+                for (uint8_t i = 0; i < count; i++) {
+                    uint32_t zigzag;
+                    if (!varint(zigzag)) return false;
+                }
+                queueBurst(channel, start);
+                return true;
+            }
+            default: { // I2C: channel is the address
+                uint8_t reg;
+                if (!byte(reg) || !byte(count)) return false;
+                if (_pos + count > _size) return false;
+                if (type == TRACE_I2C_READ) {
+                    Register *r = findRegister(channel, reg);
+                    if (r) {
+                        r->len = count < TRACE_REPLAY_REG_MAX ? count : TRACE_REPLAY_REG_MAX;
+                        memcpy(r->data, _data + _pos, r->len);
+                    }
+                }
+                _pos += count;
+                return true;
+            }
+        }
+    }
+
+    Pin *findPin(uint8_t pin) {
+        for (uint8_t i = 0; i < _pinCount; i++) {
+            if (_pins[i].pin == pin) return &_pins[i];
+        }
+        if (_pinCount >= TRACE_REPLAY_PINS) return NULL;
+        Pin &p = _pins[_pinCount++];
+        p.pin = pin;
+        p.head = p.queued = 0;
+        p.current.count = p.current.index = 0;
+        return &p;
+    }
+
+    // A full queue drops its oldest burst, which the firmware never took
+    void queueBurst(uint8_t pin, uint32_t start) {
+        Pin *p = findPin(pin);
+        if (p == NULL) return;
+        if (p->queued == TRACE_REPLAY_QUEUE) {
+            p->head = (p->head + 1) % TRACE_REPLAY_QUEUE;
+            p->queued--;
+            _skipped++;
+        }
+        Queued &q = p->queue[(p->head + p->queued++) % TRACE_REPLAY_QUEUE];
+        q.time = _now;
+        q.pos = start;
+    }
+
+    // Drop the queued bursts from before `ms`; true if any are left
+    bool dropQueued(uint64_t ms) {
+        bool left = false;
+        for (uint8_t i = 0; i < _pinCount; i++) {
+            Pin &p = _pins[i];
+            while (p.queued > 0 && p.queue[p.head].time < ms) {
+                p.head = (p.head + 1) % TRACE_REPLAY_QUEUE;
+                p.queued--;
+                _skipped++;
+            }
+            left |= p.queued > 0;
+        }
+        return left;
+    }
+
+    // Samples of the burst at `start`, already checked by apply()
+    void decodeBurst(uint32_t start, Burst &burst) {
+        size_t pos = _pos;
+        _pos = start;
+        byte(burst.count);
+        uint16_t sample = 0;
+        for (uint8_t i = 0; i < burst.count; i++) {
+            uint32_t zigzag;
+            varint(zigzag);
+            sample += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            burst.samples[i] = sample;
+        }
+        burst.index = 0;
+        _pos = pos;
+    }
+
+    Register *findRegister(uint8_t addr, uint8_t reg) {
+        for (uint8_t i = 0; i < _regCount; i++) {
+            if (_regs[i].addr == addr && _regs[i].reg == reg) return &_regs[i];
+        }
+        if (_regCount >= TRACE_REPLAY_REGS) return NULL;
+        Register &r = _regs[_regCount++];
+        r.addr = addr;
+        r.reg = reg;
+        r.len = 0;
+        return &r;
+    }
+
+public:
+    // The trace stays owned by the caller (e.g. a whole file read into memory)
+    void begin(const uint8_t *data, size_t size) {
+        _data = data;
+        _size = size;
+        _pos = 0;
+        _now = _offset = 0;
+        _boot = true;
+        peekNext();
+    }
+
+    // Jump to the next recorded ms and apply its events, stopping at the
+    // start of the next loop pass unless `overPass`; false if it applied
+    // nothing
+    bool advance(bool overPass = false) {
+        if (!_hasNext || (_nextType == TRACE_LOOP && !overPass)) return false;
+        if (_nextTime > _now) _now = _nextTime;
+        uint64_t due = _nextTime;
+        while (_hasNext && _nextTime == due) {
+            if (_nextType == TRACE_LOOP && !overPass) break;
+            if (!apply(_nextType)) {
+                _hasNext = false;
+                break;
+            }
+            _events++;
+            peekNext();
+        }
+        return true;
+    }
+
+    // Apply the pass's events up to `ms` and set the clock there (delay())
+    void runUntil(uint64_t ms) {
+        while (_hasNext && _nextTime <= ms && advance()) {}
+        if (ms > _now) _now = ms;
+    }
+
+    // Start the next recorded loop pass: apply what is left of this one,
+    // drop the bursts it did not take, set the clock to the pass's start
+    // and apply the events of that ms. Unmarked (version 1) traces start a pass now while bursts of
+    // this ms are waiting, else at the next burst; a pass that took none
+    // gives those up. False at the end
+    bool runToNextPass() {
+        if (_marked) {
+            while (advance()) {}
+            dropQueued(UINT64_MAX);
+            if (!_hasNext) return false;
+            if (_nextTime > _now) _now = _nextTime;
+            _events++;
+            peekNext();
+            runUntil(_now);
+            return true;
+        }
+        bool idle = _taken == _takenAtLoop;
+        if (!dropQueued(idle ? _now + 1 : _now)) {
+            while (_hasNext && _nextType != TRACE_ADC) advance();
+            if (!_hasNext) return false;
+            runUntil(_nextTime);
+        }
+        _takenAtLoop = _taken;
+        return true;
+    }
+
+    // Make the pin's next recorded burst the one analogRead() reads,
+    // applying events up to it if it is not queued yet; false when the
+    // trace has no more bursts of the pin
+    bool nextBurst(uint8_t pin) {
+        Pin *p = findPin(pin);
+        if (p == NULL) return false;
+        while (p->queued == 0 && advance(true)) {}
+        if (p->queued == 0) return false;
+        decodeBurst(p->queue[p->head].pos, p->current);
+        _taken++;
+        p->head = (p->head + 1) % TRACE_REPLAY_QUEUE;
+        p->queued--;
+        return true;
+    }
+
+    bool done() const { return !_hasNext; }
+
+    unsigned long millis() const { return (unsigned long)_now; }
+    uint64_t now() const { return _now; }
+
+    ReplayStream &uart(uint8_t channel) { return _uarts[channel < TRACE_REPLAY_UARTS ? channel : 0]; }
+
+    // Samples of the pin's current burst in order, then the last one again
+    int analogRead(uint8_t pin) {
+        for (uint8_t i = 0; i < _pinCount; i++) {
+            Burst &burst = _pins[i].current;
+            if (_pins[i].pin != pin || burst.count == 0) continue;
+            if (burst.index < burst.count) return burst.samples[burst.index++];
+            return burst.samples[burst.count - 1];
+        }
+        return 0;
+    }
+
+    // Latest recorded value of a register; 0 bytes if it was never read
+    size_t readReg(uint8_t addr, uint8_t reg, void *buf, size_t size) {
+        for (uint8_t i = 0; i < _regCount; i++) {
+            Register &r = _regs[i];
+            if (r.addr != addr || r.reg != reg) continue;
+            size_t n = size < r.len ? size : r.len;
+            memcpy(buf, r.data, n);
+            return n;
+        }
+        return 0;
+    }
+
+    uint32_t events() const { return _events; }
+    uint32_t lost() const { return _lost; }       // Dropped while recording
+    uint32_t boots() const { return _boots; }
+    uint32_t skipped() const { return _skipped; } // Bursts the firmware never took
+};
+
+// Register-level I2C replay for drivers with virtual readReg/writeReg
+template <class Device>
+class ReplayI2C : public Device {
+private:
+    TraceReplay &_replay;
+    uint8_t _addr;
+
+public:
+    // Remaining arguments go to the driver's constructor
+    template <typename... Args>
+    ReplayI2C(TraceReplay &replay, uint8_t addr, Args... args)
+        : Device(args...), _replay(replay), _addr(addr) {}
+
+protected:
+    void writeReg(uint8_t, const void *, size_t) {}
+
+    size_t readReg(uint8_t reg, void *buf, size_t size) {
+        return _replay.readReg(_addr, reg, buf, size);
+    }
+};
+
+#endif // _TRACE_REPLAY_H_
@@ -0,0 +1,125 @@
+#ifndef _WARMUP_TRACKER_H_
+#define _WARMUP_TRACKER_H_
+
+/*
+ * Warmup Tracker
+ *
+ * Non-blocking readiness detection for heated gas sensors. Instead of
+ * waiting a fixed preheat time, each sensor is sampled every few seconds
+ * and declared ready once its signal (Rs, or voltage for the MG-811) has
+ * stopped drifting:
+ *
+ *   HEATING  - before the minimum warmup time; the slope is tracked
+ *   SETTLING - minimum time passed, relative slope still above threshold
+ *   READY    - slope below threshold for several samples in a row, or the
+ *              maximum warmup time ran out (timedOut() tells which)
+ *
+ * The slope is dx/x per minute, smoothed with an EWMA before taking its
+ * magnitude, so sample noise averages out instead of looking like drift. update() returns true once,
+ * on the transition to READY, so the caller can calibrate right then.
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define WARMUP_SAMPLE_INTERVAL 5000   // ms between slope samples
+#define WARMUP_STABLE_SAMPLES  6      // Consecutive settled samples required (30 s)
+#define WARMUP_SLOPE_ALPHA     0.3f   // EWMA weight of the newest slope
+
+enum WarmupState : uint8_t {
+    WARMUP_HEATING,
+    WARMUP_SETTLING,
+    WARMUP_READY
+};
+
+class WarmupTracker {
+private:
+    uint32_t _start = 0;
+    uint32_t _lastSample = 0;
+    uint32_t _minTime = 30000;
+    uint32_t _maxTime = 180000;
+    float _threshold = 0.01;          // Relative change per minute (1 %/min)
+    float _last = 0;
+    float _slope = 0;
+    uint8_t _stableCount = 0;
+    bool _hasSample = false;
+    bool _timedOut = false;
+    WarmupState _state = WARMUP_HEATING;
+
+public:
+    // minTime <= maxTime; slopeThreshold is the relative change per minute
+    void configure(uint32_t minTime, uint32_t maxTime, float slopeThreshold) {
+        _maxTime = maxTime;
+        _minTime = minTime < maxTime ? minTime : maxTime;
+        _threshold = slopeThreshold;
+    }
+
+    void begin(uint32_t now) {
+        _start = now;
+        _lastSample = now;
+        _slope = 0;
+        _stableCount = 0;
+        _hasSample = false;
+        _timedOut = false;
+        _state = WARMUP_HEATING;
+    }
+
+    // True when the sensor should be read and passed to update()
+    bool due(uint32_t now) const {
+        return _state != WARMUP_READY && (!_hasSample || now - _lastSample >= WARMUP_SAMPLE_INTERVAL);
+    }
+
+    // Feed one reading; returns true on the transition to READY
+    bool update(uint32_t now, float value) {
+        if (_state == WARMUP_READY) return false;
+
+        if (_hasSample) {
+            uint32_t dt = now - _lastSample;
+            float base = fabs(_last) > 1e-6f ? fabs(_last) : 1e-6f;
+            float slope = dt > 0 ? (value - _last) / base * (60000.0f / dt) : 0;
+            _slope += WARMUP_SLOPE_ALPHA * (slope - _slope);
+            if (fabs(_slope) < _threshold) {
+                if (_stableCount < 255) _stableCount++;
+            } else {
+                _stableCount = 0;
+            }
+        } else {
+            _slope = _threshold; // Not settled until measured
+        }
+        _last = value;
+        _lastSample = now;
+        _hasSample = true;
+
+        uint32_t elapsed = now - _start;
+        if (elapsed >= _maxTime) {
+            _timedOut = true;
+            _state = WARMUP_READY;
+            return true;
+        }
+        if (elapsed < _minTime) {
+            _state = WARMUP_HEATING;
+            return false;
+        }
+        if (_stableCount >= WARMUP_STABLE_SAMPLES) {
+            _state = WARMUP_READY;
+            return true;
+        }
+        _state = WARMUP_SETTLING;
+        return false;
+    }
+
+    WarmupState state() const { return _state; }
+    bool ready() const { return _state == WARMUP_READY; }
+    bool timedOut() const { return _timedOut; }
+    float slope() const { return fabs(_slope); }
+    uint32_t elapsed(uint32_t now) const { return now - _start; }
+};
+
+// Rs of a load-resistor divider up to the constant RL, from a raw ADC code.
+// Enough for a relative slope, and needs no per-sensor calibration.
+inline float warmupRsProxy(uint16_t adc, uint16_t adcMax) {
+    if (adc == 0) return 1e6;
+    return (float)(adcMax - (adc < adcMax ? adc : adcMax)) / adc;
+}
+
+#endif // _WARMUP_TRACKER_H_
@@ -1,5 +1,11 @@
 #include "CO2Sensor.h"
 
+// No FPU on AVR: evaluate 400^x with the Q16.16 log/exp tables
+#ifdef __AVR__
+#include "FixedPoint.h"
+#define CO2_LOG2_D 566484L // log2(400) in Q16.16
+#endif
+
 // CO2 sensor readings
 #define CO2SENSOR_DEBUG true
 
@@ -35,7 +41,11 @@ int CO2Sensor::read(){
 
   double co2_exp = (_co2_a-_co2_v)/co2_b;
 
+#ifdef __AVR__
+  _co2ppm = q16ToFloat(q16Exp2(q16Mul(CO2_LOG2_D, q16FromFloat(co2_exp))));
+#else
   _co2ppm = pow(co2_d, co2_exp);
+#endif
 
   if (_co2ppm<CO2_LOW) _greenLevel = 255;
   else {
@@ -72,6 +82,20 @@ int CO2Sensor::getVoltage(){
   return _co2_v;
 }
 
+double CO2Sensor::getCalibration(){
+  return _co2_a;
+}
+
+// Restore the curve offset from a stored calibration
+void CO2Sensor::setCalibration(double co2_a){
+  _co2_a = co2_a;
+}
+
+// Curve offset that calibrate() would set if the last reading were 400 ppm
+double CO2Sensor::getBaselineEstimate(){
+  return _co2_v + co2_b;
+}
+
 int CO2Sensor::getGreenLevel(){
   return _greenLevel;
 }
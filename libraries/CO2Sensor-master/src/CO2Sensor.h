@@ -17,6 +17,9 @@ class CO2Sensor
     void calibrate();
 
     int getVoltage();
+    double getCalibration();
+    void setCalibration(double co2_a);
+    double getBaselineEstimate();
 
     int getGreenLevel();
     int getRedLevel();
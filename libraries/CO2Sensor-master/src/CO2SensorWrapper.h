@@ -3,16 +3,18 @@
 
 /*
  * CO2 Sensor Wrapper
- * 
- * This wrapper enhances the CO2Sensor library to use stable ADC readings on ESP32.
- * It overrides the read() method to use readStableADC() instead of direct analogRead().
- * 
+ *
+ * Streaming MG-811 driver built on readStableADC(). Each instance owns its
+ * filter state, so several CO2 heads can run on one board.
+ *
+ * Pipeline per read() - one ADC burst, constant work:
+ *   readStableADC -> median of the last N bursts -> IIR (inertia) -> ppm
+ *
  * Benefits:
- * - Improves CO2 reading reliability and accuracy
- * - Discards unreliable initial readings
- * - Maintains the original inertia and multiple-try functionality
- * - Uses multiple samples with proper delays between readings
- * - Maintains compatibility with the original CO2Sensor API
+ * - calibrate() and read() share the same sampling and filter pipeline
+ * - No function-level statics, state is per instance
+ * - Median stage rejects single-burst spikes, IIR stage smooths drift
+ * - Same curve as the original CO2Sensor: ppm = 400^((a - mV) / 600)
  */
 
 #include "CO2Sensor.h"
@@ -20,65 +22,124 @@
 // Forward declaration of the global stable ADC function
 uint16_t readStableADC(uint8_t pin);
 
-// This class extends CO2Sensor with improved ESP32 ADC reading
-class CO2SensorWrapper : public CO2Sensor {
+#define CO2_MEDIAN_MAX 9       // Largest median window (bursts)
+#ifndef CO2_ADC_MAX
+#define CO2_ADC_MAX 4095       // 12-bit ADC on ESP32
+#endif
+#ifndef CO2_VREF_MV
+#define CO2_VREF_MV 3300       // Voltage at full scale in mV
+#endif
+
+class CO2SensorWrapper {
 private:
-    int _pin; // Store our own copy of the pin
-    float _myInertia; // Store our own copy of inertia
-    int _myTries; // Store our own copy of tries
+    static constexpr float CO2_B = 600;    // mV per decade (base 400) of the MG-811 curve
+    static constexpr float CO2_D = 400;    // Fresh-air CO2 in ppm
+
+    uint8_t _pin;
+    float _inertia;             // IIR weight of the previous value (0 = off)
+    uint8_t _window;            // Median window in bursts (1 = off)
+
+    uint16_t _history[CO2_MEDIAN_MAX];
+    uint8_t _head = 0;
+    uint8_t _filled = 0;
+
+    bool _seeded = false;
+    float _voltage = 0;         // Filtered sensor voltage in mV
+    float _co2_a = 1500;        // Curve offset, set by calibrate()
+    float _co2ppm = CO2_D;
+
+    // Median of the buffered bursts (window <= CO2_MEDIAN_MAX)
+    uint16_t median() const {
+        uint16_t sorted[CO2_MEDIAN_MAX];
+        for (uint8_t i = 0; i < _filled; i++) {
+            uint16_t v = _history[i];
+            uint8_t j = i;
+            while (j > 0 && sorted[j - 1] > v) {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = v;
+        }
+        return sorted[_filled / 2];
+    }
+
+    // Take one burst through the median stage; returns mV
+    float burst() {
+        _history[_head] = readStableADC(_pin);
+        _head = (_head + 1) % _window;
+        if (_filled < _window) _filled++;
+        return (float)median() * CO2_VREF_MV / CO2_ADC_MAX;
+    }
+
+    // Take one burst and run it through the median and IIR stages
+    float sample() {
+        float mv = burst();
+        if (!_seeded) {
+            _voltage = mv;
+            _seeded = true;
+        } else {
+            _voltage = _voltage * _inertia + mv * (1.0 - _inertia);
+        }
+        return _voltage;
+    }
 
 public:
-    // Use the parent constructor but store the pin
-    CO2SensorWrapper(int pin, float inertia = 0.99, int tries = 5) 
-        : CO2Sensor(pin, inertia, tries), _pin(pin), _myInertia(inertia), _myTries(tries) {
+    CO2SensorWrapper(int pin, float inertia = 0.99, int tries = 5)
+        : _pin(pin) {
+        setInertia(inertia);
+        setTries(tries);
     }
-    
-    // Override setInertia to update our local copy too
+
     void setInertia(float inertia) {
-        _myInertia = inertia;
-        CO2Sensor::setInertia(inertia);
+        _inertia = constrain(inertia, 0.0f, 0.999f);
     }
-    
-    // Override setTries to update our local copy too
+
+    // Median window in bursts; kept under the old name for config.txt compatibility
     void setTries(int tries) {
-        _myTries = tries;
-        CO2Sensor::setTries(tries);
+        setMedianWindow(tries);
     }
 
-    // Override the read method to use stable ADC
-    float read() {
-        // Instead of direct analogRead, use the stable version
-        int value = readStableADC(_pin);
-        
-        // Apply the inertia filter as in the original CO2Sensor
-        // But using our own implementation since we can't access private members
-        static bool firstReading = true;
-        static float lastValue = 0;
-        
-        if (_myTries == 1) {
-            return value;
-        }
+    void setMedianWindow(int window) {
+        _window = constrain(window, 1, CO2_MEDIAN_MAX);
+        _head = 0;
+        _filled = 0;
+    }
 
-        // Multiple tries with inertia
-        if (firstReading) {
-            lastValue = value;
-            firstReading = false;
-            return value;
+    // Take the current air as 400 ppm: the median stage's output averaged
+    // over a fresh window of bursts. The IIR is bypassed (with inertia 0.99
+    // it would still hold the first burst) and restarts from the result.
+    void calibrate() {
+        _head = 0;
+        _filled = 0;
+        float sum = 0;
+        for (uint8_t i = 0; i < _window; i++) {
+            sum += burst();
         }
+        _voltage = sum / _window;
+        _seeded = true;
+        Serial.print("Calibration. Old a: ");
+        Serial.print(_co2_a);
 
-        float currentValue = 0;
-        for (int i = 0; i < _myTries; i++) {
-            // Use stable reading for each try
-            currentValue += readStableADC(_pin);
-        }
-        currentValue /= _myTries;
+        _co2_a = _voltage + CO2_B;
+        _co2ppm = CO2_D;
 
-        // Apply inertia (low-pass filter)
-        float result = lastValue * _myInertia + currentValue * (1.0 - _myInertia);
-        lastValue = result;
-        
-        return result;
+        Serial.print(", New a: ");
+        Serial.println(_co2_a);
     }
+
+    // One burst per call, returns CO2 in ppm
+    float read() {
+        sample();
+        _co2ppm = pow(CO2_D, (_co2_a - _voltage) / CO2_B);
+        return _co2ppm;
+    }
+
+    float getVoltage() const { return _voltage; }
+    float getCalibration() const { return _co2_a; }
+    void setCalibration(float co2_a) { _co2_a = co2_a; }
+
+    // Curve offset that calibrate() would set if the current air were 400 ppm
+    float getBaselineEstimate() const { return _voltage + CO2_B; }
 };
 
-#endif // _CO2_SENSOR_WRAPPER_H_ 
\ No newline at end of file
+#endif // _CO2_SENSOR_WRAPPER_H_
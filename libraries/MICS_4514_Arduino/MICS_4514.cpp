@@ -95,6 +95,29 @@ void MICS_4514::setR0() {
   _r0_ox = r_ox_sum / samples;
 }
 
+// Restore R0 values from a stored calibration
+void MICS_4514::setR0Values(float r0_red, float r0_ox) {
+  _r0_red = r0_red;
+  _r0_ox = r0_ox;
+}
+
+float MICS_4514::getR0Red() {
+  return _r0_red;
+}
+
+float MICS_4514::getR0OX() {
+  return _r0_ox;
+}
+
+// Current sensing resistance, e.g. for tracking the clean-air baseline
+float MICS_4514::getResistanceRed() {
+  return read_R_RED();
+}
+
+float MICS_4514::getResistanceNOX() {
+  return read_R_OX();
+}
+
 float MICS_4514::getCarbonMonoxide() {
   if (!sensorReady() || _r0_red == 0) {
     return -1.0;
@@ -37,6 +37,11 @@ class MICS_4514 {
     void warmupStart();
     bool sensorReady();
     void setR0();
+    void setR0Values(float r0_red, float r0_ox);
+    float getR0Red();
+    float getR0OX();
+    float getResistanceRed();
+    float getResistanceNOX();
     void setHeatingState(uint8_t on_off);
     bool getHeatingState();
     float getCarbonMonoxide();
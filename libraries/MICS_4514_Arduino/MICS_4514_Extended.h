@@ -73,6 +73,16 @@ public:
         _r0_ox_ext = r_ox_sum / samples;
     }
 
+    // Restore R0 values from a stored calibration, skipping setR0()
+    void setR0Values(float r0_red, float r0_ox) {
+        MICS_4514::setR0Values(r0_red, r0_ox);
+        _r0_red_ext = r0_red;
+        _r0_ox_ext = r0_ox;
+    }
+
+    float getR0Red() const { return _r0_red_ext; }
+    float getR0OX() const { return _r0_ox_ext; }
+
     // Override gas concentration calculation methods
     float getCarbonMonoxide() {
         if (!sensorReady() || _r0_red_ext == 0) {
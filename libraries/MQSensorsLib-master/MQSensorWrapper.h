@@ -20,7 +20,7 @@
 class MQSensorWrapper : public MQUnifiedsensor {
 public:
     // Constructor - just passes everything to the parent class
-    MQSensorWrapper(String Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, String type) 
+    MQSensorWrapper(const char* Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, const char* type) 
         : MQUnifiedsensor(Placa, Voltage_Resolution, ADC_Bit_Resolution, pin, type) {
     }
 
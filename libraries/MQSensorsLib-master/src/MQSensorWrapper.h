@@ -26,7 +26,7 @@ private:
 
 public:
     // Constructor - passes everything to the parent class but stores the pin
-    MQSensorWrapper(String Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, String type) 
+    MQSensorWrapper(const char* Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, const char* type) 
         : MQUnifiedsensor(Placa, Voltage_Resolution, ADC_Bit_Resolution, pin, type), _sensorPin(pin) {
     }
 
@@ -3,18 +3,22 @@
 #define retries 2
 #define retry_interval 20
 
-MQUnifiedsensor::MQUnifiedsensor(String Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, String type) {
+MQUnifiedsensor::MQUnifiedsensor(const char* Placa, float Voltage_Resolution, int ADC_Bit_Resolution, int pin, const char* type) {
   this->_pin = pin;
-  Placa.toCharArray(this->_placa, 20);
-  type.toCharArray(this->_type, 7);
+  strncpy(this->_placa, Placa, sizeof(this->_placa) - 1);
+  this->_placa[sizeof(this->_placa) - 1] = '\0';
+  strncpy(this->_type, type, sizeof(this->_type) - 1);
+  this->_type[sizeof(this->_type) - 1] = '\0';
   //this->_type = type; //MQ-2, MQ-3 ... MQ-309A
   //this->_placa = Placa;
   this-> _VOLT_RESOLUTION = Voltage_Resolution;
   this-> _ADC_Bit_Resolution = ADC_Bit_Resolution;
 }
-MQUnifiedsensor::MQUnifiedsensor(String Placa, String type) {
-  Placa.toCharArray(this->_placa, 20);
-  type.toCharArray(this->_type, 7);
+MQUnifiedsensor::MQUnifiedsensor(const char* Placa, const char* type) {
+  strncpy(this->_placa, Placa, sizeof(this->_placa) - 1);
+  this->_placa[sizeof(this->_placa) - 1] = '\0';
+  strncpy(this->_type, type, sizeof(this->_type) - 1);
+  this->_type[sizeof(this->_type) - 1] = '\0';
 }
 void MQUnifiedsensor::init()
 {
@@ -59,7 +63,7 @@ float MQUnifiedsensor::getVoltResolution()
 {
   return _VOLT_RESOLUTION;
 }
-String MQUnifiedsensor::getRegressionMethod()
+const char* MQUnifiedsensor::getRegressionMethod()
 {
   if(_regressionMethod == 1) return "Exponential";
   else return "Linear";
@@ -233,7 +237,7 @@ float MQUnifiedsensor::getRS()
   return _RS_Calc;
 }
 
-float MQUnifiedsensor::stringTofloat(String & str)
+float MQUnifiedsensor::stringTofloat(const char* str)
 {
-  return atof( str.c_str() );
+  return atof(str);
 }
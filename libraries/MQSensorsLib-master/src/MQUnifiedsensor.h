@@ -9,8 +9,8 @@
 class MQUnifiedsensor
 {
   public:
-    MQUnifiedsensor(String Placa = "Arduino", float Voltage_Resolution =  5, int ADC_Bit_Resolution = 10, int pin = 1, String type = "CUSTOM MQ");
-    MQUnifiedsensor(String Placa = "Arduino", String type = "CUSTOM MQ");
+    MQUnifiedsensor(const char* Placa = "Arduino", float Voltage_Resolution =  5, int ADC_Bit_Resolution = 10, int pin = 1, const char* type = "CUSTOM MQ");
+    MQUnifiedsensor(const char* Placa = "Arduino", const char* type = "CUSTOM MQ");
     
     //Functions to set values
     void init();
@@ -38,9 +38,9 @@ class MQUnifiedsensor
     float getR0();
     float getRL();
     float getVoltResolution();
-    String getRegressionMethod();
+    const char* getRegressionMethod();
     float getVoltage(bool read = true, bool injected = false, int value = 0);
-    float stringTofloat(String & str);
+    float stringTofloat(const char* str);
 
     // functions for testing
     float getRS();    
@@ -6,103 +6,211 @@
 //
 // Documentation:
 //		- The iNovaFitness SDS011 datasheet
+//		- Laser Dust Sensor Control Protocol V1.3
+//
+// Frames:
+//		command  AA B4 cmd d2 d3 00*10 idL idH chk AB  (19 bytes, chk = sum of cmd..idH)
+//		data     AA C0 pm25L pm25H pm10L pm10H idL idH chk AB
+//		reply    AA C5 cmd d2 d3 d4 idL idH chk AB        (chk = sum of bytes 2..7)
 //
 
 #include "SDS011.h"
 
-static constexpr uint8_t SLEEPCMD[19] = {
-	0xAA, 0xB4, 0x06, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,	0x00, 0x00, 0x00, 0xFF,	0xFF, 0x05, 0xAB
-};
-static constexpr uint8_t WAKEUPCMD[19] = {
-	0xAA, 0xB4, 0x06, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x06, 0xAB
-};
-static constexpr uint8_t VERSION_CMD[] PROGMEM = {
-	0xAA, 0xB4, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x05, 0xAB
-};
-static constexpr uint8_t CONTINUOUS_MODE_CMD[] PROGMEM = {
-	0xAA, 0xB4, 0x08, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x07, 0xAB
-};
-
 SDS011::SDS011(void) {
 
 }
 
 // --------------------------------------------------------
-// SDS011:read
+// SDS011:sendCommand
 // --------------------------------------------------------
-int SDS011::read(float *p25, float *p10) {
-	byte buffer;
-	int value;
-	int len = 0;
-	int pm10_serial = 0;
-	int pm25_serial = 0;
-	int checksum_is;
-	int checksum_ok = 0;
-	int error = 1;
-	while ((sds_data->available() > 0) && (sds_data->available() >= (10-len))) {
-		buffer = sds_data->read();
-		value = int(buffer);
-		switch (len) {
-			case (0): if (value != 170) { len = -1; }; break;
-			case (1): if (value != 192) { len = -1; }; break;
-			case (2): pm25_serial = value; checksum_is = value; break;
-			case (3): pm25_serial += (value << 8); checksum_is += value; break;
-			case (4): pm10_serial = value; checksum_is += value; break;
-			case (5): pm10_serial += (value << 8); checksum_is += value; break;
-			case (6): checksum_is += value; break;
-			case (7): checksum_is += value; break;
-			case (8): if (value == (checksum_is % 256)) { checksum_ok = 1; } else { len = -1; }; break;
-			case (9): if (value != 171) { len = -1; }; break;
+void SDS011::sendCommand(uint8_t cmd, uint8_t set, uint8_t value, uint8_t extra1, uint8_t extra2) {
+	uint8_t packet[19] = {0xAA, 0xB4, cmd, set, value};
+	packet[13] = extra1;
+	packet[14] = extra2;
+	packet[15] = _device_id & 0xFF;
+	packet[16] = _device_id >> 8;
+	uint8_t checksum = 0;
+	for (uint8_t i = 2; i < 17; i++) {
+		checksum += packet[i];
+	}
+	packet[17] = checksum;
+	packet[18] = 0xAB;
+	sds_data->write(packet, sizeof(packet));
+}
+
+void SDS011::expectReply(uint8_t cmd) {
+	_pending_cmd = cmd;
+	_sent_at = millis();
+	_status = SDS011_PENDING;
+}
+
+// --------------------------------------------------------
+// SDS011:poll - byte-at-a-time frame decoder
+// --------------------------------------------------------
+void SDS011::poll() {
+	while (sds_data->available() > 0) {
+		uint8_t value = sds_data->read();
+		if (_len == 0 && value != 0xAA) continue;
+		if (_len == 1 && value != 0xC0 && value != 0xC5) {
+			_len = value == 0xAA ? 1 : 0;
+			continue;
 		}
-		len++;
-		if (len == 10 && checksum_ok == 1) {
-			*p10 = (float)pm10_serial/10.0;
-			*p25 = (float)pm25_serial/10.0;
-			len = 0; checksum_ok = 0; pm10_serial = 0.0; pm25_serial = 0.0; checksum_is = 0;
-			error = 0;
+		_frame[_len++] = value;
+		if (_len == 10) {
+			_len = 0;
+			uint8_t checksum = 0;
+			for (uint8_t i = 2; i < 8; i++) {
+				checksum += _frame[i];
+			}
+			if (_frame[8] == checksum && _frame[9] == 0xAB) {
+				handleFrame();
+			}
 		}
+	}
+
+	if (_status == SDS011_PENDING && millis() - _sent_at > SDS011_REPLY_TIMEOUT) {
+		_status = SDS011_TIMEOUT;
+		_pending_cmd = 0;
+	}
+}
+
+void SDS011::handleFrame() {
+	uint16_t id = _frame[6] | (_frame[7] << 8);
+
+	if (_frame[1] == 0xC0) {
+		_pm25 = (float)(_frame[2] | (_frame[3] << 8)) / 10.0;
+		_pm10 = (float)(_frame[4] | (_frame[5] << 8)) / 10.0;
+		_new_data = true;
+		return;
+	}
+
+	uint8_t cmd = _frame[2];
+	switch (cmd) {
+		case SDS011_CMD_REPORT_MODE: _query_mode = _frame[4] == 1; break;
+		case SDS011_CMD_SLEEP: _working = _frame[4] == 1; break;
+		case SDS011_CMD_PERIOD: _period = _frame[4]; break;
+		case SDS011_CMD_FIRMWARE:
+			_fw_year = _frame[3];
+			_fw_month = _frame[4];
+			_fw_day = _frame[5];
+			break;
+	}
+	if (_pending_cmd == cmd) {
+		// Replies carry the (new) device ID, so addressing follows a set-ID
+		if (cmd == SDS011_CMD_SET_ID || _device_id == SDS011_ALL_DEVICES) {
+			_device_id = id;
+		}
+		_pending_cmd = 0;
+		_status = SDS011_OK;
+	}
+}
+
+// --------------------------------------------------------
+// SDS011:waitReply
+// --------------------------------------------------------
+bool SDS011::waitReply(uint16_t timeout) {
+	uint32_t start = millis();
+	while (_status == SDS011_PENDING && millis() - start <= timeout) {
+		poll();
 		yield();
 	}
-	return error;
+	if (_status == SDS011_PENDING) {
+		_status = SDS011_TIMEOUT;
+		_pending_cmd = 0;
+	}
+	return _status == SDS011_OK;
+}
+
+// --------------------------------------------------------
+// SDS011:read
+// --------------------------------------------------------
+int SDS011::read(float *p25, float *p10) {
+	poll();
+	if (!_new_data) {
+		return 1;
+	}
+	*p25 = _pm25;
+	*p10 = _pm10;
+	_new_data = false;
+	return 0;
 }
 
 // --------------------------------------------------------
 // SDS011:sleep
 // --------------------------------------------------------
 void SDS011::sleep() {
-	for (uint8_t i = 0; i < 19; i++) {
-		sds_data->write(SLEEPCMD[i]);
-	}
-	sds_data->flush();
-	while (sds_data->available() > 0) {
-		sds_data->read();
-	}
+	sendCommand(SDS011_CMD_SLEEP, 1, 0);
+	expectReply(SDS011_CMD_SLEEP);
 }
 
 // --------------------------------------------------------
 // SDS011:wakeup
 // --------------------------------------------------------
 void SDS011::wakeup() {
-	for (uint8_t i = 0; i < 19; i++) {
-		sds_data->write(WAKEUPCMD[i]);
-	}
-	sds_data->flush();
-	while (sds_data->available() > 0) {
-		sds_data->read();
-	}
+	sendCommand(SDS011_CMD_SLEEP, 1, 1);
+	expectReply(SDS011_CMD_SLEEP);
 }
 
 // --------------------------------------------------------
 // SDS011:continuous_mode
 // --------------------------------------------------------
 void SDS011::continuous_mode() {
-	for (uint8_t i = 0; i < 19; i++) {
-		sds_data->write(CONTINUOUS_MODE_CMD[i]);
-	}
-	sds_data->flush();
-	while (sds_data->available() > 0) {
-		sds_data->read();
+	sendCommand(SDS011_CMD_PERIOD, 1, 0);
+	expectReply(SDS011_CMD_PERIOD);
+}
+
+// --------------------------------------------------------
+// SDS011:setWorkingPeriod
+// --------------------------------------------------------
+bool SDS011::setWorkingPeriod(uint8_t minutes) {
+	if (minutes > 30) minutes = 30;
+	sendCommand(SDS011_CMD_PERIOD, 1, minutes);
+	expectReply(SDS011_CMD_PERIOD);
+	return waitReply() && _period == minutes;
+}
+
+// --------------------------------------------------------
+// SDS011:setQueryMode
+// --------------------------------------------------------
+bool SDS011::setQueryMode(bool query) {
+	sendCommand(SDS011_CMD_REPORT_MODE, 1, query ? 1 : 0);
+	expectReply(SDS011_CMD_REPORT_MODE);
+	return waitReply() && _query_mode == query;
+}
+
+// --------------------------------------------------------
+// SDS011:setDeviceId
+// --------------------------------------------------------
+bool SDS011::setDeviceId(uint16_t id) {
+	sendCommand(SDS011_CMD_SET_ID, 0, 0, id & 0xFF, id >> 8);
+	expectReply(SDS011_CMD_SET_ID);
+	return waitReply() && _device_id == id;
+}
+
+// --------------------------------------------------------
+// SDS011:getFirmwareVersion
+// --------------------------------------------------------
+bool SDS011::getFirmwareVersion(uint8_t *year, uint8_t *month, uint8_t *day) {
+	sendCommand(SDS011_CMD_FIRMWARE, 0, 0);
+	expectReply(SDS011_CMD_FIRMWARE);
+	if (!waitReply()) {
+		return false;
 	}
+	*year = _fw_year;
+	*month = _fw_month;
+	*day = _fw_day;
+	return true;
+}
+
+// --------------------------------------------------------
+// SDS011:queryData
+// --------------------------------------------------------
+void SDS011::queryData() {
+	sendCommand(SDS011_CMD_QUERY_DATA, 0, 0);
+}
+
+void SDS011::begin(Stream* stream) {
+	sds_data = stream;
 }
 
 #ifndef ESP32
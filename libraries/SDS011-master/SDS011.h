@@ -6,6 +6,12 @@
 //
 // Documentation:
 //		- The iNovaFitness SDS011 datasheet
+//		- Laser Dust Sensor Control Protocol V1.3
+//
+// Bytes from the sensor go through one frame decoder (poll()), which
+// handles both 0xC0 data frames and 0xC5 command replies. Every command
+// records which reply it expects; the reply is matched in poll() and a
+// command without a reply times out after SDS011_REPLY_TIMEOUT ms.
 //
 
 #ifndef __SDS011_H
@@ -17,14 +23,32 @@
 	#include "WProgram.h"
 #endif
 
-#ifndef ESP32 
+#ifndef ESP32
 #include <SoftwareSerial.h>
 #endif
 
+#define SDS011_REPLY_TIMEOUT 1000	// ms to wait for a 0xC5 reply
+#define SDS011_ALL_DEVICES 0xFFFF
+
+// Command IDs (first data byte of a 0xB4 command and of its 0xC5 reply)
+#define SDS011_CMD_REPORT_MODE 2
+#define SDS011_CMD_QUERY_DATA 4
+#define SDS011_CMD_SET_ID 5
+#define SDS011_CMD_SLEEP 6
+#define SDS011_CMD_FIRMWARE 7
+#define SDS011_CMD_PERIOD 8
+
+enum SDS011Status : uint8_t {
+	SDS011_IDLE,		// No command sent yet
+	SDS011_PENDING,		// Waiting for the reply
+	SDS011_OK,			// Reply received
+	SDS011_TIMEOUT		// No reply within SDS011_REPLY_TIMEOUT
+};
+
 class SDS011 {
 	public:
 		SDS011(void);
-#ifndef ESP32 
+#ifndef ESP32
 		void begin(SoftwareSerial* serial);
 		void begin(uint8_t pin_rx, uint8_t pin_tx);
 #endif
@@ -32,13 +56,50 @@ class SDS011 {
 		void begin(HardwareSerial* serial);
 		void begin(HardwareSerial* serial, int8_t pin_rx, int8_t pin_tx);
 #endif
+		void begin(Stream* stream);	// Already opened at 9600 baud, e.g. a wrapped UART
 		int read(float *p25, float *p10);
 		void sleep();
 		void wakeup();
 		void continuous_mode();
+
+		// Decoder, call often (read() calls it too)
+		void poll();
+		SDS011Status commandStatus() const { return _status; }
+		bool waitReply(uint16_t timeout = SDS011_REPLY_TIMEOUT);
+
+		// Blocking commands, true when the sensor confirmed
+		bool setWorkingPeriod(uint8_t minutes);	// 0 = continuous, 1-30 = one measurement every n minutes
+		bool setQueryMode(bool query);			// true: frames only on queryData()
+		bool setDeviceId(uint16_t id);
+		bool getFirmwareVersion(uint8_t *year, uint8_t *month, uint8_t *day);
+
+		// Ask for one data frame (query mode); it arrives through read()
+		void queryData();
+
+		bool queryMode() const { return _query_mode; }
+		uint16_t deviceId() const { return _device_id; }
 	private:
+		void sendCommand(uint8_t cmd, uint8_t set, uint8_t value, uint8_t extra1 = 0, uint8_t extra2 = 0);
+		void expectReply(uint8_t cmd);
+		void handleFrame();
+
 		uint8_t _pin_rx, _pin_tx;
 		Stream *sds_data;
+
+		uint8_t _frame[10];
+		uint8_t _len = 0;
+		bool _new_data = false;
+		float _pm25 = 0, _pm10 = 0;
+
+		uint8_t _pending_cmd = 0;
+		uint32_t _sent_at = 0;
+		SDS011Status _status = SDS011_IDLE;
+
+		uint16_t _device_id = SDS011_ALL_DEVICES;
+		bool _query_mode = false;
+		bool _working = true;
+		uint8_t _period = 0;
+		uint8_t _fw_year = 0, _fw_month = 0, _fw_day = 0;
 };
 
 #endif
@@ -40,6 +40,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define _GPS_FEET_PER_METER 3.2808399
 #define _GPS_MAX_FIELD_SIZE 15
 
+template <uint16_t Fields, uint8_t Sentences> class TinyGPSLite;
+
 struct RawDegrees
 {
    uint16_t deg;
@@ -53,6 +55,7 @@ public:
 struct TinyGPSLocation
 {
    friend class TinyGPSPlus;
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
 public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
@@ -77,6 +80,7 @@ private:
 struct TinyGPSDate
 {
    friend class TinyGPSPlus;
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
 public:
    bool isValid() const       { return valid; }
    bool isUpdated() const     { return updated; }
@@ -101,6 +105,7 @@ private:
 struct TinyGPSTime
 {
    friend class TinyGPSPlus;
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
 public:
    bool isValid() const       { return valid; }
    bool isUpdated() const     { return updated; }
@@ -126,6 +131,7 @@ private:
 struct TinyGPSDecimal
 {
    friend class TinyGPSPlus;
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
 public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
@@ -146,6 +152,7 @@ private:
 struct TinyGPSInteger
 {
    friend class TinyGPSPlus;
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
 public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
@@ -0,0 +1,355 @@
+/*
+TinyGPSLite - a TinyGPS++ parser trimmed at compile time
+
+The fields to decode are template flags, e.g.
+
+   TinyGPSLite<GPS_LOCATION | GPS_DATE | GPS_TIME> gps;
+
+and only the sentences that carry them are parsed (here RMC alone; pass
+the sentence flags explicitly to override). Sentences that are not wanted
+are skipped byte by byte up to the next '$' - no term buffering and no
+checksum - and within a wanted sentence only the terms of wanted fields
+are copied and converted. Fields that are not selected are empty
+placeholders, so using one is a compile error rather than a silent zero.
+
+The selected fields are the TinyGPS++ objects (TinyGPSLocation,
+TinyGPSDate, ...) with the same API and commit rules: date and time on
+every RMC with a valid checksum, location, speed, course and altitude only
+from sentences with a fix. GPS_STATS adds the TinyGPS++ counters.
+*/
+
+#ifndef __TinyGPSLite_h
+#define __TinyGPSLite_h
+
+#include "TinyGPS++.h"
+
+#include <string.h>
+
+// Fields
+#define GPS_LOCATION   0x0001
+#define GPS_DATE       0x0002
+#define GPS_TIME       0x0004
+#define GPS_SPEED      0x0008
+#define GPS_COURSE     0x0010
+#define GPS_ALTITUDE   0x0020
+#define GPS_SATELLITES 0x0040
+#define GPS_HDOP       0x0080
+#define GPS_STATS      0x0100   // charsProcessed(), passedChecksum(), ...
+
+// Sentences
+#define GPS_RMC 0x01
+#define GPS_GGA 0x02
+
+// The fewest sentences that carry all the fields: RMC for location, date
+// and time, GGA only for what RMC lacks
+constexpr uint8_t tinyGPSSentences(uint16_t fields)
+{
+  return ((fields & (GPS_LOCATION | GPS_DATE | GPS_TIME | GPS_SPEED | GPS_COURSE)) ? GPS_RMC : 0) |
+         ((fields & (GPS_ALTITUDE | GPS_SATELLITES | GPS_HDOP)) ? GPS_GGA : 0);
+}
+
+// Stand-in for a field that was not selected
+struct TinyGPSNoField
+{
+   template <uint16_t, uint8_t> friend class TinyGPSLite;
+private:
+   void commit() {}
+   void set(const char *) {}
+   void setTime(const char *) {}
+   void setDate(const char *) {}
+   void setLatitude(const char *) {}
+   void setLongitude(const char *) {}
+};
+
+template <bool Enabled, class Field> struct TinyGPSSelect { typedef Field type; };
+template <class Field> struct TinyGPSSelect<false, Field> { typedef TinyGPSNoField type; };
+
+// Statistics, compiled out (and zero bytes as a base) unless GPS_STATS
+template <bool Enabled> struct TinyGPSLiteStats
+{
+  uint32_t charsProcessed()   const { return encodedCharCount; }
+  uint32_t sentencesWithFix() const { return sentencesWithFixCount; }
+  uint32_t failedChecksum()   const { return failedChecksumCount; }
+  uint32_t passedChecksum()   const { return passedChecksumCount; }
+
+protected:
+  uint32_t encodedCharCount = 0;
+  uint32_t sentencesWithFixCount = 0;
+  uint32_t failedChecksumCount = 0;
+  uint32_t passedChecksumCount = 0;
+  void countChar()   { ++encodedCharCount; }
+  void countFix()    { ++sentencesWithFixCount; }
+  void countFailed() { ++failedChecksumCount; }
+  void countPassed() { ++passedChecksumCount; }
+};
+
+template <> struct TinyGPSLiteStats<false>
+{
+protected:
+  void countChar()   {}
+  void countFix()    {}
+  void countFailed() {}
+  void countPassed() {}
+};
+
+template <uint16_t Fields, uint8_t Sentences = tinyGPSSentences(Fields)>
+class TinyGPSLite : public TinyGPSLiteStats<(Fields & GPS_STATS) != 0>
+{
+public:
+  bool encode(char c); // process one character received from GPS
+  TinyGPSLite &operator << (char c) {encode(c); return *this;}
+
+  typename TinyGPSSelect<(Fields & GPS_LOCATION) != 0, TinyGPSLocation>::type location;
+  typename TinyGPSSelect<(Fields & GPS_DATE) != 0, TinyGPSDate>::type date;
+  typename TinyGPSSelect<(Fields & GPS_TIME) != 0, TinyGPSTime>::type time;
+  typename TinyGPSSelect<(Fields & GPS_SPEED) != 0, TinyGPSSpeed>::type speed;
+  typename TinyGPSSelect<(Fields & GPS_COURSE) != 0, TinyGPSCourse>::type course;
+  typename TinyGPSSelect<(Fields & GPS_ALTITUDE) != 0, TinyGPSAltitude>::type altitude;
+  typename TinyGPSSelect<(Fields & GPS_SATELLITES) != 0, TinyGPSInteger>::type satellites;
+  typename TinyGPSSelect<(Fields & GPS_HDOP) != 0, TinyGPSHDOP>::type hdop;
+
+private:
+  typedef TinyGPSLiteStats<(Fields & GPS_STATS) != 0> Stats;
+
+  enum {SENTENCE_SKIP, SENTENCE_RMC, SENTENCE_GGA};
+
+  // Terms (bit n = term n) to buffer and decode in each sentence
+  enum : uint16_t
+  {
+    RMC_TERMS =
+    ((Fields & GPS_TIME) ? 1u << 1 : 0) |
+    ((Fields & (GPS_LOCATION | GPS_SPEED | GPS_COURSE)) ? 1u << 2 : 0) |
+    ((Fields & GPS_LOCATION) ? 0xFu << 3 : 0) |
+    ((Fields & GPS_SPEED) ? 1u << 7 : 0) |
+    ((Fields & GPS_COURSE) ? 1u << 8 : 0) |
+    ((Fields & GPS_DATE) ? 1u << 9 : 0),
+    GGA_TERMS =
+    ((Fields & GPS_TIME) ? 1u << 1 : 0) |
+    ((Fields & GPS_LOCATION) ? 0xFu << 2 : 0) |
+    ((Fields & (GPS_LOCATION | GPS_ALTITUDE)) ? 1u << 6 : 0) |
+    ((Fields & GPS_SATELLITES) ? 1u << 7 : 0) |
+    ((Fields & GPS_HDOP) ? 1u << 8 : 0) |
+    ((Fields & GPS_ALTITUDE) ? 1u << 9 : 0)
+  };
+
+  // parsing state variables
+  uint8_t parity = 0;
+  bool isChecksumTerm = false;
+  bool skipping = true;       // rest of the sentence is ignored
+  bool keepTerm = false;      // current term is buffered
+  char term[_GPS_MAX_FIELD_SIZE];
+  uint8_t curSentenceType = SENTENCE_SKIP;
+  uint8_t curTermNumber = 0;
+  uint8_t curTermOffset = 0;
+  bool sentenceHasFix = false;
+
+  static int fromHex(char a)
+  {
+    if (a >= 'A' && a <= 'F')
+      return a - 'A' + 10;
+    else if (a >= 'a' && a <= 'f')
+      return a - 'a' + 10;
+    else
+      return a - '0';
+  }
+
+  static void setHemisphere(TinyGPSLocation &loc, bool latitude, bool negative)
+  {
+    if (latitude)
+      loc.rawNewLatData.negative = negative;
+    else
+      loc.rawNewLngData.negative = negative;
+  }
+  static void setHemisphere(TinyGPSNoField &, bool, bool) {}
+
+  bool termWanted(uint8_t number) const
+  {
+    if (number >= 16)
+      return false;
+    uint16_t terms = curSentenceType == SENTENCE_RMC ? RMC_TERMS : GGA_TERMS;
+    return (terms >> number) & 1;
+  }
+
+  uint8_t sentenceType() const;
+  bool endOfTermHandler();
+  void termHandler();
+};
+
+template <uint16_t Fields, uint8_t Sentences>
+bool TinyGPSLite<Fields, Sentences>::encode(char c)
+{
+  Stats::countChar();
+
+  if (c == '$') // sentence begin
+  {
+    curTermNumber = curTermOffset = 0;
+    parity = 0;
+    curSentenceType = SENTENCE_SKIP;
+    isChecksumTerm = false;
+    sentenceHasFix = false;
+    skipping = false;
+    keepTerm = true; // sentence name
+    return false;
+  }
+
+  if (skipping)
+    return false;
+
+  switch(c)
+  {
+  case ',': // term terminators
+    parity ^= (uint8_t)c;
+  case '\r':
+  case '\n':
+  case '*':
+    {
+      bool isValidSentence = false;
+      if (curTermOffset < sizeof(term))
+      {
+        term[curTermOffset] = 0;
+        isValidSentence = endOfTermHandler();
+      }
+      ++curTermNumber;
+      curTermOffset = 0;
+      isChecksumTerm = c == '*';
+      keepTerm = isChecksumTerm || termWanted(curTermNumber);
+      return isValidSentence;
+    }
+
+  default: // ordinary characters
+    if (keepTerm && curTermOffset < sizeof(term) - 1)
+      term[curTermOffset++] = c;
+    if (!isChecksumTerm)
+      parity ^= c;
+    return false;
+  }
+}
+
+template <uint16_t Fields, uint8_t Sentences>
+uint8_t TinyGPSLite<Fields, Sentences>::sentenceType() const
+{
+  // GP (GPS) and GN (multi-constellation) talkers, as TinyGPS++
+  if (term[0] != 'G' || (term[1] != 'P' && term[1] != 'N'))
+    return SENTENCE_SKIP;
+  if ((Sentences & GPS_RMC) && !strcmp(term + 2, "RMC"))
+    return SENTENCE_RMC;
+  if ((Sentences & GPS_GGA) && !strcmp(term + 2, "GGA"))
+    return SENTENCE_GGA;
+  return SENTENCE_SKIP;
+}
+
+// Processes a just-completed term
+// Returns true if a wanted sentence has just passed the checksum test
+template <uint16_t Fields, uint8_t Sentences>
+bool TinyGPSLite<Fields, Sentences>::endOfTermHandler()
+{
+  if (isChecksumTerm)
+  {
+    skipping = true; // nothing follows but the line end
+    byte checksum = 16 * fromHex(term[0]) + fromHex(term[1]);
+    if (checksum != parity)
+    {
+      Stats::countFailed();
+      return false;
+    }
+
+    Stats::countPassed();
+    if (sentenceHasFix)
+      Stats::countFix();
+
+    if (curSentenceType == SENTENCE_RMC)
+    {
+      date.commit();
+      time.commit();
+      if (sentenceHasFix)
+      {
+        location.commit();
+        speed.commit();
+        course.commit();
+      }
+    }
+    else
+    {
+      time.commit();
+      if (sentenceHasFix)
+      {
+        location.commit();
+        altitude.commit();
+      }
+      satellites.commit();
+      hdop.commit();
+    }
+    return true;
+  }
+
+  // the first term determines the sentence type
+  if (curTermNumber == 0)
+  {
+    curSentenceType = sentenceType();
+    skipping = curSentenceType == SENTENCE_SKIP;
+    return false;
+  }
+
+  if (term[0])
+    termHandler();
+  return false;
+}
+
+#define COMBINE_LITE(sentence_type, term_number) (((unsigned)(sentence_type) << 5) | term_number)
+
+// Only wanted terms get here, so each case is a field that was selected
+template <uint16_t Fields, uint8_t Sentences>
+void TinyGPSLite<Fields, Sentences>::termHandler()
+{
+  switch(COMBINE_LITE(curSentenceType, curTermNumber))
+  {
+    case COMBINE_LITE(SENTENCE_RMC, 1): // Time in both sentences
+    case COMBINE_LITE(SENTENCE_GGA, 1):
+      time.setTime(term);
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 2): // RMC validity
+      sentenceHasFix = term[0] == 'A';
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 3): // Latitude
+    case COMBINE_LITE(SENTENCE_GGA, 2):
+      location.setLatitude(term);
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 4): // N/S
+    case COMBINE_LITE(SENTENCE_GGA, 3):
+      setHemisphere(location, true, term[0] == 'S');
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 5): // Longitude
+    case COMBINE_LITE(SENTENCE_GGA, 4):
+      location.setLongitude(term);
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 6): // E/W
+    case COMBINE_LITE(SENTENCE_GGA, 5):
+      setHemisphere(location, false, term[0] == 'W');
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 7): // Speed (RMC)
+      speed.set(term);
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 8): // Course (RMC)
+      course.set(term);
+      break;
+    case COMBINE_LITE(SENTENCE_RMC, 9): // Date (RMC)
+      date.setDate(term);
+      break;
+    case COMBINE_LITE(SENTENCE_GGA, 6): // Fix data (GGA)
+      sentenceHasFix = term[0] > '0';
+      break;
+    case COMBINE_LITE(SENTENCE_GGA, 7): // Satellites used (GGA)
+      satellites.set(term);
+      break;
+    case COMBINE_LITE(SENTENCE_GGA, 8): // HDOP
+      hdop.set(term);
+      break;
+    case COMBINE_LITE(SENTENCE_GGA, 9): // Altitude (GGA)
+      altitude.set(term);
+      break;
+  }
+}
+
+#undef COMBINE_LITE
+
+#endif // def(__TinyGPSLite_h)
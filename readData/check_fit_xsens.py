@@ -0,0 +1,109 @@
+"""Check fit_xsens.py on synthetic data with a known model.
+
+Writes an xsens_log.txt (header repeated after a power-up, as the unit
+writes it) and a reference CSV whose gases follow a known log-linear
+model of the inputs with 1 % noise, at a 60 s averaging period. Runs
+fit_xsens.py on them and checks that it recovers the coefficients and
+that the held-out samples have r2 >= 0.99.
+
+    python check_fit_xsens.py
+
+Exits 1 if a check failed.
+"""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+import numpy as np
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+INPUTS = ['ln_mq136', 'ln_mq4', 'ln_mics_red', 'ln_mics_ox', 'ln_tvoc', 'temperature', 'humidity']
+
+# Bias and one weight per input, as fit_xsens.py writes them
+MODEL = {
+    'so2': [-1.2, -0.9, 0.15, 0.0, 0.0, 0.05, 0.01, -0.004],
+    'h2s': [-2.5, -1.4, 0.0, 0.1, 0.0, 0.0, 0.02, 0.003],
+    'no2': [-3.0, 0.0, 0.0, 0.2, 1.1, 0.0, -0.01, 0.002],
+}
+
+
+def write_inputs(path, seconds):
+    rng = np.random.default_rng(1)
+    start = 1781503200000
+    t = np.arange(seconds)
+    x = np.column_stack([
+        -0.5 + 0.4 * np.sin(t / 1900.0) + 0.05 * rng.standard_normal(seconds),
+        -0.2 + 0.3 * np.sin(t / 2700.0 + 1) + 0.05 * rng.standard_normal(seconds),
+        0.1 + 0.5 * np.sin(t / 3100.0 + 2) + 0.05 * rng.standard_normal(seconds),
+        0.3 * np.sin(t / 1300.0 + 3) + 0.05 * rng.standard_normal(seconds),
+        4.5 + 0.6 * np.sin(t / 5300.0) + 0.05 * rng.standard_normal(seconds),
+        24 + 6 * np.sin(t / 43200.0),
+        55 + 20 * np.sin(t / 21600.0 + 1),
+    ])
+    epoch = start + t * 1000
+    header = 'epoch_ms,' + ','.join(INPUTS) + '\n'
+    with open(path, 'w') as f:
+        f.write(header)
+        for i in range(seconds):
+            if i == seconds // 3:
+                f.write(header)
+            f.write('%d,%s\n' % (epoch[i], ','.join('%.4f' % v for v in x[i])))
+    return epoch, x
+
+
+def write_reference(path, epoch, x, window_ms):
+    # The mean of each window's inputs through the model, labelled by the window's end
+    rng = np.random.default_rng(2)
+    labels = (epoch // window_ms + 1) * window_ms
+    with open(path, 'w') as f:
+        f.write('epoch_ms,' + ','.join(MODEL) + '\n')
+        for label in np.unique(labels)[:-1]:
+            mean = x[labels == label].mean(axis=0)
+            ppm = [np.exp(w[0] + mean @ np.array(w[1:])) * (1 + 0.01 * rng.standard_normal()) for w in MODEL.values()]
+            f.write('%d,%s\n' % (label, ','.join('%.5f' % v for v in ppm)))
+
+
+def main():
+    failures = 0
+    with tempfile.TemporaryDirectory() as work:
+        inputs = os.path.join(work, 'xsens_log.txt')
+        reference = os.path.join(work, 'reference.csv')
+        output = os.path.join(work, 'xsens.txt')
+        epoch, x = write_inputs(inputs, 4 * 86400)
+        write_reference(reference, epoch, x, 60000)
+        run = subprocess.run([sys.executable, os.path.join(HERE, 'fit_xsens.py'), inputs, reference, '-o', output,
+                              '--window', '60'], capture_output=True, text=True)
+        print(run.stdout, end='')
+        if run.returncode != 0:
+            print('check_fit_xsens: FAILED: fit_xsens.py exited %d: %s' % (run.returncode, run.stderr))
+            return 1
+
+        held_out = dict(re.findall(r'^(\w+) n=.*held out: n=\d+ rmse=\S+ ppm r2=([0-9.]+)', run.stdout, re.M))
+        fitted = {}
+        with open(output) as f:
+            for line in f:
+                m = re.match(r'(\w+)=log,(.*)', line.strip())
+                if m:
+                    fitted[m.group(1)] = [float(v) for v in m.group(2).split(',')]
+        for gas, weights in MODEL.items():
+            if gas not in fitted or gas not in held_out:
+                print('check_fit_xsens: FAILED: %s not fitted' % gas)
+                failures += 1
+                continue
+            if float(held_out[gas]) < 0.99:
+                print('check_fit_xsens: FAILED: %s held-out r2 %s' % (gas, held_out[gas]))
+                failures += 1
+            # The weights that drive the gas come back; temperature and humidity
+            # move slowly, so their weights (and the bias) trade off a little
+            error = np.abs(np.array(fitted[gas][1:6]) - np.array(weights[1:6]))
+            if error.max() > 0.05:
+                print('check_fit_xsens: FAILED: %s weights %s, model %s' % (gas, fitted[gas], weights))
+                failures += 1
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
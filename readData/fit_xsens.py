@@ -0,0 +1,138 @@
+"""Fit the cross-sensitivity model (xsens.txt) against reference data.
+
+The unit logs its model inputs with XS_log=1 to /xsens_log.txt:
+
+    epoch_ms,ln_mq136,ln_mq4,ln_mics_red,ln_mics_ox,ln_tvoc,temperature,humidity
+
+The reference file is a CSV from co-located instruments with an
+epoch_ms column (or a UTC "time" column) and one column per gas in ppm,
+named as the data.txt channels: so2, h2s, ch4, no2, c2h5oh, h2, nh3, co.
+Only the gases present are fitted.
+
+    python fit_xsens.py xsens_log.txt reference.csv -o xsens.txt
+
+Each gas gets one row of coefficients, fitted by ridge regression of
+ln(ppm) (or ppm with --linear) on the inputs. The last --holdout share
+of the matched samples is kept out of the fit and used to report the
+error. Copy xsens.txt to the SD card; the firmware loads it at boot.
+
+check_fit_xsens.py runs this on synthetic data from a known model.
+"""
+
+import argparse
+import sys
+
+import numpy as np
+import pandas as pd
+
+VERSION = 1
+INPUTS = ['ln_mq136', 'ln_mq4', 'ln_mics_red', 'ln_mics_ox', 'ln_tvoc', 'temperature', 'humidity']
+GASES = ['so2', 'h2s', 'ch4', 'no2', 'c2h5oh', 'h2', 'nh3', 'co']
+
+
+def read_inputs(path):
+    # The header is repeated after every power-up
+    df = pd.read_csv(path, skipinitialspace=True)
+    df = df[pd.to_numeric(df['epoch_ms'], errors='coerce').notna()]
+    df = df.astype({c: float for c in INPUTS}).astype({'epoch_ms': 'int64'})
+    return df.sort_values('epoch_ms').drop_duplicates('epoch_ms')
+
+
+def read_reference(path):
+    df = pd.read_csv(path, skipinitialspace=True)
+    if 'epoch_ms' not in df.columns:
+        if 'time' not in df.columns:
+            sys.exit('reference: needs an epoch_ms or time column')
+        df['epoch_ms'] = pd.to_datetime(df['time'], utc=True).astype('int64') // 1000000
+    df['epoch_ms'] = df['epoch_ms'].astype('int64')
+    return df.sort_values('epoch_ms')
+
+
+def average_inputs(inputs, window_ms):
+    # Mean of the inputs over each reference averaging period, labelled by its end
+    binned = inputs.copy()
+    binned['epoch_ms'] = (binned['epoch_ms'] // window_ms + 1) * window_ms
+    return binned.groupby('epoch_ms', as_index=False)[INPUTS].mean()
+
+
+def ridge(x, y, alpha):
+    # Least squares with the bias left unpenalised; constant inputs get 0
+    used = [0] + [i for i in range(1, x.shape[1]) if np.std(x[:, i]) > 1e-9]
+    xs = x[:, used]
+    penalty = alpha * np.eye(len(used))
+    penalty[0, 0] = 0
+    coef = np.linalg.solve(xs.T @ xs + penalty, xs.T @ y)
+    w = np.zeros(x.shape[1])
+    w[used] = coef
+    return w
+
+
+def report(name, truth, predicted):
+    error = predicted - truth
+    rmse = np.sqrt(np.mean(error ** 2))
+    total = np.sum((truth - truth.mean()) ** 2)
+    r2 = 1 - np.sum(error ** 2) / total if total > 0 else float('nan')
+    return '%s n=%d rmse=%.4g ppm r2=%.3f' % (name, len(truth), rmse, r2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('inputs', help='xsens_log.txt from the unit')
+    parser.add_argument('reference', help='reference CSV (epoch_ms or time, gas columns in ppm)')
+    parser.add_argument('-o', '--output', default='xsens.txt')
+    parser.add_argument('--window', type=float, default=0,
+                        help='reference averaging period in s; inputs are averaged over it (default: nearest sample)')
+    parser.add_argument('--tolerance', type=float, default=30, help='largest time gap to a matched sample, s')
+    parser.add_argument('--linear', action='store_true', help='fit ppm instead of ln(ppm)')
+    parser.add_argument('--alpha', type=float, default=1e-3, help='ridge penalty')
+    parser.add_argument('--holdout', type=float, default=0.2, help='share of the samples (the latest) kept for testing')
+    parser.add_argument('--floor', type=float, default=1e-3, help='reference values below this are clipped (log fit)')
+    args = parser.parse_args()
+
+    inputs = read_inputs(args.inputs)
+    reference = read_reference(args.reference)
+    gases = [g for g in GASES if g in reference.columns]
+    if not gases:
+        sys.exit('reference: no gas columns (%s)' % ', '.join(GASES))
+
+    if args.window > 0:
+        inputs = average_inputs(inputs, int(args.window * 1000))
+    matched = pd.merge_asof(reference[['epoch_ms'] + gases], inputs, on='epoch_ms', direction='nearest',
+                            tolerance=int(args.tolerance * 1000)).dropna(subset=INPUTS)
+    print('%d input samples, %d reference samples, %d matched' % (len(inputs), len(reference), len(matched)))
+
+    mode = 'linear' if args.linear else 'log'
+    rows = []
+    for gas in gases:
+        data = matched.dropna(subset=[gas])
+        if len(data) < 2 * (len(INPUTS) + 1):
+            print('%s: %d samples, too few to fit, skipped' % (gas, len(data)))
+            continue
+        x = np.column_stack([np.ones(len(data))] + [data[c].to_numpy() for c in INPUTS])
+        truth = data[gas].to_numpy(dtype=float)
+        y = truth if args.linear else np.log(np.maximum(truth, args.floor))
+        split = int(len(data) * (1 - args.holdout))
+        w = ridge(x[:split], y[:split], args.alpha)
+        predicted = x @ w
+        if not args.linear:
+            predicted = np.exp(predicted)
+        else:
+            predicted = np.maximum(predicted, 0)
+        line = report(gas, truth[:split], predicted[:split])
+        if split < len(data):
+            line += ', held out: ' + report('', truth[split:], predicted[split:]).strip()
+        print(line)
+        rows.append('%s=%s,%s' % (gas, mode, ','.join('%.6g' % v for v in w)))
+
+    if not rows:
+        sys.exit('nothing fitted')
+    with open(args.output, 'w') as f:
+        f.write('version=%d\n' % VERSION)
+        f.write('# inputs: bias,%s\n' % ','.join(INPUTS))
+        for row in rows:
+            f.write(row + '\n')
+    print('wrote %s (%d gases)' % (args.output, len(rows)))
+
+
+if __name__ == '__main__':
+    main()
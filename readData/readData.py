@@ -1,8 +1,61 @@
+import io
+import re
+
+import numpy as np
 import pandas as pd
 import tkinter as tk
 from tkinter import ttk, messagebox, filedialog
 from datetime import datetime
 from openpyxl.styles import numbers
+from openpyxl.utils import get_column_letter
+
+# Status bits of the <name>_status columns (schema 2 logs, see SensorRegistry.h)
+STATUS_WARMING = 0x01
+STATUS_CALIBRATED = 0x02
+STATUS_STALE = 0x04
+STATUS_FAULT = 0x08
+STATUS_INTERPOLATED = 0x10
+DROP_DEFAULT = STATUS_WARMING | STATUS_FAULT
+
+EPOCH_VALID_MS = 946684800000  # 2000-01-01 UTC; smaller epoch_ms values are uptime before the first GPS time
+HEADER = re.compile(r'^\s*[A-Za-z]')
+
+
+def read_log(path):
+    # The header is repeated after every power-up and changes with the
+    # firmware, so each header line starts a segment with its own columns
+    with open(path, newline='') as f:
+        lines = f.read().splitlines(keepends=True)
+    starts = [i for i, line in enumerate(lines) if HEADER.match(line)]
+    if not starts or starts[0] != 0:
+        starts.insert(0, 0)
+    segments = []
+    for begin, end in zip(starts, starts[1:] + [len(lines)]):
+        if end - begin > 1:
+            segment = pd.read_csv(io.StringIO(''.join(lines[begin:end])), skipinitialspace=True)
+            segment.columns = segment.columns.str.strip()
+            segments.append(segment)
+    return pd.concat(segments, ignore_index=True) if segments else pd.DataFrame()
+
+
+def valid_time(df):
+    # Rows with a GPS time; logs older than the epoch_ms column only have date and time
+    if 'epoch_ms' in df.columns:
+        return (pd.to_numeric(df['epoch_ms'], errors='coerce') >= EPOCH_VALID_MS).to_numpy()
+    return ((df['date'] != 0) & (df['time'] != 0)).to_numpy()
+
+
+def apply_status(df, drop=DROP_DEFAULT):
+    # Blank every value whose <name>_status has any of the drop bits; logs
+    # without status columns (schema 1) are left as they are
+    for status in [c for c in df.columns if c.endswith('_status')]:
+        name = status[:-len('_status')]
+        if name not in df.columns:
+            continue
+        bits = df[status].fillna(0).to_numpy(dtype=np.int64)
+        df[name] = df[name].mask((bits & drop) != 0)
+    return df
+
 
 class LiupeConverter:
     def __init__(self, root):
@@ -12,7 +65,7 @@ class LiupeConverter:
     def setup_ui(self):
         # Window configuration
         self.root.title("Liupe Tech - Data Converter")
-        self.root.geometry("500x280")
+        self.root.geometry("500x310")
         self.root.resizable(False, False)
         self.root.configure(bg='#f5f5f5')
         
@@ -59,7 +112,19 @@ class LiupeConverter:
             fg='#555555',
             bg=self.color_light,
             font=('Segoe UI', 9)
-        ).pack(pady=(0, 20))
+        ).pack(pady=(0, 10))
+
+        # Status filter (schema 2 logs)
+        self.drop_flagged = tk.BooleanVar(value=True)
+        tk.Checkbutton(
+            main_frame,
+            text="Blank readings of warming-up or faulty sensors",
+            variable=self.drop_flagged,
+            fg='#555555',
+            bg=self.color_light,
+            activebackground=self.color_light,
+            font=('Segoe UI', 9)
+        ).pack(pady=(0, 10))
         
         # Convert button
         convert_btn = tk.Button(
@@ -104,20 +169,21 @@ class LiupeConverter:
             self.status.config(text="Processing data...")
             self.root.update()
             
-            # Read CSV with proper handling
-            df = pd.read_csv(input_file)
-            
-            # Clean data - remove duplicate headers if present
-            df = df[~df.iloc[:, 0].astype(str).str.contains('date , time')]
+            # Read CSV, one segment per header line
+            df = read_log(input_file)
+            if self.drop_flagged.get():
+                df = apply_status(df)
             
             # Convert date/time
             if 'date' in df.columns and 'time' in df.columns:
-                # Handle zero values (0,0) and proper timestamps (20250420,114905)
-                mask = (df['date'] != 0) & (df['time'] != 0)
+                # Rows logged before the first GPS time get 0,0 instead of a date and time
+                mask = valid_time(df)
                 
                 # Create datetime objects for valid rows
+                date = pd.to_numeric(df['date'], errors='coerce').fillna(0).astype('int64')
+                time = pd.to_numeric(df['time'], errors='coerce').fillna(0).astype('int64')
                 df['datetime'] = pd.to_datetime(
-                    df['date'].astype(str).str.zfill(8) + df['time'].astype(str).str.zfill(6),
+                    date.astype(str).str.zfill(8) + time.astype(str).str.zfill(6),
                     format='%Y%m%d%H%M%S',
                     errors='coerce'
                 )
@@ -183,7 +249,7 @@ class LiupeConverter:
                 
                 # Format other columns
                 for col in range(3, len(df.columns) + 1):
-                    column_letter = chr(64 + col)  # Convert to Excel column letter
+                    column_letter = get_column_letter(col)
                     worksheet.column_dimensions[column_letter].width = 12
             
             success_msg = f"Success! Saved to {output_file}"
@@ -203,7 +269,7 @@ if __name__ == "__main__":
     
     # Center the window on screen
     window_width = 500
-    window_height = 280
+    window_height = 310
     screen_width = root.winfo_screenwidth()
     screen_height = root.winfo_screenheight()
     x = (screen_width // 2) - (window_width // 2)
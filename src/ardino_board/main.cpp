@@ -8,11 +8,11 @@
  * 1. Improved sensor handling
  * 2. Enhanced GPS data processing
  * 3. Better warmup sequences
+ * 
+ * Build with -DAQMS_NO_SD (or use main_no_sd.cpp) for boards without an
+ * SD card: records go to Serial only and config.txt defaults apply.
  */
 
-// SD card
-#include <SD.h>
-
 // GPS sensor
 #include <TinyGPS++.h>
 
@@ -31,6 +31,74 @@
 // MICS Sensor
 #include <MICS_4514.h>
 
+// Shared acquisition core and storage policies
+#include "AcquisitionCore.h"
+#ifndef AQMS_NO_SD
+#include <SD.h>
+#include "SDStorage.h"
+#endif
+
+// Sensor channel registry
+#include "SensorRegistry.h"
+
+// Background warmup with readiness detection
+#include "WarmupTracker.h"
+
+// Persistent R0 / baseline calibration (SD file + EEPROM)
+#include "CalibrationStore.h"
+
+// Automatic baseline correction from the rolling clean-air percentile
+#include "BaselineTracker.h"
+
+// SDS011 duty cycling
+#include "PMScheduler.h"
+
+// AVR build profile: Q16.16 gas curves instead of soft-float pow()
+#ifdef __AVR__
+#define AQMS_FIXED_POINT
+#endif
+
+// 2 KB parts (UNO, Nano): the baseline histograms (~350 bytes) do not fit next
+// to the SD block cache, so automatic baseline correction is left out there
+#if defined(__AVR__) && RAMEND < 0x900 && !defined(AQMS_NO_ABC)
+#define AQMS_NO_ABC
+#endif
+
+#ifdef AQMS_FIXED_POINT
+#include "FixedPoint.h"
+#define MQ_ADC_MAX 1023 // 10-bit ADC
+
+// Gas curve ppm = a * (RS/R0)^b, prepared once after calibration
+struct MQFixedCurve {
+  q16_t rlOverR0; // RL / R0, so RS / R0 = rlOverR0 * (max - adc) / adc
+  q16_t log2a;    // log2(a)
+  q16_t b;
+};
+
+MQFixedCurve so2Curve, h2sCurve, ch4Curve;
+q16_t mq136Ratio = 0; // Shared by readSO2() and readH2S() within one cycle
+MQFixedCurve makeFixedCurve(MQUnifiedsensor &sensor, float a, float b);
+#endif
+
+// GPS on a hardware UART when the board has a spare one (Mega), else SoftwareSerial
+#if defined(HAVE_HWSERIAL1)
+#define GPS_SERIAL Serial1
+typedef HardwareSerial GPSSerial;
+#else
+#define GPS_SERIAL GPS_SS
+typedef SoftwareSerial GPSSerial;
+#endif
+
+// SDS011 on its own UART when the board has one (Mega: Serial2, pins 16/17).
+// The UNO's only UART carries the Serial log, so the sensor's TX goes to pin 0
+// and it is only listened to: commands would be mixed into the log on pin 1
+#if defined(HAVE_HWSERIAL2)
+#define PM_SERIAL Serial2
+#else
+#define PM_SERIAL Serial
+#define PM_LISTEN_ONLY
+#endif
+
 // Define pins
 #define MG811_PIN A0
 #define MQ136_PIN A1
@@ -59,6 +127,27 @@ float RatioMQ136CleanAir = 3.6; //RS / R0 = 3.6 ppm
 float RatioMQ4CleanAir = 4.4; //RS / R0 = 60 ppm 
 unsigned long cycleInterval = 1000; // Changed from uint8_t
 unsigned long warmupTime = 180000; // 180000 ms = 3 min, changed from uint8_t
+unsigned long warmupMinTime = 30000; // No sensor is declared ready earlier than this
+float warmupSlope = 0.01; // Ready once the signal drifts less than 1 % per minute
+unsigned long CAL_max_age = 30; // Days before a stored calibration is redone
+float CAL_max_change = 0.5; // Largest accepted relative change of a stored value
+int CAL_recalibrate = 0; // 1 = ignore stored values and calibrate again
+unsigned long calCheckInterval = 3600000; // Check calibration age every hour
+float timezone = 5.5; // Local time offset in hours (IST)
+#ifndef AQMS_NO_ABC
+int ABC_enable = 1; // 1 = slowly track the clean-air baseline of each sensor
+int ABC_days = 7; // Days of history before the baseline is adjusted
+float ABC_max_step = 0.05; // Largest relative change of a value per day
+unsigned long abcSampleInterval = 60000; // One baseline sample per minute
+unsigned long abcDayLength = 86400000; // Baseline day: UTC days once the GPS time is known
+#endif
+#ifdef PM_LISTEN_ONLY
+unsigned long PM_period = 0; // SDS011 runs continuously, it cannot be sent to sleep
+#else
+unsigned long PM_period = 300000; // SDS011 wakes every 5 min (0 = run continuously)
+#endif
+unsigned long PM_window = 30000; // Frames averaged per wake
+unsigned long PM_spinup = 30000; // Fan spin-up before the window, frames dropped
 float CO2_inertia = 0.99;
 int CO2_tries = 100;
 float MQ136_H2S_A = 36.737;
@@ -68,28 +157,113 @@ float MQ136_SO2_B = -3.774;
 float MQ4_CH4_A = 1012.7;
 float MQ4_CH4_B = -2.786;
 bool ledState = 0;
+unsigned long cycleMicros = 0, cycleMicrosMax = 0; // Time spent reading sensors per loop
+unsigned long diagInterval = 60000; // Print cycle time and free RAM every minute
 
-//data
-float lat = 0.0, lng = 0.0;
-uint32_t m_date = 0, m_time = 0, tvoc = 0, eco2 = 0;
-float co2 = 0.0, so2 = 0.0, h2s = 0.0, ch4 = 0.0, no2 = 0.0, c2h5oh = 0.0, h2 = 0.0, nh3 = 0.0, co = 0.0;
+//data - GPS fields live in the core, sensor values in the registry below
 float pm25 = 0.0, pm10 = 0.0;
 
+//Storage policy: SD card, or nothing on boards without one
+#ifdef AQMS_NO_SD
+typedef NoStorage BoardStorage;
+BoardStorage storage;
+#else
+typedef SDStorage BoardStorage;
+BoardStorage storage(PIN_SPI_CS, "/data.txt");
+#endif
+
 //Declare Sensor
-File myFile;
+typedef SDS011 PMSensor; // The instance below hides the class name
 SDS011 SDS011;
-TinyGPSPlus GPS; // The TinyGPS++ object
+PMScheduler<PMSensor> pmScheduler(SDS011);
+#if !defined(HAVE_HWSERIAL1)
 SoftwareSerial GPS_SS(RXPin, TXPin); // The serial connection to the GPS device
+#endif
+AcquisitionCore<BoardStorage, RawADC, GPSSerial> core(storage, GPS_SERIAL);
 CO2Sensor co2Sensor(MG811_PIN, CO2_inertia, CO2_tries);
 DFRobot_ENS160_I2C ENS160(&Wire, ENS160_I2C_ADDRESS);
 MICS_4514 MICS_4514(MICS_RED_PIN, MICS_NOX_PIN, MICS_PRE_PIN);
 MQUnifiedsensor MQ4(Board, Voltage_Resolution, ADC_Bit_Resolution, MQ4_PIN, "MQ-4");
 MQUnifiedsensor MQ136(Board, Voltage_Resolution, ADC_Bit_Resolution, MQ136_PIN, "MQ-136");
 
+// Function prototypes
+void setupPMSensor();
+void readPM();
+float readCO2();
+float readSO2(float A, float B);
+float readH2S(float A, float B);
+float readCH4(float A, float B);
+float readNO2();
+float readC2H5OH();
+float readH2();
+float readNH3();
+float readCO();
+uint16_t readTVOC();
+uint16_t readeECO2();
+uint8_t warmupMask();
+void calibrateMQ(MQUnifiedsensor &mq, float cleanAirRatio, const __FlashStringHelper *label);
+void startWarmup();
+void serviceWarmup(uint32_t now);
+bool loadCalibration();
+void saveCalibration();
+bool sensorCalibrated(uint8_t sensor);
+bool calibrationExpired(uint8_t sensor);
+void applyCalibration(uint8_t sensor);
+void recalibrate(uint8_t sensor);
+void serviceCalibration();
+#ifndef AQMS_NO_ABC
+float baselineEstimate(uint8_t slot);
+void serviceBaseline(uint64_t epochMs);
+#endif
+#ifdef AQMS_FIXED_POINT
+void prepareFixedCurves();
+#endif
+#ifdef __AVR__
+int freeMemory();
+#endif
+
+// Warmup readiness, one tracker per heated sensor; bit i of the "ready" column
+enum { WARM_CO2, WARM_MQ136, WARM_MQ4, WARM_MICS, WARM_COUNT };
+WarmupTracker warmup[WARM_COUNT];
+
+// Stored calibration values, named as in /calib.txt
+enum { CAL_MQ136_R0, CAL_MQ4_R0, CAL_MICS_RED_R0, CAL_MICS_OX_R0, CAL_CO2_A, CAL_COUNT };
+const char *const calNames[CAL_COUNT] = {"MQ136_R0", "MQ4_R0", "MICS_RED_R0", "MICS_OX_R0", "CO2_A"};
+CalibrationStore calStore(calNames, CAL_COUNT);
+
+// Warmup sensor each stored value belongs to
+const uint8_t calSensor[CAL_COUNT] = {WARM_MQ136, WARM_MQ4, WARM_MICS, WARM_MICS, WARM_CO2};
+
+#ifndef AQMS_NO_ABC
+// Clean-air baseline per stored value: 16 bins over +/- 2 octaves, up to 7 days (~70 bytes each)
+#define ABC_MAX_DAYS 7
+BaselineTracker<16, ABC_MAX_DAYS> baseline[CAL_COUNT];
+BaselineClock abcClock;
+#endif
+
+// Sensor channels: name, unit, read period (ms, 0 = every loop), decimals, read function.
+// The scheduler, CSV header, data.txt record and Serial log are generated from this list.
+auto sensors = makeSensorRegistry(
+    sensorChannel("co2",    "ppm",   0,    2, []() { return readCO2(); }),
+    sensorChannel("so2",    "ppm",   0,    2, []() { return readSO2(MQ136_SO2_A, MQ136_SO2_B); }),
+    sensorChannel("h2s",    "ppm",   0,    2, []() { return readH2S(MQ136_H2S_A, MQ136_H2S_B); }),
+    sensorChannel("ch4",    "ppm",   0,    2, []() { return readCH4(MQ4_CH4_A, MQ4_CH4_B); }),
+    sensorChannel("no2",    "ppm",   0,    2, []() { return readNO2(); }),
+    sensorChannel("c2h5oh", "ppm",   0,    2, []() { return readC2H5OH(); }),
+    sensorChannel("h2",     "ppm",   0,    2, []() { return readH2(); }),
+    sensorChannel("nh3",    "ppm",   0,    2, []() { return readNH3(); }),
+    sensorChannel("co",     "ppm",   0,    2, []() { return readCO(); }),
+    sensorChannel("tvoc",   "ppb",   1000, 0, []() { return (float)readTVOC(); }),
+    sensorChannel("eco2",   "ppm",   1000, 0, []() { return (float)readeECO2(); }),
+    sensorChannel("pm25",   "ug/m3", 1000, 2, []() { readPM(); return pm25; }),
+    sensorChannel("pm10",   "ug/m3", 1000, 2, []() { return pm10; }),
+    sensorChannel("ready",  "mask",  0,    0, []() { return (float)warmupMask(); })
+);
+
 void setup() {
 //Init serial port
     Serial.begin(BAUDRATE);
-    GPS_SS.begin(BAUDRATE);
+    GPS_SERIAL.begin(BAUDRATE);
 
 // Configure pin modes
     pinMode(MG811_PIN, INPUT);        // CO2 sensor
@@ -103,192 +277,445 @@ void setup() {
 // LED
     digitalWrite(LED_PIN, HIGH);
 
-// SD card
-    if (!SD.begin(PIN_SPI_CS)) {
-        Serial.println(F("SD card initialization failed!"));
-        while (true){
-            Serial.println(F("SD card initialization failed!"));
-            delay(1000);
-        }
-    }
-    Serial.println(F("SD Card: initialization successful!"));
-
-//read config
-    String warmupTimeStr = readConfig("warmupTime");
-    if (warmupTimeStr.length() > 0) {
-        warmupTime = warmupTimeStr.toInt();
-    }
-    
-    String ratioMQ136Str = readConfig("RatioMQ136CleanAir");
-    if (ratioMQ136Str.length() > 0) {
-        RatioMQ136CleanAir = ratioMQ136Str.toFloat();
-    }
-    
-    String ratioMQ4Str = readConfig("RatioMQ4CleanAir");
-    if (ratioMQ4Str.length() > 0) {
-        RatioMQ4CleanAir = ratioMQ4Str.toFloat();
-    }
-    
-    String tempStr = readConfig("ENS160temperature");
-    if (tempStr.length() > 0) {
-        ENS160temperature = tempStr.toFloat();
-    }
-    
-    String humidityStr = readConfig("ENS160humidity");
-    if (humidityStr.length() > 0) {
-        ENS160humidity = humidityStr.toFloat();
-    }
-
-    String co2InertiaStr = readConfig("CO2_inertia");
-    if (co2InertiaStr.length() > 0) {
-        CO2_inertia = co2InertiaStr.toFloat();
+// Storage (SD card)
+    storage.begin();
+
+//read config - fixed buffers, no String allocations
+    core.readConfigFloat("timezone", timezone);
+    core.gps.setTimezone(timezone);
+    core.readConfigULong("warmupTime", warmupTime);
+    core.readConfigULong("warmupMinTime", warmupMinTime);
+    core.readConfigFloat("warmupSlope", warmupSlope);
+    if (core.readConfigULong("CAL_max_age", CAL_max_age)) {
+        calStore.setMaxAgeDays(CAL_max_age);
     }
-
-    String co2TriesStr = readConfig("CO2_tries");
-    if (co2TriesStr.length() > 0) {
-        CO2_tries = co2TriesStr.toInt();
-    }
-
-    String MQ136_H2S_A_Str = readConfig("MQ136_H2S_A");
-    if (MQ136_H2S_A_Str.length() > 0) {
-        MQ136_H2S_A = MQ136_H2S_A_Str.toFloat();
-    }
-
-    String MQ136_H2S_B_Str = readConfig("MQ136_H2S_B");
-    if (MQ136_H2S_B_Str.length() > 0) {
-        MQ136_H2S_B = MQ136_H2S_B_Str.toFloat();
-    }
-
-    String MQ136_SO2_A_Str = readConfig("MQ136_SO2_A");
-    if (MQ136_SO2_A_Str.length() > 0) {
-        MQ136_SO2_A = MQ136_SO2_A_Str.toFloat();
+    if (core.readConfigFloat("CAL_max_change", CAL_max_change)) {
+        calStore.setMaxChange(CAL_max_change);
     }
-
-    String MQ136_SO2_B_Str = readConfig("MQ136_SO2_B");
-    if (MQ136_SO2_B_Str.length() > 0) {
-        MQ136_SO2_B = MQ136_SO2_B_Str.toFloat();
+    core.readConfigInt("CAL_recalibrate", CAL_recalibrate);
+#ifndef AQMS_NO_ABC
+    core.readConfigInt("ABC_enable", ABC_enable);
+    if (core.readConfigInt("ABC_days", ABC_days)) {
+        ABC_days = constrain(ABC_days, 1, ABC_MAX_DAYS);
     }
+    core.readConfigFloat("ABC_max_step", ABC_max_step);
+#endif
+    core.readConfigULong("PM_period", PM_period);
+    core.readConfigULong("PM_window", PM_window);
+    core.readConfigULong("PM_spinup", PM_spinup);
+    core.readConfigFloat("RatioMQ136CleanAir", RatioMQ136CleanAir);
+    core.readConfigFloat("RatioMQ4CleanAir", RatioMQ4CleanAir);
+    core.readConfigFloat("ENS160temperature", ENS160temperature);
+    core.readConfigFloat("ENS160humidity", ENS160humidity);
+    core.readConfigFloat("CO2_inertia", CO2_inertia);
+    core.readConfigInt("CO2_tries", CO2_tries);
+    core.readConfigFloat("MQ136_H2S_A", MQ136_H2S_A);
+    core.readConfigFloat("MQ136_H2S_B", MQ136_H2S_B);
+    core.readConfigFloat("MQ136_SO2_A", MQ136_SO2_A);
+    core.readConfigFloat("MQ136_SO2_B", MQ136_SO2_B);
+    core.readConfigFloat("MQ4_CH4_A", MQ4_CH4_A);
+    core.readConfigFloat("MQ4_CH4_B", MQ4_CH4_B);
 
-    String MQ4_CH4_A_Str = readConfig("MQ4_CH4_A");
-    if (MQ4_CH4_A_Str.length() > 0) {
-        MQ4_CH4_A = MQ4_CH4_A_Str.toFloat();
+//SDS011 Setup
+#ifdef PM_LISTEN_ONLY
+    if (PM_period != 0) {
+        Serial.println(F("SDS011: shares the Serial UART, PM_period ignored"));
+        PM_period = 0;
     }
-
-    String MQ4_CH4_B_Str = readConfig("MQ4_CH4_B");
-    if (MQ4_CH4_B_Str.length() > 0) {
-        MQ4_CH4_B = MQ4_CH4_B_Str.toFloat();
+    SDS011.begin(&PM_SERIAL); // Already open at 9600 baud, active reporting
+#else
+    PM_SERIAL.begin(9600);
+    SDS011.begin(&PM_SERIAL);
+    setupPMSensor();
+#endif
+    pmScheduler.configure(PM_period, PM_window, PM_spinup);
+#ifdef PM_LISTEN_ONLY
+    pmScheduler.begin(millis(), false); // No wakeup command, it would go out on pin 1
+#else
+    pmScheduler.begin(millis());
+#endif
+    Serial.print(F("SDS011 duty cycle: "));
+    Serial.print(pmScheduler.dutyCycle() * 100, 0);
+    Serial.println(F(" %"));
+
+//Calibration store - stored R0/baseline values replace the cold calibration
+    if (CAL_recalibrate != 1) {
+        loadCalibration();
     }
 
-//SDS011 Setup
-    SDS011.begin(0, 1); //RX, TX
-
 //MG-811 Setup
-    co2Sensor.calibrate();
+    if (sensorCalibrated(WARM_CO2)) applyCalibration(WARM_CO2);
+    else co2Sensor.calibrate();
 
 //MICS-4514 Setup
-    MICS_4514.setR0();
+    if (sensorCalibrated(WARM_MICS)) applyCalibration(WARM_MICS);
+    else MICS_4514.setR0();
 
 //ENS160 Setup
     ENS160.begin();
     ENS160.setPWRMode(ENS160_STANDARD_MODE);
     ENS160.setTempAndHum(ENS160temperature, ENS160humidity);
 
-//MQ-136 Setup
+//MQ-136 Setup - stored R0, or a cold R0 recalibrated once the sensor is warm
     MQ136.init(); 
     MQ136.setRegressionMethod(1); //_PPM =  a*ratio^b
-    Serial.print("MQ-136 Calibrating...");
-    calcR0 = 0;
-    for(int i = 1; i<=10; i ++){
-        MQ136.update(); // Update data, the arduino will read the voltage from the analog pin
-        calcR0 += MQ136.calibrate(RatioMQ136CleanAir);}
-    MQ136.setR0(calcR0/10);
-    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println("Invalid");} else Serial.println("  done!.");
+    if (sensorCalibrated(WARM_MQ136)) applyCalibration(WARM_MQ136);
+    else calibrateMQ(MQ136, RatioMQ136CleanAir, F("MQ-136"));
 
 //MQ-4 Setup
     MQ4.init(); 
     MQ4.setRegressionMethod(1); //_PPM =  a*ratio^b
-    Serial.print("MQ-4 Calibrating...");
-    calcR0 = 0;
-    for(int i = 1; i<=10; i ++){
-        MQ4.update(); // Update data, the arduino will read the voltage from the analog pin
-        calcR0 += MQ4.calibrate(RatioMQ4CleanAir);}
-    MQ4.setR0(calcR0/10);
-    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println("Invalid");} else Serial.println("  done!.");
+    if (sensorCalibrated(WARM_MQ4)) applyCalibration(WARM_MQ4);
+    else calibrateMQ(MQ4, RatioMQ4CleanAir, F("MQ-4"));
 
-//Warmup
-    Warmup(warmupTime);
+//Warmup - runs in the background from loop(), logging starts now
+    startWarmup();
 
 //write data_title
-    myFile = SD.open("data.txt", FILE_WRITE);
-    if (myFile) {
-        myFile.println("date , time , lat , lng , co2 , so2 , h2s , ch4 , no2 , c2h5oh , h2 , nh3 , co , tvoc , eco2 , pm25 , pm10");
-        myFile.close();
-    } else {
-        Serial.println(F("SD Card: error on opening file data.txt"));
-    }
+    core.writeHeader(sensors);
 
 //data_title
-    Serial.println(F("date | time | lat | lng | co2 | so2 | h2s | ch4 | no2 | c2h5oh | h2 | nh3 | co | tvoc | eco2 | pm25 | pm10"));
+    core.printHeader(Serial, sensors, " | ");
 }
 
 void loop() {
-    // Read data from sensors
-    readPM();
-    readGPSData();
-    co2 = readCO2();
-    so2 = readSO2(MQ136_SO2_A, MQ136_SO2_B);
-    h2s = readH2S(MQ136_H2S_A, MQ136_H2S_B);
-    ch4 = readCH4(MQ4_CH4_A, MQ4_CH4_B);
-    no2 = readNO2();
-    c2h5oh = readC2H5OH();
-    h2 = readH2();
-    nh3 = readNH3();
-    co = readCO();
-    tvoc = readTVOC();
-    eco2 = readeECO2();
+    // Read data from sensors - each channel on its own period
+    unsigned long cycleStart = micros();
+    core.gps.poll();
+    serviceWarmup(millis());
+    pmScheduler.poll(millis());
+    sensors.poll(millis());
+    cycleMicros = micros() - cycleStart;
+    if (cycleMicros > cycleMicrosMax) cycleMicrosMax = cycleMicros;
 
     // Log data every cycleInterval - using proper time tracking
-    static unsigned long lastCycleTime = 0;
-    if (millis() - lastCycleTime >= cycleInterval) {
-        lastCycleTime = millis();
+    if (core.cycleDue(millis(), cycleInterval)) {
         ledState = !ledState;
-        writeData();
-        logData();
+        core.writeRecord(sensors);
+        core.logRecord(sensors);
         digitalWrite(LED_PIN, ledState);
     }
+
+    // Stored calibration: date it on the first GPS fix, redo it when too old
+    static unsigned long lastCalCheck = 0;
+    if (millis() - lastCalCheck >= calCheckInterval) {
+        lastCalCheck = millis();
+        serviceCalibration();
+    }
+
+#ifndef AQMS_NO_ABC
+    // Automatic baseline correction: sample once a minute, adjust once a day
+    serviceBaseline(core.gps.epochMs);
+#endif
+
+    // Cycle time and RAM headroom
+    static unsigned long lastDiagTime = 0;
+    if (millis() - lastDiagTime >= diagInterval) {
+        lastDiagTime = millis();
+        Serial.print(F("Cycle us (last/max): "));
+        Serial.print(cycleMicros); Serial.print('/');
+        Serial.print(cycleMicrosMax);
+#ifdef __AVR__
+        Serial.print(F(" | Free RAM: "));
+        Serial.print(freeMemory());
+#endif
+        Serial.println();
+    }
+}
+
+#ifdef __AVR__
+// Bytes between the heap and the stack
+extern char *__brkval;
+extern char __heap_start;
+int freeMemory() {
+    char top;
+    return __brkval ? &top - __brkval : &top - &__heap_start;
 }
+#endif
 
-void Warmup(unsigned long warmupTime) {
-    Serial.println("Starting sensor warmup sequence...");
-    
-    // Start MICS heater
-    MICS_4514.setWarmupTime(warmupTime);
+void calibrateMQ(MQUnifiedsensor &mq, float cleanAirRatio, const __FlashStringHelper *label) {
+    Serial.print(label);
+    Serial.print(F(" Calibrating..."));
+    calcR0 = 0;
+    for(int i = 1; i<=10; i ++){
+        mq.update(); // Update data, the arduino will read the voltage from the analog pin
+        calcR0 += mq.calibrate(cleanAirRatio);}
+    mq.setR0(calcR0/10);
+    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println(F("Invalid"));} else Serial.println(F("  done!."));
+
+#ifdef AQMS_FIXED_POINT
+    prepareFixedCurves();
+#endif
+}
+
+// Start the heaters and readiness trackers; warmupTime is now the upper bound
+void startWarmup() {
+    Serial.println(F("Starting sensor warmup sequence..."));
+
+    // Readiness comes from the trackers, so the MICS timer gate is disabled
+    MICS_4514.setWarmupTime(0);
     MICS_4514.warmupStart();
-    
-    Serial.println("Waiting for sensors to preheat...");
-    
-    // Debugging MICS sensor warmup status
-    Serial.print("MICS sensor ready state: ");
-    Serial.println(MICS_4514.sensorReady() ? "READY" : "NOT READY");
-    
-    while(!MICS_4514.sensorReady()) {
-        Serial.println("Preheating Gas Sensors...");
-        delay(1000);
+
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        warmup[i].configure(warmupMinTime, warmupTime, warmupSlope);
+        warmup[i].begin(millis());
+    }
+}
+
+// Signal whose drift decides readiness: Rs for the heated resistive sensors,
+// the cell EMF for the MG-811
+float warmupSignal(uint8_t sensor) {
+    const uint16_t adcMax = (1 << ADC_Bit_Resolution) - 1;
+    switch (sensor) {
+        case WARM_CO2:   return analogRead(MG811_PIN);
+        case WARM_MQ136: return warmupRsProxy(analogRead(MQ136_PIN), adcMax);
+        case WARM_MQ4:   return warmupRsProxy(analogRead(MQ4_PIN), adcMax);
+        default:         return warmupRsProxy(analogRead(MICS_RED_PIN), adcMax);
+    }
+}
+
+// Sample each warming sensor; calibrate it the moment it settles unless a
+// stored calibration is already in use
+void serviceWarmup(uint32_t now) {
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (!warmup[i].due(now)) continue;
+        if (!warmup[i].update(now, warmupSignal(i))) continue;
+
+        Serial.print(F("Warmup: sensor "));
+        Serial.print(i);
+        Serial.print(F(" ready after "));
+        Serial.print(warmup[i].elapsed(now) / 1000);
+        Serial.println(warmup[i].timedOut() ? F(" s (timeout)") : F(" s (settled)"));
+
+        if (!sensorCalibrated(i)) {
+            recalibrate(i);
+        }
+    }
+}
+
+// Load stored R0/baseline values from storage, falling back to EEPROM
+bool loadCalibration() {
+    bool loaded = false;
+    storage.readFile(CAL_STORE_PATH, [&](Stream &calFile) { loaded = calStore.load(calFile); });
+    if (!loaded) {
+        calStore.clear();
+        loaded = calStore.loadNVS();
     }
-    
-    // Extra delay for MQ sensors to stabilize
-    Serial.println("Almost done, final stabilization...");
-    delay(5000);
-    
-    // Call setR0 one more time after we're fully stabilized
-    Serial.println("Setting final R0 calibration values...");
-    MICS_4514.setR0();
-    
-    Serial.println("Gas Sensors Preheated and Ready");
+    Serial.print(F("Calibration store: "));
+    Serial.println(loaded ? F("loaded") : F("not found, calibrating after warmup"));
+    return loaded;
 }
 
+void saveCalibration() {
+    if (!storage.writeFile(CAL_STORE_PATH, [](Print &calFile) { calStore.save(calFile); })
+        && BoardStorage::persistent) {
+        Serial.println(F("SD Card: error on opening file calib.txt"));
+    }
+    calStore.saveNVS();
+}
+
+// True when every stored value a warmup sensor needs is present
+bool sensorCalibrated(uint8_t sensor) {
+    switch (sensor) {
+        case WARM_CO2:   return calStore.has(CAL_CO2_A);
+        case WARM_MQ136: return calStore.has(CAL_MQ136_R0);
+        case WARM_MQ4:   return calStore.has(CAL_MQ4_R0);
+        default:         return calStore.has(CAL_MICS_RED_R0) && calStore.has(CAL_MICS_OX_R0);
+    }
+}
+
+bool calibrationExpired(uint8_t sensor) {
+    uint32_t today = core.gps.date;
+    switch (sensor) {
+        case WARM_CO2:   return calStore.expired(CAL_CO2_A, today);
+        case WARM_MQ136: return calStore.expired(CAL_MQ136_R0, today);
+        case WARM_MQ4:   return calStore.expired(CAL_MQ4_R0, today);
+        default:         return calStore.expired(CAL_MICS_RED_R0, today) || calStore.expired(CAL_MICS_OX_R0, today);
+    }
+}
+
+// Push the stored values into the sensor driver
+void applyCalibration(uint8_t sensor) {
+    switch (sensor) {
+        case WARM_CO2:   co2Sensor.setCalibration(calStore.value(CAL_CO2_A)); break;
+        case WARM_MQ136: MQ136.setR0(calStore.value(CAL_MQ136_R0)); break;
+        case WARM_MQ4:   MQ4.setR0(calStore.value(CAL_MQ4_R0)); break;
+        default:         MICS_4514.setR0Values(calStore.value(CAL_MICS_RED_R0), calStore.value(CAL_MICS_OX_R0)); break;
+    }
+#ifdef AQMS_FIXED_POINT
+    prepareFixedCurves();
+#endif
+}
+
+// Calibrate a warm sensor in the current air and store the result, unless it
+// is implausibly far from the stored value (e.g. the unit booted in smoke)
+void recalibrate(uint8_t sensor) {
+    uint8_t slots[2];
+    float values[2];
+    uint8_t count = 1;
+
+    switch (sensor) {
+        case WARM_CO2:
+            co2Sensor.calibrate();
+            slots[0] = CAL_CO2_A; values[0] = co2Sensor.getCalibration();
+            break;
+        case WARM_MQ136:
+            calibrateMQ(MQ136, RatioMQ136CleanAir, F("MQ-136"));
+            slots[0] = CAL_MQ136_R0; values[0] = MQ136.getR0();
+            break;
+        case WARM_MQ4:
+            calibrateMQ(MQ4, RatioMQ4CleanAir, F("MQ-4"));
+            slots[0] = CAL_MQ4_R0; values[0] = MQ4.getR0();
+            break;
+        default:
+            MICS_4514.setR0();
+            slots[0] = CAL_MICS_RED_R0; values[0] = MICS_4514.getR0Red();
+            slots[1] = CAL_MICS_OX_R0; values[1] = MICS_4514.getR0OX();
+            count = 2;
+            break;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        calStore.attempted(slots[i], core.gps.date);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!calStore.acceptable(slots[i], values[i])) {
+            Serial.print(F("Calibration: "));
+            Serial.print(calStore.name(slots[i]));
+            Serial.print(F(" = "));
+            Serial.print(values[i]);
+            Serial.print(F(" rejected, keeping "));
+            Serial.println(calStore.value(slots[i]));
+            if (sensorCalibrated(sensor)) applyCalibration(sensor);
+            saveCalibration(); // The attempt, so an expired value is retried tomorrow
+            return;
+        }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        calStore.set(slots[i], values[i], core.gps.date);
+    }
+    saveCalibration();
+}
+
+// Date entries stored before the first GPS fix and redo expired ones
+void serviceCalibration() {
+    if (calStore.stampDate(core.gps.date)) {
+        saveCalibration();
+    }
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (warmup[i].ready() && calibrationExpired(i)) {
+            Serial.print(F("Calibration: sensor "));
+            Serial.print(i);
+            Serial.println(F(" is older than CAL_max_age, recalibrating"));
+            recalibrate(i);
+        }
+    }
+}
+
+#ifndef AQMS_NO_ABC
+// R0 / curve offset the current reading would give if the air were clean
+float baselineEstimate(uint8_t slot) {
+    switch (slot) {
+        case CAL_MQ136_R0:    MQ136.update(); return MQ136.calibrate(RatioMQ136CleanAir);
+        case CAL_MQ4_R0:      MQ4.update(); return MQ4.calibrate(RatioMQ4CleanAir);
+        case CAL_MICS_RED_R0: return MICS_4514.getResistanceRed();
+        case CAL_MICS_OX_R0:  return MICS_4514.getResistanceNOX();
+        default:              return co2Sensor.getBaselineEstimate();
+    }
+}
+
+// Feed each warm, calibrated sensor into its baseline tracker; once a day move
+// every stored value at most ABC_max_step towards the cleanest daily baseline
+// of the last ABC_days days, and log the change to /abc_log.txt
+void serviceBaseline(uint64_t epochMs) {
+    if (ABC_enable != 1 || !abcClock.sampleDue(epochMs, abcSampleInterval)) return;
+
+    bool sampled = false;
+    for (uint8_t slot = 0; slot < CAL_COUNT; slot++) {
+        if (!warmup[calSensor[slot]].ready() || !calStore.has(slot)) continue;
+        if (baseline[slot].reference() == 0) {
+            // Rs of the oxidising-gas element rises with NO2, so clean air is its low end
+            baseline[slot].begin(calStore.value(slot), slot != CAL_MICS_OX_R0);
+        }
+        baseline[slot].add(baselineEstimate(slot));
+        sampled = true;
+    }
+    // Nothing warm yet (a wake from deep sleep): the sample stays due
+    if (!sampled) return;
+    abcClock.sampled(epochMs);
+
+    if (!abcClock.dayEnded(epochMs, abcDayLength, core.gps.clock.synced())) return;
+
+    bool changed = false;
+    for (uint8_t slot = 0; slot < CAL_COUNT; slot++) {
+        if (baseline[slot].reference() == 0 || !baseline[slot].closeDay()) continue;
+        if (baseline[slot].days() < ABC_days) continue;
+
+        float current = calStore.value(slot);
+        float target = baseline[slot].baseline(ABC_days);
+        // Less than one histogram bin per day, so the quantised target is approached smoothly
+        float step = min(ABC_max_step, baseline[slot].binWidth() / 2) * current;
+        float next = constrain(target, current - step, current + step);
+        if (next == current) continue;
+
+        Serial.print(F("ABC: "));
+        Serial.print(calStore.name(slot));
+        Serial.print(' ');
+        Serial.print(current, 4);
+        Serial.print(F(" -> "));
+        Serial.println(next, 4);
+        storage.appendFile("/abc_log.txt", [&](Print &log) {
+            log.print(core.gps.date); log.print(',');
+            log.print(core.gps.time); log.print(',');
+            log.print(calStore.name(slot)); log.print(',');
+            log.print(current, 4); log.print(',');
+            log.print(next, 4); log.print(',');
+            log.println(target, 4);
+        });
+
+        calStore.adjust(slot, next);
+        applyCalibration(calSensor[slot]);
+        baseline[slot].setReference(next);
+        changed = true;
+    }
+    if (changed) saveCalibration();
+}
+#endif
+
+// Bit i set once warmup[i] is ready (bit 0 MG-811, 1 MQ-136, 2 MQ-4, 3 MICS)
+uint8_t warmupMask() {
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (warmup[i].ready()) mask |= 1 << i;
+    }
+    return mask;
+}
+
+// Wake the SDS011 (it may still be asleep from before a reset), let it
+// measure continuously while awake, and switch it to query mode so exactly
+// one frame is read per logging cycle. Without replies, use its own stream.
+void setupPMSensor() {
+    SDS011.wakeup();
+    SDS011.waitReply();
+    uint8_t year = 0, month = 0, day = 0;
+    if (SDS011.setWorkingPeriod(0) && SDS011.setQueryMode(true)) {
+        pmScheduler.setQueryInterval(cycleInterval);
+        SDS011.getFirmwareVersion(&year, &month, &day);
+        Serial.print(F("SDS011: query mode, ID "));
+        Serial.print(SDS011.deviceId(), HEX);
+        Serial.print(F(", firmware "));
+        Serial.print(year); Serial.print('-');
+        Serial.print(month); Serial.print('-');
+        Serial.println(day);
+    } else {
+        Serial.println(F("SDS011: no reply, using active reporting"));
+    }
+}
+
+// Average of the last SDS011 sampling window, held while the sensor sleeps
 void readPM() {
-    SDS011.read(&pm25, &pm10);
+    pm25 = pmScheduler.pm25();
+    pm10 = pmScheduler.pm10();
 }
 
 uint16_t readTVOC() {
@@ -303,6 +730,50 @@ float readCO2() {
     return (co2Sensor.read());
 }   
 
+#ifdef AQMS_FIXED_POINT
+// The fixed-point curves carry RL/R0, so rebuild them whenever R0 changes
+void prepareFixedCurves() {
+    so2Curve = makeFixedCurve(MQ136, MQ136_SO2_A, MQ136_SO2_B);
+    h2sCurve = makeFixedCurve(MQ136, MQ136_H2S_A, MQ136_H2S_B);
+    ch4Curve = makeFixedCurve(MQ4, MQ4_CH4_A, MQ4_CH4_B);
+}
+
+MQFixedCurve makeFixedCurve(MQUnifiedsensor &sensor, float a, float b) {
+    MQFixedCurve curve;
+    curve.rlOverR0 = q16FromFloat(sensor.getR0() > 0 ? sensor.getRL() / sensor.getR0() : 0);
+    curve.log2a = q16FromFloat(log(a) / log(2.0));
+    curve.b = q16FromFloat(b);
+    return curve;
+}
+
+// RS/R0 from two raw ADC readings, integer math only
+q16_t readMQRatio(uint8_t pin, q16_t rlOverR0) {
+    uint16_t sum = analogRead(pin);
+    sum += analogRead(pin);
+    if (sum == 0) return Q16_MAX;
+    if (sum >= 2 * MQ_ADC_MAX) return 0;
+    uint16_t rest = 2 * MQ_ADC_MAX - sum;
+    if ((uint32_t)rlOverR0 < (1UL << 20)) {
+        return (q16_t)(((uint32_t)rlOverR0 * rest) / sum); // Fits in 32 bits
+    }
+    return q16Saturate(((int64_t)rlOverR0 * rest) / sum);
+}
+
+float readH2S(float A, float B) {
+    // Uses the MQ-136 ratio read by readSO2() earlier in the same cycle
+    return q16ToFloat(q16PowerLaw(h2sCurve.log2a, mq136Ratio, h2sCurve.b));
+}
+
+float readSO2(float A, float B) {
+    mq136Ratio = readMQRatio(MQ136_PIN, so2Curve.rlOverR0);
+    return q16ToFloat(q16PowerLaw(so2Curve.log2a, mq136Ratio, so2Curve.b));
+}
+
+float readCH4(float A, float B) {
+    q16_t ratio = readMQRatio(MQ4_PIN, ch4Curve.rlOverR0);
+    return q16ToFloat(q16PowerLaw(ch4Curve.log2a, ratio, ch4Curve.b));
+}
+#else
 float readH2S(float A, float B) {
     MQ136.update(); // Update data, the arduino will read the voltage from the analog pin
     MQ136.setA(A); MQ136.setB(B); // Configure the equation to calculate H2S
@@ -321,6 +792,8 @@ float readCH4(float A, float B) {
     return (MQ4.readSensor()); // CH4 Concentration
 }
 
+#endif
+
 float readNO2() {
     gasdata = MICS_4514.getNitrogenDioxide();
     return (gasdata);
@@ -345,141 +818,3 @@ float readCO() {
     gasdata = MICS_4514.getCarbonMonoxide();
     return (gasdata);
 }
-
-// Modified readGPSData() with robust validation
-void readGPSData() {
-  static unsigned long lastValidFix = 0;
-  bool hasFix = false;
-
-  // Process incoming GPS data
-  while (GPS_SS.available() > 0) {
-    if (GPS.encode(GPS_SS.read())) {
-      if (GPS.location.isValid() && GPS.date.isValid() && GPS.time.isValid()) {
-        hasFix = true;
-        lastValidFix = millis();
-      }
-    }
-  }
-
-  // Only use data if we had a recent valid fix (within 2 seconds)
-  if (hasFix || (millis() - lastValidFix < 2000)) {
-    // Location data
-    lat = GPS.location.lat();
-    lng = GPS.location.lng();
-
-    // Date handling (YYYYMMDD format)
-    uint8_t day = GPS.date.day();
-    uint8_t month = GPS.date.month();
-    uint16_t year = GPS.date.year();
-
-    // Enhanced date validation
-    if (year >= 2020 && year <= 2100 &&
-        month >= 1 && month <= 12 &&
-        day >= 1 && day <= 31) {
-      m_date = (year * 10000UL) + (month * 100UL) + day;
-    }
-
-    // Time handling with proper timezone math
-    const float timezone = 5.5; // IST
-    uint8_t hour = GPS.time.hour();
-    uint8_t minute = GPS.time.minute();
-    uint8_t second = GPS.time.second();
-
-    // Convert all to seconds, add timezone offset
-    uint32_t total_seconds = hour * 3600UL + minute * 60UL + second;
-    total_seconds += (uint32_t)(timezone * 3600);
-
-    // Handle day rollover
-    while (total_seconds >= 86400) {
-      total_seconds -= 86400;
-      // Note: Would need to handle date increment here if needed
-    }
-
-    // Convert back to hours/minutes/seconds
-    hour = total_seconds / 3600;
-    total_seconds %= 3600;
-    minute = total_seconds / 60;
-    second = total_seconds % 60;
-
-    // Final validation
-    if (hour < 24 && minute < 60 && second < 60) {
-      m_time = (hour * 10000UL) + (minute * 100UL) + second;
-    }
-  }
-}
-
-// Function to find a value by its name/key
-String readConfig(const String &name) {
-  String value = ""; // Default empty value
-  myFile = SD.open("config.txt", FILE_READ);
-  if (!myFile) {
-    Serial.println(F("SD Card: error on opening file config.txt"));
-    return value; // Return empty value if file can't be opened
-  }
-  
-  while (myFile.available()) {
-    String line = myFile.readStringUntil('\n');
-    line.trim(); // Remove any leading/trailing whitespace
-    // Find the separator position
-    int separatorPos = line.indexOf('=');
-    if (separatorPos > 0) {
-      String key = line.substring(0, separatorPos);
-      key.trim();
-      
-      if (key == name) {
-        value = line.substring(separatorPos + 1);
-        value.trim();
-        break; // Found the value, exit the loop
-      }
-    }
-  }
-  
-  myFile.close(); // Always close the file
-  return value;
-}
-
-void logData() {
-    Serial.print(m_date); Serial.print(" | ");
-    Serial.print(m_time); Serial.print(" | ");
-    Serial.print(lat, 4); Serial.print(" | ");
-    Serial.print(lng, 4); Serial.print(" | ");
-    Serial.print(co2); Serial.print(" | ");
-    Serial.print(so2); Serial.print(" | ");
-    Serial.print(h2s); Serial.print(" | ");
-    Serial.print(ch4); Serial.print(" | ");
-    Serial.print(no2); Serial.print(" | ");
-    Serial.print(c2h5oh); Serial.print(" | ");
-    Serial.print(h2); Serial.print(" | ");
-    Serial.print(nh3); Serial.print(" | ");
-    Serial.print(co); Serial.print(" | ");
-    Serial.print(tvoc); Serial.print(" | ");
-    Serial.print(eco2); Serial.print(" | ");
-    Serial.print(pm25); Serial.print(" | ");
-    Serial.print(pm10); Serial.println();
-}
-
-void writeData() {
-    myFile = SD.open("data.txt", FILE_WRITE);
-    if (myFile) {
-        myFile.print(m_date); myFile.print(",");
-        myFile.print(m_time); myFile.print(",");
-        myFile.print(lat, 6); myFile.print(",");
-        myFile.print(lng, 6); myFile.print(",");
-        myFile.print(co2); myFile.print(",");
-        myFile.print(so2); myFile.print(",");
-        myFile.print(h2s); myFile.print(",");
-        myFile.print(ch4); myFile.print(",");
-        myFile.print(no2); myFile.print(",");
-        myFile.print(c2h5oh); myFile.print(",");
-        myFile.print(h2); myFile.print(",");
-        myFile.print(nh3); myFile.print(",");
-        myFile.print(co); myFile.print(",");
-        myFile.print(tvoc); myFile.print(",");
-        myFile.print(eco2); myFile.print(",");
-        myFile.print(pm25); myFile.print(",");
-        myFile.print(pm10); myFile.println();
-        myFile.close();
-    } else {
-        Serial.println(F("SD Card: error on opening file data.txt"));
-    }
-}
@@ -4,6 +4,9 @@
 /*
  * EnviroSense AQMS - ESP32 with ADC Stability Improvements
  * 
+ * Build with -DAQMS_NO_SD (or use esp_main_no_sd.cpp) for boards without
+ * an SD card: records go to Serial only and config.txt defaults apply.
+ * 
  * This code includes several improvements to handle ESP32 ADC reading issues:
  * 1. Added readStableADC() function for reliable analog readings
  * 2. Used custom wrapper classes for all sensors that use ADC
@@ -14,9 +17,6 @@
  * See README_ADC_IMPROVEMENTS.md for detailed explanation of changes.
  */
 
-// SD card
-#include <SD.h>
-
 // GPS sensor
 #include <TinyGPS++.h>
 
@@ -38,43 +38,209 @@
 #include <MICS_4514.h>
 #include "MICS_4514_Extended.h"
 
+// ADC calibration and adaptive oversampling
+#include "ADCCalibration.h"
+#include "AdaptiveSampler.h"
+
+// Shared acquisition core and storage policies
+#include "AcquisitionCore.h"
+#ifndef AQMS_NO_SD
+#include "SDStorage.h"
+#endif
+
+// Sensor channel registry
+#include "SensorRegistry.h"
+
+// Background warmup with readiness detection
+#include "WarmupTracker.h"
+
+// Persistent R0 / baseline calibration
+#include "CalibrationStore.h"
+
+// Automatic baseline correction from the rolling clean-air percentile
+#include "BaselineTracker.h"
+
+// SDS011 duty cycling
+#include "PMScheduler.h"
+
+// Low-power windows with an RTC-memory record queue
+#include "PowerManager.h"
+#include <esp_sleep.h>
+
+// Raw input trace for host replay (AQMS_Core)
+#include "TraceRecorder.h"
+
+// Event-triggered high-rate capture of the gas inputs (AQMS_Core)
+#include "SpikeCapture.h"
+
+// MQTT uplink over WiFi (AQMS_Core)
+#include <WiFi.h>
+#include "MqttUplink.h"
+
+// HTTP dashboard / API over WiFi (AQMS_Core)
+#include "HttpDashboard.h"
+
+// Air Quality Index over sliding 1 h / 8 h / 24 h windows (AQMS_Core)
+#include "AQIEngine.h"
+
+// Cross-sensitivity compensation fitted against reference data (AQMS_Core)
+#include "CrossSensitivity.h"
+
+// Per-channel filter chains and the CO2 fusion filter (AQMS_Core)
+#include "SignalFilter.h"
+
+// Streaming fault checks on the inputs (AQMS_Core)
+#include "HealthMonitor.h"
+
 // Helper function for stable ADC readings
-#define NUM_SAMPLES 16  // Number of samples to average
+#define NUM_SAMPLES 16  // Maximum number of samples to average
+#define ADC_FULL_SCALE_MV 3300  // Input voltage that maps to code 4095 (11dB attenuation)
+#define ADC_CAL_SAMPLES 256  // Samples averaged per reference point during calibration
+#define ADC_CAL_TIMEOUT 60000 // ms to wait for each reference point before giving up
+
+// ESP32 GPIOs on ADC2 (the rest of the analog pins are ADC1)
+inline bool onADC2(uint8_t pin) {
+  switch (pin) {
+    case 0: case 2: case 4: case 12: case 13: case 14: case 15: case 25: case 26: case 27: return true;
+    default: return false;
+  }
+}
+
+// Per-unit ADC correction tables (identity until calibrated), one per ADC unit
+enum { ADC_TABLE_1, ADC_TABLE_2, ADC_TABLES };
+ADCCalibration adcCal[ADC_TABLES];
+const char *const adcCalPaths[ADC_TABLES] = {"/adc_cal.txt", "/adc_cal2.txt"};
+const char *const adcCalSpaces[ADC_TABLES] = {"adc_cal", "adc_cal2"};
+
+inline uint8_t adcTable(uint8_t pin) { return onADC2(pin) ? ADC_TABLE_2 : ADC_TABLE_1; }
+AdaptiveSampler adcSampler; // Per-channel sample count driven by measured noise
+
+// Raw input trace: ADC bursts, GPS/SDS011 bytes and ENS160 registers
+#define TRACE_PATH "/trace.bin"
+#define TRACE_BUFFER_BYTES 4096
+#ifndef AQMS_TRACER
+#define AQMS_TRACER TraceRecorder<TRACE_BUFFER_BYTES> // The host replay puts its own in
+#endif
+typedef AQMS_TRACER Tracer;
+Tracer trace;
+
+// Spike capture: a sampler task on core 0 reads the gas inputs at CAP_rate;
+// the ADC is shared with readStableADC through adcMutex
+#define CAPTURE_PATH "/capture.txt"
+#define CAPTURE_FRAMES 1024 // Ring of single readings, 10 s at 100 Hz
+const char *const captureNames[] = {"mg811", "mq136", "mq4", "mics_ox", "mics_red"};
+SpikeCapture<5, CAPTURE_FRAMES> capture(captureNames);
+SemaphoreHandle_t adcMutex = NULL; // Created only when the capture runs
+
+// Input health: flatline, rail, range, step and missing checks per source.
+// The ADC sources are in analogPins order; bit s of the "fault" column is source s
+enum { HS_MG811, HS_MQ136, HS_MQ4, HS_MICS_OX, HS_MICS_RED, HS_ENS160, HS_SDS011, HS_GPS, HS_COUNT };
+const char *const healthNames[HS_COUNT] = {"mg811", "mq136", "mq4", "mics_ox", "mics_red", "ens160", "sds011", "gps"};
+#define ADC_HEALTH {0, 4095, 0, 4095, 1500, 300000} // Codes: rails, any value, 1500 per burst, 5 min unchanged
+const HealthLimits healthLimits[HS_COUNT] = {
+    ADC_HEALTH, ADC_HEALTH, ADC_HEALTH, ADC_HEALTH, ADC_HEALTH,
+    {-1, 65535, 400, 65000, 0, 0},      // ENS160 eCO2 (ppm): sits at 400 in clean air, 0 (no data) sampled as missing
+    {-1, 999.9, 0, 999.9, 0, 0},        // SDS011 PM2.5 window average (ug/m3), held between windows
+    {0, 0, 0, 0, 0, 0}                  // GPS: set() only
+};
+HealthMonitor<HS_COUNT> health(healthLimits);
+
+// The checks through a deep sleep, so an input stuck for flatMs is caught
+// even when no single wake lasts that long (~250 bytes of RTC memory)
+struct HealthSleepState {
+    uint32_t magic;
+    HealthState<HS_COUNT> checks;
+};
+RTC_DATA_ATTR HealthSleepState lpHealth;
+#define GPS_FIX_TIMEOUT 10000 // GPS counts as missing after this long without a valid fix
+void checkADCHealth(uint8_t pin, uint16_t code); // Needs the pin table below
 
 // Read ADC with stability improvements
 uint16_t readStableADC(uint8_t pin) {
   uint32_t sum = 0;
+  uint64_t sumSq = 0;
+  uint8_t samples = adcSampler.samplesFor(pin);
+  const ADCCalibration &cal = adcCal[adcTable(pin)];
+  if (adcMutex != NULL) xSemaphoreTake(adcMutex, portMAX_DELAY);
   
+  // Every raw read goes into the trace, discarded ones too, so a replay
+  // runs this function on the same input
+  trace.adcBegin(pin);
+
   // Discard first readings (they're often incorrect on ESP32)
-  analogRead(pin);
-  analogRead(pin);
+  trace.adcSample(analogRead(pin));
+  trace.adcSample(analogRead(pin));
   delayMicroseconds(50);
   
-  // Average multiple samples
-  for (int i = 0; i < NUM_SAMPLES; i++) {
-    sum += analogRead(pin);
+  // Average multiple corrected samples
+  for (int i = 0; i < samples; i++) {
+    uint16_t raw = analogRead(pin);
+    trace.adcSample(raw);
+    uint16_t value = cal.apply(raw);
+    sum += value;
+    sumSq += (uint32_t)value * value;
     delayMicroseconds(10); // Small delay between readings
   }
+  adcSampler.update(pin, samples, sum, sumSq);
+  trace.adcEnd();
+  if (adcMutex != NULL) xSemaphoreGive(adcMutex);
   
-  return sum / NUM_SAMPLES;
+  uint16_t code = sum / samples;
+  checkADCHealth(pin, code);
+  return code;
 }
 
-// Define pins
+// Define pins. The default (PCB) map has the gas inputs on ADC2, which the
+// WiFi driver takes over, so MQTT / HTTP stay off with it. Boards wired to
+// ADC1 (GPIO 32-39) build with -DAQMS_ADC1_INPUTS.
+#ifdef AQMS_ADC1_INPUTS
+#define MG811_PIN 36
+#define MQ136_PIN 39
+#define MQ4_PIN 34
+#define MICS_NOX_PIN 35   // MICS OX/NOX sensor (NO2)
+#define MICS_RED_PIN 32  // MICS RED sensor (CO, hydrocarbons)
+#define MICS_PRE_PIN 27  // Heater power control
+#define ADC_CAL_PIN 33 // Default reference voltage input for ADC calibration (ADC1)
+#else
 #define MG811_PIN 12
 #define MQ136_PIN 14 
 #define MQ4_PIN 27
 #define MICS_NOX_PIN 26   // MICS OX/NOX sensor (NO2)
 #define MICS_RED_PIN 25  // MICS RED sensor (CO, hydrocarbons)
+#define MICS_PRE_PIN 33  // Heater power control
+#define ADC_CAL_PIN 32 // Default reference voltage input for ADC calibration (ADC1)
+#endif
 #define PM_TXPin         2   // PM TX
 #define PM_RXPin         4   // PM RX
 #define GPS_RXPin        16   // GPS RX
 #define GPS_TXPin        17   // GPS TX
-#define MICS_PRE_PIN 33  // Heater power control
 #define LED_PIN 13 // LED pin
 #define PIN_SPI_CS   5 // SD card
 #define ENS160_I2C_ADDRESS 0x53
 #define BAUDRATE 9600
 
+// Analog inputs swept to settle the ADC during warmup
+const uint8_t analogPins[] = {MG811_PIN, MQ136_PIN, MQ4_PIN, MICS_NOX_PIN, MICS_RED_PIN};
+
+// True when a gas input is on ADC2: analogRead() on it fails while WiFi runs,
+// so MQTT and HTTP are refused
+bool adc2InputsUsed() {
+    for (uint8_t i = 0; i < sizeof(analogPins); i++) {
+        if (onADC2(analogPins[i])) return true;
+    }
+    return false;
+}
+
+// Health check of one burst; the ADC calibration input is not a source
+void checkADCHealth(uint8_t pin, uint16_t code) {
+    for (uint8_t i = 0; i < sizeof(analogPins); i++) {
+        if (analogPins[i] == pin) {
+            health.sample(i, code, millis());
+            return;
+        }
+    }
+}
+
 //Definitions MQ Sensors
 #define Board "ESP32"
 #define Voltage_Resolution 5
@@ -88,36 +254,274 @@ float ENS160humidity = 50.0;
 float RatioMQ136CleanAir = 3.6; //RS / R0 = 3.6 ppm  
 float RatioMQ4CleanAir = 4.4; //RS / R0 = 60 ppm 
 unsigned long cycleInterval = 1000; // Changed from uint8_t to unsigned long
+unsigned long adcDiagInterval = 60000; // Print adaptive sampling diagnostics every minute
+float ADC_noise_target = 2.0; // Target noise of an averaged reading (ADC codes)
+int ADC_min_samples = 2;
+int ADC_max_samples = NUM_SAMPLES;
+#ifdef AQMS_NO_SD
+unsigned long warmupTime = 180000; // No config.txt to shorten it, so use the full 3 min
+#else
 unsigned long warmupTime = 1000; // 180000 ms = 3 min, changed from uint8_t to unsigned long
+#endif
+unsigned long warmupMinTime = 30000; // No sensor is declared ready earlier than this
+float warmupSlope = 0.01; // Ready once the signal drifts less than 1 % per minute
+unsigned long CAL_max_age = 30; // Days before a stored calibration is redone
+float CAL_max_change = 0.5; // Largest accepted relative change of a stored value
+int CAL_recalibrate = 0; // 1 = ignore stored values and calibrate again
+unsigned long calCheckInterval = 3600000; // Check calibration age every hour
+float timezone = 5.5; // Local time offset in hours (IST)
+int GPS_pps_pin = -1; // GPS PPS output, -1 = not connected
+int ABC_enable = 1; // 1 = slowly track the clean-air baseline of each sensor
+int ABC_days = 7; // Days of history before the baseline is adjusted
+float ABC_max_step = 0.05; // Largest relative change of a value per day
+unsigned long abcSampleInterval = 60000; // One baseline sample per minute
+unsigned long abcDayLength = 86400000; // Baseline day: UTC days once the GPS time is known
+unsigned long PM_period = 300000; // SDS011 wakes every 5 min (0 = run continuously)
+unsigned long PM_window = 30000; // Frames averaged per wake
+unsigned long PM_spinup = 30000; // Fan spin-up before the window, frames dropped
+int LP_mode = LP_OFF; // 0 = always on, 1 = light sleep, 2 = deep sleep between windows
+unsigned long LP_interval = 300000; // One measurement window every 5 min
+unsigned long LP_lead = 60000; // Sensors run this long before the first record of a window
+int LP_burst = 5; // Records per window, one per cycleInterval
+int LP_batch = 5; // Windows queued in RTC memory per SD write (~25 records fit)
+float LP_active_mA = 250; // Unit current while awake, for the battery projection
+float LP_sleep_mA = 160; // Unit current while asleep (MQ heaters stay on)
+float LP_battery_mAh = 10000;
 float CO2_inertia = 0.99;
-int CO2_tries = 100;
+int CO2_tries = 5;
+int CO2_fusion = 1; // 1 = fuse the MG-811 with the ENS160 eCO2 (Kalman) instead of CO2_inertia
+float CO2_rate = 0.2; // Fusion: CO2 wander while the air is steady, ppm per sqrt(s)
+float CO2_noise = 0.05; // Fusion: MG-811 reading noise, share of the reading
+float ECO2_noise = 20; // Fusion: ENS160 eCO2 reading noise, ppm
 float MQ136_H2S_A = 36.737;
 float MQ136_H2S_B = -3.536;
 float MQ136_SO2_A = 503.34;
 float MQ136_SO2_B = -3.774;
 float MQ4_CH4_A = 1012.7;
 float MQ4_CH4_B = -2.786;
+int TRACE_enable = 0; // 1 = record raw sensor input to /trace.bin for replay
+int MQTT_enable = 0; // 1 = publish the data.txt records to an MQTT broker over WiFi
+char WIFI_ssid[33] = "";
+char WIFI_password[64] = "";
+char MQTT_host[40] = "";
+int MQTT_port = 1883;
+char MQTT_topic[48] = "aqms/data";
+char MQTT_client[24] = "aqms";
+int MQTT_batch = 60; // Records per publish
+unsigned long MQTT_interval = 60000; // ms between publishes once the backlog is sent
+int HTTP_enable = 0; // 1 = serve /latest, /stats and /history over WiFi
+int HTTP_port = 80;
+int XS_enable = 1; // 1 = apply the /xsens.txt cross-sensitivity model when present
+int XS_log = 0; // 1 = append the model inputs to /xsens_log.txt each cycle, for fitting
+int CAP_enable = 0; // 1 = capture the raw gas inputs at CAP_rate around spikes to /capture.txt
+int CAP_rate = 100; // Readings per second per input
+float CAP_level = 200; // Trigger: ADC codes away from the 30 s baseline (0 = off)
+float CAP_slope = 2000; // Trigger: ADC codes per second (0 = off)
+unsigned long CAP_pre = 2000; // ms kept before the trigger
+unsigned long CAP_post = 5000; // ms captured after it
+char AQI_standard[8] = "NAQI"; // NAQI (India) or EPA (US) breakpoint table
+int AQI_alert = 201; // LED stays lit while the AQI is at or above this (0 = no alert)
 bool ledState = 0;
 
-//data
-float lat = 0.0, lng = 0.0;
-uint32_t m_date = 0, m_time = 0, tvoc = 0, eco2 = 0;
-float co2 = 0.0, so2 = 0.0, h2s = 0.0, ch4 = 0.0, no2 = 0.0, c2h5oh = 0.0, h2 = 0.0, nh3 = 0.0, co = 0.0;
+// Records queued between SD writes; RTC memory keeps them through deep sleep
+#define LP_QUEUE_BYTES 3072
+RTC_DATA_ATTR RecordQueue<LP_QUEUE_BYTES> lpQueue;
+RecordQueueWriter<RecordQueue<LP_QUEUE_BYTES> > lpWriter(lpQueue);
+PowerSchedule lpSchedule;
+PowerBudget lpBudget;
+RTC_DATA_ATTR TimeServiceState lpClock; // GPS time sync, so records are UTC right after a wake
+
+#ifdef AQMS_HEAP_CHECK
+// Build with -DAQMS_HEAP_CHECK to report any heap use after setup()
+uint32_t heapAfterSetup = 0;
+#endif
+
+//data - GPS fields live in the core, sensor values in the registry below
 float pm25 = 0.0, pm10 = 0.0;
 
+//Storage policy: SD card, or nothing on boards without one
+#ifdef AQMS_NO_SD
+typedef NoStorage BoardStorage;
+BoardStorage storage;
+#else
+typedef SDStorage BoardStorage;
+BoardStorage storage(PIN_SPI_CS);
+#endif
+
+// MQTT uplink: data.txt is the store-and-forward queue, the acked offset is kept in
+// /mqtt_ack0.txt and /mqtt_ack1.txt in turn
+WiFiClient mqttClient;
+MqttUplink<WiFiClient, BoardStorage> uplink(mqttClient, storage, "/data.txt", "/mqtt_ack0.txt", "/mqtt_ack1.txt");
+
+// HTTP dashboard: /latest comes from a snapshot taken each logging cycle
+WiFiServer httpServer;
+HttpDashboard<WiFiServer, WiFiClient, BoardStorage> dashboard(httpServer, storage, "/data.txt");
+
 //Declare Sensor
-File myFile;
+typedef SDS011 PMSensor; // The instance below hides the class name
 SDS011 SDS011;
-TinyGPSPlus GPS; // The TinyGPS++ object
+PMScheduler<PMSensor> pmScheduler(SDS011);
 HardwareSerial SerialPM(1); // UART_PM for SDS011
+TraceStream<Tracer> pmTrace(SerialPM, trace, TRACE_PM);
+TraceStream<Tracer> gpsTrace(Serial2, trace, TRACE_GPS);
+AcquisitionCore<BoardStorage, StableADC, TraceStream<Tracer> > core(storage, gpsTrace); // GPS on UART2
 CO2SensorWrapper co2Sensor(MG811_PIN, CO2_inertia, CO2_tries);
-DFRobot_ENS160_I2C ENS160(&Wire, ENS160_I2C_ADDRESS);
+TraceI2C<DFRobot_ENS160_I2C, Tracer> ENS160(trace, ENS160_I2C_ADDRESS, &Wire, ENS160_I2C_ADDRESS);
 MICS_4514_Extended MICS_4514(MICS_RED_PIN, MICS_NOX_PIN, MICS_PRE_PIN);
 MQSensorWrapper MQ4(Board, Voltage_Resolution, ADC_Bit_Resolution, MQ4_PIN, "MQ-4");
 MQSensorWrapper MQ136(Board, Voltage_Resolution, ADC_Bit_Resolution, MQ136_PIN, "MQ-136");
 
 // Function prototypes
-String readConfig(const String &name);
+bool loadADCTable(uint8_t t);
+bool loadADCCalibration();
+void runADCCalibration(uint8_t pin);
+void calibrateMQ(MQSensorWrapper &mq, float cleanAirRatio, const char *label);
+void startWarmup();
+void serviceWarmup(uint32_t now);
+bool loadCalibration();
+void saveCalibration();
+bool sensorCalibrated(uint8_t sensor);
+bool calibrationExpired(uint8_t sensor);
+void applyCalibration(uint8_t sensor);
+void recalibrate(uint8_t sensor);
+void serviceCalibration();
+float baselineEstimate(uint8_t slot);
+void serviceBaseline(uint64_t epochMs);
+void setupPMSensor();
+void onGPSPulse();
+void queueRecord();
+void flushRecordQueue();
+void sleepUntilNextWindow();
+void printStats(Print &out);
+void startCapture();
+void loadCrossSensitivity();
+void updateCrossSensitivity();
+void logCrossSensitivity();
+void updateHealth(uint32_t now);
+uint8_t channelStatus(uint8_t channel, uint32_t now);
+float updateAQI(uint32_t now);
+void readPM();
+float readCO2();
+float readSO2(float A, float B);
+float readH2S(float A, float B);
+float readCH4(float A, float B);
+float readNO2();
+float readC2H5OH();
+float readH2();
+float readNH3();
+float readCO();
+uint16_t readTVOC();
+uint16_t readeECO2();
+uint8_t warmupMask();
+
+// Warmup readiness, one tracker per heated sensor; bit i of the "ready" column
+enum { WARM_CO2, WARM_MQ136, WARM_MQ4, WARM_MICS, WARM_COUNT };
+WarmupTracker warmup[WARM_COUNT];
+const char *const warmupNames[WARM_COUNT] = {"MG-811", "MQ-136", "MQ-4", "MICS-4514"};
+
+// Stored calibration values, named as in /calib.txt
+enum { CAL_MQ136_R0, CAL_MQ4_R0, CAL_MICS_RED_R0, CAL_MICS_OX_R0, CAL_CO2_A, CAL_COUNT };
+const char *const calNames[CAL_COUNT] = {"MQ136_R0", "MQ4_R0", "MICS_RED_R0", "MICS_OX_R0", "CO2_A"};
+CalibrationStore calStore(calNames, CAL_COUNT);
+
+// Warmup sensor each stored value belongs to
+const uint8_t calSensor[CAL_COUNT] = {WARM_MQ136, WARM_MQ4, WARM_MICS, WARM_MICS, WARM_CO2};
+
+// Clean-air baseline per stored value: 64 bins over +/- 2 octaves, up to 14 days
+#define ABC_MAX_DAYS 14
+BaselineTracker<64, ABC_MAX_DAYS> baseline[CAL_COUNT];
+BaselineClock abcClock;
+
+// The trackers and their clock through a deep sleep (~1 KB of RTC memory)
+struct BaselineSleepState {
+    uint32_t magic;
+    BaselineClock clock;
+    BaselineState<64, ABC_MAX_DAYS> trackers[CAL_COUNT];
+};
+RTC_DATA_ATTR BaselineSleepState lpBaseline;
+
+// Positions of the channels in the registry below
+enum { CH_CO2, CH_SO2, CH_H2S, CH_CH4, CH_NO2, CH_C2H5OH, CH_H2, CH_NH3, CH_CO, CH_TVOC, CH_ECO2,
+       CH_PM25, CH_PM10, CH_READY, CH_AQI, CH_AQI_POLLUTANT, CH_FAULT, CH_COUNT };
+
+// Filter chain per measured channel (those before "ready"), from <name>_filter in config.txt
+SignalFilter channelFilter[CH_READY];
+FusionKalman co2Fusion; // MG-811 level with the ENS160 eCO2, when CO2_fusion is set
+
+inline float filtered(uint8_t channel, float value) {
+    return channelFilter[channel].update(value, millis());
+}
+
+// Per measured channel: the warmup tracker behind it (WARM_COUNT: none) and its health source
+const uint8_t channelWarmup[CH_READY] = {WARM_CO2, WARM_MQ136, WARM_MQ136, WARM_MQ4, WARM_MICS, WARM_MICS, WARM_MICS,
+                                         WARM_MICS, WARM_MICS, WARM_COUNT, WARM_COUNT, WARM_COUNT, WARM_COUNT};
+const uint8_t channelSource[CH_READY] = {HS_MG811, HS_MQ136, HS_MQ136, HS_MQ4, HS_MICS_OX, HS_MICS_RED, HS_MICS_RED,
+                                         HS_MICS_RED, HS_MICS_RED, HS_ENS160, HS_ENS160, HS_SDS011, HS_SDS011};
+uint8_t ens160Status = DFRobot_ENS160::eInitialStartUpPhase; // Operating status, read with TVOC
+
+// AQI from the registry's pollutant channels
+AQIEngine aqi;
+
+// Cross-sensitivity model: one row per gas channel, loaded from /xsens.txt
+enum { XS_OUT_SO2, XS_OUT_H2S, XS_OUT_CH4, XS_OUT_NO2, XS_OUT_C2H5OH, XS_OUT_H2, XS_OUT_NH3, XS_OUT_CO, XS_OUTPUTS };
+const char *const xsensNames[XS_OUTPUTS] = {"so2", "h2s", "ch4", "no2", "c2h5oh", "h2", "nh3", "co"};
+CrossSensitivity<XS_OUTPUTS> xsens(xsensNames);
+float xsInput[XS_INPUTS]; // Model inputs of the last update
+bool xsInputValid = false;
+
+// Sensor channels: name, unit, read period (ms, 0 = every loop), decimals, read function.
+// The scheduler, CSV header, data.txt record and Serial log are generated from this list;
+// measured channels also get a <name>_status column.
+auto sensors = makeSensorRegistry(
+    measuredChannel("co2",    "ppm",   0,    2, []() { return filtered(CH_CO2, readCO2()); }),
+    measuredChannel("so2",    "ppm",   0,    2, []() { return filtered(CH_SO2, readSO2(MQ136_SO2_A, MQ136_SO2_B)); }),
+    measuredChannel("h2s",    "ppm",   0,    2, []() { return filtered(CH_H2S, readH2S(MQ136_H2S_A, MQ136_H2S_B)); }),
+    measuredChannel("ch4",    "ppm",   0,    2, []() { return filtered(CH_CH4, readCH4(MQ4_CH4_A, MQ4_CH4_B)); }),
+    measuredChannel("no2",    "ppm",   0,    2, []() { return filtered(CH_NO2, readNO2()); }),
+    measuredChannel("c2h5oh", "ppm",   0,    2, []() { return filtered(CH_C2H5OH, readC2H5OH()); }),
+    measuredChannel("h2",     "ppm",   0,    2, []() { return filtered(CH_H2, readH2()); }),
+    measuredChannel("nh3",    "ppm",   0,    2, []() { return filtered(CH_NH3, readNH3()); }),
+    measuredChannel("co",     "ppm",   0,    2, []() { return filtered(CH_CO, readCO()); }),
+    measuredChannel("tvoc",   "ppb",   1000, 0, []() { return filtered(CH_TVOC, readTVOC()); }),
+    measuredChannel("eco2",   "ppm",   1000, 0, []() { return filtered(CH_ECO2, readeECO2()); }),
+    measuredChannel("pm25",   "ug/m3", 1000, 2, []() { readPM(); return filtered(CH_PM25, pm25); }),
+    measuredChannel("pm10",   "ug/m3", 1000, 2, []() { return filtered(CH_PM10, pm10); }),
+    sensorChannel("ready",  "mask",  0,    0, []() { return (float)warmupMask(); }),
+    sensorChannel("aqi",    "index", 1000, 0, []() { return updateAQI(millis()); }),
+    sensorChannel("aqi_pollutant", "code", 1000, 0, []() { return (float)aqi.dominant(); }),
+    sensorChannel("fault",  "mask",  0,    0, []() { return (float)health.mask(); })
+);
+static_assert(decltype(sensors)::count == CH_COUNT, "channel positions out of step with the registry");
+
+// Reads <name>_filter for each measured channel, in registry order
+struct ChannelFilterConfig {
+    uint8_t index;
+
+    template <typename Channel>
+    void operator()(Channel &channel) {
+        uint8_t i = index++;
+        if (i >= CH_READY) return;
+        char key[24], spec[48];
+        snprintf(key, sizeof(key), "%s_filter", channel.name);
+        if (!core.readConfig(key, spec, sizeof(spec))) return;
+        Serial.print(key);
+        Serial.print(" = ");
+        Serial.println(spec);
+        if (!channelFilter[i].configure(spec)) Serial.println("Filter not understood, channel left unfiltered");
+    }
+};
+
+// Sets the status of each measured channel, in registry order
+struct ChannelStatusUpdate {
+    uint8_t index;
+    uint32_t now;
+
+    template <typename Channel>
+    void operator()(Channel &channel) {
+        uint8_t i = index++;
+        if (channel.hasStatus) channel.status = channelStatus(i, now);
+    }
+};
 
 void setup() {
 //Init serial port
@@ -125,18 +529,21 @@ void setup() {
     SerialPM.begin(BAUDRATE, SERIAL_8N1, PM_RXPin, PM_TXPin); // SDS011 on UART1 (RX1=5, TX1=4)
     Serial2.begin(BAUDRATE, SERIAL_8N1, GPS_RXPin, GPS_TXPin); // GPS on UART2 (RX2=16, TX2=17)
 
+// Storage (SD card), and the raw input trace from the first ADC read on
+    storage.begin();
+    core.readConfigInt("TRACE_enable", TRACE_enable);
+    trace.begin(TRACE_enable == 1 && BoardStorage::persistent);
+
 // Configure ADC
     analogSetWidth(12);               // 12-bit resolution (0-4095)
     analogSetAttenuation(ADC_11db);   // Full voltage range (0-3.3V)
+    adcSampler.setNoiseTarget(ADC_noise_target);
+    adcSampler.setSampleRange(ADC_min_samples, ADC_max_samples);
     
     // Warm up ADC by discarding some readings on all pins
     Serial.println("Warming up ADC...");
     for (int i = 0; i < 10; i++) {
-        readStableADC(MG811_PIN);
-        readStableADC(MQ136_PIN);
-        readStableADC(MQ4_PIN);
-        readStableADC(MICS_NOX_PIN);
-        readStableADC(MICS_RED_PIN);
+        core.sweepADC(analogPins, sizeof(analogPins));
         delay(1);
     }
     Serial.println("ADC warm-up complete");
@@ -148,423 +555,1133 @@ void setup() {
     pinMode(MICS_NOX_PIN, INPUT);     // NO2 sensor
     pinMode(MICS_RED_PIN, INPUT);     // CO and hydrocarbons sensor
     pinMode(MICS_PRE_PIN, OUTPUT);    // Heater power control
-    pinMode(PIN_SPI_CS, OUTPUT);      // SD card chip select
     pinMode(LED_PIN, OUTPUT);
 
 // LED
     digitalWrite(LED_PIN, HIGH);
 
-// SD card
-    while (!SD.begin(PIN_SPI_CS)) {
-        Serial.println(F("SD Card: initialization failed!"));
-        delay(1000);
+// ADC calibration - load the stored curve, or capture a new one when requested
+    int adcCalibrate = 0;
+    int adcCalPin = ADC_CAL_PIN;
+    core.readConfigInt("ADC_calibrate", adcCalibrate);
+    core.readConfigInt("ADC_cal_pin", adcCalPin);
+    if (adcCalibrate == 1) {
+        runADCCalibration(adcCalPin);
+    } else {
+        loadADCCalibration();
     }
-    Serial.println(F("SD Card: initialization successful!"));
 
-read config - fixed variable shadowing by using global variables
-    String warmupTimeStr = readConfig("warmupTime");
-    Serial.println(warmupTimeStr);
-    if (warmupTimeStr.length() > 0) {
-        warmupTime = warmupTimeStr.toInt();
+//read config - fixed buffers, no String allocations
+    core.readConfigFloat("timezone", timezone);
+    core.gps.setTimezone(timezone);
+    core.readConfigInt("GPS_pps_pin", GPS_pps_pin);
+    core.readConfigULong("warmupTime", warmupTime);
+    core.readConfigULong("warmupMinTime", warmupMinTime);
+    core.readConfigFloat("warmupSlope", warmupSlope);
+    if (core.readConfigULong("CAL_max_age", CAL_max_age)) {
+        calStore.setMaxAgeDays(CAL_max_age);
     }
-    
-    String ratioMQ136Str = readConfig("RatioMQ136CleanAir");
-    Serial.println(ratioMQ136Str);
-    if (ratioMQ136Str.length() > 0) {
-        RatioMQ136CleanAir = ratioMQ136Str.toFloat();
+    if (core.readConfigFloat("CAL_max_change", CAL_max_change)) {
+        calStore.setMaxChange(CAL_max_change);
     }
-    
-    String ratioMQ4Str = readConfig("RatioMQ4CleanAir");
-    Serial.println(ratioMQ4Str);
-    if (ratioMQ4Str.length() > 0) {
-        RatioMQ4CleanAir = ratioMQ4Str.toFloat();
-    }
-    
-    String tempStr = readConfig("ENS160temperature");
-    Serial.println(tempStr);
-    if (tempStr.length() > 0) {
-        ENS160temperature = tempStr.toFloat();
+    core.readConfigInt("CAL_recalibrate", CAL_recalibrate);
+    core.readConfigInt("ABC_enable", ABC_enable);
+    if (core.readConfigInt("ABC_days", ABC_days)) {
+        ABC_days = constrain(ABC_days, 1, ABC_MAX_DAYS);
     }
-    
-    String humidityStr = readConfig("ENS160humidity");
-    Serial.println(humidityStr);
-    if (humidityStr.length() > 0) {
-        ENS160humidity = humidityStr.toFloat();
+    core.readConfigFloat("ABC_max_step", ABC_max_step);
+    core.readConfigULong("PM_period", PM_period);
+    core.readConfigULong("PM_window", PM_window);
+    core.readConfigULong("PM_spinup", PM_spinup);
+    core.readConfigInt("LP_mode", LP_mode);
+    core.readConfigULong("LP_interval", LP_interval);
+    core.readConfigULong("LP_lead", LP_lead);
+    if (core.readConfigInt("LP_burst", LP_burst)) {
+        LP_burst = constrain(LP_burst, 1, 255);
     }
-
-    String co2InertiaStr = readConfig("CO2_inertia");
-    Serial.println(co2InertiaStr);
-    if (co2InertiaStr.length() > 0) {
-        CO2_inertia = co2InertiaStr.toFloat();
+    core.readConfigInt("LP_batch", LP_batch);
+    core.readConfigFloat("LP_active_mA", LP_active_mA);
+    core.readConfigFloat("LP_sleep_mA", LP_sleep_mA);
+    core.readConfigFloat("LP_battery_mAh", LP_battery_mAh);
+    core.readConfigFloat("RatioMQ136CleanAir", RatioMQ136CleanAir);
+    core.readConfigFloat("RatioMQ4CleanAir", RatioMQ4CleanAir);
+    core.readConfigFloat("ENS160temperature", ENS160temperature);
+    core.readConfigFloat("ENS160humidity", ENS160humidity);
+    if (core.readConfigFloat("CO2_inertia", CO2_inertia)) {
         co2Sensor.setInertia(CO2_inertia);
     }
-
-    String co2TriesStr = readConfig("CO2_tries");
-    Serial.println(co2TriesStr);
-    if (co2TriesStr.length() > 0) {
-        CO2_tries = co2TriesStr.toInt();
+    if (core.readConfigInt("CO2_tries", CO2_tries)) {
         co2Sensor.setTries(CO2_tries);
     }
-
-    String MQ136_H2S_A_Str = readConfig("MQ136_H2S_A");
-    Serial.println(MQ136_H2S_A_Str);
-    if (MQ136_H2S_A_Str.length() > 0) {
-        MQ136_H2S_A = MQ136_H2S_A_Str.toFloat();
+    core.readConfigInt("CO2_fusion", CO2_fusion);
+    core.readConfigFloat("CO2_rate", CO2_rate);
+    core.readConfigFloat("CO2_noise", CO2_noise);
+    core.readConfigFloat("ECO2_noise", ECO2_noise);
+    if (CO2_fusion == 1) {
+        co2Sensor.setInertia(0); // The fusion filter does the smoothing
+        co2Fusion.configure(CO2_rate, CO2_noise, ECO2_noise, 0.1, 400); // eCO2 offset drifts ~0.1 ppm/sqrt(s)
     }
-
-    String MQ136_H2S_B_Str = readConfig("MQ136_H2S_B");
-    Serial.println(MQ136_H2S_B_Str);
-    if (MQ136_H2S_B_Str.length() > 0) {
-        MQ136_H2S_B = MQ136_H2S_B_Str.toFloat();
+    ChannelFilterConfig filterConfig = {0};
+    sensors.forEach(filterConfig);
+    core.readConfigFloat("MQ136_H2S_A", MQ136_H2S_A);
+    core.readConfigFloat("MQ136_H2S_B", MQ136_H2S_B);
+    core.readConfigFloat("MQ136_SO2_A", MQ136_SO2_A);
+    core.readConfigFloat("MQ136_SO2_B", MQ136_SO2_B);
+    core.readConfigFloat("MQ4_CH4_A", MQ4_CH4_A);
+    core.readConfigFloat("MQ4_CH4_B", MQ4_CH4_B);
+    if (core.readConfigFloat("ADC_noise_target", ADC_noise_target)) {
+        adcSampler.setNoiseTarget(ADC_noise_target);
+    }
+    core.readConfigInt("ADC_min_samples", ADC_min_samples);
+    if (core.readConfigInt("ADC_max_samples", ADC_max_samples)) {
+        ADC_max_samples = constrain(ADC_max_samples, 2, 255);
+    }
+    ADC_min_samples = constrain(ADC_min_samples, 1, ADC_max_samples);
+    adcSampler.setSampleRange(ADC_min_samples, ADC_max_samples);
+    core.readConfigInt("MQTT_enable", MQTT_enable);
+    if (!BoardStorage::persistent) MQTT_enable = 0; // The queue is data.txt
+    if (MQTT_enable == 1 && adc2InputsUsed()) {
+        Serial.println("MQTT: gas inputs are on ADC2, which cannot be read with WiFi on - disabled");
+        MQTT_enable = 0;
+    }
+    core.readConfigInt("HTTP_enable", HTTP_enable);
+    if (HTTP_enable == 1 && adc2InputsUsed()) {
+        Serial.println("HTTP: gas inputs are on ADC2, which cannot be read with WiFi on - disabled");
+        HTTP_enable = 0;
+    }
+    core.readConfigInt("HTTP_port", HTTP_port);
+    core.readConfigInt("XS_enable", XS_enable);
+    core.readConfigInt("XS_log", XS_log);
+    core.readConfigInt("CAP_enable", CAP_enable);
+    if (!BoardStorage::persistent || LP_mode != LP_OFF) CAP_enable = 0; // Needs the card and a core that stays awake
+    if (CAP_enable == 1) {
+        if (core.readConfigInt("CAP_rate", CAP_rate)) {
+            CAP_rate = constrain(CAP_rate, 10, 500);
+        }
+        core.readConfigFloat("CAP_level", CAP_level);
+        core.readConfigFloat("CAP_slope", CAP_slope);
+        core.readConfigULong("CAP_pre", CAP_pre);
+        core.readConfigULong("CAP_post", CAP_post);
+    }
+    if (!core.readConfig("AQI_standard", AQI_standard, sizeof(AQI_standard))) strcpy(AQI_standard, "NAQI");
+    aqi.setStandard(strcmp(AQI_standard, "EPA") == 0 ? aqiEPA : aqiNAQI);
+    // Light sleep: a burst of records every LP_interval
+    if (LP_mode == LP_LIGHT) aqi.setSampleInterval(LP_interval);
+    core.readConfigInt("AQI_alert", AQI_alert);
+    if (MQTT_enable == 1 || HTTP_enable == 1) {
+        core.readConfig("WIFI_ssid", WIFI_ssid, sizeof(WIFI_ssid));
+        core.readConfig("WIFI_password", WIFI_password, sizeof(WIFI_password));
+    }
+    if (MQTT_enable == 1) {
+        core.readConfig("MQTT_host", MQTT_host, sizeof(MQTT_host));
+        core.readConfigInt("MQTT_port", MQTT_port);
+        if (!core.readConfig("MQTT_topic", MQTT_topic, sizeof(MQTT_topic))) strcpy(MQTT_topic, "aqms/data");
+        if (!core.readConfig("MQTT_client", MQTT_client, sizeof(MQTT_client))) strcpy(MQTT_client, "aqms");
+        if (core.readConfigInt("MQTT_batch", MQTT_batch)) {
+            MQTT_batch = constrain(MQTT_batch, 1, 255);
+        }
+        core.readConfigULong("MQTT_interval", MQTT_interval);
     }
 
-    String MQ136_SO2_A_Str = readConfig("MQ136_SO2_A");
-    Serial.println(MQ136_SO2_A_Str);
-    if (MQ136_SO2_A_Str.length() > 0) {
-        MQ136_SO2_A = MQ136_SO2_A_Str.toFloat();
+//WiFi - connects in the background; the uplink and dashboard start once it is up
+    if (MQTT_enable == 1 || HTTP_enable == 1) {
+        WiFi.mode(WIFI_STA);
+        WiFi.begin(WIFI_ssid, WIFI_password);
+    }
+    if (MQTT_enable == 1) {
+        uplink.configure(MQTT_host, MQTT_port, MQTT_topic, MQTT_client);
+        uplink.setBatch(MQTT_batch, MQTT_interval);
+        uplink.begin();
+    }
+    if (HTTP_enable == 1) {
+        httpServer.begin(HTTP_port);
+        dashboard.setStats(printStats);
     }
 
-    String MQ136_SO2_B_Str = readConfig("MQ136_SO2_B");
-    Serial.println(MQ136_SO2_B_Str);
-    if (MQ136_SO2_B_Str.length() > 0) {
-        MQ136_SO2_B = MQ136_SO2_B_Str.toFloat();
+//GPS PPS - disciplines the clock to the start of each second
+    if (GPS_pps_pin >= 0) {
+        pinMode(GPS_pps_pin, INPUT);
+        attachInterrupt(digitalPinToInterrupt(GPS_pps_pin), onGPSPulse, RISING);
     }
 
 //SDS011 Setup
-    SDS011.begin(&SerialPM); // Initialize SDS011 with SerialPM
+    SDS011.begin(&pmTrace); // SerialPM, through the trace
+    setupPMSensor();
+    // In low-power mode the window's lead time is the SDS011's only awake time
+    pmScheduler.configure(LP_mode == LP_OFF ? PM_period : 0, PM_window, PM_spinup);
+    pmScheduler.begin(millis());
+    Serial.print("SDS011 duty cycle: ");
+    Serial.print(pmScheduler.dutyCycle() * 100, 0);
+    Serial.println(" %");
+
+//Calibration store - stored R0/baseline values replace the cold calibration
+    if (CAL_recalibrate != 1) {
+        loadCalibration();
+    }
+
+//Cross-sensitivity model - replaces the single-gas curves of the gases it has rows for
+    if (XS_enable == 1) loadCrossSensitivity();
 
 //MG-811 Setup
-    co2Sensor.calibrate();
+    if (sensorCalibrated(WARM_CO2)) applyCalibration(WARM_CO2);
+    else co2Sensor.calibrate();
 
 //MICS-4514 Setup
-    MICS_4514.setR0();
+    if (sensorCalibrated(WARM_MICS)) applyCalibration(WARM_MICS);
+    else MICS_4514.setR0();
 
 //ENS160 Setup
     ENS160.begin();
     ENS160.setPWRMode(ENS160_STANDARD_MODE);
     ENS160.setTempAndHum(ENS160temperature, ENS160humidity);
 
-//MQ-136 Setup
+//MQ-136 Setup - stored R0, or a cold R0 recalibrated once the sensor is warm
     MQ136.init(); 
     MQ136.setRegressionMethod(1); //_PPM =  a*ratio^b
-    Serial.print("MQ-136 Calibrating...");
-    calcR0 = 0;
-    for(int i = 1; i<=10; i ++){
-        MQ136.update(); // Update data, the arduino will read the voltage from the analog pin
-        calcR0 += MQ136.calibrate(RatioMQ136CleanAir);}
-    MQ136.setR0(calcR0/10);
-    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println("Invalid");} else Serial.println("  done!.");
+    if (sensorCalibrated(WARM_MQ136)) applyCalibration(WARM_MQ136);
+    else calibrateMQ(MQ136, RatioMQ136CleanAir, "MQ-136");
 
 //MQ-4 Setup
     MQ4.init(); 
     MQ4.setRegressionMethod(1); //_PPM =  a*ratio^b
-    Serial.print("MQ-4 Calibrating...");
-    calcR0 = 0;
-    for(int i = 1; i<=10; i ++){
-        MQ4.update(); // Update data, the arduino will read the voltage from the analog pin
-        calcR0 += MQ4.calibrate(RatioMQ4CleanAir);}
-    MQ4.setR0(calcR0/10);
-    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println("Invalid");} else Serial.println("  done!.");
+    if (sensorCalibrated(WARM_MQ4)) applyCalibration(WARM_MQ4);
+    else calibrateMQ(MQ4, RatioMQ4CleanAir, "MQ-4");
+
+//Warmup - runs in the background from loop(), logging starts now
+    startWarmup();
+
+//Low-power mode - keep records queued before a deep sleep, start the first window
+    lpQueue.begin();
+    lpSchedule.configure(LP_interval, LP_lead, LP_burst);
+    lpSchedule.beginWindow(millis());
+    lpBudget.activeMa = LP_active_mA;
+    lpBudget.sleepMa = LP_sleep_mA;
+    bool wokeFromSleep = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+    if (wokeFromSleep && core.gps.clock.restore(lpClock)) {
+        Serial.println("Clock: GPS time kept through deep sleep");
+    }
+    lpClock.magic = 0; // Only valid for the wake right after save()
+    if (wokeFromSleep && lpBaseline.magic == BASELINE_STATE_MAGIC) {
+        abcClock = lpBaseline.clock;
+        for (uint8_t slot = 0; slot < CAL_COUNT; slot++) baseline[slot].restore(lpBaseline.trackers[slot]);
+    }
+    lpBaseline.magic = 0;
+    if (wokeFromSleep && lpHealth.magic == HEALTH_STATE_MAGIC) health.restore(lpHealth.checks, millis());
+    lpHealth.magic = 0;
 
-//Warmup
-    Warmup(warmupTime);
+//write data_title - once per power-up, not on every deep-sleep wake
+    if (!wokeFromSleep) core.writeHeader(sensors);
 
-//write data_title
-    while (!(myFile = SD.open("/data.txt", FILE_APPEND))) {
-        Serial.println(F("SD Card: error on opening file data.txt"));
-        delay(1000);
+//data_title
+    core.printHeader(Serial, sensors, " | ");
+    if (XS_log == 1 && !wokeFromSleep) {
+        storage.appendFile("/xsens_log.txt", [](Print &file) {
+            file.print("epoch_ms");
+            for (uint8_t i = XS_MQ136; i < XS_INPUTS; i++) {
+                file.print(',');
+                file.print(xsensInputNames[i]);
+            }
+            file.print('\n');
+        });
     }
-    myFile.println("date , time , lat , lng , co2 , so2 , h2s , ch4 , no2 , c2h5oh , h2 , nh3 , co , tvoc , eco2 , pm25 , pm10");
-    myFile.close();
 
-//data_title
-    Serial.println(F("co2 | so2 | h2s | ch4 | no2 | c2h5oh | h2 | nh3 | co |"));
+//Spike capture - the sampler starts once setup no longer sweeps the ADC
+    if (CAP_enable == 1) startCapture();
+
+//Trace of the setup traffic (SDS011 commands, ENS160 init)
+    trace.flush(storage, TRACE_PATH);
+
+#ifdef AQMS_HEAP_CHECK
+    heapAfterSetup = ESP.getFreeHeap();
+#endif
 }
 
 void loop() {
 
-// Read data from sensors
-    readPM();
-    readGPSData();
-    co2 = readCO2();
-    so2 = readSO2(MQ136_SO2_A, MQ136_SO2_B);
-    h2s = readH2S(MQ136_H2S_A, MQ136_H2S_B);
-    ch4 = readCH4(MQ4_CH4_A, MQ4_CH4_B);
-    no2 = readNO2();
-    c2h5oh = readC2H5OH();
-    h2 = readH2();
-    nh3 = readNH3();
-    co = readCO();
-    tvoc = readTVOC();
-    eco2 = readeECO2();
+// Raw input trace - the replay starts its passes where this one started
+    trace.loopStart();
+
+// Read data from sensors - each channel on its own period; the cross-sensitivity
+// model takes new inputs once per record, before its gas channels are read
+    bool recordDue = core.cycleDue(millis(), cycleInterval);
+    core.gps.poll();
+    serviceWarmup(millis());
+    pmScheduler.poll(millis());
+    if (recordDue && (xsens.loaded() || XS_log == 1)) updateCrossSensitivity();
+    updateHealth(millis());
+    sensors.poll(millis());
+
+// Raw input trace - append to the SD card once the buffer is half full
+    if (trace.needsFlush()) trace.flush(storage, TRACE_PATH);
+
+// Spike capture - append a triggered event to the SD card a chunk per loop
+    if (capture.busy()) {
+        capture.write(storage, CAPTURE_PATH, core.gps.epochMs, millis());
+    }
+
+// MQTT uplink - one step per loop, never waits for the broker
+    if (MQTT_enable == 1) {
+        uplink.poll(millis(), WiFi.status() == WL_CONNECTED);
+    }
+
+// HTTP dashboard - bounded work per connection, never waits for a client
+    if (HTTP_enable == 1) {
+        dashboard.poll(millis());
+    }
 
 // Log data every cycleInterval - using proper time tracking
-    static unsigned long lastCycleTime = 0;
-    if (millis() - lastCycleTime >= cycleInterval) {
-        lastCycleTime = millis();
-        ledState = !ledState;
-        writeData();
-        logData();
+    if (recordDue) {
+        // The LED blinks once per record, and stays lit while the AQI is at the alert level
+        static bool aqiAlert = false;
+        bool alert = AQI_alert > 0 && aqi.valid() && aqi.index() >= AQI_alert;
+        if (alert != aqiAlert) {
+            aqiAlert = alert;
+            Serial.print(alert ? "AQI alert: " : "AQI alert cleared: ");
+            Serial.print(aqi.index(), 0);
+            Serial.print(' ');
+            Serial.println(aqi.category());
+        }
+        ledState = alert ? HIGH : !ledState;
+        ChannelStatusUpdate status = {0, (uint32_t)millis()};
+        sensors.forEach(status);
+        if (LP_mode == LP_OFF) {
+            core.writeRecord(sensors);
+        } else if (lpSchedule.measuring(millis())) {
+            queueRecord();
+        }
+        core.logRecord(sensors);
+        if (XS_log == 1) logCrossSensitivity();
+        if (HTTP_enable == 1) {
+            core.printJson(dashboard.beginSnapshot(), sensors);
+            dashboard.endSnapshot();
+        }
+        health.endRecord();
         digitalWrite(LED_PIN, ledState);
     }
 
+// Low-power mode: sleep once the window's burst is queued
+    if (LP_mode != LP_OFF && lpSchedule.windowDone()) {
+        sleepUntilNextWindow();
+    }
+
+// Stored calibration: date it on the first GPS fix, redo it when too old
+    static unsigned long lastCalCheck = 0;
+    if (millis() - lastCalCheck >= calCheckInterval) {
+        lastCalCheck = millis();
+        serviceCalibration();
+    }
+
+// Automatic baseline correction: sample once a minute, adjust once a day
+    serviceBaseline(core.gps.epochMs);
+
+// ADC diagnostics: samples chosen and achieved noise per channel (pin:samples/noise)
+    static unsigned long lastDiagTime = 0;
+    if (millis() - lastDiagTime >= adcDiagInterval) {
+        lastDiagTime = millis();
+        Serial.print("ADC samples/noise: ");
+        adcSampler.printDiagnostics(Serial);
+        Serial.print("Clock: ");
+        Serial.print(core.gps.clock.synced() ? "GPS" : "uptime, no GPS time yet");
+        Serial.print(", rate ");
+        Serial.print(core.gps.clock.ratePpm(), 1);
+        Serial.println(" ppm");
+        if (trace.enabled()) {
+            Serial.print("Trace: ");
+            Serial.print(trace.lost());
+            Serial.println(" events lost (buffer full)");
+        }
+        if (CAP_enable == 1) {
+            Serial.print("Capture: ");
+            Serial.print(capture.events());
+            Serial.print(" events at ");
+            Serial.print(capture.rate());
+            Serial.print(" Hz, ");
+            Serial.print(capture.lost());
+            Serial.println(" readings lost");
+        }
+        if (MQTT_enable == 1) {
+            Serial.print("MQTT: ");
+            Serial.print(uplink.state() >= MQTT_READY ? "connected" : "offline");
+            Serial.print(", ");
+            Serial.print(uplink.records());
+            Serial.print(" records in ");
+            Serial.print(uplink.batches());
+            Serial.print(" batches, acked to byte ");
+            Serial.println(uplink.acked());
+        }
+        if (CO2_fusion == 1) {
+            Serial.print("CO2 fusion: +/- ");
+            Serial.print(co2Fusion.sigma(), 1);
+            Serial.print(" ppm, eCO2 offset ");
+            Serial.print(co2Fusion.bias(), 0);
+            Serial.print(" ppm over ");
+            Serial.print(co2Fusion.secondaryCount());
+            Serial.print(" readings, ");
+            Serial.print(co2Fusion.rejected());
+            Serial.println(" rejected");
+        }
+        Serial.print("Health:");
+        bool healthy = true;
+        for (uint8_t s = 0; s < HS_COUNT; s++) {
+            if (health.total(s) == 0) continue;
+            healthy = false;
+            Serial.print(' ');
+            Serial.print(healthNames[s]);
+            for (uint8_t c = 0; c < HEALTH_CONDITIONS; c++) {
+                if (health.count(s, c) == 0) continue;
+                Serial.print(' ');
+                Serial.print(healthConditionNames[c]);
+                Serial.print('=');
+                Serial.print(health.count(s, c));
+            }
+            if (health.active(s) != 0) Serial.print(" (now)");
+            Serial.print(';');
+        }
+        Serial.println(healthy ? " no faults" : "");
+        Serial.print("AQI (");
+        Serial.print(aqi.standard().name);
+        Serial.print("): ");
+        if (aqi.valid()) {
+            Serial.print(aqi.index(), 0);
+            Serial.print(' ');
+            Serial.print(aqi.category());
+            Serial.print(", dominant ");
+            Serial.println(aqiPollutantName(aqi.dominant()));
+        } else {
+            Serial.println("averaging, not enough data yet");
+        }
+        if (HTTP_enable == 1) {
+            Serial.print("HTTP: http://");
+            Serial.print(WiFi.localIP());
+            Serial.print("/, ");
+            Serial.print(dashboard.requests());
+            Serial.print(" requests, worst poll ");
+            Serial.print(dashboard.worstPollUs());
+            Serial.println(" us");
+        }
+#ifdef AQMS_HEAP_CHECK
+        uint32_t heapNow = ESP.getFreeHeap();
+        if (heapNow != heapAfterSetup) {
+            Serial.print("Heap changed since setup: ");
+            Serial.print((int32_t)(heapAfterSetup - heapNow));
+            Serial.println(" bytes");
+        }
+#endif
+    }
+
 }
 
-void Warmup(unsigned long warmupTime) {
+void calibrateMQ(MQSensorWrapper &mq, float cleanAirRatio, const char *label) {
+    Serial.print(label);
+    Serial.print(" Calibrating...");
+    calcR0 = 0;
+    for(int i = 1; i<=10; i ++){
+        mq.update(); // Update data, the arduino will read the voltage from the analog pin
+        calcR0 += mq.calibrate(cleanAirRatio);}
+    mq.setR0(calcR0/10);
+    if(isinf(calcR0) || (calcR0 == 0)) {Serial.println("Invalid");} else Serial.println("  done!.");
+}
+
+// Start the heaters and readiness trackers; warmupTime is now the upper bound
+void startWarmup() {
     Serial.println("Starting sensor warmup sequence...");
-    
-    // Start MICS heater
-    MICS_4514.setWarmupTime(warmupTime);
+
+    // Readiness comes from the trackers, so the MICS timer gate is disabled
+    MICS_4514.setWarmupTime(0);
     MICS_4514.warmupStart();
-    
-    // First, let's do a thorough ADC stabilization on all sensor pins
-    Serial.println("Stabilizing ADC readings on all sensors...");
-    unsigned long adcStabilizeStart = millis();
-    unsigned long adcStabilizeTime = 2000; // 2 seconds of ADC readings to stabilize
-    
-    while (millis() - adcStabilizeStart < adcStabilizeTime) {
-        // Take readings from all analog pins to stabilize them
-        readStableADC(MG811_PIN);
-        readStableADC(MQ136_PIN);
-        readStableADC(MQ4_PIN);
-        readStableADC(MICS_NOX_PIN);
-        readStableADC(MICS_RED_PIN);
-        delay(10);
-    }
-    Serial.println("ADC readings stabilized");
-    
-    // Wait for MICS sensor to complete warmup
-    Serial.println("Waiting for sensors to preheat...");
-    
-    // Debugging MICS sensor warmup status
-    Serial.print("MICS sensor ready state: ");
-    Serial.println(MICS_4514.sensorReady() ? "READY" : "NOT READY");
-    
-    while(!MICS_4514.sensorReady()) {
-        Serial.println("Preheating Gas Sensors...");
-        
-        // Continue taking readings during warmup to keep ADC stable
-        readStableADC(MG811_PIN);
-        readStableADC(MQ136_PIN);
-        readStableADC(MQ4_PIN);
-        readStableADC(MICS_NOX_PIN);
-        readStableADC(MICS_RED_PIN);
-        
-        delay(1000);
+
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        warmup[i].configure(warmupMinTime, warmupTime, warmupSlope);
+        warmup[i].begin(millis());
     }
-    
-    // Extra delay for MQ sensors to stabilize
-    Serial.println("Almost done, final stabilization...");
-    delay(warmupTime/2);
-    
-    // Check and log the sensor resistance values
-    float rRed = MICS_4514.getResistanceRed();
-    float rNOX = MICS_4514.getResistanceNOX();
-    Serial.print("Red sensor resistance: ");
-    Serial.println(rRed);
-    Serial.print("NOX sensor resistance: ");
-    Serial.println(rNOX);
-    
-    // Call setR0 one more time after we're fully stabilized
-    Serial.println("Setting final R0 calibration values...");
-    MICS_4514.setR0();
-    
-    Serial.println("Gas Sensors Preheated and Ready");
 }
 
+// Signal whose drift decides readiness: Rs for the heated resistive sensors,
+// the cell EMF for the MG-811
+float warmupSignal(uint8_t sensor) {
+    const uint16_t adcMax = (1 << ADC_Bit_Resolution) - 1;
+    switch (sensor) {
+        case WARM_CO2:   return readStableADC(MG811_PIN);
+        case WARM_MQ136: return warmupRsProxy(readStableADC(MQ136_PIN), adcMax);
+        case WARM_MQ4:   return warmupRsProxy(readStableADC(MQ4_PIN), adcMax);
+        default:         return MICS_4514.getResistanceRed();
+    }
+}
+
+// Sample each warming sensor; calibrate it the moment it settles unless a
+// stored calibration is already in use
+void serviceWarmup(uint32_t now) {
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (!warmup[i].due(now)) continue;
+        if (!warmup[i].update(now, warmupSignal(i))) continue;
+
+        Serial.print("Warmup: ");
+        Serial.print(warmupNames[i]);
+        Serial.print(" ready after ");
+        Serial.print(warmup[i].elapsed(now) / 1000);
+        Serial.println(warmup[i].timedOut() ? " s (timeout)" : " s (settled)");
+
+        if (!sensorCalibrated(i)) {
+            recalibrate(i);
+        }
+    }
+}
+
+// Load stored R0/baseline values from storage, falling back to NVS
+bool loadCalibration() {
+    bool loaded = false;
+    storage.readFile(CAL_STORE_PATH, [&](Stream &calFile) { loaded = calStore.load(calFile); });
+    if (!loaded) {
+        calStore.clear();
+        loaded = calStore.loadNVS();
+    }
+    Serial.print("Calibration store: ");
+    if (!loaded) {
+        Serial.println("not found, calibrating after warmup");
+        return false;
+    }
+    for (uint8_t i = 0; i < CAL_COUNT; i++) {
+        if (!calStore.has(i)) continue;
+        Serial.print(calStore.name(i)); Serial.print('=');
+        Serial.print(calStore.value(i)); Serial.print(' ');
+    }
+    Serial.println();
+    return true;
+}
+
+void saveCalibration() {
+    if (!storage.writeFile(CAL_STORE_PATH, [](Print &calFile) { calStore.save(calFile); })
+        && BoardStorage::persistent) {
+        Serial.println(F("SD Card: error on opening file calib.txt"));
+    }
+    calStore.saveNVS();
+}
+
+// True when every stored value a warmup sensor needs is present
+bool sensorCalibrated(uint8_t sensor) {
+    switch (sensor) {
+        case WARM_CO2:   return calStore.has(CAL_CO2_A);
+        case WARM_MQ136: return calStore.has(CAL_MQ136_R0);
+        case WARM_MQ4:   return calStore.has(CAL_MQ4_R0);
+        default:         return calStore.has(CAL_MICS_RED_R0) && calStore.has(CAL_MICS_OX_R0);
+    }
+}
+
+bool calibrationExpired(uint8_t sensor) {
+    uint32_t today = core.gps.date;
+    switch (sensor) {
+        case WARM_CO2:   return calStore.expired(CAL_CO2_A, today);
+        case WARM_MQ136: return calStore.expired(CAL_MQ136_R0, today);
+        case WARM_MQ4:   return calStore.expired(CAL_MQ4_R0, today);
+        default:         return calStore.expired(CAL_MICS_RED_R0, today) || calStore.expired(CAL_MICS_OX_R0, today);
+    }
+}
+
+// Push the stored values into the sensor driver
+void applyCalibration(uint8_t sensor) {
+    switch (sensor) {
+        case WARM_CO2:   co2Sensor.setCalibration(calStore.value(CAL_CO2_A)); break;
+        case WARM_MQ136: MQ136.setR0(calStore.value(CAL_MQ136_R0)); break;
+        case WARM_MQ4:   MQ4.setR0(calStore.value(CAL_MQ4_R0)); break;
+        default:         MICS_4514.setR0Values(calStore.value(CAL_MICS_RED_R0), calStore.value(CAL_MICS_OX_R0)); break;
+    }
+}
+
+// Calibrate a warm sensor in the current air and store the result, unless it
+// is implausibly far from the stored value (e.g. the unit booted in smoke)
+void recalibrate(uint8_t sensor) {
+    uint8_t slots[2];
+    float values[2];
+    uint8_t count = 1;
+
+    switch (sensor) {
+        case WARM_CO2:
+            co2Sensor.calibrate();
+            slots[0] = CAL_CO2_A; values[0] = co2Sensor.getCalibration();
+            break;
+        case WARM_MQ136:
+            calibrateMQ(MQ136, RatioMQ136CleanAir, "MQ-136");
+            slots[0] = CAL_MQ136_R0; values[0] = MQ136.getR0();
+            break;
+        case WARM_MQ4:
+            calibrateMQ(MQ4, RatioMQ4CleanAir, "MQ-4");
+            slots[0] = CAL_MQ4_R0; values[0] = MQ4.getR0();
+            break;
+        default:
+            MICS_4514.setR0();
+            Serial.print("Red sensor resistance: ");
+            Serial.println(MICS_4514.getResistanceRed());
+            Serial.print("NOX sensor resistance: ");
+            Serial.println(MICS_4514.getResistanceNOX());
+            slots[0] = CAL_MICS_RED_R0; values[0] = MICS_4514.getR0Red();
+            slots[1] = CAL_MICS_OX_R0; values[1] = MICS_4514.getR0OX();
+            count = 2;
+            break;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        calStore.attempted(slots[i], core.gps.date);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!calStore.acceptable(slots[i], values[i])) {
+            Serial.print("Calibration: ");
+            Serial.print(calStore.name(slots[i]));
+            Serial.print(" = ");
+            Serial.print(values[i]);
+            Serial.print(" rejected, keeping ");
+            Serial.println(calStore.value(slots[i]));
+            if (sensorCalibrated(sensor)) applyCalibration(sensor);
+            saveCalibration(); // The attempt, so an expired value is retried tomorrow
+            return;
+        }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        calStore.set(slots[i], values[i], core.gps.date);
+    }
+    saveCalibration();
+}
+
+// Date entries stored before the first GPS fix and redo expired ones
+void serviceCalibration() {
+    if (calStore.stampDate(core.gps.date)) {
+        saveCalibration();
+    }
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (warmup[i].ready() && calibrationExpired(i)) {
+            Serial.print("Calibration: ");
+            Serial.print(warmupNames[i]);
+            Serial.println(" is older than CAL_max_age, recalibrating");
+            recalibrate(i);
+        }
+    }
+}
+
+// R0 / curve offset the current reading would give if the air were clean
+float baselineEstimate(uint8_t slot) {
+    switch (slot) {
+        case CAL_MQ136_R0:    MQ136.update(); return MQ136.calibrate(RatioMQ136CleanAir);
+        case CAL_MQ4_R0:      MQ4.update(); return MQ4.calibrate(RatioMQ4CleanAir);
+        case CAL_MICS_RED_R0: return MICS_4514.getResistanceRed();
+        case CAL_MICS_OX_R0:  return MICS_4514.getResistanceNOX();
+        default:              return co2Sensor.getBaselineEstimate();
+    }
+}
+
+// Feed each warm, calibrated sensor into its baseline tracker; once a day move
+// every stored value at most ABC_max_step towards the cleanest daily baseline
+// of the last ABC_days days, and log the change to /abc_log.txt
+void serviceBaseline(uint64_t epochMs) {
+    if (ABC_enable != 1 || !abcClock.sampleDue(epochMs, abcSampleInterval)) return;
+
+    bool sampled = false;
+    for (uint8_t slot = 0; slot < CAL_COUNT; slot++) {
+        if (!warmup[calSensor[slot]].ready() || !calStore.has(slot)) continue;
+        if (baseline[slot].reference() == 0) {
+            // Rs of the oxidising-gas element rises with NO2, so clean air is its low end
+            baseline[slot].begin(calStore.value(slot), slot != CAL_MICS_OX_R0);
+        }
+        baseline[slot].add(baselineEstimate(slot));
+        sampled = true;
+    }
+    // Nothing warm yet (a wake from deep sleep): the sample stays due
+    if (!sampled) return;
+    abcClock.sampled(epochMs);
+
+    if (!abcClock.dayEnded(epochMs, abcDayLength, core.gps.clock.synced())) return;
+
+    bool changed = false;
+    for (uint8_t slot = 0; slot < CAL_COUNT; slot++) {
+        if (baseline[slot].reference() == 0 || !baseline[slot].closeDay()) continue;
+        if (baseline[slot].days() < ABC_days) continue;
+
+        float current = calStore.value(slot);
+        float target = baseline[slot].baseline(ABC_days);
+        // Less than one histogram bin per day, so the quantised target is approached smoothly
+        float step = min(ABC_max_step, baseline[slot].binWidth() / 2) * current;
+        float next = constrain(target, current - step, current + step);
+        if (next == current) continue;
+
+        Serial.print("ABC: ");
+        Serial.print(calStore.name(slot));
+        Serial.print(' ');
+        Serial.print(current, 4);
+        Serial.print(" -> ");
+        Serial.print(next, 4);
+        Serial.print(" (baseline ");
+        Serial.print(target, 4);
+        Serial.println(')');
+        storage.appendFile("/abc_log.txt", [&](Print &log) {
+            log.print(core.gps.date); log.print(',');
+            log.print(core.gps.time); log.print(',');
+            log.print(calStore.name(slot)); log.print(',');
+            log.print(current, 4); log.print(',');
+            log.print(next, 4); log.print(',');
+            log.println(target, 4);
+        });
+
+        calStore.adjust(slot, next);
+        applyCalibration(calSensor[slot]);
+        baseline[slot].setReference(next);
+        changed = true;
+    }
+    if (changed) saveCalibration();
+}
+
+// Bit i set once warmup[i] is ready (bit 0 MG-811, 1 MQ-136, 2 MQ-4, 3 MICS)
+uint8_t warmupMask() {
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < WARM_COUNT; i++) {
+        if (warmup[i].ready()) mask |= 1 << i;
+    }
+    return mask;
+}
+
+void loadCrossSensitivity() {
+    storage.readFile(XSENS_PATH, [](Stream &file) { xsens.load(file); });
+    Serial.print("Cross-sensitivity model: ");
+    if (!xsens.loaded()) {
+        Serial.println("none, single-gas curves");
+        return;
+    }
+    Serial.print(xsens.rows());
+    Serial.println(" gases compensated");
+}
+
+// Model inputs from one read of each element; the gas channels then return
+// the compensated values
+void updateCrossSensitivity() {
+    MQ136.update();
+    MQ4.update();
+    float red = MICS_4514.getResistanceRed() / MICS_4514.getR0Red();
+    float ox = MICS_4514.getResistanceNOX() / MICS_4514.getR0OX();
+    xsInputValid = xsensFeatures(xsInput, MQ136.getRS() / MQ136.getR0(), MQ4.getRS() / MQ4.getR0(), red, ox,
+                                 sensors.value<CH_TVOC>(), ENS160temperature, ENS160humidity);
+    xsens.update(xsInputValid ? xsInput : NULL);
+}
+
+// One line of model inputs per record, joined with reference data by fit_xsens.py
+void logCrossSensitivity() {
+    if (!xsInputValid) return;
+    storage.appendFile("/xsens_log.txt", [](Print &file) {
+        printUint64(file, core.gps.epochMs);
+        for (uint8_t i = XS_MQ136; i < XS_INPUTS; i++) {
+            file.print(',');
+            file.print(xsInput[i], 4);
+        }
+        file.print('\n');
+    });
+}
+
+// Sampler for the spike capture: one reading of each gas input per period,
+// on core 0 so the loop's sensor reads and SD writes do not delay it
+void captureTask(void *param) {
+    TickType_t period = (TickType_t)(uintptr_t)param;
+    TickType_t wake = xTaskGetTickCount();
+    uint16_t frame[sizeof(analogPins)];
+    for (;;) {
+        xSemaphoreTake(adcMutex, portMAX_DELAY);
+        for (uint8_t i = 0; i < sizeof(analogPins); i++) {
+            frame[i] = adcCal[adcTable(analogPins[i])].apply(analogRead(analogPins[i]));
+        }
+        xSemaphoreGive(adcMutex);
+        capture.addFrame(millis(), frame);
+        vTaskDelayUntil(&wake, period);
+    }
+}
+
+void startCapture() {
+    // The task runs on whole ticks, so the rate is rounded to one
+    TickType_t period = pdMS_TO_TICKS(1000 / CAP_rate);
+    if (period == 0) period = 1;
+    uint16_t rate = 1000 / (period * portTICK_PERIOD_MS);
+    capture.configure(rate, CAP_level, CAP_slope, CAP_pre, CAP_post);
+    adcMutex = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(captureTask, "capture", 2048, (void *)(uintptr_t)period, 1, NULL, 0);
+    Serial.print("Spike capture: ");
+    Serial.print(rate);
+    Serial.println(" Hz per input");
+}
+
+// A calibrated R0: positive and finite
+inline bool validR0(float r0) {
+    return r0 > 0 && !isinf(r0);
+}
+
+// STATUS_* bits of a measured channel's latest value
+uint8_t channelStatus(uint8_t channel, uint32_t now) {
+    uint8_t status = 0;
+    uint8_t sensor = channelWarmup[channel];
+    if (sensor < WARM_COUNT) {
+        if (!warmup[sensor].ready()) status |= STATUS_WARMING;
+        if (sensorCalibrated(sensor)) status |= STATUS_CALIBRATED;
+    } else if (channel == CH_TVOC || channel == CH_ECO2) {
+        // Factory calibrated
+        status |= STATUS_CALIBRATED;
+        bool starting = ens160Status == DFRobot_ENS160::eWarmUpPhase ||
+                        ens160Status == DFRobot_ENS160::eInitialStartUpPhase;
+        if (starting) status |= STATUS_WARMING;
+        else if (ens160Status == DFRobot_ENS160::eInvalidOutput) status |= STATUS_FAULT;
+    } else {
+        // SDS011: factory calibrated; the window average is held between windows
+        status |= STATUS_CALIBRATED;
+        if (!pmScheduler.hasAverage()) status |= STATUS_WARMING;
+        else if (pmScheduler.averageAge(now) >= cycleInterval) status |= STATUS_STALE;
+    }
+    if (channel >= CH_SO2 && channel <= CH_CO && xsens.active(XS_OUT_SO2 + channel - CH_SO2)) {
+        status |= STATUS_CALIBRATED;
+    }
+    if (health.flags(channelSource[channel]) != 0) status |= STATUS_FAULT;
+    if (channelFilter[channel].replaced()) status |= STATUS_INTERPOLATED;
+    if (channel == CH_CO2 && CO2_fusion == 1 && co2Fusion.gated()) status |= STATUS_INTERPOLATED;
+    return status;
+}
+
+// Conditions the samples cannot show: SDS011 windows without a frame, the
+// GPS fix and the R0 values (only printed as "Invalid" by the calibration)
+void updateHealth(uint32_t now) {
+    static uint32_t pmWindows = 0;
+    if (pmScheduler.windows() != pmWindows) {
+        pmWindows = pmScheduler.windows();
+        health.sample(HS_SDS011, pmScheduler.lastFrames() > 0 ? pmScheduler.pm25() : NAN, now);
+    }
+    health.set(HS_GPS, core.gps.fixAge(now) < GPS_FIX_TIMEOUT ? 0 : HEALTH_MISSING);
+    health.set(HS_MQ136, validR0(MQ136.getR0()) ? 0 : HEALTH_RANGE);
+    health.set(HS_MQ4, validR0(MQ4.getR0()) ? 0 : HEALTH_RANGE);
+    health.set(HS_MICS_OX, validR0(MICS_4514.getR0OX()) ? 0 : HEALTH_RANGE);
+    health.set(HS_MICS_RED, validR0(MICS_4514.getR0Red()) ? 0 : HEALTH_RANGE);
+}
+
+// Feed the AQI engine; gases count once their sensor is warm, PM once the
+// SDS011 has averaged a window
+float updateAQI(uint32_t now) {
+    bool pmReady = pmScheduler.hasAverage();
+    bool micsReady = warmup[WARM_MICS].ready();
+    aqi.sample(now,
+               pmReady ? sensors.value<CH_PM25>() : NAN,
+               pmReady ? sensors.value<CH_PM10>() : NAN,
+               micsReady ? sensors.value<CH_CO>() : NAN,
+               micsReady ? sensors.value<CH_NO2>() : NAN,
+               warmup[WARM_MQ136].ready() ? sensors.value<CH_SO2>() : NAN,
+               micsReady ? sensors.value<CH_NH3>() : NAN);
+    return aqi.index();
+}
+
+// Load the correction curve of ADC unit t from storage, falling back to NVS
+bool loadADCTable(uint8_t t) {
+    ADCCalibration &cal = adcCal[t];
+    storage.readFile(adcCalPaths[t], [&](Stream &calFile) { cal.load(calFile); });
+    if (!cal.valid()) {
+        cal.loadNVS(adcCalSpaces[t]);
+    }
+    Serial.print("ADC");
+    Serial.print(t + 1);
+    Serial.print(" calibration: ");
+    if (cal.valid()) {
+        Serial.print(cal.pointCount());
+        Serial.println(" points loaded");
+    } else {
+        Serial.println("not found, using raw ADC");
+    }
+    return cal.valid();
+}
+
+bool loadADCCalibration() {
+    bool any = false;
+    for (uint8_t t = 0; t < ADC_TABLES; t++) any |= loadADCTable(t);
+    return any;
+}
+
+// One-time capture of the correction curve of the pin's ADC unit against
+// known voltages. Apply each requested reference voltage to the calibration
+// pin and send any character over Serial to record the point. Without a
+// reply within ADC_CAL_TIMEOUT (no console attached) the stored curves are
+// kept.
+void runADCCalibration(uint8_t pin) {
+    static const uint16_t referenceMv[] = {150, 500, 1000, 1500, 2000, 2500, 2900, 3150};
+    const uint8_t numPoints = sizeof(referenceMv) / sizeof(referenceMv[0]);
+    uint8_t table = adcTable(pin);
+    ADCCalibration &cal = adcCal[table];
+
+    Serial.print("ADC calibration: starting capture on pin ");
+    Serial.print(pin);
+    Serial.print(", ADC");
+    Serial.println(table + 1);
+    cal.reset();
+    pinMode(pin, INPUT);
+
+    for (uint8_t i = 0; i < numPoints; i++) {
+        Serial.print("Apply ");
+        Serial.print(referenceMv[i]);
+        Serial.println(" mV to the calibration pin and send any key...");
+        while (Serial.available() > 0) Serial.read();
+        unsigned long waitStart = millis();
+        while (Serial.available() == 0 && millis() - waitStart < ADC_CAL_TIMEOUT) delay(10);
+        if (Serial.available() == 0) {
+            Serial.println("ADC calibration: no reply, keeping the stored curves");
+            loadADCCalibration();
+            return;
+        }
+
+        // Average raw (uncorrected) readings for this reference point
+        uint32_t sum = 0;
+        analogRead(pin);
+        delayMicroseconds(50);
+        for (int s = 0; s < ADC_CAL_SAMPLES; s++) {
+            sum += analogRead(pin);
+            delayMicroseconds(10);
+        }
+        uint16_t raw = sum / ADC_CAL_SAMPLES;
+        uint16_t ideal = ((uint32_t)referenceMv[i] * 4095UL + ADC_FULL_SCALE_MV / 2) / ADC_FULL_SCALE_MV;
+        cal.addPoint(raw, ideal);
+
+        Serial.print("  raw "); Serial.print(raw);
+        Serial.print(" -> ideal "); Serial.println(ideal);
+    }
+
+    if (!cal.build()) {
+        Serial.println("ADC calibration: failed, not enough points");
+        loadADCCalibration();
+        return;
+    }
+
+    if (!storage.writeFile(adcCalPaths[table], [&](Print &calFile) { cal.save(calFile); })
+        && BoardStorage::persistent) {
+        Serial.print(F("SD Card: error on opening file "));
+        Serial.println(adcCalPaths[table]);
+    }
+    cal.saveNVS(adcCalSpaces[table]);
+    loadADCTable(table == ADC_TABLE_1 ? ADC_TABLE_2 : ADC_TABLE_1); // The other unit keeps its stored curve
+    Serial.println("ADC calibration: saved. Set ADC_calibrate=0 in config.txt");
+}
+
+// Wake the SDS011 (it may still be asleep from before a reset), let it
+// measure continuously while awake, and switch it to query mode so exactly
+// one frame is read per logging cycle. Without replies, use its own stream.
+void setupPMSensor() {
+    SDS011.wakeup();
+    SDS011.waitReply();
+    uint8_t year = 0, month = 0, day = 0;
+    if (SDS011.setWorkingPeriod(0) && SDS011.setQueryMode(true)) {
+        pmScheduler.setQueryInterval(cycleInterval);
+        SDS011.getFirmwareVersion(&year, &month, &day);
+        Serial.print("SDS011: query mode, ID ");
+        Serial.print(SDS011.deviceId(), HEX);
+        Serial.print(", firmware ");
+        Serial.print(year); Serial.print('-');
+        Serial.print(month); Serial.print('-');
+        Serial.println(day);
+    } else {
+        Serial.println("SDS011: no reply, using active reporting");
+    }
+}
+
+// Format one record into the RTC queue, writing the queue out first if full
+void queueRecord() {
+    if (lpQueue.space() < LP_RECORD_MAX) {
+        flushRecordQueue();
+    }
+    core.printRecord(lpWriter, sensors, ",", 6);
+    lpQueue.records++;
+    lpSchedule.recordTaken();
+}
+
+// One SD write for every record queued since the last one
+void flushRecordQueue() {
+    Print *out = storage.record();
+    if (out == NULL) {
+        lpQueue.clear(); // No storage: records already went to Serial
+        return;
+    }
+    Serial.print("Power: writing ");
+    Serial.print(lpQueue.records);
+    Serial.println(" queued records");
+    lpQueue.flush(*out);
+    storage.commit();
+}
+
+// Switch the MICS heater and SDS011 off, sleep until the next window, then
+// start them again. Deep sleep does not return: setup() runs on the wake.
+void sleepUntilNextWindow() {
+    if (++lpQueue.windows >= LP_batch) {
+        flushRecordQueue();
+    }
+
+    uint32_t sleepMs = lpSchedule.sleepTime(millis());
+    Serial.print("Power: awake ");
+    Serial.print(lpSchedule.activeMs() / 1000.0, 1);
+    Serial.print(" s of ");
+    Serial.print(LP_interval / 1000);
+    Serial.print(" s, average ");
+    Serial.print(lpBudget.averageMa(lpSchedule.activeMs(), LP_interval), 1);
+    Serial.print(" mA, battery ");
+    Serial.print(lpBudget.batteryHours(LP_battery_mAh, lpSchedule.activeMs(), LP_interval), 0);
+    Serial.println(" h");
+    if (sleepMs == 0) {
+        lpSchedule.nextWindow(millis());
+        return;
+    }
+
+    MICS_4514.setHeatingState(0);
+    SDS011.sleep();
+    SDS011.waitReply();
+    trace.flush(storage, TRACE_PATH); // Deep sleep loses RAM
+    digitalWrite(LED_PIN, LOW);
+    Serial.flush();
+
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000ULL);
+    if (LP_mode == LP_DEEP) {
+        core.gps.clock.save(lpClock);
+        lpBaseline.clock = abcClock;
+        for (uint8_t slot = 0; slot < CAL_COUNT; slot++) baseline[slot].save(lpBaseline.trackers[slot]);
+        lpBaseline.magic = BASELINE_STATE_MAGIC;
+        health.save(lpHealth.checks, millis());
+        lpHealth.magic = HEALTH_STATE_MAGIC;
+        esp_deep_sleep_start();
+    }
+    esp_light_sleep_start();
+
+    MICS_4514.setHeatingState(1);
+    warmup[WARM_MICS].begin(millis()); // The heater was off, so it warms up again
+    pmScheduler.begin(millis());
+    lpSchedule.nextWindow(millis());
+}
+
+// HTTP /stats: counters only, the sensors are not touched
+void printStats(Print &out) {
+    out.print("{\"uptime_ms\":");
+    out.print(millis());
+    out.print(",\"clock\":");
+    out.print(core.gps.clock.synced() ? "\"gps\"" : "\"uptime\"");
+    out.print(",\"rate_ppm\":");
+    out.print(core.gps.clock.ratePpm(), 1);
+    out.print(",\"pm_duty\":");
+    out.print(pmScheduler.dutyCycle(), 2);
+    out.print(",\"trace_lost\":");
+    out.print(trace.lost());
+    out.print(",\"mqtt_state\":");
+    out.print((int)uplink.state());
+    out.print(",\"mqtt_records\":");
+    out.print(uplink.records());
+    out.print(",\"mqtt_acked\":");
+    out.print(uplink.acked());
+    out.print(",\"http_requests\":");
+    out.print(dashboard.requests());
+    out.print(",\"http_worst_poll_us\":");
+    out.print(dashboard.worstPollUs());
+    out.print(",\"capture_events\":");
+    out.print(capture.events());
+    out.print(",\"co2_sigma\":");
+    printJsonNumber(out, CO2_fusion == 1 ? co2Fusion.sigma() : NAN, 1);
+    out.print(",\"eco2_offset\":");
+    printJsonNumber(out, CO2_fusion == 1 ? co2Fusion.bias() : NAN, 0);
+    out.print(",\"fault\":");
+    out.print(health.mask());
+    out.print(",\"faults\":{");
+    bool first = true;
+    for (uint8_t s = 0; s < HS_COUNT; s++) {
+        if (health.total(s) == 0) continue;
+        out.print(first ? "\"" : ",\"");
+        first = false;
+        out.print(healthNames[s]);
+        out.print("\":[");
+        for (uint8_t c = 0; c < HEALTH_CONDITIONS; c++) {
+            if (c > 0) out.print(',');
+            out.print(health.count(s, c));
+        }
+        out.print(']');
+    }
+    out.print('}');
+    out.print(",\"aqi_standard\":\"");
+    out.print(aqi.standard().name);
+    out.print("\",\"aqi\":");
+    printJsonNumber(out, aqi.index(), 0);
+    out.print(",\"aqi_pollutant\":\"");
+    out.print(aqiPollutantName(aqi.dominant()));
+    out.print("\",\"aqi_category\":\"");
+    out.print(aqi.category());
+    out.print("\",\"wifi_rssi\":");
+    out.print(WiFi.RSSI());
+    out.print(",\"free_heap\":");
+    out.print(ESP.getFreeHeap());
+    out.print('}');
+}
+
+void IRAM_ATTR onGPSPulse() {
+    core.gps.clock.ppsEdge(millis());
+}
+
+// Average of the last SDS011 sampling window, held while the sensor sleeps
 void readPM() {
-    SDS011.read(&pm25, &pm10);
+    pm25 = pmScheduler.pm25();
+    pm10 = pmScheduler.pm10();
 }
 
 uint16_t readTVOC() {
+    ens160Status = ENS160.getENS160Status();
     return (ENS160.getTVOC());
 }
 
+// eCO2 also corrects the CO2 fusion; 400 is the ENS160's floor, not a reading
 uint16_t readeECO2() {
-    return (ENS160.getECO2());
-}   
+    uint16_t eco2 = ENS160.getECO2();
+    health.sample(HS_ENS160, eco2 > 0 ? eco2 : NAN, millis());
+    if (CO2_fusion == 1 && eco2 > 400) co2Fusion.updateSecondary(eco2, millis());
+    return eco2;
+}
 
 float readCO2() {
-    return (co2Sensor.read());
-}   
+    float ppm = co2Sensor.read();
+    if (CO2_fusion == 1) return co2Fusion.updatePrimary(ppm, millis());
+    return ppm;
+}
 
 float readH2S(float A, float B) {
+    if (xsens.active(XS_OUT_H2S)) return xsens.value(XS_OUT_H2S);
     MQ136.update(); // Update data, the arduino will read the voltage from the analog pin
     MQ136.setA(A); MQ136.setB(B); // Configure the equation to calculate H2S
     return (MQ136.readSensor()); // H2S Concentration
 }
 
 float readSO2(float A, float B) {
+    if (xsens.active(XS_OUT_SO2)) return xsens.value(XS_OUT_SO2);
     MQ136.update(); // Update data, the arduino will read the voltage from the analog pin
     MQ136.setA(A); MQ136.setB(B); // Configure the equation to calculate SO2
     return (MQ136.readSensor()); // SO2 Concentration
 }
 
 float readCH4(float A, float B) {
+    if (xsens.active(XS_OUT_CH4)) return xsens.value(XS_OUT_CH4);
     MQ4.update(); // Update data, the arduino will read the voltage from the analog pin
     MQ4.setA(A); MQ4.setB(B); // Configure the equation to to calculate CH4
     return (MQ4.readSensor()); // CH4 Concentration
 }
 
 float readNO2() {
+    if (xsens.active(XS_OUT_NO2)) return xsens.value(XS_OUT_NO2);
     gasdata = MICS_4514.getNitrogenDioxide();
     return (gasdata);
 }
 
 float readC2H5OH() {
+    if (xsens.active(XS_OUT_C2H5OH)) return xsens.value(XS_OUT_C2H5OH);
     gasdata = MICS_4514.getEthanol();
     return (gasdata);
 }
 
 float readH2() {
+    if (xsens.active(XS_OUT_H2)) return xsens.value(XS_OUT_H2);
     gasdata = MICS_4514.getHydrogen();
     return (gasdata);
 }
 
 float readNH3() {
+    if (xsens.active(XS_OUT_NH3)) return xsens.value(XS_OUT_NH3);
     gasdata = MICS_4514.getAmmonia();
     return (gasdata);
 }
 
 float readCO() {
+    if (xsens.active(XS_OUT_CO)) return xsens.value(XS_OUT_CO);
     gasdata = MICS_4514.getCarbonMonoxide();
     return (gasdata);
 }
-
-// Modified readGPSData() with robust validation
-void readGPSData() {
-  static uint32_t lastValidFix = 0;
-  bool hasFix = false;
-
-  // Process incoming GPS data
-  while (Serial2.available() > 0) {
-    if (GPS.encode(Serial2.read())) {
-      if (GPS.location.isValid() && GPS.date.isValid() && GPS.time.isValid()) {
-        hasFix = true;
-        lastValidFix = millis();
-      }
-    }
-  }
-
-  // Only use data if we had a recent valid fix (within 2 seconds)
-  if (hasFix || (millis() - lastValidFix < 2000)) {
-    // Location data
-    lat = GPS.location.lat();
-    lng = GPS.location.lng();
-
-    // Date handling (YYYYMMDD format)
-    uint8_t day = GPS.date.day();
-    uint8_t month = GPS.date.month();
-    uint16_t year = GPS.date.year();
-
-    // Enhanced date validation
-    if (year >= 2020 && year <= 2100 &&
-        month >= 1 && month <= 12 &&
-        day >= 1 && day <= 31) {
-      m_date = (year * 10000UL) + (month * 100UL) + day;
-    }
-
-    // Time handling with proper timezone math
-    const float timezone = 5.5; // IST
-    uint8_t hour = GPS.time.hour();
-    uint8_t minute = GPS.time.minute();
-    uint8_t second = GPS.time.second();
-
-    // Convert all to seconds, add timezone offset
-    uint32_t total_seconds = hour * 3600UL + minute * 60UL + second;
-    total_seconds += (uint32_t)(timezone * 3600);
-
-    // Handle day rollover
-    while (total_seconds >= 86400) {
-      total_seconds -= 86400;
-      // Note: Would need to handle date increment here if needed
-    }
-
-    // Convert back to hours/minutes/seconds
-    hour = total_seconds / 3600;
-    total_seconds %= 3600;
-    minute = total_seconds / 60;
-    second = total_seconds % 60;
-
-    // Final validation
-    if (hour < 24 && minute < 60 && second < 60) {
-      m_time = (hour * 10000UL) + (minute * 100UL) + second;
-    }
-  }
-}
-
-// Function to find a value by its name/key
-String readConfig(const String &name) {
-  String value = ""; // Default empty value
-  myFile = SD.open("/config.txt", FILE_READ);
-  if (!myFile) {
-    Serial.println(F("SD Card: error on opening file config.txt"));
-    return value; // Return empty value if file can't be opened
-  }
-  
-  while (myFile.available()) {
-    String line = myFile.readStringUntil('\n');
-    line.trim(); // Remove any leading/trailing whitespace
-    // Find the separator position
-    int separatorPos = line.indexOf('=');
-    if (separatorPos > 0) {
-      String key = line.substring(0, separatorPos);
-      key.trim();
-      
-      if (key == name) {
-        value = line.substring(separatorPos + 1);
-        value.trim();
-        break; // Found the value, exit the loop
-      }
-    }
-  }
-  
-  myFile.close(); // Always close the file
-  return value;
-}
-
-void logData() {
-    Serial.print(m_date); Serial.print(" | ");
-    Serial.print(m_time); Serial.print(" | ");
-    Serial.print(lat, 4); Serial.print(" | ");
-    Serial.print(lng, 4); Serial.print(" | ");
-    Serial.print(co2); Serial.print(" | ");
-    Serial.print(so2); Serial.print(" | ");
-    Serial.print(h2s); Serial.print(" | ");
-    Serial.print(ch4); Serial.print(" | ");
-    Serial.print(no2); Serial.print(" | ");
-    Serial.print(c2h5oh); Serial.print(" | ");
-    Serial.print(h2); Serial.print(" | ");
-    Serial.print(nh3); Serial.print(" | ");
-    Serial.print(co); Serial.print(" | ");
-    Serial.print(tvoc); Serial.print(" | ");
-    Serial.print(eco2); Serial.print(" | ");
-    Serial.print(pm25); Serial.print(" | ");
-    Serial.print(pm10); Serial.println();
-}
-
-void writeData() {
-    myFile = SD.open("/data.txt", FILE_APPEND);
-    if (myFile) {
-        myFile.print(m_date); myFile.print(",");
-        myFile.print(m_time); myFile.print(",");
-        myFile.print(lat, 6); myFile.print(",");
-        myFile.print(lng, 6); myFile.print(",");
-        myFile.print(co2); myFile.print(",");
-        myFile.print(so2); myFile.print(",");
-        myFile.print(h2s); myFile.print(",");
-        myFile.print(ch4); myFile.print(",");
-        myFile.print(no2); myFile.print(",");
-        myFile.print(c2h5oh); myFile.print(",");
-        myFile.print(h2); myFile.print(",");
-        myFile.print(nh3); myFile.print(",");
-        myFile.print(co); myFile.print(",");
-        myFile.print(tvoc); myFile.print(",");
-        myFile.print(eco2); myFile.print(",");
-        myFile.print(pm25); myFile.print(",");
-        myFile.print(pm10); myFile.println();
-        myFile.close();
-    } else {
-        Serial.println(F("SD Card: error on opening file data.txt"));
-    }
-}